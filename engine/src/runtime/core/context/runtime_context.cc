@@ -1,36 +1,52 @@
 #include "runtime/core/context/runtime_context.h"
-#include <direct.h>
-
-std::string CurrentWorkDir()
-{
-	char buff[256];
-	_getcwd(buff, 256);
-	std::string current_work_dir(buff);
-	return current_work_dir;
-}
+#include <filesystem>
 
 namespace peanut {
-	void GlobalEngineContext::SetupSubSystems()
+	void GlobalEngineContext::SetupSubSystems(const EngineConfig& config)
 	{
+		config_ = config;
+
 		LogSystem::init(default_log_path_);
 
 		PEANUT_LOG_INFO("Setup all engine subsystems");
 
-		WindowCreateInfo create_info(default_window_width_, default_window_height_,
-			default_window_title_);
-
-		PEANUT_LOG_INFO("Current Work directory: {0}", CurrentWorkDir());
-
-		window_system_ = std::make_shared<WindowSystem>();
-		window_system_->Initialize(create_info);
+		PEANUT_LOG_INFO("Current Work directory: {0}", std::filesystem::current_path().string());
 
 		render_system_ = std::make_shared<RenderSystem>();
-		render_system_->Initialize(window_system_);
+		render_system_->GetRHI()->SetPresentMode(config_.present_mode);
+		render_system_->GetRHI()->SetMipGenerationMode(config_.mip_generation);
+		render_system_->SetPostProcessSettings(config_.post_process);
+		render_system_->SetAntiAliasingMode(config_.anti_aliasing);
+		render_system_->SetTemporalAASettings(config_.temporal_aa);
+		render_system_->SetShaderHotReloadEnabled(config_.shader_hot_reload);
+
+		// render farms and CI machines have no display, render offscreen without creating a window
+		if (config_.headless)
+		{
+			render_system_->InitializeHeadless(config_.width, config_.height);
+		}
+		else
+		{
+			WindowCreateInfo create_info(config_.width, config_.height, config_.title);
+
+			window_system_ = std::make_shared<WindowSystem>();
+			window_system_->Initialize(create_info);
+
+			render_system_->Initialize(window_system_);
+		}
+
+		if (config_.benchmark_mip_generation)
+		{
+			render_system_->GetMipDownsampler().LogBenchmark();
+		}
 	}
 
 	void GlobalEngineContext::DestroySubSystems()
 	{
-		window_system_->Shutdown();
+		if (window_system_)
+		{
+			window_system_->Shutdown();
+		}
 		render_system_->Shutdown();
 	}
-}  // namespace peanut
\ No newline at end of file
+}  // namespace peanut
@@ -6,10 +6,48 @@
 #include "runtime/functions/window/window.h"
 #include "runtime/functions/window/window_system.h"
 #include "runtime/functions/render/render_system.h"
+#include "runtime/functions/render/render_pass/post_process_pass.h"
+#include "runtime/functions/render/render_pass/temporal_aa_pass.h"
 #include "runtime/core/log/peanut_log.h"
+#include "runtime/core/time/frame_timer.h"
 
 namespace peanut {
 class RenderSystem;
+
+struct EngineConfig
+{
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	std::string title = "Peanut Engine";
+
+	PresentMode present_mode = PresentMode::Fifo;
+	// how mip chains are generated, unsupported textures fall back to blits
+	MipGenerationMode mip_generation = MipGenerationMode::SinglePassCompute;
+	// time both mip generation modes after the render system is initialized and log the results
+	bool benchmark_mip_generation = false;
+	// frame rate cap of the engine loop, 0 is uncapped
+	double max_fps = 0.0;
+	// effects from the hdr scene color to the display image, can be changed at runtime through the render system
+	PostProcessSettings post_process;
+	// msaa or temporal anti-aliasing of the scene, fixed once the render system is initialized
+	AntiAliasingMode anti_aliasing = AntiAliasingMode::MSAA;
+	// temporal anti-aliasing only, can be changed at runtime through the render system
+	TemporalAASettings temporal_aa;
+	// recompile and reload shaders whose files change while the engine runs, for shader development
+	bool shader_hot_reload = false;
+
+	// render into offscreen images without a window or presentation, e.g. for batch rendering and CI
+	bool headless = false;
+	// headless only, number of frames rendered before the engine stops
+	uint32_t frame_count = 100;
+	// headless only, the last frame is written to this png file unless empty
+	std::string capture_path;
+	// the gpu timings of all frames are written to this chrome trace json file unless empty
+	std::string gpu_trace_path;
+	// the cpu profile zones of all frames are written to this chrome trace json file unless empty, not in release builds
+	std::string cpu_trace_path;
+};
+
 /**
  * @brief manage the global states of the game engine runtime
  *
@@ -23,11 +61,15 @@ public:
 		return &global_context;
 	}
 
-	void SetupSubSystems();
+	void SetupSubSystems(const EngineConfig& config = EngineConfig());
 	void DestroySubSystems();
 
 	std::shared_ptr<RenderSystem> GetRenderSystem() { return render_system_; }
+	// null in headless mode
 	std::shared_ptr<WindowSystem> GetWindowSystem() { return window_system_; }
+	const EngineConfig& GetConfig() const { return config_; }
+	// delta time and frame time statistics of the engine loop
+	FrameTimer& GetFrameTimer() { return frame_timer_; }
 
 public:
 	std::shared_ptr<WindowSystem> window_system_;
@@ -38,11 +80,11 @@ private:
 	~GlobalEngineContext() = default;
 
 private:
+	EngineConfig config_;
+	FrameTimer frame_timer_;
+
 	// TODO: use config system to config this values
 	const std::string default_log_path_ = "./logs/runtime_log.txt";
-	const uint32_t default_window_width_ = 1280;
-	const uint32_t default_window_height_ = 720;
-	const std::string default_window_title_ = "Peanut Engine";
 };
 
 }  // namespace peanut
\ No newline at end of file
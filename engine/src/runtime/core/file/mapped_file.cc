@@ -0,0 +1,109 @@
+#include "mapped_file.h"
+
+#ifdef PE_PLATFORM_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace peanut
+{
+#ifdef PE_PLATFORM_WINDOWS
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data == nullptr)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		file_handle_ = file;
+		mapping_handle_ = mapping;
+		data_ = data;
+		size_ = static_cast<size_t>(file_size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (data_ != nullptr)
+			UnmapViewOfFile(data_);
+		if (mapping_handle_ != nullptr)
+			CloseHandle(mapping_handle_);
+		if (file_handle_ != nullptr)
+			CloseHandle(file_handle_);
+
+		data_ = nullptr;
+		mapping_handle_ = nullptr;
+		file_handle_ = nullptr;
+		size_ = 0;
+	}
+#else
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps its own reference to the file
+		close(fd);
+		if (data == MAP_FAILED)
+		{
+			return false;
+		}
+
+		data_ = data;
+		size_ = static_cast<size_t>(file_stat.st_size);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (data_ != nullptr)
+			munmap(data_, size_);
+
+		data_ = nullptr;
+		size_ = 0;
+	}
+#endif
+} // namespace peanut
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace peanut
+{
+	/**
+	 * @brief read-only memory mapping of a whole file
+	 *
+	 * The data stays valid until Close() or destruction, so callers can hand the
+	 * pointer straight to the driver without copying the file into a heap buffer.
+	 */
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const std::string& path);
+		void Close();
+
+		bool IsOpen() const { return data_ != nullptr; }
+		const uint8_t* Data() const { return static_cast<const uint8_t*>(data_); }
+		size_t Size() const { return size_; }
+
+	private:
+		void* data_ = nullptr;
+		size_t size_ = 0;
+
+#ifdef PE_PLATFORM_WINDOWS
+		void* file_handle_ = nullptr;
+		void* mapping_handle_ = nullptr;
+#endif
+	};
+} // namespace peanut
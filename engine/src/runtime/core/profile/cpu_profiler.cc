@@ -0,0 +1,270 @@
+#include "runtime/core/profile/cpu_profiler.h"
+
+#ifdef PEANUT_ENABLE_PROFILER
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <json11.hpp>
+
+#include "runtime/core/base/logger.h"
+
+namespace peanut
+{
+	CpuProfileRing::CpuProfileRing(uint32_t capacity)
+	{
+		uint32_t size = 1;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		events_ = std::make_unique<CpuProfileEvent[]>(size);
+		mask_ = size - 1;
+	}
+
+	bool CpuProfileRing::Push(const CpuProfileEvent& event)
+	{
+		const uint64_t write_index = write_index_.load(std::memory_order_relaxed);
+		if (write_index - read_index_.load(std::memory_order_acquire) > mask_)
+		{
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// publish the event only after it is written
+		events_[write_index & mask_] = event;
+		write_index_.store(write_index + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t CpuProfileRing::Drain(std::vector<CpuProfileEvent>& out_events)
+	{
+		const uint64_t read_index = read_index_.load(std::memory_order_relaxed);
+		const uint64_t write_index = write_index_.load(std::memory_order_acquire);
+		for (uint64_t i = read_index; i < write_index; ++i)
+		{
+			out_events.push_back(events_[i & mask_]);
+		}
+
+		// the slots can be overwritten once the read index moved past them
+		read_index_.store(write_index, std::memory_order_release);
+		return static_cast<size_t>(write_index - read_index);
+	}
+
+	CpuProfiler& CpuProfiler::Get()
+	{
+		static CpuProfiler profiler;
+		return profiler;
+	}
+
+	CpuProfiler::CpuProfiler() : epoch_ns_(NowNs())
+	{
+		frame_start_ns_ = epoch_ns_;
+	}
+
+	uint64_t CpuProfiler::NowNs()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	CpuProfiler::ThreadData& CpuProfiler::GetThreadData()
+	{
+		// threads keep their ring after they exit, so their zones still reach the capture
+		thread_local ThreadData* thread_data = nullptr;
+		if (thread_data == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			threads_.push_back(std::make_unique<ThreadData>(kRingCapacity, static_cast<uint32_t>(threads_.size())));
+			thread_data = threads_.back().get();
+		}
+		return *thread_data;
+	}
+
+	void CpuProfiler::RecordZone(const char* name, uint64_t start_ns, uint64_t end_ns)
+	{
+		ThreadData& thread_data = GetThreadData();
+		thread_data.ring.Push({ name, thread_data.index, start_ns, end_ns });
+	}
+
+	void CpuProfiler::SetThreadName(const std::string& name)
+	{
+		ThreadData& thread_data = GetThreadData();
+		std::lock_guard<std::mutex> lock(mutex_);
+		thread_data.name = name;
+	}
+
+	void CpuProfiler::MarkFrame()
+	{
+		const uint64_t now_ns = NowNs();
+		const uint32_t thread_index = GetThreadData().index;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		const size_t first_event = events_.size();
+		DrainThreads();
+
+		CpuProfileFrame frame;
+		frame.index = frames_.size();
+		frame.thread = thread_index;
+		frame.start_ns = frame_start_ns_;
+		frame.end_ns = now_ns;
+		frames_.push_back(frame);
+		frame_start_ns_ = now_ns;
+
+		const double frame_ms = static_cast<double>(frame.end_ns - frame.start_ns) / 1000000.0;
+		if (hitch_threshold_ms_ > 0.0 && frame_ms > hitch_threshold_ms_ && frame.index > 0)
+		{
+			ReportHitch(frame, first_event);
+		}
+
+		// zones beyond the capture size were only kept for the hitch report of this frame
+		if (events_.size() > kMaxCapturedEvents)
+		{
+			if (!capture_full_reported_)
+			{
+				PEANUT_LOG_WARN("The cpu profile capture is full, later zones are not kept");
+				capture_full_reported_ = true;
+			}
+			events_.resize(kMaxCapturedEvents);
+		}
+	}
+
+	void CpuProfiler::DrainThreads()
+	{
+		for (auto& thread_data : threads_)
+		{
+			thread_data->ring.Drain(events_);
+		}
+	}
+
+	void CpuProfiler::ReportHitch(const CpuProfileFrame& frame, size_t first_event) const
+	{
+		const std::vector<CpuProfileEvent> frame_events(events_.begin() + first_event, events_.end());
+		const std::vector<CpuProfileEvent> longest = FindLongestZones(frame_events, frame.start_ns, frame.end_ns, kHitchZoneCount);
+
+		PEANUT_LOG_WARN("Frame {0} took {1:.2f}ms", frame.index, static_cast<double>(frame.end_ns - frame.start_ns) / 1000000.0);
+		for (const CpuProfileEvent& event : longest)
+		{
+			const std::string& thread_name = threads_[event.thread]->name;
+			PEANUT_LOG_WARN("    {0:<40} {1:>8.2f}ms  [{2}]", event.name, static_cast<double>(event.end_ns - event.start_ns) / 1000000.0,
+				thread_name.empty() ? "thread " + std::to_string(event.thread) : thread_name);
+		}
+	}
+
+	std::vector<CpuProfileEvent> CpuProfiler::FindLongestZones(const std::vector<CpuProfileEvent>& events,
+		uint64_t start_ns, uint64_t end_ns, size_t count)
+	{
+		std::vector<CpuProfileEvent> overlapping;
+		for (const CpuProfileEvent& event : events)
+		{
+			if (event.start_ns < end_ns && event.end_ns > start_ns)
+			{
+				overlapping.push_back(event);
+			}
+		}
+
+		const size_t result_count = std::min(count, overlapping.size());
+		std::partial_sort(overlapping.begin(), overlapping.begin() + result_count, overlapping.end(),
+			[](const CpuProfileEvent& lhs, const CpuProfileEvent& rhs)
+			{
+				return lhs.end_ns - lhs.start_ns > rhs.end_ns - rhs.start_ns;
+			});
+		overlapping.resize(result_count);
+		return overlapping;
+	}
+
+	bool CpuProfiler::WriteChromeTrace(const std::string& file_path)
+	{
+		std::string trace;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			DrainThreads();
+
+			std::vector<std::string> thread_names;
+			for (const auto& thread_data : threads_)
+			{
+				thread_names.push_back(thread_data->name);
+			}
+
+			// timestamps are written relative to the profiler start
+			std::vector<CpuProfileEvent> events(events_.begin(), events_.begin() + std::min(events_.size(), kMaxCapturedEvents));
+			std::vector<CpuProfileFrame> frames = frames_;
+			for (auto& event : events)
+			{
+				event.start_ns -= std::min(event.start_ns, epoch_ns_);
+				event.end_ns -= std::min(event.end_ns, epoch_ns_);
+			}
+			for (auto& frame : frames)
+			{
+				frame.start_ns -= std::min(frame.start_ns, epoch_ns_);
+				frame.end_ns -= std::min(frame.end_ns, epoch_ns_);
+			}
+			trace = FormatChromeTrace(events, frames, thread_names);
+		}
+
+		std::ofstream file(file_path, std::ios::out | std::ios::trunc);
+		if (!file.is_open())
+		{
+			PEANUT_LOG_ERROR("Failed to open cpu trace file {0}", file_path);
+			return false;
+		}
+
+		file << trace;
+		PEANUT_LOG_INFO("Write cpu profile of {0} frames to {1}", frames_.size(), file_path);
+		return true;
+	}
+
+	std::string CpuProfiler::FormatChromeTrace(const std::vector<CpuProfileEvent>& events, const std::vector<CpuProfileFrame>& frames,
+		const std::vector<std::string>& thread_names)
+	{
+		json11::Json::array trace_events;
+		trace_events.reserve(events.size() + frames.size() + thread_names.size());
+
+		for (size_t i = 0; i < thread_names.size(); ++i)
+		{
+			const std::string name = thread_names[i].empty() ? "thread " + std::to_string(i) : thread_names[i];
+			trace_events.push_back(json11::Json::object{
+				{"name", "thread_name"},
+				{"ph", "M"},
+				{"pid", 0},
+				{"tid", static_cast<int>(i)},
+				{"args", json11::Json::object{{"name", name}}},
+			});
+		}
+
+		// frames enclose the zones of their thread, so the viewer nests them below the frame
+		for (const CpuProfileFrame& frame : frames)
+		{
+			trace_events.push_back(json11::Json::object{
+				{"name", "Frame"},
+				{"cat", "frame"},
+				{"ph", "X"},
+				{"ts", static_cast<double>(frame.start_ns) / 1000.0},
+				{"dur", static_cast<double>(frame.end_ns - frame.start_ns) / 1000.0},
+				{"pid", 0},
+				{"tid", static_cast<int>(frame.thread)},
+				{"args", json11::Json::object{{"frame", static_cast<double>(frame.index)}}},
+			});
+		}
+
+		for (const CpuProfileEvent& event : events)
+		{
+			trace_events.push_back(json11::Json::object{
+				{"name", event.name},
+				{"cat", "cpu"},
+				{"ph", "X"},
+				{"ts", static_cast<double>(event.start_ns) / 1000.0},
+				{"dur", static_cast<double>(event.end_ns - event.start_ns) / 1000.0},
+				{"pid", 0},
+				{"tid", static_cast<int>(event.thread)},
+			});
+		}
+
+		return json11::Json(json11::Json::object{
+			{"traceEvents", trace_events},
+			{"displayTimeUnit", "ms"},
+		}).dump();
+	}
+} // namespace peanut
+
+#endif // PEANUT_ENABLE_PROFILER
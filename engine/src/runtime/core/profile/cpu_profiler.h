@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// PEANUT_ENABLE_PROFILER is defined for every configuration except Release, see src/runtime/CMakeLists.txt
+#ifdef PEANUT_ENABLE_PROFILER
+
+namespace peanut
+{
+	// a finished zone, the name has to outlive the profiler, e.g. a string literal
+	struct CpuProfileEvent
+	{
+		const char* name = nullptr;
+		uint32_t thread = 0;
+		uint64_t start_ns = 0;
+		uint64_t end_ns = 0;
+	};
+
+	struct CpuProfileFrame
+	{
+		uint64_t index = 0;
+		uint32_t thread = 0;
+		uint64_t start_ns = 0;
+		uint64_t end_ns = 0;
+	};
+
+	/**
+	 * @brief single producer single consumer ring of finished zones
+	 *
+	 * The owning thread pushes without locks, the frame marker drains it on the main thread.
+	 * Zones are dropped instead of blocking the producer when the ring is full.
+	 */
+	class CpuProfileRing
+	{
+	public:
+		explicit CpuProfileRing(uint32_t capacity);
+
+		// capacity is rounded up to a power of two
+		uint32_t GetCapacity() const { return mask_ + 1; }
+
+		bool Push(const CpuProfileEvent& event);
+
+		// move every pushed event to out_events, returns the number of events
+		size_t Drain(std::vector<CpuProfileEvent>& out_events);
+
+		uint64_t GetDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+	private:
+		std::unique_ptr<CpuProfileEvent[]> events_;
+		uint32_t mask_ = 0;
+		std::atomic<uint64_t> write_index_{ 0 };
+		std::atomic<uint64_t> read_index_{ 0 };
+		std::atomic<uint64_t> dropped_{ 0 };
+	};
+
+	/**
+	 * @brief cpu timings of scoped zones on every thread, exported as a chrome trace
+	 *
+	 * Every thread records into its own ring buffer, registering a thread is the only lock.
+	 * MarkFrame() on the main thread drains the rings into the capture and warns about frames
+	 * longer than the hitch threshold with the longest zones that ran during them.
+	 */
+	class CpuProfiler
+	{
+	public:
+		static CpuProfiler& Get();
+
+		CpuProfiler(const CpuProfiler&) = delete;
+		CpuProfiler& operator=(const CpuProfiler&) = delete;
+
+		static uint64_t NowNs();
+
+		void RecordZone(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+		// name of the calling thread in the trace
+		void SetThreadName(const std::string& name);
+
+		// end the current frame and start the next one
+		void MarkFrame();
+
+		// frames above the threshold are logged with their longest zones, 0 disables it
+		void SetHitchThreshold(double milliseconds) { hitch_threshold_ms_ = milliseconds; }
+
+		bool WriteChromeTrace(const std::string& file_path);
+
+		// longest zones overlapping [start_ns, end_ns], longest first
+		static std::vector<CpuProfileEvent> FindLongestZones(const std::vector<CpuProfileEvent>& events,
+			uint64_t start_ns, uint64_t end_ns, size_t count);
+
+		static std::string FormatChromeTrace(const std::vector<CpuProfileEvent>& events, const std::vector<CpuProfileFrame>& frames,
+			const std::vector<std::string>& thread_names);
+
+	private:
+		struct ThreadData
+		{
+			ThreadData(uint32_t ring_capacity, uint32_t thread_index) : ring(ring_capacity), index(thread_index) {}
+
+			CpuProfileRing ring;
+			uint32_t index;
+			std::string name;
+		};
+
+		CpuProfiler();
+
+		ThreadData& GetThreadData();
+
+		// the caller holds mutex_
+		void DrainThreads();
+		void ReportHitch(const CpuProfileFrame& frame, size_t first_event) const;
+
+		std::mutex mutex_;
+		std::vector<std::unique_ptr<ThreadData> > threads_;
+
+		std::vector<CpuProfileEvent> events_;
+		std::vector<CpuProfileFrame> frames_;
+		uint64_t frame_start_ns_ = 0;
+		bool capture_full_reported_ = false;
+		double hitch_threshold_ms_ = 50.0;
+
+		const uint64_t epoch_ns_;
+
+		static constexpr uint32_t kRingCapacity = 1 << 14;
+		static constexpr size_t kMaxCapturedEvents = 1 << 20;
+		static constexpr size_t kHitchZoneCount = 5;
+	};
+
+	// records the enclosing block as a zone of the calling thread
+	class CpuProfileScope
+	{
+	public:
+		explicit CpuProfileScope(const char* name) : name_(name), start_ns_(CpuProfiler::NowNs()) {}
+		~CpuProfileScope() { CpuProfiler::Get().RecordZone(name_, start_ns_, CpuProfiler::NowNs()); }
+
+		CpuProfileScope(const CpuProfileScope&) = delete;
+		CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+	private:
+		const char* name_;
+		uint64_t start_ns_;
+	};
+} // namespace peanut
+
+#define PEANUT_PROFILE_CONCAT_INNER(a, b) a##b
+#define PEANUT_PROFILE_CONCAT(a, b) PEANUT_PROFILE_CONCAT_INNER(a, b)
+#define PEANUT_PROFILE_SCOPE(name) ::peanut::CpuProfileScope PEANUT_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PEANUT_PROFILE_FUNCTION() PEANUT_PROFILE_SCOPE(__FUNCTION__)
+#define PEANUT_PROFILE_FRAME() ::peanut::CpuProfiler::Get().MarkFrame()
+#define PEANUT_PROFILE_THREAD(name) ::peanut::CpuProfiler::Get().SetThreadName(name)
+
+#else
+
+#define PEANUT_PROFILE_SCOPE(name) ((void)0)
+#define PEANUT_PROFILE_FUNCTION() ((void)0)
+#define PEANUT_PROFILE_FRAME() ((void)0)
+#define PEANUT_PROFILE_THREAD(name) ((void)0)
+
+#endif // PEANUT_ENABLE_PROFILER
@@ -0,0 +1,60 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include "runtime/core/profile/cpu_profiler.h"
+
+namespace peanut
+{
+	ThreadPool::ThreadPool(uint32_t thread_count)
+	{
+		if (thread_count == 0)
+		{
+			const uint32_t hardware_threads = std::thread::hardware_concurrency();
+			thread_count = std::max(1u, hardware_threads > 1 ? hardware_threads - 1 : 1u);
+		}
+
+		workers_.reserve(thread_count);
+		for (uint32_t i = 0; i < thread_count; ++i)
+		{
+			workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		condition_.notify_all();
+
+		for (auto& worker : workers_)
+		{
+			if (worker.joinable())
+				worker.join();
+		}
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		PEANUT_PROFILE_THREAD("ThreadPool worker");
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				condition_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+				if (stopping_ && tasks_.empty())
+				{
+					return;
+				}
+
+				task = std::move(tasks_.front());
+				tasks_.pop();
+			}
+
+			task();
+		}
+	}
+} // namespace peanut
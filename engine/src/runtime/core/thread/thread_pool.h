@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace peanut
+{
+	/**
+	 * @brief fixed size pool of worker threads consuming a FIFO job queue
+	 *
+	 * Jobs are plain callables, the returned future resolves with the job result.
+	 * The destructor drains the queue before joining, so every submitted job runs.
+	 */
+	class ThreadPool
+	{
+	public:
+		// thread_count 0 means one worker per hardware thread except the calling one
+		explicit ThreadPool(uint32_t thread_count = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		template<typename Func>
+		auto Submit(Func&& func) -> std::future<std::invoke_result_t<std::decay_t<Func> > >
+		{
+			using ResultType = std::invoke_result_t<std::decay_t<Func> >;
+
+			auto task = std::make_shared<std::packaged_task<ResultType()> >(std::forward<Func>(func));
+			std::future<ResultType> result = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				tasks_.emplace([task]() { (*task)(); });
+			}
+			condition_.notify_one();
+
+			return result;
+		}
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+	private:
+		void WorkerLoop();
+
+		std::vector<std::thread> workers_;
+		std::queue<std::function<void()> > tasks_;
+		std::mutex mutex_;
+		std::condition_variable condition_;
+		bool stopping_ = false;
+	};
+} // namespace peanut
@@ -0,0 +1,143 @@
+#include "runtime/core/time/frame_timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "runtime/core/base/logger.h"
+
+namespace peanut
+{
+	FrameTimer::FrameTimer(uint32_t window_size)
+		: frame_times_ms_(std::max(window_size, 1u), 0.0)
+	{
+	}
+
+	float FrameTimer::Tick()
+	{
+		const Clock::time_point now = Clock::now();
+		if (!has_ticked_)
+		{
+			// the first frame has nothing to measure against
+			has_ticked_ = true;
+			last_tick_ = now;
+			delta_time_ = 0.0f;
+			return delta_time_;
+		}
+
+		const double frame_seconds = std::chrono::duration<double>(now - last_tick_).count();
+		last_tick_ = now;
+
+		AddFrameTime(frame_seconds * 1000.0);
+		return delta_time_;
+	}
+
+	void FrameTimer::AddFrameTime(double frame_ms)
+	{
+		frame_times_ms_[next_sample_] = frame_ms;
+		next_sample_ = (next_sample_ + 1) % static_cast<uint32_t>(frame_times_ms_.size());
+		sample_count_ = std::min(sample_count_ + 1, static_cast<uint32_t>(frame_times_ms_.size()));
+
+		const auto bucket = std::lower_bound(kHistogramBoundsMs.begin(), kHistogramBoundsMs.end(), frame_ms);
+		histogram_[static_cast<size_t>(bucket - kHistogramBoundsMs.begin())]++;
+
+		delta_time_ = std::min(static_cast<float>(frame_ms / 1000.0), kMaxDeltaTime);
+		frame_index_++;
+	}
+
+	FrameTimeStats FrameTimer::GetStats() const
+	{
+		FrameTimeStats stats;
+		stats.frame_count = sample_count_;
+		if (sample_count_ == 0)
+		{
+			return stats;
+		}
+
+		std::vector<double> samples(frame_times_ms_.begin(), frame_times_ms_.begin() + sample_count_);
+		std::sort(samples.begin(), samples.end());
+
+		double total_ms = 0.0;
+		for (double sample : samples)
+		{
+			total_ms += sample;
+		}
+
+		// nearest rank percentile
+		const size_t p99_rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(samples.size())));
+		stats.min_ms = samples.front();
+		stats.max_ms = samples.back();
+		stats.p99_ms = samples[std::max<size_t>(p99_rank, 1) - 1];
+		stats.avg_ms = total_ms / static_cast<double>(samples.size());
+		stats.fps = stats.avg_ms > 0.0 ? 1000.0 / stats.avg_ms : 0.0;
+		return stats;
+	}
+
+	void FrameTimer::LogStats() const
+	{
+		const FrameTimeStats stats = GetStats();
+		PEANUT_LOG_INFO("Frame time over the last {0} frames: min {1:.2f}ms, avg {2:.2f}ms, p99 {3:.2f}ms, max {4:.2f}ms, {5:.1f} fps",
+			stats.frame_count, stats.min_ms, stats.avg_ms, stats.p99_ms, stats.max_ms, stats.fps);
+
+		if (frame_index_ == 0)
+		{
+			return;
+		}
+
+		PEANUT_LOG_INFO("Frame time histogram of {0} frames:", frame_index_);
+		double lower_bound_ms = 0.0;
+		for (size_t i = 0; i < histogram_.size(); ++i)
+		{
+			if (histogram_[i] != 0)
+			{
+				const double percent = 100.0 * static_cast<double>(histogram_[i]) / static_cast<double>(frame_index_);
+				if (i < kHistogramBoundsMs.size())
+				{
+					PEANUT_LOG_INFO("    {0:>6.1f} - {1:>6.1f}ms {2:>8} {3:>6.2f}%", lower_bound_ms, kHistogramBoundsMs[i], histogram_[i], percent);
+				}
+				else
+				{
+					PEANUT_LOG_INFO("    {0:>6.1f}ms and more {1:>8} {2:>6.2f}%", lower_bound_ms, histogram_[i], percent);
+				}
+			}
+			lower_bound_ms = i < kHistogramBoundsMs.size() ? kHistogramBoundsMs[i] : lower_bound_ms;
+		}
+	}
+
+	void FrameLimiter::SetTargetFps(double fps)
+	{
+		target_fps_ = std::max(fps, 0.0);
+		interval_ = target_fps_ > 0.0
+			? std::chrono::duration_cast<FrameTimer::Clock::duration>(std::chrono::duration<double>(1.0 / target_fps_))
+			: FrameTimer::Clock::duration(0);
+		started_ = false;
+	}
+
+	void FrameLimiter::Wait()
+	{
+		if (target_fps_ <= 0.0)
+		{
+			return;
+		}
+
+		const FrameTimer::Clock::time_point now = FrameTimer::Clock::now();
+		if (!started_ || now >= next_frame_ + interval_)
+		{
+			// first frame or the frame overran a whole interval, start a new schedule from now
+			started_ = true;
+			next_frame_ = now + interval_;
+			return;
+		}
+
+		if (next_frame_ - now > kSpinMargin)
+		{
+			std::this_thread::sleep_until(next_frame_ - kSpinMargin);
+		}
+		while (FrameTimer::Clock::now() < next_frame_)
+		{
+			std::this_thread::yield();
+		}
+
+		next_frame_ += interval_;
+	}
+} // namespace peanut
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace peanut
+{
+	struct FrameTimeStats
+	{
+		uint32_t frame_count = 0; // frames in the rolling window
+		double min_ms = 0.0;
+		double avg_ms = 0.0;
+		double p99_ms = 0.0;
+		double max_ms = 0.0;
+		double fps = 0.0;         // from the average frame time
+	};
+
+	/**
+	 * @brief delta time and frame time statistics of the engine loop
+	 *
+	 * Min, average and 99th percentile are computed over a rolling window of the last frames,
+	 * the histogram counts every frame since the timer was created.
+	 */
+	class FrameTimer
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// upper bounds of the histogram buckets, the last bucket counts everything above
+		static constexpr std::array<double, 13> kHistogramBoundsMs = { 2.0, 4.0, 6.0, 8.0, 10.0, 12.0, 14.0, 16.7, 20.0, 25.0, 33.4, 50.0, 100.0 };
+		static constexpr size_t kHistogramBucketCount = kHistogramBoundsMs.size() + 1;
+
+		explicit FrameTimer(uint32_t window_size = kDefaultWindowSize);
+
+		// call once at the start of every frame, returns the delta time in seconds
+		float Tick();
+
+		// record the duration of one frame, Tick() measures it from the clock
+		void AddFrameTime(double frame_ms);
+
+		// seconds since the previous frame, clamped so a breakpoint or a hitch does not explode the simulation
+		float GetDeltaTime() const { return delta_time_; }
+		uint64_t GetFrameIndex() const { return frame_index_; }
+
+		FrameTimeStats GetStats() const;
+		const std::array<uint64_t, kHistogramBucketCount>& GetHistogram() const { return histogram_; }
+
+		void LogStats() const;
+
+	private:
+		std::vector<double> frame_times_ms_;
+		uint32_t next_sample_ = 0;
+		uint32_t sample_count_ = 0;
+
+		std::array<uint64_t, kHistogramBucketCount> histogram_{};
+		Clock::time_point last_tick_;
+		bool has_ticked_ = false;
+		float delta_time_ = 0.0f;
+		uint64_t frame_index_ = 0;
+
+		static constexpr uint32_t kDefaultWindowSize = 240;
+		static constexpr float kMaxDeltaTime = 0.25f;
+	};
+
+	/**
+	 * @brief caps the frame rate by sleeping until the next frame interval
+	 *
+	 * The OS sleep is only precise to about a millisecond, so the thread sleeps until shortly
+	 * before the deadline and spins the rest. Deadlines advance by whole intervals to keep the
+	 * pacing even, a frame that overran the interval restarts the schedule instead of bursting.
+	 */
+	class FrameLimiter
+	{
+	public:
+		// 0 disables the limiter
+		void SetTargetFps(double fps);
+		double GetTargetFps() const { return target_fps_; }
+
+		// block until the current frame interval is over
+		void Wait();
+
+	private:
+		double target_fps_ = 0.0;
+		FrameTimer::Clock::duration interval_{ 0 };
+		FrameTimer::Clock::time_point next_frame_;
+		bool started_ = false;
+
+		static constexpr std::chrono::microseconds kSpinMargin{ 1500 };
+	};
+} // namespace peanut
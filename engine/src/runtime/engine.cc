@@ -1,15 +1,18 @@
 #include "runtime/engine.h"
 
+#include <chrono>
+
 #include "runtime/core/context/runtime_context.h"
 #include "runtime/core/event/event.h"
+#include "runtime/core/profile/cpu_profiler.h"
 
 namespace peanut {
-void PeanutEngine::Initliaze() {
-  GlobalRuntimeContext::GetContext()->SetupSubSystems();
+void PeanutEngine::Initliaze(const EngineConfig& config) {
+  GlobalEngineContext::GetContext()->SetupSubSystems(config);
 }
 
 void PeanutEngine::Shutdown() {
-  GlobalRuntimeContext::GetContext()->DestroySubSystems();
+  GlobalEngineContext::GetContext()->DestroySubSystems();
 }
 
 bool PeanutEngine::HandleWindowCloseEvent(WindowCloseEvent& e) {
@@ -20,10 +23,15 @@ bool PeanutEngine::HandleWindowCloseEvent(WindowCloseEvent& e) {
 }
 
 void PeanutEngine::Run() {
+  if (GlobalEngineContext::GetContext()->GetConfig().headless) {
+    RunHeadless();
+    return;
+  }
+
   const auto& window_system =
-      GlobalRuntimeContext::GetContext()->GetWindowSystem();
+      GlobalEngineContext::GetContext()->GetWindowSystem();
   const auto& render_system =
-      GlobalRuntimeContext::GetContext()->GetRenderSystem();
+      GlobalEngineContext::GetContext()->GetRenderSystem();
 
   window_system->PushEventCallback([this](Event& e) {
     EventDispatcher dispatcher(e);
@@ -31,9 +39,85 @@ void PeanutEngine::Run() {
         BIND_EVENT_FN(PeanutEngine::HandleWindowCloseEvent));
   });
 
+  FrameTimer& frame_timer = GlobalEngineContext::GetContext()->GetFrameTimer();
+  FrameLimiter frame_limiter;
+  frame_limiter.SetTargetFps(
+      GlobalEngineContext::GetContext()->GetConfig().max_fps);
+
+  PEANUT_PROFILE_THREAD("Main");
   while (!IsShutdown) {
+    frame_timer.Tick();
     render_system->Tick();
     window_system->OnUpdate();
+    {
+      PEANUT_PROFILE_SCOPE("FrameLimiter");
+      frame_limiter.Wait();
+    }
+    PEANUT_PROFILE_FRAME();
+  }
+  render_system->GetRHI()->WaitIdle();
+  ReportProfiles();
+}
+
+void PeanutEngine::RunHeadless() {
+  const EngineConfig& config = GlobalEngineContext::GetContext()->GetConfig();
+  const auto& render_system =
+      GlobalEngineContext::GetContext()->GetRenderSystem();
+
+  // frames are only bound by the gpu unless max_fps caps them, there is no presentation to wait for
+  FrameTimer& frame_timer = GlobalEngineContext::GetContext()->GetFrameTimer();
+  FrameLimiter frame_limiter;
+  frame_limiter.SetTargetFps(config.max_fps);
+
+  PEANUT_PROFILE_THREAD("Main");
+  const auto start_time = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < config.frame_count && !IsShutdown; ++frame) {
+    frame_timer.Tick();
+    render_system->Tick();
+    frame_limiter.Wait();
+    PEANUT_PROFILE_FRAME();
+  }
+  render_system->GetRHI()->WaitIdle();
+
+  const double elapsed_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time)
+          .count();
+  if (config.frame_count > 0 && elapsed_seconds > 0.0) {
+    PEANUT_LOG_INFO(
+        "Rendered {0} headless frames in {1:.3f}s, {2:.3f}ms per frame, {3:.1f} fps",
+        config.frame_count, elapsed_seconds,
+        elapsed_seconds * 1000.0 / config.frame_count,
+        config.frame_count / elapsed_seconds);
+  }
+
+  if (!config.capture_path.empty()) {
+    render_system->SaveFrame(config.capture_path);
+  }
+  ReportProfiles();
+}
+
+void PeanutEngine::ReportProfiles() {
+  const EngineConfig& config = GlobalEngineContext::GetContext()->GetConfig();
+  GlobalEngineContext::GetContext()->GetFrameTimer().LogStats();
+
+#ifdef PEANUT_ENABLE_PROFILER
+  if (!config.cpu_trace_path.empty()) {
+    CpuProfiler::Get().WriteChromeTrace(config.cpu_trace_path);
+  }
+#endif
+
+  GpuProfiler& gpu_profiler =
+      GlobalEngineContext::GetContext()->GetRenderSystem()->GetGpuProfiler();
+  if (!gpu_profiler.IsEnabled()) {
+    return;
+  }
+
+  // the device is idle, so the frames still in flight can be resolved as well
+  gpu_profiler.ResolvePendingFrames();
+  gpu_profiler.LogTimingTable();
+  if (!config.gpu_trace_path.empty()) {
+    gpu_profiler.WriteChromeTrace(config.gpu_trace_path);
   }
 }
 }  // namespace peanut
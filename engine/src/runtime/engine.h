@@ -1,6 +1,7 @@
 #pragma once
 #include "runtime/core/event/event.h"
 #include "runtime/core/event/window_event.h"
+#include "runtime/core/context/runtime_context.h"
 
 namespace peanut {
 	class PeanutEngine {
@@ -9,7 +10,7 @@ namespace peanut {
 			static PeanutEngine peanut_engine;
 			return peanut_engine;
 		}
-		void Initliaze();
+		void Initliaze(const EngineConfig& config = EngineConfig());
 		void Shutdown();
 		void Run();
 
@@ -21,6 +22,11 @@ namespace peanut {
 		PeanutEngine() = default;
 		~PeanutEngine() = default;
 
+		// render the configured number of frames back to back and report the throughput
+		void RunHeadless();
+		// log the frame time statistics and gpu timings, write the configured cpu and gpu traces
+		void ReportProfiles();
+
 		bool IsShutdown = false;
 	};
 }
\ No newline at end of file
@@ -2,10 +2,10 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include <direct.h>
 
 #include "runtime/core/base/logger.h"
 #include "runtime/core/context/runtime_context.h"
+#include "runtime/core/profile/cpu_profiler.h"
 #include "runtime/functions/assets/mesh.h"
 #include "runtime/functions/render/render_utils.h"
 
@@ -17,6 +17,7 @@ std::shared_ptr<TextureData> AssetsManager::LoadTextureData(const std::string& t
                                                             VkFormat format /*TODO: set a wapper format*/, int channels,
                                                             uint32_t levels) 
 {
+    PEANUT_PROFILE_FUNCTION();
     std::shared_ptr<TextureData> texture_data = std::make_shared<TextureData>();
     int width = 0;
     int height = 0;
@@ -48,6 +49,7 @@ std::shared_ptr<TextureData> AssetsManager::LoadTextureData(const std::string& t
     auto texture_height = texture_data->height;
     texture_data->levels = levels > 0 ? levels : RenderUtils::NumMipmapLevels(texture_width, texture_height);
     texture_data->layers = 1;
+    texture_data->format = format;
 
     VkImageUsageFlags usage =
         VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
@@ -111,6 +113,7 @@ std::shared_ptr<TextureData> AssetsManager::LoadTextureData(const std::string& t
 
 std::shared_ptr<MeshBuffer> AssetsManager::LoadMeshBuffer(const std::string& mesh_filepath) 
 {
+    PEANUT_PROFILE_FUNCTION();
     std::shared_ptr<Mesh> mesh = Mesh::ReadFromFile(mesh_filepath);
     if (mesh.get() == nullptr) 
     {
@@ -202,6 +205,7 @@ void AssetsManager::LoadRenderObjectFromDescriptionFile(const std::string& descr
                                                         std::map<std::string, std::shared_ptr<PbrMaterial> >& out_pbr_material_models,
                                                         std::map<std::string, std::shared_ptr<MeshBuffer> >& out_pbr_mesh_models) 
 {
+    PEANUT_PROFILE_FUNCTION();
     std::string json_content = ReadJsonFile(description_file);
     if (json_content.empty()) 
     {
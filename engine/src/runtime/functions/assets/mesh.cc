@@ -8,6 +8,7 @@
 #include <assimp/LogStream.hpp>
 
 #include "runtime/core/base/logger.h"
+#include "runtime/core/profile/cpu_profiler.h"
 
 namespace peanut {
 struct LogStream : public Assimp::LogStream {
@@ -56,6 +57,7 @@ Mesh::Mesh(const aiMesh* mesh) {
 
 std::shared_ptr<Mesh> Mesh::ReadFromFile(const std::string& filename) 
 {
+    PEANUT_PROFILE_FUNCTION();
     LogStream::initialize();
 
     PEANUT_LOG_INFO("Loading mesh from file: {0}", filename.c_str());
@@ -0,0 +1,143 @@
+#include "runtime/functions/render/draw_list.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace peanut
+{
+	namespace
+	{
+		constexpr uint64_t FieldMax(uint32_t bits) { return (1ull << bits) - 1; }
+
+		// saturate instead of wrapping so an overflowing id cannot reorder the fields above it
+		uint64_t PackField(uint64_t value, uint32_t bits, uint32_t shift) { return std::min(value, FieldMax(bits)) << shift; }
+	}
+
+	void DrawList::Clear()
+	{
+		commands_.clear();
+		sorted_commands_.clear();
+		entries_.clear();
+		material_ids_.clear();
+		mesh_ids_.clear();
+	}
+
+	uint32_t DrawList::GetDenseId(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t key)
+	{
+		auto result = ids.emplace(key, static_cast<uint32_t>(ids.size()));
+		return result.first->second;
+	}
+
+	void DrawList::Add(const MeshDrawCommand& draw_command, uint32_t pass, uint64_t material_id, float view_depth)
+	{
+		const uint32_t material = GetDenseId(material_ids_, material_id);
+		const uint32_t mesh = GetDenseId(mesh_ids_, reinterpret_cast<uintptr_t>(draw_command.mesh));
+
+		DrawSortEntry entry;
+		entry.index = static_cast<uint32_t>(commands_.size());
+		entry.key = order_ == DrawSortOrder::FrontToBack
+			? MakeFrontToBackKey(pass, draw_command.feature_mask, material, mesh, view_depth)
+			: MakeBackToFrontKey(pass, draw_command.feature_mask, material, mesh, view_depth);
+		entries_.push_back(entry);
+		commands_.push_back(draw_command);
+	}
+
+	void DrawList::Sort()
+	{
+		RadixSort(entries_, scratch_);
+
+		sorted_commands_.resize(entries_.size());
+		for (size_t i = 0; i < entries_.size(); ++i)
+		{
+			sorted_commands_[i] = commands_[entries_[i].index];
+		}
+	}
+
+	uint32_t DrawList::DepthToBits(float view_depth)
+	{
+		// behind the camera and nan sort as depth 0
+		if (!(view_depth > 0.0f))
+		{
+			return 0;
+		}
+
+		uint32_t bits;
+		std::memcpy(&bits, &view_depth, sizeof(bits));
+		return bits;
+	}
+
+	uint64_t DrawList::MakeFrontToBackKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float view_depth)
+	{
+		// the coarse depth buckets are the exponent and the top of the mantissa,
+		// so draws at a similar distance still group by material and mesh
+		const uint32_t depth = DepthToBits(view_depth);
+		const uint64_t coarse_depth = depth >> 21;
+		const uint64_t fine_depth = (depth >> 3) & FieldMax(18);
+
+		return PackField(pass, 2, 62) |
+			PackField(pipeline, 10, 52) |
+			PackField(coarse_depth, 10, 42) |
+			PackField(material, 12, 30) |
+			PackField(mesh, 12, 18) |
+			fine_depth;
+	}
+
+	uint64_t DrawList::MakeBackToFrontKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float view_depth)
+	{
+		const uint64_t inverted_depth = static_cast<uint32_t>(~DepthToBits(view_depth));
+
+		return PackField(pass, 2, 62) |
+			(inverted_depth << 30) |
+			PackField(pipeline, 10, 20) |
+			PackField(material, 10, 10) |
+			PackField(mesh, 10, 0);
+	}
+
+	void DrawList::RadixSort(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch)
+	{
+		if (entries.size() < 2)
+		{
+			return;
+		}
+
+		// a byte only needs a pass if it differs between keys
+		uint64_t all_and = ~0ull;
+		uint64_t all_or = 0;
+		for (const DrawSortEntry& entry : entries)
+		{
+			all_and &= entry.key;
+			all_or |= entry.key;
+		}
+		const uint64_t varying_bits = all_and ^ all_or;
+
+		scratch.resize(entries.size());
+		for (uint32_t shift = 0; shift < 64; shift += 8)
+		{
+			if (((varying_bits >> shift) & 0xff) == 0)
+			{
+				continue;
+			}
+
+			std::array<uint32_t, 256> offsets{};
+			for (const DrawSortEntry& entry : entries)
+			{
+				offsets[(entry.key >> shift) & 0xff]++;
+			}
+
+			uint32_t sum = 0;
+			for (uint32_t& offset : offsets)
+			{
+				const uint32_t count = offset;
+				offset = sum;
+				sum += count;
+			}
+
+			for (const DrawSortEntry& entry : entries)
+			{
+				scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+			}
+			entries.swap(scratch);
+		}
+	}
+} // namespace peanut
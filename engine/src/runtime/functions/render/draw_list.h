@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace peanut
+{
+	struct StaticMeshRenderData;
+
+	// one submesh draw
+	struct MeshDrawCommand
+	{
+		const StaticMeshRenderData* mesh = nullptr;
+		uint32_t submesh_index = 0;
+		uint32_t feature_mask = 0;
+		uint32_t object_offset = 0; // dynamic offset of the mesh's TransformUBO in the frame uniform buffer
+	};
+
+	namespace DrawSortOrder
+	{
+		enum Type : uint8_t
+		{
+			FrontToBack = 0, // opaque, grouped by state and roughly front to back for early depth rejection
+			BackToFront,     // blended, strictly back to front
+		};
+	}
+
+	struct DrawSortEntry
+	{
+		uint64_t key = 0;
+		uint32_t index = 0;
+	};
+
+	/**
+	 * @brief draws of a pass ordered by a 64 bit sort key
+	 *
+	 * Front to back keys, msb first:
+	 *     pass(2) | pipeline(10) | coarse depth(10) | material(12) | mesh(12) | fine depth(18)
+	 * Back to front keys:
+	 *     pass(2) | inverted depth(32) | pipeline(10) | material(10) | mesh(10)
+	 *
+	 * Materials and meshes get dense ids in the order they are added, ids beyond a field
+	 * share its largest value which only costs some redundant binds. Depth is the view space
+	 * distance, positive floats order like their bit patterns so it is packed without a range.
+	 */
+	class DrawList
+	{
+	public:
+		explicit DrawList(DrawSortOrder::Type order) : order_(order) {}
+
+		void Clear();
+
+		// material_id identifies the bound material state, draws with equal ids are grouped
+		void Add(const MeshDrawCommand& draw_command, uint32_t pass, uint64_t material_id, float view_depth);
+
+		// radix sort the keys and reorder the commands
+		void Sort();
+
+		const std::vector<MeshDrawCommand>& GetCommands() const { return sorted_commands_; }
+		DrawSortOrder::Type GetOrder() const { return order_; }
+
+		static uint64_t MakeFrontToBackKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float view_depth);
+		static uint64_t MakeBackToFrontKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float view_depth);
+
+		// bits of a non negative float, monotonic in the depth
+		static uint32_t DepthToBits(float view_depth);
+
+		// stable lsd radix sort by key, bytes that are equal in every key are skipped
+		static void RadixSort(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch);
+
+	private:
+		static uint32_t GetDenseId(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t key);
+
+		DrawSortOrder::Type order_;
+		std::vector<MeshDrawCommand> commands_;
+		std::vector<MeshDrawCommand> sorted_commands_;
+		std::vector<DrawSortEntry> entries_;
+		std::vector<DrawSortEntry> scratch_;
+		std::unordered_map<uint64_t, uint32_t> material_ids_;
+		std::unordered_map<uint64_t, uint32_t> mesh_ids_;
+	};
+} // namespace peanut
@@ -0,0 +1,162 @@
+#include "ibl_cache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "render_utils.h"
+#include "functions/rhi/gpu_readback.h"
+
+namespace peanut
+{
+	namespace
+	{
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+		};
+
+		struct TextureHeader
+		{
+			uint32_t width;
+			uint32_t height;
+			uint32_t layers;
+			uint32_t levels;
+			uint32_t format;
+			uint32_t padding;
+			uint64_t data_size;
+		};
+
+		template <typename T>
+		void Append(std::vector<char>& out_data, const T& value)
+		{
+			const char* bytes = reinterpret_cast<const char*>(&value);
+			out_data.insert(out_data.end(), bytes, bytes + sizeof(T));
+		}
+
+		template <typename T>
+		bool Read(const std::vector<char>& data, size_t& offset, T& out_value)
+		{
+			if (data.size() - offset < sizeof(T))
+			{
+				return false;
+			}
+			std::memcpy(&out_value, data.data() + offset, sizeof(T));
+			offset += sizeof(T);
+			return true;
+		}
+
+		void AppendTexture(std::vector<char>& out_data, const IblCacheTexture& texture)
+		{
+			const TextureHeader header = { texture.width, texture.height, texture.layers, texture.levels,
+				static_cast<uint32_t>(texture.format), 0, texture.data.size() };
+			Append(out_data, header);
+			out_data.insert(out_data.end(), texture.data.begin(), texture.data.end());
+		}
+
+		bool ReadTexture(const std::vector<char>& data, size_t& offset, IblCacheTexture& out_texture)
+		{
+			TextureHeader header;
+			if (!Read(data, offset, header))
+			{
+				return false;
+			}
+
+			// the texels have to fill exactly the layout the upload expects
+			const VkFormat format = static_cast<VkFormat>(header.format);
+			const uint64_t expected_size = IblCache::GetTextureDataSize(header.width, header.height, header.layers, header.levels, format);
+			if (expected_size == 0 || header.data_size != expected_size || data.size() - offset < header.data_size)
+			{
+				return false;
+			}
+
+			out_texture.width = header.width;
+			out_texture.height = header.height;
+			out_texture.layers = header.layers;
+			out_texture.levels = header.levels;
+			out_texture.format = format;
+			out_texture.data.assign(data.begin() + offset, data.begin() + offset + header.data_size);
+			offset += header.data_size;
+			return true;
+		}
+	}
+
+	uint64_t IblCache::ComputeKey(const std::string& source_path, const IblCacheParams& params)
+	{
+		std::vector<char> source_data;
+		if (!RenderUtils::ReadBinaryFile(source_path, source_data) || source_data.empty())
+		{
+			return 0;
+		}
+
+		const uint64_t source_hash = RenderUtils::HashBytes(source_data.data(), source_data.size());
+		return RenderUtils::HashBytes(&params, sizeof(params), source_hash);
+	}
+
+	std::string IblCache::GetCachePath(uint64_t key)
+	{
+		char file_name[32];
+		std::snprintf(file_name, sizeof(file_name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return std::string("./cache/ibl/") + file_name;
+	}
+
+	void IblCache::Serialize(uint64_t key, const IblCacheData& cache_data, std::vector<char>& out_data)
+	{
+		out_data.clear();
+		out_data.reserve(sizeof(FileHeader) + 3 * sizeof(TextureHeader) + sizeof(cache_data.irradiance_sh) +
+			cache_data.environment_map.data.size() + cache_data.filtered_texture.data.size() + cache_data.brdf_lut.data.size());
+
+		Append(out_data, FileHeader{ kMagic, kFormatVersion, key });
+		AppendTexture(out_data, cache_data.environment_map);
+		Append(out_data, cache_data.irradiance_sh);
+		AppendTexture(out_data, cache_data.filtered_texture);
+		AppendTexture(out_data, cache_data.brdf_lut);
+	}
+
+	bool IblCache::Deserialize(const std::vector<char>& data, uint64_t key, IblCacheData& out_cache_data)
+	{
+		size_t offset = 0;
+		FileHeader header;
+		if (!Read(data, offset, header) || header.magic != kMagic || header.version != kFormatVersion || header.key != key)
+		{
+			return false;
+		}
+
+		return ReadTexture(data, offset, out_cache_data.environment_map) &&
+			Read(data, offset, out_cache_data.irradiance_sh) &&
+			ReadTexture(data, offset, out_cache_data.filtered_texture) &&
+			ReadTexture(data, offset, out_cache_data.brdf_lut) &&
+			offset == data.size();
+	}
+
+	bool IblCache::Save(uint64_t key, const IblCacheData& cache_data)
+	{
+		std::vector<char> data;
+		Serialize(key, cache_data, data);
+		return RenderUtils::WriteBinaryFile(GetCachePath(key), data.data(), data.size());
+	}
+
+	bool IblCache::Load(uint64_t key, IblCacheData& out_cache_data)
+	{
+		std::vector<char> data;
+		if (!RenderUtils::ReadBinaryFile(GetCachePath(key), data))
+		{
+			return false;
+		}
+		return Deserialize(data, key, out_cache_data);
+	}
+
+	uint64_t IblCache::GetTextureDataSize(uint32_t width, uint32_t height, uint32_t layers, uint32_t levels, VkFormat format)
+	{
+		ReadbackImageDesc desc;
+		desc.width = width;
+		desc.height = height;
+		desc.layers = layers;
+		desc.levels = levels;
+		desc.bytes_per_pixel = GpuReadback::GetFormatTexelSize(format);
+
+		std::vector<ReadbackSubresource> subresources;
+		return GpuReadback::ComputeImageLayout(desc, subresources);
+	}
+} // namespace peanut
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "render_data.h"
+#include "spherical_harmonics.h"
+
+namespace peanut
+{
+	// parameters of the ibl precompute passes, a change of any of them invalidates the cached textures
+	struct IblCacheParams
+	{
+		uint32_t version = 0;               // bumped whenever the precompute shaders change their output
+		uint32_t sh_projection_size = 0;
+		uint32_t brdf_lut_size = 0;
+		uint32_t ibl_format = 0;            // VkFormat of the environment and prefiltered maps
+		uint32_t brdf_lut_format = 0;
+	};
+
+	// all levels and layers of a texture, placed as GpuReadback::ComputeImageLayout() does
+	struct IblCacheTexture
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t layers = 0;
+		uint32_t levels = 0;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		std::vector<uint8_t> data;
+	};
+
+	struct IblCacheData
+	{
+		IblCacheTexture environment_map;
+		SphericalHarmonics::Coefficients irradiance_sh = {};
+		IblCacheTexture filtered_texture;
+		IblCacheTexture brdf_lut;
+	};
+
+	/**
+	 * @brief binary file of the precomputed ibl textures
+	 *
+	 * The file is keyed on the content of the source hdr and the precompute parameters, a file
+	 * written for another source, other parameters or by another version of the format is rejected
+	 * as a whole, so a stale cache can only cost a recompute.
+	 */
+	class IblCache
+	{
+	public:
+		// 0 if the source can not be read
+		static uint64_t ComputeKey(const std::string& source_path, const IblCacheParams& params);
+		static std::string GetCachePath(uint64_t key);
+
+		static void Serialize(uint64_t key, const IblCacheData& cache_data, std::vector<char>& out_data);
+		// false if the data is truncated, of another format version or written for another key
+		static bool Deserialize(const std::vector<char>& data, uint64_t key, IblCacheData& out_cache_data);
+
+		static bool Save(uint64_t key, const IblCacheData& cache_data);
+		static bool Load(uint64_t key, IblCacheData& out_cache_data);
+
+		// size of the texels of a texture with the layout of GpuReadback::ComputeImageLayout(), 0 for unknown formats
+		static uint64_t GetTextureDataSize(uint32_t width, uint32_t height, uint32_t layers, uint32_t levels, VkFormat format);
+
+	private:
+		static constexpr uint32_t kMagic = 0x4C424950; // "PIBL"
+		static constexpr uint32_t kFormatVersion = 2;
+	};
+} // namespace peanut
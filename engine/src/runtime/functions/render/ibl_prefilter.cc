@@ -0,0 +1,181 @@
+#include "ibl_prefilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peanut
+{
+	namespace
+	{
+		float RadicalInverse(uint32_t bits)
+		{
+			bits = (bits << 16u) | (bits >> 16u);
+			bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+			bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+			bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+			bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+			return static_cast<float>(bits) * 2.3283064365386963e-10f;
+		}
+
+		float NdfGGX(float cos_lh, float roughness)
+		{
+			const float alpha = roughness * roughness;
+			const float alpha_square = alpha * alpha;
+			const float denominator = (cos_lh * cos_lh) * (alpha_square - 1.0f) + 1.0f;
+			return alpha_square / (static_cast<float>(PI) * denominator * denominator);
+		}
+
+		// face and texel coordinates in [0, 1] of a direction, the inverse of the cube face table of the shaders
+		void GetCubeFaceCoordinates(const glm::vec3& dir, uint32_t& out_face, glm::vec2& out_st)
+		{
+			const glm::vec3 abs_dir = glm::abs(dir);
+			float sc, tc, ma;
+			if (abs_dir.x >= abs_dir.y && abs_dir.x >= abs_dir.z)
+			{
+				out_face = dir.x > 0.0f ? 0 : 1;
+				sc = dir.x > 0.0f ? -dir.z : dir.z;
+				tc = -dir.y;
+				ma = abs_dir.x;
+			}
+			else if (abs_dir.y >= abs_dir.z)
+			{
+				out_face = dir.y > 0.0f ? 2 : 3;
+				sc = dir.x;
+				tc = dir.y > 0.0f ? dir.z : -dir.z;
+				ma = abs_dir.y;
+			}
+			else
+			{
+				out_face = dir.z > 0.0f ? 4 : 5;
+				sc = dir.z > 0.0f ? dir.x : -dir.x;
+				tc = -dir.y;
+				ma = abs_dir.z;
+			}
+			out_st = glm::vec2(0.5f * (sc / ma + 1.0f), 0.5f * (tc / ma + 1.0f));
+		}
+
+		glm::vec3 SampleLevel(const CubeMapLevel& level, uint32_t face, const glm::vec2& st)
+		{
+			const int max_texel = static_cast<int>(level.size) - 1;
+			const glm::vec2 texel = st * static_cast<float>(level.size) - 0.5f;
+			const glm::vec2 base = glm::floor(texel);
+			const glm::vec2 fraction = texel - base;
+
+			auto fetch = [&](int x, int y)
+			{
+				x = std::clamp(x, 0, max_texel);
+				y = std::clamp(y, 0, max_texel);
+				return glm::vec3(level.texels[(face * level.size + y) * level.size + x]);
+			};
+
+			const int x = static_cast<int>(base.x);
+			const int y = static_cast<int>(base.y);
+			const glm::vec3 top = glm::mix(fetch(x, y), fetch(x + 1, y), fraction.x);
+			const glm::vec3 bottom = glm::mix(fetch(x, y + 1), fetch(x + 1, y + 1), fraction.x);
+			return glm::mix(top, bottom, fraction.y);
+		}
+	}
+
+	uint32_t IblPrefilter::GetSampleCount(float roughness)
+	{
+		// doubles in equal roughness steps, the rough levels are small so their samples cost little
+		const float t = std::clamp(roughness, 0.0f, 1.0f);
+		const float count = kMinSampleCount * std::exp2(t * std::log2(static_cast<float>(kMaxSampleCount) / kMinSampleCount));
+		return std::min(static_cast<uint32_t>(std::ceil(count - 0.001f)), kMaxSampleCount);
+	}
+
+	float IblPrefilter::GetSourceMipLevel(float pdf, uint32_t sample_count, uint32_t source_size)
+	{
+		// solid angles of a texel of level 0 and of the sample
+		const float texel_solid_angle = 4.0f * static_cast<float>(PI) / (6.0f * source_size * source_size);
+		const float sample_solid_angle = 1.0f / (sample_count * pdf);
+		return std::max(0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.0f, 0.0f);
+	}
+
+	void IblPrefilter::BuildMipChain(std::vector<CubeMapLevel>& levels)
+	{
+		levels.resize(1);
+		while (levels.back().size > 1)
+		{
+			const CubeMapLevel& source = levels.back();
+			CubeMapLevel level;
+			level.size = source.size / 2;
+			level.texels.resize(6 * level.size * level.size);
+			for (uint32_t face = 0; face < 6; ++face)
+			{
+				for (uint32_t y = 0; y < level.size; ++y)
+				{
+					for (uint32_t x = 0; x < level.size; ++x)
+					{
+						const glm::vec4* row = &source.texels[(face * source.size + 2 * y) * source.size + 2 * x];
+						level.texels[(face * level.size + y) * level.size + x] =
+							0.25f * (row[0] + row[1] + row[source.size] + row[source.size + 1]);
+					}
+				}
+			}
+			levels.push_back(std::move(level));
+		}
+	}
+
+	glm::vec3 IblPrefilter::SampleCubeMap(const std::vector<CubeMapLevel>& levels, const glm::vec3& dir, float lod)
+	{
+		uint32_t face = 0;
+		glm::vec2 st;
+		GetCubeFaceCoordinates(dir, face, st);
+
+		lod = std::clamp(lod, 0.0f, static_cast<float>(levels.size() - 1));
+		const uint32_t level = static_cast<uint32_t>(lod);
+		const uint32_t next_level = std::min(level + 1, static_cast<uint32_t>(levels.size() - 1));
+		return glm::mix(SampleLevel(levels[level], face, st), SampleLevel(levels[next_level], face, st), lod - level);
+	}
+
+	glm::vec3 IblPrefilter::Prefilter(const std::vector<CubeMapLevel>& levels, const glm::vec3& n, float roughness, uint32_t sample_count)
+	{
+		// tangent frame of spmap_cs.glsl
+		glm::vec3 t = glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+		if (glm::dot(t, t) < 0.00001f)
+		{
+			t = glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f));
+		}
+		t = glm::normalize(t);
+		const glm::vec3 s = glm::normalize(glm::cross(n, t));
+
+		const float alpha = roughness * roughness;
+		glm::vec3 color(0.0f);
+		float weight = 0.0f;
+		for (uint32_t i = 0; i < sample_count; ++i)
+		{
+			const float u1 = static_cast<float>(i) / static_cast<float>(sample_count);
+			const float u2 = RadicalInverse(i);
+
+			const float cos_theta = std::sqrt((1.0f - u2) / (1.0f + (alpha * alpha - 1.0f) * u2));
+			const float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+			const float phi = 2.0f * static_cast<float>(PI) * u1;
+			const glm::vec3 lh = glm::normalize(s * (sin_theta * std::cos(phi)) + t * (sin_theta * std::sin(phi)) + n * cos_theta);
+
+			const glm::vec3 li = 2.0f * glm::dot(n, lh) * lh - n;
+			const float cos_li = glm::dot(n, li);
+			if (cos_li > 0.0f)
+			{
+				const float pdf = NdfGGX(std::max(glm::dot(n, lh), 0.0f), roughness) * 0.25f;
+				const float lod = GetSourceMipLevel(pdf, sample_count, levels[0].size);
+				color += SampleCubeMap(levels, li, lod) * cos_li;
+				weight += cos_li;
+			}
+		}
+		return weight > 0.0f ? color / weight : color;
+	}
+
+	float IblPrefilter::ComputeRelativeError(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference)
+	{
+		double error = 0.0;
+		double energy = 0.0;
+		for (size_t i = 0; i < std::min(image.size(), reference.size()); ++i)
+		{
+			const glm::vec3 difference = image[i] - reference[i];
+			error += glm::dot(difference, difference);
+			energy += glm::dot(reference[i], reference[i]);
+		}
+		return energy > 0.0 ? static_cast<float>(std::sqrt(error / energy)) : 0.0f;
+	}
+} // namespace peanut
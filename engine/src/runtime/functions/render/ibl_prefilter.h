@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "render_data.h"
+
+namespace peanut
+{
+	// one mip level of a cube map, the six faces one after another and row by row
+	struct CubeMapLevel
+	{
+		uint32_t size = 0;
+		std::vector<glm::vec4> texels;
+	};
+
+	/**
+	 * @brief sample counts of the prefiltered environment map and a cpu reference of spmap_cs.glsl
+	 *
+	 * Every GGX sample reads the source mip level whose texels cover the solid angle of the sample,
+	 * so low roughness levels, which hold most of the texels, need few samples and the sample count
+	 * grows with the roughness. The reference is slow and only meant for tests and offline checks.
+	 */
+	class IblPrefilter
+	{
+	public:
+		// the fixed count of the prefilter before the counts followed the roughness
+		static constexpr uint32_t kReferenceSampleCount = 1024;
+		static constexpr uint32_t kMinSampleCount = 32;
+		static constexpr uint32_t kMaxSampleCount = 1024;
+
+		static uint32_t GetSampleCount(float roughness);
+
+		// source mip level of a sample with the given pdf, source_size is the face size of level 0
+		static float GetSourceMipLevel(float pdf, uint32_t sample_count, uint32_t source_size);
+
+		// box filter levels[0] down to 1x1 faces
+		static void BuildMipChain(std::vector<CubeMapLevel>& levels);
+
+		// trilinear lookup, the faces are clamped at their edges
+		static glm::vec3 SampleCubeMap(const std::vector<CubeMapLevel>& levels, const glm::vec3& dir, float lod);
+
+		// prefiltered radiance around a direction, as spmap_cs.glsl computes it for one texel
+		static glm::vec3 Prefilter(const std::vector<CubeMapLevel>& levels, const glm::vec3& n, float roughness, uint32_t sample_count);
+
+		// root mean square of the difference relative to the one of the reference
+		static float ComputeRelativeError(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference);
+	};
+} // namespace peanut
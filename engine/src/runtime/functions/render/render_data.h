@@ -47,6 +47,9 @@ namespace peanut
         uint32_t levels;
         uint32_t layers;
 
+        // VK_FORMAT_UNDEFINED if the creator of the texture did not record it
+        VkFormat format = VK_FORMAT_UNDEFINED;
+
         void* pixels;
     };
 
@@ -88,6 +91,14 @@ namespace peanut
 
         std::vector<uint32_t> index_counts;
         std::vector<uint32_t> index_offsets;
+
+        // model space bounds used to cull shadow casters, meshes without bounds are never culled
+        bool has_bounding_box = false;
+        glm::vec3 bounding_box_min{ 0.0f };
+        glm::vec3 bounding_box_max{ 0.0f };
+        bool cast_shadow = true;
+        // static casters are cached in the local light shadow atlas and only re-rendered when they change
+        bool is_static = false;
     };
 
     struct StaticMeshRenderData : public MeshRenderData
@@ -98,9 +109,37 @@ namespace peanut
         std::vector<PbrMaterial> pbr_materials;
     };
 
+    // pipeline variant key of a material, see MATERIAL_FEATURE_* in constants.h
+    inline uint32_t GetMaterialFeatureMask(const MaterialPCO& material_pco)
+    {
+        uint32_t feature_mask = 0;
+        feature_mask |= material_pco.has_base_color_texture ? MATERIAL_FEATURE_BASE_COLOR_TEXTURE : 0;
+        feature_mask |= material_pco.has_emissive_texture ? MATERIAL_FEATURE_EMISSIVE_TEXTURE : 0;
+        feature_mask |= material_pco.has_metallic_roughness_occlusion_texture ? MATERIAL_FEATURE_METALLIC_ROUGHNESS_OCCLUSION_TEXTURE : 0;
+        feature_mask |= material_pco.contains_occlusion_channel ? MATERIAL_FEATURE_OCCLUSION_CHANNEL : 0;
+        feature_mask |= material_pco.has_normal_texture ? MATERIAL_FEATURE_NORMAL_TEXTURE : 0;
+        feature_mask |= material_pco.is_blend ? MATERIAL_FEATURE_BLEND : 0;
+        feature_mask |= material_pco.is_double_sided ? MATERIAL_FEATURE_DOUBLE_SIDED : 0;
+        return feature_mask;
+    }
+
+    // identity of the textures a material binds, materials with equal ids can share a descriptor set
+    inline uint64_t GetMaterialId(const PbrMaterial& material)
+    {
+        const TextureData* textures[] = { material.base_color_texture.get(), material.metallic_roughness_occlusion_texture.get(),
+            material.normal_texture.get(), material.emissive_texture.get() };
+
+        uint64_t id = 14695981039346656037ull;
+        for (const TextureData* texture : textures)
+        {
+            id = (id ^ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(texture))) * 1099511628211ull;
+        }
+        return id;
+    }
+
+    // the diffuse irradiance is not a texture, it is stored as sh coefficients in the sky light
     struct IblLightTexture
     {
-        TextureData ibl_irradiance_texture;
         TextureData ibl_prefilter_texture;
         TextureData brdf_lut_texture;
     };
@@ -113,12 +152,20 @@ namespace peanut
         std::vector<LightingUBO> lighting_ubo_data;
         Resource<VkBuffer> lighting_ub;
 
+        // culled into light clusters every frame, at most MAX_POINT_LIGHT_NUM / MAX_SPOT_LIGHT_NUM are used
+        std::vector<PointLight> point_lights;
+        std::vector<SpotLight> spot_lights;
+
         // todo: ibl textures
         IblLightTexture ibl_light_texture;
 
         TextureData directional_light_shadow_map;
-        std::vector<TextureData> point_light_shadow_map;
-        std::vector<TextureData> spot_light_shadow_map;
+        // tiles of the point and spot light shadows, see LocalLightShadowPass
+        TextureData local_light_shadow_atlas;
+
+        // placed by the scene, at most MAX_REFLECTION_PROBE_NUM are captured, see ReflectionProbePass
+        std::vector<ReflectionProbe> reflection_probes;
+        TextureData reflection_probe_array;
     };
 
     struct SkyboxRenderData : public RenderData
@@ -270,6 +317,7 @@ namespace peanut
     {
       uint32_t level;
       float roughness;
+      uint32_t sample_count;  // see IblPrefilter::GetSampleCount()
     };
 
     struct TransformUniforms 
@@ -277,6 +325,11 @@ namespace peanut
       glm::mat4 viewProjectionMatrix;
       glm::mat4 skyProjectionMatrix;
       glm::mat4 sceneRotationMatrix;
+      // last frame without jitter, for the motion vectors
+      glm::mat4 prevViewProjectionMatrix;
+      glm::mat4 prevSkyProjectionMatrix;
+      glm::mat4 prevSceneRotationMatrix;
+      glm::vec4 jitter;  // xy: sub-pixel offset of this frame's projection in ndc
     };
 
     struct ViewSettings {
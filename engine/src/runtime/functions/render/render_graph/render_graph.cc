@@ -0,0 +1,607 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+#include "runtime/core/base/logger.h"
+#include "runtime/functions/rhi/gpu_profiler.h"
+#include "runtime/functions/rhi/rhi.h"
+
+namespace peanut
+{
+	namespace
+	{
+		struct UsageInfo
+		{
+			VkPipelineStageFlags stage;
+			VkAccessFlags access;
+			VkImageLayout layout;
+			VkImageUsageFlags image_usage;
+		};
+
+		constexpr VkPipelineStageFlags kFragmentTestsStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+		const UsageInfo kUsageInfos[RGResourceUsage::UsageCount] =
+		{
+			// ColorAttachmentWrite
+			{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT },
+			// DepthAttachmentWrite
+			{ kFragmentTestsStages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT },
+			// DepthAttachmentRead
+			{ kFragmentTestsStages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT },
+			// InputAttachmentRead
+			{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT },
+			// FragmentSampledRead
+			{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT },
+			// ComputeSampledRead
+			{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT },
+			// ComputeStorageRead
+			{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT },
+			// ComputeStorageWrite
+			{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT },
+			// TransferSrc
+			{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT },
+			// TransferDst
+			{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT },
+			// Present
+			{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0 },
+		};
+
+		VkImageLayout GetUsageLayout(RGResourceUsage::Type usage, VkImageAspectFlags aspect)
+		{
+			// depth is read in shaders through the depth read only layout
+			const bool is_depth = (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+			if (is_depth && kUsageInfos[usage].layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			{
+				return VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			}
+			return kUsageInfos[usage].layout;
+		}
+
+		bool IsLifetimeOverlap(const RGAliasRequest& lhs, const RGAliasRequest& rhs)
+		{
+			return lhs.first_pass <= rhs.last_pass && rhs.first_pass <= lhs.last_pass;
+		}
+	}
+
+	RGTextureHandle RGPassBuilder::Read(RGTextureHandle texture, RGResourceUsage::Type usage)
+	{
+		graph_.AddTextureAccess(pass_index_, texture, usage, false);
+		return texture;
+	}
+
+	RGTextureHandle RGPassBuilder::Write(RGTextureHandle texture, RGResourceUsage::Type usage)
+	{
+		graph_.AddTextureAccess(pass_index_, texture, usage, true);
+		return texture;
+	}
+
+	void RGPassBuilder::SetSideEffect()
+	{
+		graph_.passes_[pass_index_].side_effect = true;
+	}
+
+	RenderGraph::~RenderGraph()
+	{
+		DestroyTransientTextures();
+	}
+
+	RGTextureHandle RenderGraph::CreateTexture(const std::string& name, const RGTextureDesc& desc)
+	{
+		Texture texture;
+		texture.name = name;
+		texture.desc = desc;
+		textures_.push_back(texture);
+		compiled_ = false;
+
+		return { static_cast<uint32_t>(textures_.size() - 1) };
+	}
+
+	RGTextureHandle RenderGraph::ImportTexture(const std::string& name, VkImage image, VkImageView image_view, const RGTextureDesc& desc,
+		VkImageLayout current_layout, VkImageLayout final_layout)
+	{
+		Texture texture;
+		texture.name = name;
+		texture.desc = desc;
+		texture.imported = true;
+		texture.image = image;
+		texture.image_view = image_view;
+		texture.initial_layout = current_layout;
+		texture.final_layout = final_layout;
+		textures_.push_back(texture);
+		compiled_ = false;
+
+		return { static_cast<uint32_t>(textures_.size() - 1) };
+	}
+
+	void RenderGraph::AddPass(const std::string& name, const SetupCallback& setup, ExecuteCallback execute)
+	{
+		Pass pass;
+		pass.name = name;
+		pass.execute = std::move(execute);
+		passes_.push_back(std::move(pass));
+		compiled_ = false;
+
+		RGPassBuilder builder(*this, static_cast<uint32_t>(passes_.size() - 1));
+		setup(builder);
+	}
+
+	void RenderGraph::AddTextureAccess(uint32_t pass_index, RGTextureHandle texture, RGResourceUsage::Type usage, bool is_write)
+	{
+		assert(texture.IsValid() && texture.index < textures_.size());
+
+		const UsageInfo& usage_info = kUsageInfos[usage];
+		const VkImageLayout layout = GetUsageLayout(usage, textures_[texture.index].desc.aspect);
+
+		Pass& pass = passes_[pass_index];
+		auto access = std::find_if(pass.accesses.begin(), pass.accesses.end(),
+			[&texture](const TextureAccess& texture_access) { return texture_access.texture == texture.index; });
+		if (access == pass.accesses.end())
+		{
+			pass.accesses.push_back({});
+			access = pass.accesses.end() - 1;
+			access->texture = texture.index;
+			access->layout = layout;
+		}
+		else if (access->layout != layout)
+		{
+			// e.g. storage read and write are both GENERAL, a sampled read and a storage write are not
+			PEANUT_LOG_ERROR("Render graph pass {0} uses texture {1} in two different layouts", pass.name, textures_[texture.index].name);
+		}
+
+		access->stage |= usage_info.stage;
+		access->access |= usage_info.access;
+		access->image_usage |= usage_info.image_usage;
+		access->is_read |= !is_write;
+		access->is_write |= is_write;
+	}
+
+	void RenderGraph::Compile()
+	{
+		stats_ = Stats();
+
+		CullPasses();
+		ComputeLifetimes();
+		AllocateTransientTextures();
+		PlanBarriers();
+
+		compiled_ = true;
+	}
+
+	void RenderGraph::CullPasses()
+	{
+		// walk backwards, a pass is kept if it has side effects, writes an imported texture
+		// or writes a texture that a kept pass reads later on
+		std::vector<bool> is_consumed(textures_.size(), false);
+		for (auto pass = passes_.rbegin(); pass != passes_.rend(); ++pass)
+		{
+			bool is_needed = pass->side_effect;
+			for (const auto& access : pass->accesses)
+			{
+				if (access.is_write && (textures_[access.texture].imported || is_consumed[access.texture]))
+				{
+					is_needed = true;
+				}
+			}
+
+			pass->culled = !is_needed;
+			if (pass->culled)
+			{
+				stats_.culled_passes++;
+				continue;
+			}
+
+			// writes may be partial, so they do not end the liveness of the previous contents
+			for (const auto& access : pass->accesses)
+			{
+				if (access.is_read)
+				{
+					is_consumed[access.texture] = true;
+				}
+			}
+		}
+	}
+
+	void RenderGraph::ComputeLifetimes()
+	{
+		for (auto& texture : textures_)
+		{
+			texture.first_pass = UINT32_MAX;
+			texture.last_pass = 0;
+			texture.usage = 0;
+		}
+
+		for (uint32_t pass_index = 0; pass_index < passes_.size(); ++pass_index)
+		{
+			const Pass& pass = passes_[pass_index];
+			if (pass.culled)
+			{
+				continue;
+			}
+
+			for (const auto& access : pass.accesses)
+			{
+				Texture& texture = textures_[access.texture];
+				texture.first_pass = std::min(texture.first_pass, pass_index);
+				texture.last_pass = std::max(texture.last_pass, pass_index);
+				texture.usage |= access.image_usage;
+			}
+		}
+	}
+
+	std::vector<uint32_t> RenderGraph::AssignAliasBlocks(const std::vector<RGAliasRequest>& requests, std::vector<RGAliasBlock>& out_blocks)
+	{
+		out_blocks.clear();
+		std::vector<uint32_t> block_indices(requests.size(), UINT32_MAX);
+
+		std::vector<uint32_t> order(requests.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(),
+			[&requests](uint32_t lhs, uint32_t rhs) { return requests[lhs].size > requests[rhs].size; });
+
+		for (uint32_t request_index : order)
+		{
+			const RGAliasRequest& request = requests[request_index];
+
+			uint32_t block_index = 0;
+			for (; block_index < out_blocks.size(); ++block_index)
+			{
+				const RGAliasBlock& block = out_blocks[block_index];
+				if ((block.memory_type_bits & request.memory_type_bits) == 0)
+				{
+					continue;
+				}
+
+				const bool is_overlapped = std::any_of(block.requests.begin(), block.requests.end(),
+					[&](uint32_t other) { return IsLifetimeOverlap(requests[other], request); });
+				if (!is_overlapped)
+				{
+					break;
+				}
+			}
+
+			if (block_index == out_blocks.size())
+			{
+				out_blocks.push_back({ 0, request.memory_type_bits, {} });
+			}
+
+			// every texture is bound at offset 0, so the block only has to be as large as the largest one
+			RGAliasBlock& block = out_blocks[block_index];
+			block.size = std::max(block.size, request.size);
+			block.memory_type_bits &= request.memory_type_bits;
+			block.requests.push_back(request_index);
+			block_indices[request_index] = block_index;
+		}
+
+		return block_indices;
+	}
+
+	void RenderGraph::AllocateTransientTextures()
+	{
+		DestroyTransientTextures();
+
+		std::vector<uint32_t> transient_textures;
+		for (uint32_t i = 0; i < textures_.size(); ++i)
+		{
+			if (!textures_[i].imported && textures_[i].first_pass <= textures_[i].last_pass)
+			{
+				transient_textures.push_back(i);
+			}
+		}
+
+		if (transient_textures.empty())
+		{
+			return;
+		}
+
+		auto rhi = rhi_.lock();
+		if (rhi.get() == nullptr)
+		{
+			PEANUT_LOG_ERROR("Render graph has transient textures but no rhi to create them");
+			return;
+		}
+
+		std::vector<RGAliasRequest> alias_requests;
+		for (uint32_t texture_index : transient_textures)
+		{
+			Texture& texture = textures_[texture_index];
+			texture.image = rhi->CreateUnboundImage(texture.desc.width, texture.desc.height, texture.desc.layers,
+				texture.desc.levels, 1, texture.desc.format, texture.usage);
+
+			const VkMemoryRequirements requirements = rhi->GetImageMemoryRequirements(texture.image);
+
+			RGAliasRequest request;
+			request.size = requirements.size;
+			request.alignment = requirements.alignment;
+			request.memory_type_bits = requirements.memoryTypeBits;
+			request.first_pass = texture.first_pass;
+			request.last_pass = texture.last_pass;
+			alias_requests.push_back(request);
+		}
+
+		std::vector<RGAliasBlock> alias_blocks;
+		const std::vector<uint32_t> block_indices = AssignAliasBlocks(alias_requests, alias_blocks);
+
+		for (const auto& block : alias_blocks)
+		{
+			VkMemoryRequirements block_requirements{};
+			block_requirements.size = block.size;
+			block_requirements.memoryTypeBits = block.memory_type_bits;
+
+			VkDeviceMemory memory = rhi->AllocateMemory(block_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (memory == VK_NULL_HANDLE)
+			{
+				PEANUT_LOG_FATAL("Failed to allocate render graph transient memory");
+			}
+			transient_memory_.push_back(memory);
+			stats_.transient_memory_size += block.size;
+		}
+		stats_.alias_blocks = static_cast<uint32_t>(alias_blocks.size());
+
+		for (uint32_t i = 0; i < transient_textures.size(); ++i)
+		{
+			Texture& texture = textures_[transient_textures[i]];
+			const RGAliasBlock& block = alias_blocks[block_indices[i]];
+
+			if (!rhi->BindImageMemory(texture.image, transient_memory_[block_indices[i]], 0))
+			{
+				PEANUT_LOG_FATAL("Failed to bind render graph texture {0}", texture.name);
+			}
+
+			texture.aliased = block.requests.size() > 1;
+			texture.image_view = rhi->CreateImageView(texture.image, texture.desc.format, texture.desc.aspect,
+				0, texture.desc.levels, texture.desc.layers);
+		}
+	}
+
+	void RenderGraph::PlanBarriers()
+	{
+		struct TextureState
+		{
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags write_stage = 0;
+			VkAccessFlags write_access = 0;
+			VkPipelineStageFlags read_stages = 0;
+			// stages and accesses the last write has already been made visible to
+			VkPipelineStageFlags visible_stages = 0;
+			VkAccessFlags visible_access = 0;
+			bool first_use = true;
+		};
+
+		std::vector<TextureState> states(textures_.size());
+		for (uint32_t i = 0; i < textures_.size(); ++i)
+		{
+			states[i].layout = textures_[i].imported ? textures_[i].initial_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+
+		for (auto& pass : passes_)
+		{
+			pass.barriers.clear();
+			if (pass.culled)
+			{
+				continue;
+			}
+
+			for (const auto& access : pass.accesses)
+			{
+				TextureState& state = states[access.texture];
+
+				bool needs_barrier = state.layout != access.layout;
+				if (state.write_stage != 0)
+				{
+					const bool is_visible = (state.visible_stages & access.stage) == access.stage &&
+						(state.visible_access & access.access) == access.access;
+					// write after write, or read after a write that this stage has not seen yet
+					needs_barrier |= access.is_write || !is_visible;
+				}
+				// write after read
+				needs_barrier |= access.is_write && state.read_stages != 0;
+
+				if (needs_barrier)
+				{
+					RGBarrier barrier;
+					barrier.texture = access.texture;
+					barrier.old_layout = state.layout;
+					barrier.new_layout = access.layout;
+					barrier.src_stage = state.write_stage | state.read_stages;
+					barrier.src_access = state.write_access;
+					barrier.dst_stage = access.stage;
+					barrier.dst_access = access.access;
+
+					if (state.first_use && textures_[access.texture].aliased)
+					{
+						// the memory was used by another texture earlier in the frame
+						barrier.src_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+						barrier.src_access = VK_ACCESS_MEMORY_WRITE_BIT;
+					}
+					if (barrier.src_stage == 0)
+					{
+						barrier.src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					}
+
+					pass.barriers.push_back(barrier);
+					stats_.barriers++;
+				}
+				else
+				{
+					stats_.trimmed_barriers++;
+				}
+
+				state.layout = access.layout;
+				state.first_use = false;
+				if (access.is_write)
+				{
+					state.write_stage = access.stage;
+					state.write_access = access.access;
+					state.read_stages = access.is_read ? access.stage : 0;
+					state.visible_stages = 0;
+					state.visible_access = 0;
+				}
+				else if (needs_barrier)
+				{
+					// the barrier waited for every earlier read as well
+					state.read_stages = access.stage;
+					state.visible_stages |= access.stage;
+					state.visible_access |= access.access;
+				}
+				else
+				{
+					state.read_stages |= access.stage;
+				}
+			}
+		}
+
+		final_barriers_.clear();
+		for (uint32_t i = 0; i < textures_.size(); ++i)
+		{
+			const Texture& texture = textures_[i];
+			const TextureState& state = states[i];
+			if (!texture.imported || texture.final_layout == VK_IMAGE_LAYOUT_UNDEFINED || texture.final_layout == state.layout)
+			{
+				continue;
+			}
+
+			RGBarrier barrier;
+			barrier.texture = i;
+			barrier.old_layout = state.layout;
+			barrier.new_layout = texture.final_layout;
+			barrier.src_stage = state.write_stage | state.read_stages;
+			barrier.src_access = state.write_access;
+			barrier.dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			barrier.dst_access = 0;
+			if (barrier.src_stage == 0)
+			{
+				barrier.src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			}
+
+			final_barriers_.push_back(barrier);
+			stats_.barriers++;
+		}
+	}
+
+	void RenderGraph::Execute(VkCommandBuffer command_buffer)
+	{
+		if (!compiled_)
+		{
+			Compile();
+		}
+
+		auto record_barriers = [this, command_buffer](const std::vector<RGBarrier>& barriers)
+		{
+			if (barriers.empty())
+			{
+				return;
+			}
+
+			VkPipelineStageFlags src_stages = 0;
+			VkPipelineStageFlags dst_stages = 0;
+			std::vector<VkImageMemoryBarrier> image_barriers;
+			image_barriers.reserve(barriers.size());
+			for (const auto& barrier : barriers)
+			{
+				const Texture& texture = textures_[barrier.texture];
+
+				VkImageMemoryBarrier image_barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+				image_barrier.srcAccessMask = barrier.src_access;
+				image_barrier.dstAccessMask = barrier.dst_access;
+				image_barrier.oldLayout = barrier.old_layout;
+				image_barrier.newLayout = barrier.new_layout;
+				image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				image_barrier.image = texture.image;
+				image_barrier.subresourceRange.aspectMask = texture.desc.aspect;
+				image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+				image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+				image_barriers.push_back(image_barrier);
+
+				src_stages |= barrier.src_stage;
+				dst_stages |= barrier.dst_stage;
+			}
+
+			vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, nullptr, 0, nullptr,
+				static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+		};
+
+		for (const auto& pass : passes_)
+		{
+			if (pass.culled)
+			{
+				continue;
+			}
+
+			PEANUT_GPU_PROFILE_SCOPE(profiler_, command_buffer, pass.name);
+			record_barriers(pass.barriers);
+			if (pass.execute)
+			{
+				pass.execute(command_buffer, *this);
+			}
+		}
+
+		record_barriers(final_barriers_);
+	}
+
+	void RenderGraph::DestroyTransientTextures()
+	{
+		auto rhi = rhi_.lock();
+		for (auto& texture : textures_)
+		{
+			if (texture.imported)
+			{
+				continue;
+			}
+
+			if (rhi.get() != nullptr)
+			{
+				rhi->DestroyImageView(texture.image_view);
+				rhi->DestroyImage({ texture.image });
+			}
+			texture.image = VK_NULL_HANDLE;
+			texture.image_view = VK_NULL_HANDLE;
+			texture.aliased = false;
+		}
+
+		if (rhi.get() != nullptr)
+		{
+			for (VkDeviceMemory memory : transient_memory_)
+			{
+				rhi->FreeMemory(memory);
+			}
+		}
+		transient_memory_.clear();
+	}
+
+	void RenderGraph::Reset()
+	{
+		DestroyTransientTextures();
+		passes_.clear();
+		textures_.clear();
+		final_barriers_.clear();
+		stats_ = Stats();
+		compiled_ = false;
+	}
+
+	bool RenderGraph::IsPassCulled(const std::string& name) const
+	{
+		auto pass = std::find_if(passes_.begin(), passes_.end(), [&name](const Pass& graph_pass) { return graph_pass.name == name; });
+		return pass != passes_.end() && pass->culled;
+	}
+
+	const std::vector<RGBarrier>& RenderGraph::GetPassBarriers(const std::string& name) const
+	{
+		static const std::vector<RGBarrier> kNoBarriers;
+		auto pass = std::find_if(passes_.begin(), passes_.end(), [&name](const Pass& graph_pass) { return graph_pass.name == name; });
+		return pass != passes_.end() ? pass->barriers : kNoBarriers;
+	}
+} // namespace peanut
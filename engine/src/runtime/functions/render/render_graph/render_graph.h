@@ -0,0 +1,224 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace peanut
+{
+	class RHI;
+	class GpuProfiler;
+
+	namespace RGResourceUsage
+	{
+		enum Type : uint8_t
+		{
+			ColorAttachmentWrite = 0,
+			DepthAttachmentWrite,
+			DepthAttachmentRead,
+			InputAttachmentRead,
+			FragmentSampledRead,
+			ComputeSampledRead,
+			ComputeStorageRead,
+			ComputeStorageWrite,
+			TransferSrc,
+			TransferDst,
+			Present,
+			UsageCount
+		};
+	}
+
+	struct RGTextureDesc
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t layers = 1;
+		uint32_t levels = 1;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+
+	struct RGTextureHandle
+	{
+		uint32_t index = UINT32_MAX;
+		bool IsValid() const { return index != UINT32_MAX; }
+	};
+
+	// one image memory barrier, stage masks are merged per pass when recorded
+	struct RGBarrier
+	{
+		uint32_t texture = 0;
+		VkImageLayout old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout new_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags src_stage = 0;
+		VkPipelineStageFlags dst_stage = 0;
+		VkAccessFlags src_access = 0;
+		VkAccessFlags dst_access = 0;
+	};
+
+	// transient texture memory request, used to pack textures with disjoint lifetimes into shared blocks
+	struct RGAliasRequest
+	{
+		VkDeviceSize size = 0;
+		VkDeviceSize alignment = 1;
+		uint32_t memory_type_bits = 0;
+		uint32_t first_pass = 0;
+		uint32_t last_pass = 0;
+	};
+
+	struct RGAliasBlock
+	{
+		VkDeviceSize size = 0;
+		uint32_t memory_type_bits = 0;
+		std::vector<uint32_t> requests;
+	};
+
+	class RenderGraph;
+
+	class RGPassBuilder
+	{
+	public:
+		RGPassBuilder(RenderGraph& graph, uint32_t pass_index) : graph_(graph), pass_index_(pass_index) {}
+
+		RGTextureHandle Read(RGTextureHandle texture, RGResourceUsage::Type usage);
+		RGTextureHandle Write(RGTextureHandle texture, RGResourceUsage::Type usage);
+
+		// the pass has effects outside the graph, e.g. readback, and is never culled
+		void SetSideEffect();
+
+	private:
+		RenderGraph& graph_;
+		uint32_t pass_index_;
+	};
+
+	/**
+	 * @brief frame graph of passes and the textures they read and write
+	 *
+	 * Passes declare their resource usage in a setup callback, Compile() culls passes whose
+	 * results are never consumed, gives transient textures memory (aliasing textures whose
+	 * lifetimes do not overlap) and plans the minimal layout transitions and barriers, so the
+	 * execute callbacks only record their own commands.
+	 * The graph is compiled once and can be executed every frame, Reset() it when the passes change.
+	 */
+	class RenderGraph
+	{
+	public:
+		using SetupCallback = std::function<void(RGPassBuilder& builder)>;
+		using ExecuteCallback = std::function<void(VkCommandBuffer command_buffer, const RenderGraph& graph)>;
+
+		struct Stats
+		{
+			uint32_t culled_passes = 0;
+			uint32_t barriers = 0;
+			uint32_t trimmed_barriers = 0; // accesses that needed no barrier, e.g. read after read
+			uint32_t alias_blocks = 0;
+			VkDeviceSize transient_memory_size = 0;
+		};
+
+	public:
+		RenderGraph() = default;
+		explicit RenderGraph(std::weak_ptr<RHI> rhi) : rhi_(rhi) {}
+		~RenderGraph();
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		// graph owned texture, only allocated if a pass that is not culled uses it
+		RGTextureHandle CreateTexture(const std::string& name, const RGTextureDesc& desc);
+
+		/**
+		 * Texture owned outside of the graph.
+		 * @param current_layout layout of the image when the graph starts executing
+		 * @param final_layout layout to leave the image in, VK_IMAGE_LAYOUT_UNDEFINED keeps the last used layout
+		 */
+		RGTextureHandle ImportTexture(const std::string& name, VkImage image, VkImageView image_view, const RGTextureDesc& desc,
+			VkImageLayout current_layout, VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+		void AddPass(const std::string& name, const SetupCallback& setup, ExecuteCallback execute);
+
+		void Compile();
+		void Execute(VkCommandBuffer command_buffer);
+
+		// time every executed pass, including its barriers, as a gpu scope named after the pass
+		void SetProfiler(GpuProfiler* profiler) { profiler_ = profiler; }
+
+		// destroy the transient textures and remove all passes and resources
+		void Reset();
+
+		VkImage GetImage(RGTextureHandle texture) const { return textures_[texture.index].image; }
+		VkImageView GetImageView(RGTextureHandle texture) const { return textures_[texture.index].image_view; }
+		const RGTextureDesc& GetTextureDesc(RGTextureHandle texture) const { return textures_[texture.index].desc; }
+
+		bool IsPassCulled(const std::string& name) const;
+		const std::vector<RGBarrier>& GetPassBarriers(const std::string& name) const;
+		const Stats& GetStats() const { return stats_; }
+
+		/**
+		 * Pack the requests into as few memory blocks as possible, requests whose pass ranges do not
+		 * overlap may share a block. Largest requests are placed first.
+		 * @return block index of every request
+		 */
+		static std::vector<uint32_t> AssignAliasBlocks(const std::vector<RGAliasRequest>& requests, std::vector<RGAliasBlock>& out_blocks);
+
+	private:
+		friend class RGPassBuilder;
+
+		void AddTextureAccess(uint32_t pass_index, RGTextureHandle texture, RGResourceUsage::Type usage, bool is_write);
+
+		// accesses of one texture within a pass are merged into one
+		struct TextureAccess
+		{
+			uint32_t texture = 0;
+			VkPipelineStageFlags stage = 0;
+			VkAccessFlags access = 0;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageUsageFlags image_usage = 0;
+			bool is_read = false;
+			bool is_write = false;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			ExecuteCallback execute;
+			std::vector<TextureAccess> accesses;
+			std::vector<RGBarrier> barriers;
+			bool side_effect = false;
+			bool culled = false;
+		};
+
+		struct Texture
+		{
+			std::string name;
+			RGTextureDesc desc;
+			bool imported = false;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView image_view = VK_NULL_HANDLE;
+			VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageUsageFlags usage = 0;
+
+			// pass range of the texture after culling, first_pass > last_pass when unused
+			uint32_t first_pass = UINT32_MAX;
+			uint32_t last_pass = 0;
+			bool aliased = false;
+		};
+
+		void CullPasses();
+		void ComputeLifetimes();
+		void AllocateTransientTextures();
+		void PlanBarriers();
+		void DestroyTransientTextures();
+
+		std::weak_ptr<RHI> rhi_;
+		std::vector<Pass> passes_;
+		std::vector<Texture> textures_;
+		std::vector<RGBarrier> final_barriers_;
+		std::vector<VkDeviceMemory> transient_memory_;
+		Stats stats_;
+		bool compiled_ = false;
+		GpuProfiler* profiler_ = nullptr;
+	};
+} // namespace peanut
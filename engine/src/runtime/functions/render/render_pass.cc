@@ -1,8 +1,11 @@
 #include "runtime/functions/render/render_pass.h"
 #include "runtime/functions/rhi/vulkan/vulkan_rhi.h"
+#include "runtime/functions/render/ibl_prefilter.h"
 
 #include <array>
 
+#include "runtime/core/profile/cpu_profiler.h"
+
 namespace peanut {
 
 void MainRenderPass::Initialize() {
@@ -13,6 +16,9 @@ void MainRenderPass::Initialize() {
 
   display_width_ = static_cast<VulkanRHI *>(rhi_.get())->GetDisplayWidth();
   display_height_ = static_cast<VulkanRHI *>(rhi_.get())->GetDisplayHeight();
+  anti_aliasing_mode_ = GlobalEngineContext::GetContext()
+                            ->GetRenderSystem()
+                            ->GetAntiAliasingMode();
 
   CreateRenderTarget();
 
@@ -32,7 +38,7 @@ void MainRenderPass::Initialize() {
 
   CreateFrameBuffer();
 
-  SetupToneMapPipeline();
+  SetupPostProcess();
 
   SetupPBRPipeline();
 
@@ -72,8 +78,11 @@ void MainRenderPass::DeInitialize()
     rhi_->DestroyPipelineLayout(g_pipeline_layouts_[Skybox]);
     rhi_->DestroyPipeline(skybox_pipeline_);
 
-    rhi_->DestroyPipelineLayout(g_pipeline_layouts_[ToneMap]);
-    rhi_->DestroyPipeline(tonemap_pipeline_);
+    post_process_pass_.Destroy();
+    if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA)
+    {
+        temporal_aa_pass_.Destroy();
+    }
 
     rhi_->DestroyRenderPass(g_render_pass_);
 
@@ -82,6 +91,11 @@ void MainRenderPass::DeInitialize()
     for (int32_t i = 0; i < num_frames; ++i) 
     {
         DestroyRenderTarget(g_render_targets_[i]);
+        DestroyRenderTarget(g_resolve_render_targets_[i]);
+        if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA)
+        {
+            DestroyRenderTarget(g_motion_vector_targets_[i]);
+        }
 
         rhi_->DestroyFrameBuffer(g_frame_buffers_[i]);
     }
@@ -89,6 +103,7 @@ void MainRenderPass::DeInitialize()
 
 void MainRenderPass::RenderTick(const ViewSettings &view,
                                 const SceneSettings &scene) {
+  PEANUT_PROFILE_FUNCTION();
   const VkDeviceSize zero_offset = 0;
 
   glm::mat4 projection_mat =
@@ -98,6 +113,22 @@ void MainRenderPass::RenderTick(const ViewSettings &view,
   projection_mat[1][1] *= -1.0f;  // Vulkan uses right handed NDC with Y axis
                                   // pointing down, compensate for that.
 
+  // a different sub-pixel offset every frame, accumulated by the temporal
+  // anti-aliasing
+  const bool temporal_aa = anti_aliasing_mode_ == AntiAliasingMode::TemporalAA;
+  const TemporalAASettings &temporal_aa_settings =
+      GlobalEngineContext::GetContext()
+          ->GetRenderSystem()
+          ->GetTemporalAASettings();
+  const glm::vec2 jitter =
+      temporal_aa ? TemporalAAPass::GetJitter(
+                        jitter_frame_index_++,
+                        temporal_aa_settings.jitter_sample_count,
+                        display_width_, display_height_)
+                  : glm::vec2(0.0f);
+  const glm::mat4 jittered_projection_mat =
+      TemporalAAPass::ApplyJitter(projection_mat, jitter);
+
   // PEANUT_LOG_INFO("pitch of view {0}, yaw of view {1}", view.pitch,
   // view.yaw);
 
@@ -119,9 +150,26 @@ void MainRenderPass::RenderTick(const ViewSettings &view,
   {
     TransformUniforms *const transfer_uniform =
         transform_uniform_buffer_[current_frame_index].as<TransformUniforms>();
-    transfer_uniform->viewProjectionMatrix = projection_mat * view_mat;
-    transfer_uniform->skyProjectionMatrix = projection_mat * view_rotation_mat;
+    transfer_uniform->viewProjectionMatrix = jittered_projection_mat * view_mat;
+    transfer_uniform->skyProjectionMatrix =
+        jittered_projection_mat * view_rotation_mat;
     transfer_uniform->sceneRotationMatrix = scene_rotation_mat;
+
+    // the first frame has no motion
+    if (!has_prev_transform_) {
+      prev_view_projection_mat_ = projection_mat * view_mat;
+      prev_sky_projection_mat_ = projection_mat * view_rotation_mat;
+      prev_scene_rotation_mat_ = scene_rotation_mat;
+      has_prev_transform_ = true;
+    }
+    transfer_uniform->prevViewProjectionMatrix = prev_view_projection_mat_;
+    transfer_uniform->prevSkyProjectionMatrix = prev_sky_projection_mat_;
+    transfer_uniform->prevSceneRotationMatrix = prev_scene_rotation_mat_;
+    transfer_uniform->jitter = glm::vec4(jitter, 0.0f, 0.0f);
+
+    prev_view_projection_mat_ = projection_mat * view_mat;
+    prev_sky_projection_mat_ = projection_mat * view_rotation_mat;
+    prev_scene_rotation_mat_ = scene_rotation_mat;
   }
   // update shading uniform buffer
   {
@@ -141,19 +189,31 @@ void MainRenderPass::RenderTick(const ViewSettings &view,
   // Begin recording current frame command buffer.
   VkCommandBuffer command_buffer = rhi_->BeginImmediateComputePassCommandBuffer();
   // vkResetCommandBuffer(command_buffer, 0);
+  GpuProfiler *gpu_profiler =
+      &GlobalEngineContext::GetContext()->GetRenderSystem()->GetGpuProfiler();
+  gpu_profiler->BeginFrame(command_buffer, current_frame_index);
+  gpu_profiler->BeginScope(command_buffer, "MainRenderPass");
   // begin render pass
-  std::array<VkClearValue, 2> clear_value = {};
-  clear_value[1].depthStencil.depth = 1.0f;
+  // the motion vectors are cleared to no motion
+  std::array<VkClearValue, 3> clear_value = {};
+  clear_value[MainDepthStencilAttachment].depthStencil.depth = 1.0f;
 
   VkRenderPassBeginInfo begin_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
   begin_info.renderPass = g_render_pass_;
   begin_info.framebuffer = g_frame_buffers_[current_frame_index];
   begin_info.renderArea = VkRect2D({0, 0, display_width_, display_height_});
-  begin_info.clearValueCount = static_cast<uint32_t>(clear_value.size());
+  begin_info.clearValueCount = temporal_aa ? 3 : 2;
   begin_info.pClearValues = clear_value.data();
   vkCmdBeginRenderPass(command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
+  const VkViewport viewport = {0.0f, 0.0f, (float)display_width_,
+                               (float)display_height_, 0.0f, 1.0f};
+  const VkRect2D scissor = {{0, 0}, {display_width_, display_height_}};
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
   // draw skybox
+  gpu_profiler->BeginScope(command_buffer, "Skybox");
   VkDescriptorSet uniforms_descriptorset =
       uniform_descriptor_sets_[current_frame_index];
 
@@ -174,8 +234,10 @@ void MainRenderPass::RenderTick(const ViewSettings &view,
                        VK_INDEX_TYPE_UINT32);
 
   vkCmdDrawIndexed(command_buffer, skybox_mesh_->num_elements, 1, 0, 0, 0);
+  gpu_profiler->EndScope(command_buffer);
 
   // draw pbr model
+  gpu_profiler->BeginScope(command_buffer, "PBR");
   const std::array<VkDescriptorSet, 1> pbr_descriptorsets = {
       pbr_descriptor_set_};
 
@@ -194,38 +256,62 @@ void MainRenderPass::RenderTick(const ViewSettings &view,
                        VK_INDEX_TYPE_UINT32);
 
   vkCmdDrawIndexed(command_buffer, pbr_mesh_->num_elements, 1, 0, 0, 0);
+  gpu_profiler->EndScope(command_buffer);
 
-  vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
-
-  // draw a full screen triangle for postprocessing/tone mapping
-  VkDescriptorSet tonemap_descriptorset =
-      tonemap_descriptor_sets_[current_frame_index];
-
-  const std::array<VkDescriptorSet, 1> tonemap_descriptorsets = {
-      tonemap_descriptorset};
-
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    tonemap_pipeline_);
-
-  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          g_pipeline_layouts_[DescriptorSetType::ToneMap], 0,
-                          static_cast<uint32_t>(tonemap_descriptorsets.size()),
-                          tonemap_descriptorsets.data(), 0, nullptr);
+  vkCmdEndRenderPass(command_buffer);
+  gpu_profiler->EndScope(command_buffer);
 
-  vkCmdDraw(command_buffer, 3, 1, 0, 0);
+  // resolve the jittered scene color with the history, read by the post
+  // process instead of the scene color
+  if (temporal_aa) {
+    temporal_aa_pass_.SetSettings(temporal_aa_settings);
+    temporal_aa_pass_.Render(command_buffer, current_frame_index);
+  }
 
-  vkCmdEndRenderPass(command_buffer);
+  // exposure, bloom, tone mapping and color grading into the swapchain image
+  post_process_pass_.SetSettings(GlobalEngineContext::GetContext()
+                                     ->GetRenderSystem()
+                                     ->GetPostProcessSettings());
+  post_process_pass_.Render(
+      command_buffer, current_frame_index,
+      GlobalEngineContext::GetContext()->GetFrameTimer().GetDeltaTime());
   vkEndCommandBuffer(command_buffer);
 
   // submite command buffer
   {
+    PEANUT_PROFILE_SCOPE("QueueSubmit");
     VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &command_buffer;
     rhi_->QueueSubmit(1, current_frame_index, &submit_info);
   }
 
-  rhi_->PresentFrame();
+  {
+    PEANUT_PROFILE_SCOPE("PresentFrame");
+    rhi_->PresentFrame();
+  }
+}
+
+void MainRenderPass::ResizeSwapchainObject() {
+  PEANUT_LOG_INFO("Resize main render pass");
+
+  display_width_ = static_cast<VulkanRHI *>(rhi_.get())->GetDisplayWidth();
+  display_height_ = static_cast<VulkanRHI *>(rhi_.get())->GetDisplayHeight();
+
+  // pipelines use dynamic viewport and scissor and the attachment formats do not
+  // change, so only the size dependent render targets and framebuffers are rebuilt
+  for (size_t i = 0; i < g_frame_buffers_.size(); ++i) {
+    DestroyRenderTarget(g_render_targets_[i]);
+    DestroyRenderTarget(g_resolve_render_targets_[i]);
+    if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) {
+      DestroyRenderTarget(g_motion_vector_targets_[i]);
+    }
+    rhi_->DestroyFrameBuffer(g_frame_buffers_[i]);
+  }
+
+  CreateRenderTarget();
+  CreateFrameBuffer();
+  UpdatePostProcessTargets();
 }
 
 void MainRenderPass::preparePassData() 
@@ -283,6 +369,10 @@ void MainRenderPass::SetupSamplers() {
   VkSamplerCreateInfo create_info = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
   create_info.minFilter = VK_FILTER_LINEAR;
   create_info.magFilter = VK_FILTER_LINEAR;
+  // the prefilter reads the mip its samples cover, fewer samples need the
+  // whole filtered chain
+  create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  create_info.maxLod = VK_LOD_CLAMP_NONE;
   create_info.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
   rhi_->CreateSampler(&create_info, &comput_sampler_);
 
@@ -411,17 +501,20 @@ UniformBufferAllocation MainRenderPass::AllocateSubStorageFromUniformBuffer(
 
 void MainRenderPass::SetupRenderpass() {
   std::vector<VkAttachmentDescription> attachments = {
-      // index0: main color attachment
+      // index0: main color attachment, read by the post process unless it is
+      // resolved
       {
           0,
           g_render_targets_[0].color_format,
           static_cast<VkSampleCountFlagBits>(render_samples_),
           VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-          VK_ATTACHMENT_STORE_OP_DONT_CARE,
+          (render_samples_ > 1) ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                                : VK_ATTACHMENT_STORE_OP_STORE,
           VK_ATTACHMENT_LOAD_OP_DONT_CARE,
           VK_ATTACHMENT_STORE_OP_DONT_CARE,
           VK_IMAGE_LAYOUT_UNDEFINED,
-          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+          (render_samples_ > 1) ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
       },
       // index1: depth-stencil attachment
       {0, g_render_targets_[0].depth_format,
@@ -429,26 +522,14 @@ void MainRenderPass::SetupRenderpass() {
        VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE,
        VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE,
        VK_IMAGE_LAYOUT_UNDEFINED,
-       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL},
-      // index 2: swapchain color attchment
-      {
-          0,
-          VK_FORMAT_B8G8R8A8_UNORM,
-          VK_SAMPLE_COUNT_1_BIT,
-          VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-          VK_ATTACHMENT_STORE_OP_STORE,
-          VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-          VK_ATTACHMENT_STORE_OP_DONT_CARE,
-          VK_IMAGE_LAYOUT_UNDEFINED,
-          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-      }};
+       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}};
   if (render_samples_ > 1) {
     const VkAttachmentDescription resolveAttachment = {
         0,
         g_resolve_render_targets_[0].color_format,
         VK_SAMPLE_COUNT_1_BIT,
         VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        VK_ATTACHMENT_STORE_OP_STORE,
         VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         VK_ATTACHMENT_STORE_OP_DONT_CARE,
         VK_IMAGE_LAYOUT_UNDEFINED,
@@ -456,8 +537,26 @@ void MainRenderPass::SetupRenderpass() {
     };
     attachments.push_back(resolveAttachment);
   }
-  const std::array<VkAttachmentReference, 1> mainpass_color_refs = {
-      {MainColorAttachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}};
+  const bool temporal_aa = anti_aliasing_mode_ == AntiAliasingMode::TemporalAA;
+  if (temporal_aa) {
+    // read by the temporal anti-aliasing resolve
+    const VkAttachmentDescription motionVectorAttachment = {
+        0,
+        g_motion_vector_targets_[0].color_format,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_ATTACHMENT_LOAD_OP_CLEAR,
+        VK_ATTACHMENT_STORE_OP_STORE,
+        VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+    attachments.push_back(motionVectorAttachment);
+  }
+  const std::array<VkAttachmentReference, 2> mainpass_color_refs = {{
+      {MainColorAttachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+      {MotionVectorAttachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+  }};
   const std::array<VkAttachmentReference, 1> mainpass_resolve_refs = {
       {ResolveColorAttachment, VK_IMAGE_LAYOUT_GENERAL}};
   const VkAttachmentReference mainpass_depth_stencil_refs = {
@@ -467,53 +566,30 @@ void MainRenderPass::SetupRenderpass() {
   // main pass
   VkSubpassDescription main_pass = {};
   main_pass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  main_pass.colorAttachmentCount =
-      static_cast<uint32_t>(mainpass_color_refs.size());
+  main_pass.colorAttachmentCount = temporal_aa ? 2 : 1;
   main_pass.pColorAttachments = mainpass_color_refs.data();
   main_pass.pDepthStencilAttachment = &mainpass_depth_stencil_refs;
   if (render_samples_ > 1) {
     main_pass.pResolveAttachments = mainpass_resolve_refs.data();
   }
-  // Tonemapping subpass
-  const std::array<VkAttachmentReference, 1> tonemap_subpass_input_refs = {
-      {MainColorAttachment, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
-  const std::array<VkAttachmentReference, 1> tonemap_subpass_multisample_refs =
-      {{ResolveColorAttachment, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
-  const std::array<VkAttachmentReference, 1> tonemap_subpass_color_refs = {
-      {SwapchainColorAttachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}};
-  VkSubpassDescription tonemap_subpass = {};
-  tonemap_subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  tonemap_subpass.colorAttachmentCount =
-      static_cast<uint32_t>(tonemap_subpass_color_refs.size());
-  tonemap_subpass.pColorAttachments = tonemap_subpass_color_refs.data();
-  if (render_samples_ > 1) {
-    tonemap_subpass.inputAttachmentCount =
-        static_cast<uint32_t>(tonemap_subpass_multisample_refs.size());
-    tonemap_subpass.pInputAttachments = tonemap_subpass_multisample_refs.data();
-  } else {
-    tonemap_subpass.inputAttachmentCount =
-        static_cast<uint32_t>(tonemap_subpass_input_refs.size());
-    tonemap_subpass.pInputAttachments = tonemap_subpass_input_refs.data();
-  }
-
-  const std::array<VkSubpassDescription, 2> subpasses = {main_pass,
-                                                         tonemap_subpass};
-
+  // the post process and the temporal anti-aliasing sample the scene color in
+  // compute and fragment shaders
   const VkSubpassDependency subpass_dependency = {
       0,
-      1,
+      VK_SUBPASS_EXTERNAL,
       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
       VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
       VK_ACCESS_SHADER_READ_BIT,
-      VK_DEPENDENCY_BY_REGION_BIT};
+      0};
   VkRenderPassCreateInfo renderpass_create_info = {
       VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
   renderpass_create_info.attachmentCount =
       static_cast<uint32_t>(attachments.size());
   renderpass_create_info.pAttachments = attachments.data();
-  renderpass_create_info.subpassCount = static_cast<uint32_t>(subpasses.size());
-  renderpass_create_info.pSubpasses = subpasses.data();
+  renderpass_create_info.subpassCount = 1;
+  renderpass_create_info.pSubpasses = &main_pass;
   renderpass_create_info.dependencyCount = 1;
   renderpass_create_info.pDependencies = &subpass_dependency;
 
@@ -549,6 +625,11 @@ void MainRenderPass::CreateRenderTarget() {
   render_samples_ =
       ((max_color_samples < max_depth_samples) ? (max_color_samples)
                                                : (max_depth_samples));
+  // the temporal anti-aliasing samples a pixel at a different position every
+  // frame instead
+  if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) {
+    render_samples_ = 1;
+  }
   assert(render_samples_ >= 1);
 
   uint32_t num_frames = rhi_->GetNumberFrames();
@@ -570,6 +651,15 @@ void MainRenderPass::CreateRenderTarget() {
                                  VK_FORMAT_UNDEFINED);
     }
   }
+
+  if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) {
+    g_motion_vector_targets_.resize(num_frames);
+    for (uint32_t i = 0; i < num_frames; ++i) {
+      CreateRenderTargetInternal(g_motion_vector_targets_[i], display_width_,
+                                 display_height_, 1, VK_FORMAT_R16G16_SFLOAT,
+                                 VK_FORMAT_UNDEFINED);
+    }
+  }
 }
 
 void MainRenderPass::CreateRenderTargetInternal(RenderTarget &target,
@@ -587,7 +677,7 @@ void MainRenderPass::CreateRenderTargetInternal(RenderTarget &target,
 
   VkImageUsageFlags color_image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
   if (samples == 1) {
-    color_image_usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    color_image_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
   }
 
   if (color_format != VK_FORMAT_UNDEFINED) {
@@ -630,17 +720,17 @@ void MainRenderPass::DestroyRenderTarget(RenderTarget &render_target) {
 }
 
 void MainRenderPass::CreateFrameBuffer() {
-  const std::vector<VkImageView> &swapchain_image_view =
-      static_cast<VulkanRHI *>(rhi_.get())->GetSwapchainImageView();
   uint32_t num_frames = rhi_->GetNumberFrames();
   g_frame_buffers_.resize(num_frames);
   for (uint32_t i = 0; i < num_frames; ++i) {
     std::vector<VkImageView> attachments = {g_render_targets_[i].color_view,
-                                            g_render_targets_[i].depth_view,
-                                            swapchain_image_view[i]};
+                                            g_render_targets_[i].depth_view};
     if (render_samples_ > 1) {
       attachments.push_back(g_resolve_render_targets_[i].color_view);
     }
+    if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) {
+      attachments.push_back(g_motion_vector_targets_[i].color_view);
+    }
 
     VkFramebufferCreateInfo framebuffer_create_info = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
     framebuffer_create_info.renderPass = g_render_pass_;
@@ -722,13 +812,17 @@ void MainRenderPass::SetupPBRPipeline()
   depth_stencil_state_create_info.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 
   VkShaderModule pbr_vs = rhi_->CreateShaderModule(kPbrVertexShaderFile);
-  VkShaderModule pbr_fs = rhi_->CreateShaderModule(kPbrFragmentShaderFile);
+  VkShaderModule pbr_fs = rhi_->CreateShaderModule(
+      (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA)
+          ? kPbrTaaFragmentShaderFile
+          : kPbrFragmentShaderFile);
 
   pbr_pipeline_ = rhi_->CreateGraphicsPipeline(
       g_render_pass_, 0, pbr_vs, pbr_fs,
       g_pipeline_layouts_[DescriptorSetType::Pbr], &vertex_input_bindings,
       &vertex_attributes, &multi_sample_state_create_info,
-      &depth_stencil_state_create_info);
+      &depth_stencil_state_create_info,
+      (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) ? 2 : 1);
 
   const std::vector<VkDescriptorImageInfo> textures = {
       {VK_NULL_HANDLE, albedo_texture_->image_view,
@@ -758,48 +852,50 @@ void MainRenderPass::SetupPBRPipeline()
   rhi_->DestroyShaderModule(pbr_fs);
 }
 
-void MainRenderPass::SetupToneMapPipeline()
-{
-  const std::vector<VkDescriptorSetLayoutBinding>
-      descriptorset_layout_bindings = {{0, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-                                        1, VK_SHADER_STAGE_FRAGMENT_BIT,
-                                        nullptr}};
-  g_descriptor_layouts_[DescriptorSetType::ToneMap] =
-      rhi_->CreateDescriptorSetLayout(descriptorset_layout_bindings);
-  const std::vector<VkDescriptorSetLayout> pipeline_descriptorset_layout = {
-      g_descriptor_layouts_[DescriptorSetType::ToneMap]};
-  std::vector<VkPushConstantRange> const_range;
-  g_pipeline_layouts_[DescriptorSetType::ToneMap] =
-      rhi_->CreatePipelineLayout(pipeline_descriptorset_layout, const_range);
-
-  VkShaderModule tonemap_vs =
-      rhi_->CreateShaderModule(kTonemapVertexShaderFile);
-  VkShaderModule tonemap_fs =
-      rhi_->CreateShaderModule(kTonemapFragmentShaderFile);
-
-  tonemap_pipeline_ = rhi_->CreateGraphicsPipeline(
-      g_render_pass_, 1, tonemap_vs, tonemap_fs,
-      g_pipeline_layouts_[DescriptorSetType::ToneMap]);
+void MainRenderPass::SetupPostProcess() {
+  VulkanRHI *vulkan_rhi = static_cast<VulkanRHI *>(rhi_.get());
+  post_process_pass_.Initialize(
+      rhi_, vulkan_rhi->GetSwapChainImageFormat(),
+      &GlobalEngineContext::GetContext()->GetRenderSystem()->GetGpuProfiler());
+  // the configured settings apply from the first frame, RenderTick passes
+  // runtime changes
+  post_process_pass_.SetSettings(GlobalEngineContext::GetContext()
+                                     ->GetRenderSystem()
+                                     ->GetPostProcessSettings());
+  if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) {
+    temporal_aa_pass_.Initialize(
+        rhi_,
+        &GlobalEngineContext::GetContext()->GetRenderSystem()->GetGpuProfiler());
+  }
+  UpdatePostProcessTargets();
+}
 
+void MainRenderPass::UpdatePostProcessTargets() {
   uint32_t num_frames = rhi_->GetNumberFrames();
-  tonemap_descriptor_sets_.resize(num_frames);
+  std::vector<VkImageView> scene_color_views(num_frames);
   for (uint32_t i = 0; i < num_frames; ++i) {
-    const VkDescriptorImageInfo image_info = {
-        VK_NULL_HANDLE,
-        (render_samples_ > 1) ? g_resolve_render_targets_[i].color_view
-                              : g_render_targets_[i].color_view,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    };
-    tonemap_descriptor_sets_[i] = rhi_->AllocateDescriptor(
-        g_descriptor_layouts_[DescriptorSetType::ToneMap]);
-    rhi_->UpdateImageDescriptorSet(tonemap_descriptor_sets_[i], 0,
-                                   VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-                                   {image_info});
+    scene_color_views[i] = (render_samples_ > 1)
+                               ? g_resolve_render_targets_[i].color_view
+                               : g_render_targets_[i].color_view;
   }
 
-  rhi_->DestroyShaderModule(tonemap_vs);
-  rhi_->DestroyShaderModule(tonemap_fs);
+  // the post process reads the anti-aliased scene color instead
+  if (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) {
+    std::vector<VkImageView> motion_vector_views(num_frames);
+    for (uint32_t i = 0; i < num_frames; ++i) {
+      motion_vector_views[i] = g_motion_vector_targets_[i].color_view;
+    }
+    temporal_aa_pass_.SetTargets(scene_color_views, motion_vector_views,
+                                 display_width_, display_height_);
+    scene_color_views.assign(num_frames, temporal_aa_pass_.GetOutputView());
+  }
+
+  VulkanRHI *vulkan_rhi = static_cast<VulkanRHI *>(rhi_.get());
+  post_process_pass_.SetTargets(scene_color_views,
+                                vulkan_rhi->GetSwapchainImageView(),
+                                display_width_, display_height_);
 }
+
 void MainRenderPass::SetupSkyboxPipeline()
 {
   const std::vector<VkVertexInputBindingDescription> vertex_input_bindings = {
@@ -836,13 +932,16 @@ void MainRenderPass::SetupSkyboxPipeline()
   depth_stencil_create_info.depthTestEnable = VK_FALSE;
 
   VkShaderModule skybox_vs = rhi_->CreateShaderModule(kSkyboxVertexShaderFile);
-  VkShaderModule skybox_fs =
-      rhi_->CreateShaderModule(kSkyboxFragmentShaderFile);
+  VkShaderModule skybox_fs = rhi_->CreateShaderModule(
+      (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA)
+          ? kSkyboxTaaFragmentShaderFile
+          : kSkyboxFragmentShaderFile);
 
   skybox_pipeline_ = rhi_->CreateGraphicsPipeline(
       g_render_pass_, 0, skybox_vs, skybox_fs,
       g_pipeline_layouts_[DescriptorSetType::Skybox], &vertex_input_bindings,
-      &vertex_attributes, &multisample_create_info, &depth_stencil_create_info);
+      &vertex_attributes, &multisample_create_info, &depth_stencil_create_info,
+      (anti_aliasing_mode_ == AntiAliasingMode::TemporalAA) ? 2 : 1);
 
   const VkDescriptorImageInfo skybox_texture_image_info = {
       VK_NULL_HANDLE, environment_map_->image_view,
@@ -1001,8 +1100,9 @@ void MainRenderPass::LoadAndProcessEnvironmentMap()
       for (uint32_t level = 1, size = kEnvMapSize / 2; level < env_map_levels_;
            ++level, size /= 2) {
         const uint32_t num_groups = std::max<uint32_t>(1, size / 32);
+        const float roughness = level * delta_roughness;
         const SpecularFilterPushConstants push_consts = {
-            level - 1, level * delta_roughness};
+            level - 1, roughness, IblPrefilter::GetSampleCount(roughness)};
         vkCmdPushConstants(command_buffer,
                            g_pipeline_layouts_[DescriptorSetType::Compute],
                            VK_SHADER_STAGE_COMPUTE_BIT, 0,
@@ -8,6 +8,8 @@
 #include "runtime/functions/assets/asset_manager.h"
 #include "runtime/functions/assets/mesh.h"
 #include "runtime/functions/render/render_pass_base.h"
+#include "runtime/functions/render/render_pass/post_process_pass.h"
+#include "runtime/functions/render/render_pass/temporal_aa_pass.h"
 #include "runtime/functions/render/render_utils.h"
 #include "runtime/functions/rhi/rhi.h"
 
@@ -16,7 +18,6 @@ namespace peanut {
         Uniforms = 0,
         Pbr,
         Skybox,
-        ToneMap,
         Compute,
     };
 
@@ -34,8 +35,9 @@ namespace peanut {
     enum AttachmentName : uint32_t {
         MainColorAttachment = 0,
         MainDepthStencilAttachment,
-        SwapchainColorAttachment,
         ResolveColorAttachment,
+        // temporal anti-aliasing only, which renders one sample and has no resolve attachment
+        MotionVectorAttachment = ResolveColorAttachment,
     };
 
     class MainRenderPass : public RenderPassBase {
@@ -47,6 +49,7 @@ namespace peanut {
         virtual void RenderTick(const ViewSettings &view,
                                 const SceneSettings &scene) override;
         virtual void preparePassData() override;
+        virtual void ResizeSwapchainObject() override;
 
         protected:
         void CreateUniformBuffer();
@@ -66,7 +69,9 @@ namespace peanut {
 
         void SetupPBRPipeline();
         void SetupSkyboxPipeline();
-        void SetupToneMapPipeline();
+        // hdr scene color to the swapchain
+        void SetupPostProcess();
+        void UpdatePostProcessTargets();
 
         void LoadAndProcessEnvironmentMap();
         void ComputeDiffuseIrradianceMap();
@@ -89,12 +94,13 @@ namespace peanut {
         VkRenderPass g_render_pass_;
         std::vector<RenderTarget> g_render_targets_;
         std::vector<RenderTarget> g_resolve_render_targets_;
+        // screen space motion of the scene to the last frame, temporal anti-aliasing only
+        std::vector<RenderTarget> g_motion_vector_targets_;
 
         uint32_t render_samples_;
 
         // render pipelines
         VkPipeline pbr_pipeline_;
-        VkPipeline tonemap_pipeline_;
         VkPipeline skybox_pipeline_;
 
         // samplers
@@ -105,7 +111,6 @@ namespace peanut {
         // descriptor set
         VkDescriptorPool compute_descriptor_pool_;
 
-        std::vector<VkDescriptorSet> tonemap_descriptor_sets_;
         std::vector<VkDescriptorSet> uniform_descriptor_sets_;
         VkDescriptorSet compute_descriptor_set_;
         VkDescriptorSet pbr_descriptor_set_;
@@ -138,11 +143,24 @@ namespace peanut {
         std::shared_ptr<MeshBuffer> pbr_mesh_;
         std::shared_ptr<MeshBuffer> skybox_mesh_;
 
+        // exposure, bloom, tone mapping and color grading of the resolved scene color
+        PostProcessPass post_process_pass_;
+
+        // fixed at initialization, temporal anti-aliasing renders one sample with a jittered projection
+        AntiAliasingMode anti_aliasing_mode_ = AntiAliasingMode::MSAA;
+        TemporalAAPass temporal_aa_pass_;
+        uint64_t jitter_frame_index_ = 0;
+        // unjittered transforms of the last frame for the motion vectors
+        bool has_prev_transform_ = false;
+        glm::mat4 prev_view_projection_mat_;
+        glm::mat4 prev_sky_projection_mat_;
+        glm::mat4 prev_scene_rotation_mat_;
+
         static constexpr uint32_t kEnvMapSize = 1024;
         static constexpr uint32_t kIrradianceMapSize = 32;
         static constexpr uint32_t kBrdfLutSize = 256;
         static constexpr VkDeviceSize kUniformBufferSize = 64 * 1024;
-        static constexpr uint8_t kNumDescriptorType = 5;
+        static constexpr uint8_t kNumDescriptorType = 4;
 
         // FIXME: use window size
         static constexpr uint32_t kDefaultDisplayWidth = 1024;
@@ -160,10 +178,12 @@ namespace peanut {
         // shader resource
         const std::string kPbrVertexShaderFile = "assets/spirv/pbr_vs.spv";
         const std::string kPbrFragmentShaderFile = "assets/spirv/pbr_fs.spv";
-        const std::string kTonemapVertexShaderFile = "assets/spirv/tonemap_vs.spv";
-        const std::string kTonemapFragmentShaderFile = "assets/spirv/tonemap_fs.spv";
         const std::string kSkyboxVertexShaderFile = "assets/spirv/skybox_vs.spv";
         const std::string kSkyboxFragmentShaderFile = "assets/spirv/skybox_fs.spv";
+        // variants that also write the motion vector attachment of the taa pass
+        const std::string kPbrTaaFragmentShaderFile = "assets/spirv/pbr_fs_taa.spv";
+        const std::string kSkyboxTaaFragmentShaderFile =
+            "assets/spirv/skybox_fs_taa.spv";
         const std::string kEnvMapEquirectShaderFile =
             "assets/spirv/equirect2cube_cs.spv";
         const std::string kSpecularEnvMapShaderFile = "assets/spirv/spmap_cs.spv";
@@ -0,0 +1,356 @@
+#include "directional_shadow_pass.h"
+#include "../shader_manager.h"
+#include "functions/assets/mesh.h"
+
+namespace peanut
+{
+	void DirectionalShadowPass::Initialize(std::weak_ptr<RHI> rhi, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+
+		CreateShadowMap();
+		CreateRenderPass();
+		CreateFramebuffers();
+		CreatePipeline();
+
+		is_initialized = true;
+	}
+
+	void DirectionalShadowPass::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		if (pipeline_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipeline(pipeline_);
+			pipeline_ = VK_NULL_HANDLE;
+		}
+
+		if (pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(pipeline_layout_);
+			pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		for (uint32_t i = 0; i < SHADOW_CASCADE_NUM; ++i)
+		{
+			if (cascade_framebuffers_[i] != VK_NULL_HANDLE)
+			{
+				rhi->DestroyFrameBuffer(cascade_framebuffers_[i]);
+				cascade_framebuffers_[i] = VK_NULL_HANDLE;
+			}
+			if (cascade_views_[i] != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImageView(cascade_views_[i]);
+				cascade_views_[i] = VK_NULL_HANDLE;
+			}
+		}
+
+		if (render_pass_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyRenderPass(render_pass_);
+			render_pass_ = VK_NULL_HANDLE;
+		}
+
+		if (shadow_sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&shadow_sampler_);
+			shadow_sampler_ = VK_NULL_HANDLE;
+		}
+
+		if (shadow_map_view_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyImageView(shadow_map_view_);
+			shadow_map_view_ = VK_NULL_HANDLE;
+		}
+
+		if (shadow_map_.resource != VK_NULL_HANDLE)
+		{
+			rhi->DestroyImage(shadow_map_);
+			shadow_map_ = Resource<VkImage>();
+		}
+
+		is_initialized = false;
+	}
+
+	void DirectionalShadowPass::UpdateCascades(LightingUBO& lighting_ubo)
+	{
+		ShadowCascades::ComputeCascades(lighting_ubo.inv_camera_view_proj, lighting_ubo.cluster_params.x, lighting_ubo.cluster_params.y,
+			lighting_ubo.directional_light.direction, settings_, cascades_);
+		ShadowCascades::FillDirectionalLight(cascades_, lighting_ubo.directional_light);
+	}
+
+	void DirectionalShadowPass::Render(VkCommandBuffer command_buffer, const std::vector<std::shared_ptr<RenderData> >& render_data_list)
+	{
+		if (!is_initialized)
+		{
+			return;
+		}
+
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "DirectionalShadow");
+
+		VkClearValue clear_value;
+		clear_value.depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo render_pass_begin_info{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		render_pass_begin_info.renderPass = render_pass_;
+		render_pass_begin_info.renderArea.offset = { 0, 0 };
+		render_pass_begin_info.renderArea.extent = { settings_.resolution, settings_.resolution };
+		render_pass_begin_info.clearValueCount = 1;
+		render_pass_begin_info.pClearValues = &clear_value;
+
+		VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(settings_.resolution), static_cast<float>(settings_.resolution), 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, { settings_.resolution, settings_.resolution } };
+
+		for (uint32_t cascade_index = 0; cascade_index < SHADOW_CASCADE_NUM; ++cascade_index)
+		{
+			const ShadowCascade& cascade = cascades_[cascade_index];
+			caster_counts_[cascade_index] = 0;
+
+			render_pass_begin_info.framebuffer = cascade_framebuffers_[cascade_index];
+			vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+			vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+
+			for (const auto& render_data : render_data_list)
+			{
+				const StaticMeshRenderData* mesh = static_cast<const StaticMeshRenderData*>(render_data.get());
+				if (!mesh->cast_shadow)
+				{
+					continue;
+				}
+
+				if (mesh->has_bounding_box)
+				{
+					glm::vec3 world_min;
+					glm::vec3 world_max;
+					ShadowCascades::TransformAabb(mesh->transform_ubo_data.model, mesh->bounding_box_min, mesh->bounding_box_max, world_min, world_max);
+					if (!ShadowCascades::IsAabbInFrustum(cascade.frustum_planes, world_min, world_max))
+					{
+						continue;
+					}
+				}
+
+				DrawCaster(command_buffer, pipeline_layout_, *mesh, cascade.view_proj);
+				caster_counts_[cascade_index]++;
+			}
+
+			vkCmdEndRenderPass(command_buffer);
+		}
+	}
+
+	void DirectionalShadowPass::DrawCaster(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, const StaticMeshRenderData& mesh, const glm::mat4& view_proj)
+	{
+		VkBuffer vertex_buffer[] = { mesh.vertex_buffer.resource };
+		constexpr VkDeviceSize vertex_buffer_offset = { 0 };
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer, &vertex_buffer_offset);
+		vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.resource, 0, VK_INDEX_TYPE_UINT32);
+
+		const ShadowPCO shadow_pco = { view_proj * mesh.transform_ubo_data.model };
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPCO), &shadow_pco);
+
+		// blended submeshes do not cast shadows
+		const uint32_t submesh_counts = static_cast<uint32_t>(mesh.index_counts.size());
+		for (uint32_t i = 0; i < submesh_counts; ++i)
+		{
+			if (i < mesh.material_pcos.size() && mesh.material_pcos[i].is_blend)
+			{
+				continue;
+			}
+			vkCmdDrawIndexed(command_buffer, mesh.index_counts[i], 1, mesh.index_offsets[i], 0, 0);
+		}
+	}
+
+	void DirectionalShadowPass::FillShadowMapTexture(TextureData& out_texture) const
+	{
+		out_texture.image = shadow_map_;
+		out_texture.image_view = shadow_map_view_;
+		out_texture.image_sampler = shadow_sampler_;
+		out_texture.width = settings_.resolution;
+		out_texture.height = settings_.resolution;
+		out_texture.channels = 1;
+		out_texture.levels = 1;
+		out_texture.layers = SHADOW_CASCADE_NUM;
+		out_texture.pixels = nullptr;
+	}
+
+	void DirectionalShadowPass::CreateShadowMap()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		shadow_map_ = rhi->CreateImage(settings_.resolution, settings_.resolution, SHADOW_CASCADE_NUM, 1, 1, kShadowMapFormat,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		shadow_map_view_ = rhi->CreateImageView(shadow_map_.resource, kShadowMapFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, SHADOW_CASCADE_NUM);
+		for (uint32_t i = 0; i < SHADOW_CASCADE_NUM; ++i)
+		{
+			cascade_views_[i] = rhi->CreateImageLayerView(shadow_map_.resource, kShadowMapFormat, VK_IMAGE_ASPECT_DEPTH_BIT, i);
+		}
+
+		// hardware pcf, outside of the cascade counts as lit
+		VkSamplerCreateInfo create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		create_info.compareEnable = VK_TRUE;
+		create_info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		create_info.maxLod = 1.0f;
+		rhi->CreateSampler(&create_info, &shadow_sampler_);
+
+		// the lighting descriptors sample the shadow map before the first cascade is rendered
+		TextureData shadow_map_texture;
+		FillShadowMapTexture(shadow_map_texture);
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(shadow_map_texture, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+	}
+
+	void DirectionalShadowPass::CreateRenderPass()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		VkAttachmentDescription depth_attachment = {};
+		depth_attachment.format = kShadowMapFormat;
+		depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depth_attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference depth_reference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depth_reference;
+
+		// the previous frame's lighting reads the cascade before it is cleared, the lighting of this frame after it is written
+		std::array<VkSubpassDependency, 2> dependencies = {};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo create_info = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		create_info.attachmentCount = 1;
+		create_info.pAttachments = &depth_attachment;
+		create_info.subpassCount = 1;
+		create_info.pSubpasses = &subpass;
+		create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		create_info.pDependencies = dependencies.data();
+		rhi->CreateRenderPass(&create_info, &render_pass_);
+	}
+
+	void DirectionalShadowPass::CreateFramebuffers()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		for (uint32_t i = 0; i < SHADOW_CASCADE_NUM; ++i)
+		{
+			VkFramebufferCreateInfo create_info = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+			create_info.renderPass = render_pass_;
+			create_info.attachmentCount = 1;
+			create_info.pAttachments = &cascade_views_[i];
+			create_info.width = settings_.resolution;
+			create_info.height = settings_.resolution;
+			create_info.layers = 1;
+			rhi->CreateFrameBuffer(&create_info, &cascade_framebuffers_[i]);
+		}
+	}
+
+	void DirectionalShadowPass::CreatePipeline()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		pipeline_layout_ = rhi->CreatePipelineLayout({}, { {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPCO)} });
+		pipeline_ = CreateDepthPipeline(rhi, render_pass_, pipeline_layout_);
+	}
+
+	VkPipeline DirectionalShadowPass::CreateDepthPipeline(const std::shared_ptr<RHI>& rhi, VkRenderPass render_pass, VkPipelineLayout pipeline_layout)
+	{
+		VkShaderModule shadow_vs = ShaderManager::Get().GetShaderModule(rhi, "shadow_depth.vert");
+		const VkPipelineShaderStageCreateInfo shader_stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0,
+			VK_SHADER_STAGE_VERTEX_BIT, shadow_vs, "main", nullptr };
+
+		// only the position of the mesh vertices is read
+		const VkVertexInputBindingDescription vertex_binding = { 0, sizeof(Mesh::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+		const VkVertexInputAttributeDescription position_attribute = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Mesh::Vertex, position) };
+		VkPipelineVertexInputStateCreateInfo vertex_input_state = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		vertex_input_state.vertexBindingDescriptionCount = 1;
+		vertex_input_state.pVertexBindingDescriptions = &vertex_binding;
+		vertex_input_state.vertexAttributeDescriptionCount = 1;
+		vertex_input_state.pVertexAttributeDescriptions = &position_attribute;
+
+		VkPipelineInputAssemblyStateCreateInfo input_assembly_state = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		input_assembly_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineViewportStateCreateInfo viewport_state = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewport_state.viewportCount = 1;
+		viewport_state.scissorCount = 1;
+
+		// no culling, thin and open casters would lose their back faces; slope scaled bias against acne
+		VkPipelineRasterizationStateCreateInfo rasterization_state = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterization_state.cullMode = VK_CULL_MODE_NONE;
+		rasterization_state.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rasterization_state.depthBiasEnable = VK_TRUE;
+		rasterization_state.depthBiasConstantFactor = 1.25f;
+		rasterization_state.depthBiasSlopeFactor = 1.75f;
+		rasterization_state.lineWidth = 1.0f;
+
+		VkPipelineMultisampleStateCreateInfo multisample_state = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineDepthStencilStateCreateInfo depth_stencil_state = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depth_stencil_state.depthTestEnable = VK_TRUE;
+		depth_stencil_state.depthWriteEnable = VK_TRUE;
+		depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		VkPipelineColorBlendStateCreateInfo color_blend_state = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+
+		const VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamic_state = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+		dynamic_state.dynamicStateCount = 2;
+		dynamic_state.pDynamicStates = dynamic_states;
+
+		VkGraphicsPipelineCreateInfo create_info = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		create_info.stageCount = 1;
+		create_info.pStages = &shader_stage;
+		create_info.pVertexInputState = &vertex_input_state;
+		create_info.pInputAssemblyState = &input_assembly_state;
+		create_info.pViewportState = &viewport_state;
+		create_info.pRasterizationState = &rasterization_state;
+		create_info.pMultisampleState = &multisample_state;
+		create_info.pDepthStencilState = &depth_stencil_state;
+		create_info.pColorBlendState = &color_blend_state;
+		create_info.pDynamicState = &dynamic_state;
+		create_info.layout = pipeline_layout;
+		create_info.renderPass = render_pass;
+		create_info.subpass = 0;
+		return rhi->CreateGraphicsPipeline(VK_NULL_HANDLE, 1, &create_info);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include "../render_data.h"
+#include "../shadow_cascades.h"
+#include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_profiler.h"
+
+namespace peanut
+{
+	/**
+	* @brief cascaded shadow map of the directional light
+	*
+	* Every cascade is one layer of a depth array texture and rendered by a depth only pipeline.
+	* Casters are culled against the light frustum of each cascade on the cpu, so only meshes
+	* that can throw a shadow into a cascade are drawn into it.
+	*/
+	class DirectionalShadowPass
+	{
+	public:
+		DirectionalShadowPass() = default;
+		~DirectionalShadowPass() = default;
+
+		void Initialize(std::weak_ptr<RHI> rhi, GpuProfiler* gpu_profiler = nullptr);
+		void Destroy();
+
+		// fit the cascades to the camera of the lighting constants and write them to its directional light,
+		// cluster_params has to hold the camera near and far, see LightCullingPass::FillClusterParams()
+		void UpdateCascades(LightingUBO& lighting_ubo);
+
+		// record the cascades, outside of any render pass
+		void Render(VkCommandBuffer command_buffer, const std::vector<std::shared_ptr<RenderData> >& render_data_list);
+
+		// the shadow map array and its comparison sampler
+		void FillShadowMapTexture(TextureData& out_texture) const;
+
+		void SetSettings(const ShadowCascadeSettings& settings) { settings_ = settings; }
+		const ShadowCascadeSettings& GetSettings() const { return settings_; }
+
+		// casters drawn into a cascade by the last Render()
+		uint32_t GetCasterCount(uint32_t cascade_index) const { return caster_counts_[cascade_index]; }
+
+		// depth only pipeline reading the mesh positions with a ShadowPCO push constant, shared with the local light shadows
+		static VkPipeline CreateDepthPipeline(const std::shared_ptr<RHI>& rhi, VkRenderPass render_pass, VkPipelineLayout pipeline_layout);
+		// draw the opaque submeshes of a caster into the bound depth pipeline
+		static void DrawCaster(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, const StaticMeshRenderData& mesh, const glm::mat4& view_proj);
+
+		DirectionalShadowPass(const DirectionalShadowPass&) = delete;
+		DirectionalShadowPass& operator=(const DirectionalShadowPass&) = delete;
+
+	private:
+		void CreateShadowMap();
+		void CreateRenderPass();
+		void CreateFramebuffers();
+		void CreatePipeline();
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
+
+		ShadowCascadeSettings settings_;
+		ShadowCascades::Cascades cascades_;
+		std::array<uint32_t, SHADOW_CASCADE_NUM> caster_counts_ = {};
+
+		Resource<VkImage> shadow_map_;
+		VkImageView shadow_map_view_ = VK_NULL_HANDLE;
+		std::array<VkImageView, SHADOW_CASCADE_NUM> cascade_views_ = {};
+		std::array<VkFramebuffer, SHADOW_CASCADE_NUM> cascade_framebuffers_ = {};
+		VkSampler shadow_sampler_ = VK_NULL_HANDLE;
+
+		VkRenderPass render_pass_ = VK_NULL_HANDLE;
+		VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline pipeline_ = VK_NULL_HANDLE;
+
+		static constexpr VkFormat kShadowMapFormat = VK_FORMAT_D32_SFLOAT;
+	};
+}
@@ -1,9 +1,352 @@
 #include "env_map_compute_pass.h"
+#include <cstring>
 #include "../shader_manager.h"
+#include "../render_utils.h"
+#include "../ibl_prefilter.h"
 #include "functions/assets/asset_manager.h"
 
 namespace peanut
 {
+	namespace
+	{
+		RGTextureHandle ImportTextureData(RenderGraph& render_graph, const std::string& name, const TextureData& texture,
+			VkImageLayout current_layout, VkImageLayout final_layout)
+		{
+			RGTextureDesc desc;
+			desc.width = texture.width;
+			desc.height = texture.height;
+			desc.layers = texture.layers;
+			desc.levels = texture.levels;
+			return render_graph.ImportTexture(name, texture.image.resource, texture.image_view, desc, current_layout, final_layout);
+		}
+
+		ReadbackFuture ReadbackTextureData(GpuReadback& readback, const TextureData& texture, VkFormat format)
+		{
+			ReadbackImageDesc desc;
+			desc.width = texture.width;
+			desc.height = texture.height;
+			desc.layers = texture.layers;
+			desc.levels = texture.levels;
+			desc.bytes_per_pixel = GpuReadback::GetFormatTexelSize(format);
+			return readback.ReadbackImage(texture.image.resource, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, desc);
+		}
+
+		bool CopyReadbackToCache(const ReadbackFuture& future, const TextureData& texture, VkFormat format, IblCacheTexture& out_texture)
+		{
+			const uint8_t* data = future.Data();
+			if (data == nullptr)
+			{
+				return false;
+			}
+
+			out_texture.width = texture.width;
+			out_texture.height = texture.height;
+			out_texture.layers = texture.layers;
+			out_texture.levels = texture.levels;
+			out_texture.format = format;
+			out_texture.data.assign(data, data + future.Size());
+			return true;
+		}
+
+		// the cached texels already have the layout of vkCmdCopyBufferToImage, one region per mip level
+		std::shared_ptr<TextureData> UploadCachedTexture(const std::shared_ptr<RHI>& rhi, VkCommandBuffer command_buffer,
+			const IblCacheTexture& cached_texture, std::vector<Resource<VkBuffer> >& staging_buffers)
+		{
+			ReadbackImageDesc desc;
+			desc.width = cached_texture.width;
+			desc.height = cached_texture.height;
+			desc.layers = cached_texture.layers;
+			desc.levels = cached_texture.levels;
+			desc.bytes_per_pixel = GpuReadback::GetFormatTexelSize(cached_texture.format);
+			std::vector<ReadbackSubresource> subresources;
+			GpuReadback::ComputeImageLayout(desc, subresources);
+
+			std::shared_ptr<TextureData> texture = rhi->CreateTexture(cached_texture.width, cached_texture.height,
+				cached_texture.layers, cached_texture.levels, cached_texture.format, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+			Resource<VkBuffer> staging_buffer = rhi->CreateBuffer(cached_texture.data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			rhi->CopyMemToDevice(staging_buffer.memory, cached_texture.data.data(), cached_texture.data.size());
+			staging_buffers.push_back(staging_buffer);
+
+			std::vector<VkBufferImageCopy> regions;
+			regions.reserve(subresources.size());
+			for (const ReadbackSubresource& subresource : subresources)
+			{
+				VkBufferImageCopy region = {};
+				region.bufferOffset = subresource.offset;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = subresource.level;
+				region.imageSubresource.layerCount = cached_texture.layers;
+				region.imageExtent = { subresource.width, subresource.height, 1 };
+				regions.push_back(region);
+			}
+
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				{ TextureMemoryBarrier(*texture, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) });
+			vkCmdCopyBufferToImage(command_buffer, staging_buffer.resource, texture->image.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(regions.size()), regions.data());
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				{ TextureMemoryBarrier(*texture, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) });
+			return texture;
+		}
+	}
+
+	void EnvironmentMapComputePass::Initialize(std::weak_ptr<RHI> rhi, const std::string& environment_map_url, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+		environment_map_url_ = environment_map_url;
+		is_dispatched = false;
+
+		SetupComputeSampler();
+		is_initialized = true;
+	}
+
+	void EnvironmentMapComputePass::Dispatch()
+	{
+		if (!is_initialized || is_dispatched)
+		{
+			return;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// the key hashes the whole source file, which is still much cheaper than the compute passes
+		const uint64_t cache_key = use_disk_cache_ ? IblCache::ComputeKey(environment_map_url_, GetCacheParams()) : 0;
+		if (cache_key != 0 && LoadCachedTextures(cache_key))
+		{
+			is_dispatched = true;
+			return;
+		}
+
+		LoadEnvironmentMap();
+		if (environment_map_ == nullptr)
+		{
+			return;
+		}
+
+		// all ibl textures are computed from the mipmapped environment map in one submit
+		RenderGraph render_graph(rhi_);
+		const RGTextureHandle environment_map = ImportTextureData(render_graph, "environment_map", *environment_map_,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		CreateIrradianceSH(render_graph, environment_map);
+		CreateFilteredTexture(render_graph, environment_map);
+		CreateBRDFLutTexture(render_graph);
+
+		render_graph.SetProfiler(gpu_profiler_);
+		render_graph.Compile();
+
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		{
+			PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "EnvironmentMapComputePass");
+			render_graph.Execute(command_buffer);
+		}
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+
+		ReadIrradianceSH();
+		ReleaseDispatchResources();
+		is_dispatched = true;
+
+		if (cache_key != 0)
+		{
+			SaveCachedTextures(cache_key);
+		}
+	}
+
+	IblCacheParams EnvironmentMapComputePass::GetCacheParams() const
+	{
+		IblCacheParams params;
+		params.version = kIblCacheVersion;
+		params.sh_projection_size = kSHProjectionSize;
+		params.brdf_lut_size = kDefaultBRDFLutSize;
+		params.ibl_format = static_cast<uint32_t>(kIblTextureFormat);
+		params.brdf_lut_format = static_cast<uint32_t>(kBRDFLutFormat);
+		return params;
+	}
+
+	bool EnvironmentMapComputePass::LoadCachedTextures(uint64_t cache_key)
+	{
+		IblCacheData cache_data;
+		if (!IblCache::Load(cache_key, cache_data))
+		{
+			return false;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// all textures are uploaded in one submit
+		std::vector<Resource<VkBuffer> > staging_buffers;
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		environment_map_ = UploadCachedTexture(rhi, command_buffer, cache_data.environment_map, staging_buffers);
+		prefiltered_texture_ = UploadCachedTexture(rhi, command_buffer, cache_data.filtered_texture, staging_buffers);
+		brdf_lut_texture_ = UploadCachedTexture(rhi, command_buffer, cache_data.brdf_lut, staging_buffers);
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+
+		for (const Resource<VkBuffer>& staging_buffer : staging_buffers)
+		{
+			rhi->DestroyBuffer(staging_buffer);
+		}
+
+		environment_map_mip_levels_ = environment_map_->levels;
+		irradiance_sh_ = cache_data.irradiance_sh;
+		PEANUT_LOG_INFO("Loaded ibl textures from cache {0}", IblCache::GetCachePath(cache_key));
+		return true;
+	}
+
+	void EnvironmentMapComputePass::SaveCachedTextures(uint64_t cache_key)
+	{
+		GpuReadback readback;
+		readback.Initialize(rhi_);
+
+		const ReadbackFuture environment_map = ReadbackTextureData(readback, *environment_map_, kIblTextureFormat);
+		const IblReadback ibl_readback = ReadbackIblTextures(readback);
+
+		IblCacheData cache_data;
+		cache_data.irradiance_sh = irradiance_sh_;
+		const bool is_read = CopyReadbackToCache(environment_map, *environment_map_, kIblTextureFormat, cache_data.environment_map) &&
+			CopyReadbackToCache(ibl_readback.filtered_texture, *prefiltered_texture_, kIblTextureFormat, cache_data.filtered_texture) &&
+			CopyReadbackToCache(ibl_readback.brdf_lut, *brdf_lut_texture_, kBRDFLutFormat, cache_data.brdf_lut);
+		readback.Destroy();
+
+		if (!is_read || !IblCache::Save(cache_key, cache_data))
+		{
+			PEANUT_LOG_WARN("Failed to write the ibl cache {0}", IblCache::GetCachePath(cache_key));
+		}
+	}
+
+	void EnvironmentMapComputePass::ReleaseDispatchResources()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		for (VkPipeline pipeline : dispatch_pipelines_)
+		{
+			rhi->DestroyPipeline(pipeline);
+		}
+		dispatch_pipelines_.clear();
+
+		for (VkImageView image_view : dispatch_image_views_)
+		{
+			rhi->DestroyImageView(image_view);
+		}
+		dispatch_image_views_.clear();
+
+		if (irradiance_sh_buffer_.resource != VK_NULL_HANDLE)
+		{
+			rhi->DestroyBuffer(irradiance_sh_buffer_);
+			irradiance_sh_buffer_ = {};
+		}
+	}
+
+	void EnvironmentMapComputePass::ReadIrradianceSH()
+	{
+		if (irradiance_sh_buffer_.resource == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		void* data = nullptr;
+		rhi->MapMemory(irradiance_sh_buffer_.memory, 0, sizeof(irradiance_sh_), 0, &data);
+		std::memcpy(irradiance_sh_.data(), data, sizeof(irradiance_sh_));
+		rhi->UnMapMemory(irradiance_sh_buffer_.memory);
+	}
+
+	void EnvironmentMapComputePass::FillSkyLight(SkyLight& sky_light) const
+	{
+		for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i)
+		{
+			sky_light.irradiance_sh[i] = irradiance_sh_[i];
+		}
+		sky_light.prefilter_mip_levels = prefiltered_texture_ != nullptr ? static_cast<float>(prefiltered_texture_->levels - 1) : 0.0f;
+	}
+
+	void EnvironmentMapComputePass::Destory()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		ReleaseDispatchResources();
+
+		for (auto* texture : { &environment_map_, &prefiltered_texture_, &brdf_lut_texture_ })
+		{
+			if (*texture != nullptr)
+			{
+				rhi->DestroyTexture(*texture);
+				texture->reset();
+			}
+		}
+
+		if (compute_pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(compute_pipeline_layout_);
+			compute_pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (default_descriptor_layout_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorSetLayout(rhi->GetDevice(), default_descriptor_layout_, nullptr);
+			default_descriptor_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (sh_pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(sh_pipeline_layout_);
+			sh_pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (sh_descriptor_layout_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorSetLayout(rhi->GetDevice(), sh_descriptor_layout_, nullptr);
+			sh_descriptor_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (default_sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&default_sampler_);
+			default_sampler_ = VK_NULL_HANDLE;
+		}
+
+		is_initialized = false;
+		is_dispatched = false;
+	}
+
+	std::shared_ptr<TextureData> EnvironmentMapComputePass::GetEnvironmentMap()
+	{
+		return environment_map_;
+	}
+
+	std::shared_ptr<TextureData> EnvironmentMapComputePass::GetFilteredTexture()
+	{
+		return prefiltered_texture_;
+	}
+
+	std::shared_ptr<TextureData> EnvironmentMapComputePass::GetBRDFLutTexture()
+	{
+		return brdf_lut_texture_;
+	}
+
+	EnvironmentMapComputePass::IblReadback EnvironmentMapComputePass::ReadbackIblTextures(GpuReadback& readback)
+	{
+		IblReadback ibl_readback;
+		if (!is_dispatched)
+		{
+			PEANUT_LOG_WARN("Ibl textures are read back before they were computed");
+			return ibl_readback;
+		}
+
+		ibl_readback.filtered_texture = ReadbackTextureData(readback, *prefiltered_texture_, kIblTextureFormat);
+		ibl_readback.brdf_lut = ReadbackTextureData(readback, *brdf_lut_texture_, kBRDFLutFormat);
+		return ibl_readback;
+	}
+
 	void EnvironmentMapComputePass::SetupComputeDescriptorPool()
 	{
 		std::shared_ptr<RHI> rhi = rhi_.lock();
@@ -27,9 +370,12 @@ namespace peanut
 		std::shared_ptr<RHI> rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
 
+		// the prefilter reads the mip level chosen by the pdf of every sample
 		VkSamplerCreateInfo create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
 		create_info.minFilter = VK_FILTER_LINEAR;
 		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		create_info.maxLod = VK_LOD_CLAMP_NONE;
 		create_info.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
 		rhi->CreateSampler(&create_info, &default_sampler_);
 	}
@@ -76,11 +422,6 @@ namespace peanut
 		std::shared_ptr<RHI> rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
 
-		VkDescriptorSet general_descriptor_set = rhi->AllocateDescriptor(default_descriptor_layout_);
-
-		VkShaderModule equirect2cube_cs = ShaderManager::Get().GetShaderModule(rhi_, "equirect2cube.comp");
-		VkPipeline compute_pipeline = rhi->CreateComputePipeline(equirect2cube_cs, compute_pipeline_layout_);
-
 		if (environment_map_url_.empty())
 		{
 			PEANUT_LOG_WARN("environment map url is empty can not load environment map");
@@ -97,10 +438,20 @@ namespace peanut
 		uint32_t env_map_width = env_texture_original->width;
 		uint32_t env_map_height = env_texture_original->height;
 
+		// the mip tail binding of the prefilter shader depends on the environment map size
+		environment_map_mip_levels_ = RenderUtils::NumMipmapLevels(env_map_width, env_map_height);
+		if (default_descriptor_layout_ == VK_NULL_HANDLE)
+		{
+			SetupDescriptorSetLayout();
+			SetupComputePipelineLayout();
+		}
+
+		VkDescriptorSet general_descriptor_set = rhi->AllocateDescriptor(default_descriptor_layout_);
+
+		VkShaderModule equirect2cube_cs = ShaderManager::Get().GetShaderModule(rhi_, "equirect2cube.comp");
+		VkPipeline compute_pipeline = rhi->CreateComputePipeline(equirect2cube_cs, compute_pipeline_layout_);
+
 		// create the loaded environment map
-		prefiltered_texture_ = rhi->CreateTexture(env_map_width, env_map_height, 6, 0,
-			VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
-		
 		environment_map_ = rhi->CreateTexture(env_map_width, env_map_height,
 			6, 0, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
@@ -111,80 +462,107 @@ namespace peanut
 		// update output image descriptor
 		const VkDescriptorImageInfo out_cube_image_descriptor = {default_sampler_, environment_map_->image_view, VK_IMAGE_LAYOUT_GENERAL};
         rhi->UpdateImageDescriptorSet(general_descriptor_set, OUTPUT_TEXTURE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, { out_cube_image_descriptor });
-		
-		// transition image layout
-		const auto pre_dispatch_barrier = TextureMemoryBarrier(*environment_map_, 0,
-			VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL)
-			.MipLevels(0, environment_map_->levels);
 
-		const auto post_dispatch_barrier = TextureMemoryBarrier(*environment_map_,
-			VK_ACCESS_SHADER_WRITE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
-			.MipLevels(0, environment_map_->levels);
+		// mipmap generation blits down from a base level in transfer src layout
+		RenderGraph render_graph(rhi_);
+		const RGTextureHandle equirect_texture = ImportTextureData(render_graph, "equirect_map", *env_texture_original,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED);
+		const RGTextureHandle environment_map = ImportTextureData(render_graph, "environment_map", *environment_map_,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+		render_graph.AddPass("equirect_to_cube",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Read(equirect_texture, RGResourceUsage::ComputeSampledRead);
+				builder.Write(environment_map, RGResourceUsage::ComputeStorageWrite);
+			},
+			[this, compute_pipeline, general_descriptor_set, env_map_width, env_map_height](VkCommandBuffer command_buffer, const RenderGraph&)
+			{
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
+					1, &general_descriptor_set, 0, nullptr);
+				vkCmdDispatch(command_buffer, env_map_width / 32, env_map_height / 32, 6);
+			});
 
+		render_graph.SetProfiler(gpu_profiler_);
 		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
-		{
-			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {pre_dispatch_barrier});
-			
-			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
-			
-			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
-				1, &general_descriptor_set, 0, nullptr);
-			
-            vkCmdDispatch(command_buffer, env_map_width / 32, env_map_height / 32, 6);
-			
-            rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, {post_dispatch_barrier});
-		}
+		render_graph.Execute(command_buffer);
 		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
 
 		// generate mipmap
 		rhi->GenerateMipmaps(*environment_map_);
 		
+		rhi->DestroyPipeline(compute_pipeline);
 		rhi->DestroyTexture(env_texture_original);
 	}
 
-	void EnvironmentMapComputePass::CreateIrradianceMap()
+	void EnvironmentMapComputePass::CreateIrradianceSH(RenderGraph& render_graph, RGTextureHandle environment_map)
 	{
-		// create irradiance texture
-		if (env_irradiance_map_ != nullptr)
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		if (sh_descriptor_layout_ == VK_NULL_HANDLE)
 		{
-			PEANUT_LOG_INFO("irradiance map already loaded");
-			return;
+			const std::vector<VkDescriptorSetLayoutBinding> bindings =
+			{
+				{INPUT_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &default_sampler_},
+				{OUTPUT_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+			};
+			sh_descriptor_layout_ = rhi->CreateDescriptorSetLayout(bindings);
+			sh_pipeline_layout_ = rhi->CreatePipelineLayout({ sh_descriptor_layout_ }, {});
 		}
 
-		std::shared_ptr<RHI> rhi = rhi_.lock();
-		assert(rhi.get() != nullptr);
-		
-		env_irradiance_map_ = rhi->CreateTexture(kDefaultIrradianceMapSize, kDefaultIrradianceMapSize, 6, 1,
-			VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		// a small mip level is enough for the low frequency sh, it is sampled through a view of that level only
+		uint32_t projection_level = 0;
+		while (projection_level + 1 < environment_map_->levels && (environment_map_->width >> projection_level) > kSHProjectionSize)
+		{
+			++projection_level;
+		}
+		VkImageView projection_view = rhi->CreateTextureView(environment_map_, kIblTextureFormat, VK_IMAGE_ASPECT_COLOR_BIT, projection_level, 1);
+		dispatch_image_views_.push_back(projection_view);
 
-		VkShaderModule irradiance_cs = ShaderManager::Get().GetShaderModule(rhi_, "irradiance_env_map.comp");
-		VkPipeline irradiance_pipeline = rhi->CreateComputePipeline(irradiance_cs, compute_pipeline_layout_);
-		VkDescriptorSet irradiance_ds = rhi->AllocateDescriptor(default_descriptor_layout_);
+		// read on the host after the dispatch
+		irradiance_sh_buffer_ = rhi->CreateBuffer(sizeof(irradiance_sh_), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-		// update image descriptor
-		const VkDescriptorImageInfo input_texture = {environment_map_->image_sampler, environment_map_->image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-        rhi->UpdateImageDescriptorSet(irradiance_ds, INPUT_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, { input_texture });
+		VkShaderModule irradiance_sh_cs = ShaderManager::Get().GetShaderModule(rhi_, "irradiance_sh.comp");
+		VkPipeline irradiance_sh_pipeline = rhi->CreateComputePipeline(irradiance_sh_cs, sh_pipeline_layout_);
+		VkDescriptorSet irradiance_sh_ds = rhi->AllocateDescriptor(sh_descriptor_layout_);
+		dispatch_pipelines_.push_back(irradiance_sh_pipeline);
 
-		const VkDescriptorImageInfo output_irradiance_map = {default_sampler_, env_irradiance_map_->image_view, VK_IMAGE_LAYOUT_GENERAL};
-		rhi->UpdateImageDescriptorSet(irradiance_ds, OUTPUT_TEXTURE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, { output_irradiance_map });
-		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
-        {
-            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, irradiance_pipeline);
-            
-            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
-                1, &irradiance_ds, 0, nullptr);
-            
-            vkCmdDispatch(command_buffer, env_irradiance_map_->width / 32, env_irradiance_map_->height / 32, 6);
-        }
-        rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+		const VkDescriptorImageInfo input_texture = { default_sampler_, projection_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		rhi->UpdateImageDescriptorSet(irradiance_sh_ds, INPUT_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, { input_texture });
+
+		const VkDescriptorBufferInfo output_sh = { irradiance_sh_buffer_.resource, 0, sizeof(irradiance_sh_) };
+		rhi->UpdateBufferDescriptorSet(irradiance_sh_ds, OUTPUT_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { output_sh });
 
-		// release
-		rhi->DestroyPipeline(irradiance_pipeline);
+		render_graph.AddPass("irradiance_sh",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Read(environment_map, RGResourceUsage::ComputeSampledRead);
+				// the coefficients are written to a buffer outside of the graph
+				builder.SetSideEffect();
+			},
+			[this, irradiance_sh_pipeline, irradiance_sh_ds](VkCommandBuffer command_buffer, const RenderGraph&)
+			{
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, irradiance_sh_pipeline);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sh_pipeline_layout_, 0,
+					1, &irradiance_sh_ds, 0, nullptr);
+				vkCmdDispatch(command_buffer, 1, 1, 1);
+
+				VkBufferMemoryBarrier barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.buffer = irradiance_sh_buffer_.resource;
+				barrier.size = VK_WHOLE_SIZE;
+				vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+					0, 0, nullptr, 1, &barrier, 0, nullptr);
+			});
 	}
 	
-	void EnvironmentMapComputePass::CreateFilteredTexture()
+	void EnvironmentMapComputePass::CreateFilteredTexture(RenderGraph& render_graph, RGTextureHandle environment_map)
 	{
 		if (prefiltered_texture_ != nullptr)
 		{
@@ -194,51 +572,34 @@ namespace peanut
 		
 		std::shared_ptr<RHI> rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
+
+		prefiltered_texture_ = rhi->CreateTexture(environment_map_->width, environment_map_->height, 6, 0,
+			kIblTextureFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 		
 		VkDescriptorSet prefiltered_descriptor_set = rhi->AllocateDescriptor(default_descriptor_layout_);
-		
-		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+
+		const RGTextureHandle prefiltered_texture = ImportTextureData(render_graph, "prefiltered_map", *prefiltered_texture_,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
 		// copy mipmap image to environment map
 		// fixme: maybe not need to copy
-		{
-			const std::vector<TextureMemoryBarrier> pre_copy_barriers =
+		render_graph.AddPass("prefiltered_map_copy",
+			[&](RGPassBuilder& builder)
 			{
-				TextureMemoryBarrier(*environment_map_, 0, VK_ACCESS_TRANSFER_READ_BIT,
-					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).MipLevels(0, environment_map_->levels),
-				TextureMemoryBarrier(*prefiltered_texture_, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL).MipLevels(0, prefiltered_texture_->levels),
-			};
-
-			const std::vector<TextureMemoryBarrier> post_copy_barriers =
+				builder.Read(environment_map, RGResourceUsage::TransferSrc);
+				builder.Write(prefiltered_texture, RGResourceUsage::TransferDst);
+			},
+			[this](VkCommandBuffer command_buffer, const RenderGraph&)
 			{
-				TextureMemoryBarrier(*environment_map_, VK_ACCESS_TRANSFER_READ_BIT, 0,
-                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(0, environment_map_->levels),
-			    TextureMemoryBarrier(*prefiltered_texture_, VK_ACCESS_TRANSFER_WRITE_BIT, 0,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL).MipLevels(0, prefiltered_texture_->levels),
-            };
-
-			// do copy
-			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT, pre_copy_barriers);
-
-			const uint32_t env_map_width = environment_map_->width;
-			const uint32_t env_map_height = environment_map_->height;
-			
-			VkImageCopy copy_region = {};
-			copy_region.extent = {env_map_width, env_map_height, 1};
-			copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copy_region.srcSubresource.layerCount = environment_map_->layers;
-			copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copy_region.dstSubresource.layerCount = prefiltered_texture_->layers;
-			vkCmdCopyImage(command_buffer, environment_map_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                prefiltered_texture_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, post_copy_barriers);
-		}
-		
-		std::vector<VkImageView> prefilter_out_tail_image_views;
-		std::vector<VkDescriptorImageInfo> prefilter_out_tail_image_descriptor;
+				VkImageCopy copy_region = {};
+				copy_region.extent = {environment_map_->width, environment_map_->height, 1};
+				copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				copy_region.srcSubresource.layerCount = environment_map_->layers;
+				copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				copy_region.dstSubresource.layerCount = prefiltered_texture_->layers;
+				vkCmdCopyImage(command_buffer, environment_map_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					prefiltered_texture_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+			});
 		
 		// compute prefilter texture
 		// create compute pipeline
@@ -247,6 +608,7 @@ namespace peanut
 		uint32_t mip_levels = environment_map_->levels - 1;
 		const VkSpecializationInfo specialization_info = {1, &map_entry, sizeof(uint32_t), &mip_levels};
 		VkPipeline prefilter_pipeline = rhi->CreateComputePipeline(prefilter_cs, compute_pipeline_layout_, &specialization_info);
+		dispatch_pipelines_.push_back(prefilter_pipeline);
 		
 		const VkDescriptorImageInfo prefiltered_input_texture =
 		{
@@ -255,73 +617,78 @@ namespace peanut
 
 		rhi->UpdateImageDescriptorSet(prefiltered_descriptor_set, INPUT_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, { prefiltered_input_texture });
 
+		std::vector<VkDescriptorImageInfo> prefilter_out_tail_image_descriptor;
 		for (uint32_t level = 1; level < prefiltered_texture_->levels; ++level)
 		{
-			prefilter_out_tail_image_views.push_back(
-				rhi->CreateTextureView(prefiltered_texture_, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
-			prefilter_out_tail_image_descriptor.push_back(
-                { default_sampler_, prefilter_out_tail_image_views[level - 1], VK_IMAGE_LAYOUT_GENERAL });
-
-			rhi->UpdateImageDescriptorSet(prefiltered_descriptor_set, OUTPUT_MIP_TAILS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, { prefilter_out_tail_image_descriptor[level - 1] });
-		}
-		
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, prefilter_pipeline);
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
-            1, &prefiltered_descriptor_set, 0, nullptr);
-
-		const float delta_roughness = 1.0f / std::max(static_cast<float>(mip_levels), 1.0f);
-		for (uint32_t level = 1; level < prefiltered_texture_->levels; ++level)
-		{
-			uint32_t mip_size = prefiltered_texture_->width >> level;
-			const uint32_t num_groups = std::max(1.0f, static_cast<float>(mip_size) / 32.0f);
-			const SpecularFilterPushConstants push_constant = { level - 1,  static_cast<float>(level) * delta_roughness };
-			vkCmdPushConstants(command_buffer, compute_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SpecularFilterPushConstants), &push_constant);
-			vkCmdDispatch(command_buffer, num_groups, num_groups, 6);
+			VkImageView tail_image_view = rhi->CreateTextureView(prefiltered_texture_, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+			dispatch_image_views_.push_back(tail_image_view);
+			prefilter_out_tail_image_descriptor.push_back({ default_sampler_, tail_image_view, VK_IMAGE_LAYOUT_GENERAL });
 		}
+		rhi->UpdateImageDescriptorSet(prefiltered_descriptor_set, OUTPUT_MIP_TAILS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, prefilter_out_tail_image_descriptor);
 
-		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
-
-		// release
-		for (auto& image_view : prefilter_out_tail_image_views)
-        {
-            rhi->DestroyImageView(image_view);
-        }
-
-		rhi->DestroyPipeline(prefilter_pipeline);
+		render_graph.AddPass("prefiltered_map",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Read(environment_map, RGResourceUsage::ComputeSampledRead);
+				builder.Write(prefiltered_texture, RGResourceUsage::ComputeStorageWrite);
+			},
+			[this, prefilter_pipeline, prefiltered_descriptor_set, mip_levels](VkCommandBuffer command_buffer, const RenderGraph&)
+			{
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, prefilter_pipeline);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
+					1, &prefiltered_descriptor_set, 0, nullptr);
+
+				const float delta_roughness = 1.0f / std::max(static_cast<float>(mip_levels), 1.0f);
+				for (uint32_t level = 1; level < prefiltered_texture_->levels; ++level)
+				{
+					uint32_t mip_size = prefiltered_texture_->width >> level;
+					const uint32_t num_groups = std::max(1.0f, static_cast<float>(mip_size) / 32.0f);
+					const float roughness = static_cast<float>(level) * delta_roughness;
+					const SpecularFilterPushConstants push_constant = { level - 1, roughness, IblPrefilter::GetSampleCount(roughness) };
+					vkCmdPushConstants(command_buffer, compute_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SpecularFilterPushConstants), &push_constant);
+					vkCmdDispatch(command_buffer, num_groups, num_groups, 6);
+				}
+			});
 	}
 
-	void EnvironmentMapComputePass::CreateBRDFLutTexture()
+	void EnvironmentMapComputePass::CreateBRDFLutTexture(RenderGraph& render_graph)
 	{
+		if (brdf_lut_texture_ != nullptr)
+		{
+			PEANUT_LOG_INFO("brdf lut already loaded");
+			return;
+		}
+
 		std::shared_ptr<RHI> rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
 
 		VkShaderModule brdf_lut_cs = ShaderManager::Get().GetShaderModule(rhi_, "brdf_lut.comp");
 		VkPipeline brdf_lut_pipeline = rhi->CreateComputePipeline(brdf_lut_cs, compute_pipeline_layout_);
 		VkDescriptorSet brdf_lut_ds = rhi->AllocateDescriptor(default_descriptor_layout_);
+		dispatch_pipelines_.push_back(brdf_lut_pipeline);
 
 		// create brdf lut texture
 		brdf_lut_texture_ = rhi->CreateTexture(kDefaultBRDFLutSize, kDefaultBRDFLutSize, 1, 1,
-			VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+			kBRDFLutFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
 		// update image descriptor
         const VkDescriptorImageInfo output_brdf_lut = {default_sampler_, brdf_lut_texture_->image_view, VK_IMAGE_LAYOUT_GENERAL};
         rhi->UpdateImageDescriptorSet(brdf_lut_ds, OUTPUT_TEXTURE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, { output_brdf_lut });
 
-		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
-		{
-			const auto lut_transition_barrier = TextureMemoryBarrier(*brdf_lut_texture_, 0, VK_ACCESS_SHADER_WRITE_BIT,
-						 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {lut_transition_barrier});
-			
-			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, brdf_lut_pipeline);
-            
-			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
-				1, &brdf_lut_ds, 0, nullptr);
-
-			vkCmdDispatch(command_buffer, kDefaultBRDFLutSize / 32, kDefaultBRDFLutSize / 32, 6);
-		}
-		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
-		rhi->DestroyPipeline(brdf_lut_pipeline);
+		const RGTextureHandle brdf_lut = ImportTextureData(render_graph, "brdf_lut", *brdf_lut_texture_,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		render_graph.AddPass("brdf_lut",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Write(brdf_lut, RGResourceUsage::ComputeStorageWrite);
+			},
+			[this, brdf_lut_pipeline, brdf_lut_ds](VkCommandBuffer command_buffer, const RenderGraph&)
+			{
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, brdf_lut_pipeline);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout_, 0,
+					1, &brdf_lut_ds, 0, nullptr);
+				vkCmdDispatch(command_buffer, kDefaultBRDFLutSize / 32, kDefaultBRDFLutSize / 32, 1);
+			});
 	}
-}
\ No newline at end of file
+}
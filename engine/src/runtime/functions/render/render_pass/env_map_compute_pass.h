@@ -3,15 +3,23 @@
 #include <optional>
 #include <string>
 #include "../render_data.h"
+#include "../render_graph/render_graph.h"
+#include "../ibl_cache.h"
+#include "../spherical_harmonics.h"
 #include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_readback.h"
+#include "functions/rhi/gpu_profiler.h"
 
 namespace peanut
 {
 	/**
-	* @brief pre-compute environment irradiance map, filtered texture and brdf lut texture using compute shader pass
+	* @brief pre-compute environment irradiance sh, filtered texture and brdf lut texture using compute shader pass
 	* 
-	* normally we should load these pre-computed textures from disk
-	* so, we should provide some interface to save these textures to disk file
+	* The diffuse irradiance is projected onto l2 spherical harmonics, FillSkyLight() writes them to the
+	* lighting uniform buffer so the lighting needs no irradiance map.
+	* The results are cached on disk keyed on the content of the environment map and the pass parameters,
+	* a cached environment map is uploaded directly instead of being computed again.
+	* ReadbackIblTextures() copies the textures to host memory without waiting
 	*/
 	class EnvironmentMapComputePass
 	{
@@ -19,21 +27,40 @@ namespace peanut
 		{
 			INPUT_TEXTURE = 0,
 			OUTPUT_TEXTURE,
-			OUTPUT_MIP_TAILS
+			OUTPUT_MIP_TAILS,
+			OUTPUT_BUFFER = OUTPUT_TEXTURE
 		};
 		
+	public:
+		// tightly packed texels of every mip level and cube face, see ReadbackFuture::GetSubresources()
+		struct IblReadback
+		{
+			ReadbackFuture filtered_texture;
+			ReadbackFuture brdf_lut;
+		};
+
 	public:
 		EnvironmentMapComputePass() = default;
 		~EnvironmentMapComputePass() = default;
 
-		void Initialize(std::weak_ptr<RHI> rhi, const std::string&);
+		// the graph passes of Dispatch() are timed if a gpu profiler is given
+		void Initialize(std::weak_ptr<RHI> rhi, const std::string&, GpuProfiler* gpu_profiler = nullptr);
 		void Dispatch();
 		void Destory();
 
+		// load the textures from the disk cache and write them to it after a dispatch, enabled by default
+		void SetDiskCacheEnabled(bool enabled) { use_disk_cache_ = enabled; }
+
 		std::shared_ptr<TextureData> GetEnvironmentMap();
-		std::shared_ptr<TextureData> GetIrradianceMap();
 		std::shared_ptr<TextureData> GetFilteredTexture();
 		std::shared_ptr<TextureData> GetBRDFLutTexture();
+		const SphericalHarmonics::Coefficients& GetIrradianceSH() const { return irradiance_sh_; }
+
+		// irradiance sh and prefilter mip levels of the sky light, the color is left to the caller
+		void FillSkyLight(SkyLight& sky_light) const;
+
+		// copy the computed textures to host memory without waiting, the futures are empty before Dispatch()
+		IblReadback ReadbackIblTextures(GpuReadback& readback);
 
 		void FileSkyboxRenderData(SkyboxRenderData&);
 		void FileIblTextureResource(IblLightTexture&);
@@ -54,29 +81,54 @@ namespace peanut
 		// load environment map hdr image and generate mipmap images
 		void LoadEnvironmentMap();
 
-		void CreateIrradianceMap();
-		void CreateFilteredTexture();
-		void CreateBRDFLutTexture();
+		// add the compute passes to the graph, barriers between them are left to the graph
+		void CreateIrradianceSH(RenderGraph& render_graph, RGTextureHandle environment_map);
+		void CreateFilteredTexture(RenderGraph& render_graph, RGTextureHandle environment_map);
+		void CreateBRDFLutTexture(RenderGraph& render_graph);
+
+		// pipelines and views only needed while the dispatch command buffer executes
+		void ReleaseDispatchResources();
+		// copy the sh coefficients of the executed dispatch out of their host visible buffer
+		void ReadIrradianceSH();
+
+		IblCacheParams GetCacheParams() const;
+		// create the textures from the cache file of the key, false if there is no valid file
+		bool LoadCachedTextures(uint64_t cache_key);
+		// read the dispatched textures back and write the cache file of the key
+		void SaveCachedTextures(uint64_t cache_key);
 
-		bool is_dispatched;
-		bool is_initialized;
+		bool is_dispatched = false;
+		bool is_initialized = false;
+		bool use_disk_cache_ = true;
 
-		uint32_t environment_map_mip_levels_; // mipmap levels
+		uint32_t environment_map_mip_levels_ = 1; // mipmap levels
 		std::string environment_map_url_;
 
 		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
 
 		std::shared_ptr<TextureData> environment_map_;
-		std::shared_ptr<TextureData> env_irradiance_map_;
 		std::shared_ptr<TextureData> prefiltered_texture_;
 		std::shared_ptr<TextureData> brdf_lut_texture_;
-
-		VkDescriptorPool compute_descriptor_pool_;
-		VkSampler default_sampler_;
-		VkDescriptorSetLayout default_descriptor_layout_;
-		VkPipelineLayout compute_pipeline_layout_;
-
-		static constexpr uint32_t kDefaultIrradianceMapSize = 32;
+		SphericalHarmonics::Coefficients irradiance_sh_ = {};
+		Resource<VkBuffer> irradiance_sh_buffer_;
+
+		VkDescriptorPool compute_descriptor_pool_ = VK_NULL_HANDLE;
+		VkSampler default_sampler_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout default_descriptor_layout_ = VK_NULL_HANDLE;
+		VkPipelineLayout compute_pipeline_layout_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout sh_descriptor_layout_ = VK_NULL_HANDLE;
+		VkPipelineLayout sh_pipeline_layout_ = VK_NULL_HANDLE;
+
+		std::vector<VkPipeline> dispatch_pipelines_;
+		std::vector<VkImageView> dispatch_image_views_;
+
+		static constexpr VkFormat kIblTextureFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		static constexpr VkFormat kBRDFLutFormat = VK_FORMAT_R16G16_SFLOAT;
+		// face size of the environment mip level projected onto the sh, larger levels only add texels
+		static constexpr uint32_t kSHProjectionSize = 64;
 		static constexpr  uint32_t kDefaultBRDFLutSize = 128;
+		// bump when the compute shaders change their results, older cache files are then ignored
+		static constexpr uint32_t kIblCacheVersion = 3;
 	};
 }
@@ -0,0 +1,185 @@
+#include "light_culling_pass.h"
+#include "../shader_manager.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peanut
+{
+	namespace
+	{
+		// positive view space depth of a ndc depth
+		float GetViewDepth(const glm::mat4& inv_camera_proj, float ndc_depth)
+		{
+			const glm::vec4 view_position = inv_camera_proj * glm::vec4(0.0f, 0.0f, ndc_depth, 1.0f);
+			return -view_position.z / view_position.w;
+		}
+	}
+
+	void LightCullingPass::Initialize(std::weak_ptr<RHI> rhi, VkBuffer frame_buffer, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+
+		std::shared_ptr<RHI> rhi_ptr = rhi_.lock();
+		assert(rhi_ptr.get() != nullptr);
+
+		cluster_light_counts_ = rhi_ptr->CreateBuffer(sizeof(uint32_t) * LIGHT_CLUSTER_NUM,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		cluster_light_indices_ = rhi_ptr->CreateBuffer(sizeof(uint32_t) * LIGHT_CLUSTER_NUM * LIGHT_CLUSTER_MAX_LIGHTS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		SetupDescriptorSetLayout();
+		SetupPipeline();
+		UpdateDescriptorSet(frame_buffer);
+
+		is_initialized = true;
+	}
+
+	void LightCullingPass::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		if (pipeline_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipeline(pipeline_);
+			pipeline_ = VK_NULL_HANDLE;
+		}
+
+		if (pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(pipeline_layout_);
+			pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (descriptor_layout_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorSetLayout(rhi->GetDevice(), descriptor_layout_, nullptr);
+			descriptor_layout_ = VK_NULL_HANDLE;
+		}
+		descriptor_set_ = VK_NULL_HANDLE;
+
+		for (Resource<VkBuffer>* buffer : { &cluster_light_counts_, &cluster_light_indices_ })
+		{
+			if (buffer->resource != VK_NULL_HANDLE)
+			{
+				rhi->DestroyBuffer(*buffer);
+				*buffer = Resource<VkBuffer>();
+			}
+		}
+
+		is_initialized = false;
+	}
+
+	void LightCullingPass::Dispatch(VkCommandBuffer command_buffer, const DynamicOffsets& dynamic_offsets)
+	{
+		if (!is_initialized)
+		{
+			return;
+		}
+
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "LightCulling");
+
+		// the previous frame's lighting may still read the cluster lists
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0,
+			1, &descriptor_set_, static_cast<uint32_t>(dynamic_offsets.size()), dynamic_offsets.data());
+
+		// a workgroup covers the tiles of one depth slice
+		vkCmdDispatch(command_buffer, 1, 1, LIGHT_CLUSTER_Z);
+
+		std::array<VkBufferMemoryBarrier, 2> barriers = {};
+		for (uint32_t i = 0; i < barriers.size(); ++i)
+		{
+			barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barriers[i].size = VK_WHOLE_SIZE;
+		}
+		barriers[0].buffer = cluster_light_counts_.resource;
+		barriers[1].buffer = cluster_light_indices_.resource;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+	}
+
+	void LightCullingPass::FillClusterParams(LightingUBO& lighting_ubo)
+	{
+		// glm maps depth to [0, 1], min and max also cover a reversed depth projection
+		const float depth0 = GetViewDepth(lighting_ubo.inv_camera_proj, 0.0f);
+		const float depth1 = GetViewDepth(lighting_ubo.inv_camera_proj, 1.0f);
+
+		float near_depth = std::max(std::min(depth0, depth1), 0.001f);
+		float far_depth = std::max(depth0, depth1);
+		if (!std::isfinite(far_depth) || far_depth <= near_depth)
+		{
+			// infinite far plane
+			far_depth = near_depth * 10000.0f;
+		}
+
+		const float log_depth_range = std::log(far_depth / near_depth);
+		const float slice_scale = static_cast<float>(LIGHT_CLUSTER_Z) / log_depth_range;
+		const float slice_bias = static_cast<float>(LIGHT_CLUSTER_Z) * std::log(near_depth) / log_depth_range;
+		lighting_ubo.cluster_params = glm::vec4(near_depth, far_depth, slice_scale, slice_bias);
+	}
+
+	uint32_t LightCullingPass::GetClusterDepthSlice(float view_depth, const glm::vec4& cluster_params)
+	{
+		const float slice = std::floor(std::log(std::max(view_depth, cluster_params.x)) * cluster_params.z - cluster_params.w);
+		return static_cast<uint32_t>(std::clamp(slice, 0.0f, static_cast<float>(LIGHT_CLUSTER_Z - 1)));
+	}
+
+	void LightCullingPass::SetupDescriptorSetLayout()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		const std::vector<VkDescriptorSetLayoutBinding> descriptor_set_layout_bindings =
+		{
+			{LIGHTING_UBO, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+			{POINT_LIGHTS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+			{SPOT_LIGHTS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+			{CLUSTER_LIGHT_COUNTS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+			{CLUSTER_LIGHT_INDICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+		};
+
+		descriptor_layout_ = rhi->CreateDescriptorSetLayout(descriptor_set_layout_bindings);
+	}
+
+	void LightCullingPass::SetupPipeline()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		pipeline_layout_ = rhi->CreatePipelineLayout({ descriptor_layout_ }, {});
+
+		VkShaderModule light_culling_cs = ShaderManager::Get().GetShaderModule(rhi_, "light_culling.comp");
+		pipeline_ = rhi->CreateComputePipeline(light_culling_cs, pipeline_layout_);
+	}
+
+	void LightCullingPass::UpdateDescriptorSet(VkBuffer frame_buffer)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		descriptor_set_ = rhi->AllocateDescriptor(descriptor_layout_);
+
+		// the light arrays are always allocated at their maximum size, the dynamic offsets select the frame
+		rhi->UpdateBufferDescriptorSet(descriptor_set_, LIGHTING_UBO, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			{ { frame_buffer, 0, sizeof(LightingUBO) } });
+		rhi->UpdateBufferDescriptorSet(descriptor_set_, POINT_LIGHTS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			{ { frame_buffer, 0, sizeof(PointLight) * MAX_POINT_LIGHT_NUM } });
+		rhi->UpdateBufferDescriptorSet(descriptor_set_, SPOT_LIGHTS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			{ { frame_buffer, 0, sizeof(SpotLight) * MAX_SPOT_LIGHT_NUM } });
+		rhi->UpdateBufferDescriptorSet(descriptor_set_, CLUSTER_LIGHT_COUNTS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			{ GetClusterLightCountsInfo() });
+		rhi->UpdateBufferDescriptorSet(descriptor_set_, CLUSTER_LIGHT_INDICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			{ GetClusterLightIndicesInfo() });
+	}
+}
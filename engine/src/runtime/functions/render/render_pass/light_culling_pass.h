@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include "../render_data.h"
+#include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_profiler.h"
+
+namespace peanut
+{
+	/**
+	* @brief bin point and spot lights into a view space froxel grid with a compute shader
+	*
+	* The grid is LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y screen tiles times LIGHT_CLUSTER_Z exponential depth slices.
+	* Lights and the LightingUBO are read from the frame uniform buffer through dynamic offsets, the per cluster
+	* light counts and index lists are written to device local storage buffers that the lighting shaders read,
+	* see light_cluster.h. A spot light is culled by the sphere around its apex.
+	*/
+	class LightCullingPass
+	{
+		enum DescriptorBinding : uint8_t
+		{
+			LIGHTING_UBO = 0,
+			POINT_LIGHTS,
+			SPOT_LIGHTS,
+			CLUSTER_LIGHT_COUNTS,
+			CLUSTER_LIGHT_INDICES
+		};
+
+	public:
+		// order of the dynamic offsets: lighting ubo, point lights, spot lights
+		using DynamicOffsets = std::array<uint32_t, 3>;
+
+	public:
+		LightCullingPass() = default;
+		~LightCullingPass() = default;
+
+		// frame_buffer holds the LightingUBO and light arrays of every frame, the dispatch is timed if a gpu profiler is given
+		void Initialize(std::weak_ptr<RHI> rhi, VkBuffer frame_buffer, GpuProfiler* gpu_profiler = nullptr);
+		void Destroy();
+
+		// record the culling before the render pass that shades with the clusters
+		void Dispatch(VkCommandBuffer command_buffer, const DynamicOffsets& dynamic_offsets);
+
+		VkDescriptorBufferInfo GetClusterLightCountsInfo() const { return { cluster_light_counts_.resource, 0, VK_WHOLE_SIZE }; }
+		VkDescriptorBufferInfo GetClusterLightIndicesInfo() const { return { cluster_light_indices_.resource, 0, VK_WHOLE_SIZE }; }
+
+		// derive near, far and the depth slice mapping of the clusters from lighting_ubo.inv_camera_proj
+		static void FillClusterParams(LightingUBO& lighting_ubo);
+
+		// cpu mirror of GetClusterDepthSlice() in light_cluster.h
+		static uint32_t GetClusterDepthSlice(float view_depth, const glm::vec4& cluster_params);
+
+		LightCullingPass(const LightCullingPass&) = delete;
+		LightCullingPass& operator=(const LightCullingPass&) = delete;
+
+	private:
+		void SetupDescriptorSetLayout();
+		void SetupPipeline();
+		void UpdateDescriptorSet(VkBuffer frame_buffer);
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
+
+		Resource<VkBuffer> cluster_light_counts_;
+		Resource<VkBuffer> cluster_light_indices_;
+
+		VkDescriptorSetLayout descriptor_layout_ = VK_NULL_HANDLE;
+		VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+		VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline pipeline_ = VK_NULL_HANDLE;
+	};
+}
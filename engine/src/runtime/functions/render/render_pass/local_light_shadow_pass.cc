@@ -0,0 +1,607 @@
+#include "local_light_shadow_pass.h"
+#include "directional_shadow_pass.h"
+#include "../shadow_cascades.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peanut
+{
+	namespace
+	{
+		constexpr uint64_t kHashOffset = 14695981039346656037ull;
+
+		uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return hash;
+		}
+
+		float GetShadowNearPlane(float light_radius)
+		{
+			return std::max(light_radius * 0.005f, 0.01f);
+		}
+	}
+
+	LocalLightShadowPass::LocalLightShadowPass()
+	{
+		atlas_allocator_.Reset(LOCAL_SHADOW_ATLAS_SIZE, kMinTileSize);
+	}
+
+	void LocalLightShadowPass::Initialize(std::weak_ptr<RHI> rhi, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+
+		CreateShadowAtlases();
+		CreateRenderPass();
+		CreateFramebuffers();
+		CreatePipeline();
+
+		is_initialized = true;
+	}
+
+	void LocalLightShadowPass::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		if (pipeline_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipeline(pipeline_);
+			pipeline_ = VK_NULL_HANDLE;
+		}
+
+		if (pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(pipeline_layout_);
+			pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		for (VkFramebuffer* framebuffer : { &static_atlas_framebuffer_, &shadow_atlas_framebuffer_ })
+		{
+			if (*framebuffer != VK_NULL_HANDLE)
+			{
+				rhi->DestroyFrameBuffer(*framebuffer);
+				*framebuffer = VK_NULL_HANDLE;
+			}
+		}
+
+		if (render_pass_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyRenderPass(render_pass_);
+			render_pass_ = VK_NULL_HANDLE;
+		}
+
+		if (shadow_sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&shadow_sampler_);
+			shadow_sampler_ = VK_NULL_HANDLE;
+		}
+
+		for (VkImageView* image_view : { &static_atlas_view_, &shadow_atlas_view_ })
+		{
+			if (*image_view != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImageView(*image_view);
+				*image_view = VK_NULL_HANDLE;
+			}
+		}
+
+		for (Resource<VkImage>* image : { &static_atlas_, &shadow_atlas_ })
+		{
+			if (image->resource != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImage(*image);
+				*image = Resource<VkImage>();
+			}
+		}
+
+		// the cached tiles are gone with the static atlas
+		cached_lights_.clear();
+		atlas_allocator_.Reset(LOCAL_SHADOW_ATLAS_SIZE, kMinTileSize);
+		view_count_ = 0;
+		static_refresh_count_ = 0;
+
+		is_initialized = false;
+	}
+
+	uint32_t LocalLightShadowPass::Update(PointLight* point_lights, uint32_t point_light_num, SpotLight* spot_lights, uint32_t spot_light_num,
+		const glm::vec3& camera_position, const std::vector<std::shared_ptr<RenderData> >& render_data_list, LocalShadowView* out_views)
+	{
+		shadow_lights_.clear();
+		for (uint32_t i = 0; i < point_light_num; ++i)
+		{
+			PointLight& light = point_lights[i];
+			light.shadow_index = -1;
+			if (!light.cast_shadow || light.radius <= 0.0f)
+			{
+				continue;
+			}
+
+			ShadowLight shadow_light;
+			shadow_light.key = i;
+			shadow_light.light_hash = HashBytes(HashBytes(kHashOffset, &light.position, sizeof(light.position)), &light.radius, sizeof(light.radius));
+			shadow_light.importance = ShadowAtlas::ComputeLightImportance(light.position, light.radius, camera_position);
+			shadow_light.view_count = kMaxViewsPerLight;
+			shadow_light.shadow_index = &light.shadow_index;
+			ComputePointLightViews(light, shadow_light.view_projs);
+			shadow_lights_.push_back(shadow_light);
+		}
+
+		for (uint32_t i = 0; i < spot_light_num; ++i)
+		{
+			SpotLight& light = spot_lights[i];
+			light.shadow_index = -1;
+			if (!light.cast_shadow || light.radius <= 0.0f)
+			{
+				continue;
+			}
+
+			ShadowLight shadow_light;
+			shadow_light.key = (1ull << 32) | i;
+			shadow_light.light_hash = HashBytes(kHashOffset, &light.position, sizeof(light.position));
+			shadow_light.light_hash = HashBytes(shadow_light.light_hash, &light.direction, sizeof(light.direction));
+			shadow_light.light_hash = HashBytes(shadow_light.light_hash, &light.radius, sizeof(light.radius));
+			shadow_light.light_hash = HashBytes(shadow_light.light_hash, &light.outer_cone_cos, sizeof(light.outer_cone_cos));
+			shadow_light.importance = ShadowAtlas::ComputeLightImportance(light.position, light.radius, camera_position);
+			shadow_light.view_count = 1;
+			shadow_light.shadow_index = &light.shadow_index;
+			shadow_light.view_projs[0] = ComputeSpotLightView(light);
+			shadow_lights_.push_back(shadow_light);
+		}
+
+		// the most important lights get their tiles first, the rest of the view budget goes without shadows
+		std::stable_sort(shadow_lights_.begin(), shadow_lights_.end(),
+			[](const ShadowLight& a, const ShadowLight& b) { return a.importance > b.importance; });
+
+		for (auto& cached_light : cached_lights_)
+		{
+			cached_light.second.is_used = false;
+		}
+
+		uint32_t view_budget = MAX_LOCAL_SHADOW_VIEW_NUM;
+		for (ShadowLight& shadow_light : shadow_lights_)
+		{
+			if (shadow_light.view_count > view_budget)
+			{
+				shadow_light.view_count = 0;
+				continue;
+			}
+			view_budget -= shadow_light.view_count;
+
+			// a cube face covers a quarter of the solid angle of a wide spot light
+			uint32_t tile_size = ShadowAtlas::GetTileSizeForImportance(shadow_light.importance, kMaxTileSize, kMinTileSize);
+			if (shadow_light.view_count > 1)
+			{
+				tile_size = std::max(tile_size / 2, kMinTileSize);
+			}
+
+			CachedLight& cached_light = cached_lights_[shadow_light.key];
+			cached_light.is_used = true;
+			if (cached_light.view_count != shadow_light.view_count || cached_light.tile_size != tile_size)
+			{
+				ReleaseTiles(cached_light);
+				cached_light.view_count = shadow_light.view_count;
+				cached_light.tile_size = tile_size;
+			}
+			if (cached_light.light_hash != shadow_light.light_hash)
+			{
+				cached_light.light_hash = shadow_light.light_hash;
+				cached_light.is_static_valid.fill(false);
+			}
+		}
+
+		// free the tiles of lights that are gone before new tiles are packed
+		for (auto it = cached_lights_.begin(); it != cached_lights_.end();)
+		{
+			if (!it->second.is_used)
+			{
+				ReleaseTiles(it->second);
+				it = cached_lights_.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		view_count_ = 0;
+		static_refresh_count_ = 0;
+		for (const ShadowLight& shadow_light : shadow_lights_)
+		{
+			if (shadow_light.view_count == 0)
+			{
+				continue;
+			}
+
+			CachedLight& cached_light = cached_lights_[shadow_light.key];
+			if (!cached_light.tiles[0].IsValid() && !AllocateTiles(cached_light, shadow_light.view_count, cached_light.tile_size))
+			{
+				continue;
+			}
+
+			*shadow_light.shadow_index = static_cast<int>(view_count_);
+			for (uint32_t face = 0; face < shadow_light.view_count; ++face)
+			{
+				if (view_plans_.size() <= view_count_)
+				{
+					view_plans_.emplace_back();
+				}
+
+				ViewPlan& plan = view_plans_[view_count_];
+				plan.view_proj = shadow_light.view_projs[face];
+				plan.tile = cached_light.tiles[face];
+
+				uint64_t static_hash = kHashOffset;
+				CullCasters(render_data_list, plan, static_hash);
+
+				// the sampled tile only differs from the cached one when it was refreshed or still holds dynamic casters
+				plan.refresh_static = !cached_light.is_static_valid[face] || cached_light.static_hashes[face] != static_hash;
+				plan.copy_static = plan.refresh_static || cached_light.has_dynamic_casters[face];
+
+				cached_light.static_hashes[face] = static_hash;
+				cached_light.is_static_valid[face] = true;
+				cached_light.has_dynamic_casters[face] = !plan.dynamic_casters.empty();
+
+				out_views[view_count_].view_proj = plan.view_proj;
+				out_views[view_count_].atlas_rect = atlas_allocator_.GetTileRect(plan.tile);
+				static_refresh_count_ += plan.refresh_static ? 1 : 0;
+				++view_count_;
+			}
+		}
+
+		return view_count_;
+	}
+
+	void LocalLightShadowPass::Render(VkCommandBuffer command_buffer)
+	{
+		if (!is_initialized || view_count_ == 0)
+		{
+			return;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "LocalLightShadow");
+
+		std::vector<VkImageCopy> copy_regions;
+		bool has_dynamic_casters = false;
+		for (uint32_t i = 0; i < view_count_; ++i)
+		{
+			const ViewPlan& plan = view_plans_[i];
+			if (plan.copy_static)
+			{
+				VkImageCopy region = {};
+				region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+				region.srcOffset = { static_cast<int32_t>(plan.tile.x), static_cast<int32_t>(plan.tile.y), 0 };
+				region.dstSubresource = region.srcSubresource;
+				region.dstOffset = region.srcOffset;
+				region.extent = { plan.tile.size, plan.tile.size, 1 };
+				copy_regions.push_back(region);
+			}
+			has_dynamic_casters |= !plan.dynamic_casters.empty();
+		}
+
+		TextureData static_atlas_texture = {};
+		static_atlas_texture.image = static_atlas_;
+		TextureData shadow_atlas_texture;
+		FillShadowAtlasTexture(shadow_atlas_texture);
+
+		// changed static tiles are rendered again, the static atlas waits for copies between frames
+		if (static_refresh_count_ > 0)
+		{
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				{ TextureMemoryBarrier(static_atlas_texture, VK_ACCESS_TRANSFER_READ_BIT,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+
+			DrawViews(command_buffer, static_atlas_framebuffer_, true);
+
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				{ TextureMemoryBarrier(static_atlas_texture, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+		}
+
+		// tiles without changes and without dynamic casters keep what the lighting read last frame
+		if (copy_regions.empty() && !has_dynamic_casters)
+		{
+			return;
+		}
+
+		VkPipelineStageFlags src_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		VkAccessFlags src_access = VK_ACCESS_SHADER_READ_BIT;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		if (!copy_regions.empty())
+		{
+			rhi->CmdPipelineBarrier(command_buffer, src_stage, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				{ TextureMemoryBarrier(shadow_atlas_texture, src_access, VK_ACCESS_TRANSFER_WRITE_BIT,
+					layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+
+			vkCmdCopyImage(command_buffer, static_atlas_.resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				shadow_atlas_.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copy_regions.size()), copy_regions.data());
+
+			src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			src_access = VK_ACCESS_TRANSFER_WRITE_BIT;
+			layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		}
+
+		if (has_dynamic_casters)
+		{
+			rhi->CmdPipelineBarrier(command_buffer, src_stage,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				{ TextureMemoryBarrier(shadow_atlas_texture, src_access,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					layout, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+
+			DrawViews(command_buffer, shadow_atlas_framebuffer_, false);
+
+			src_stage = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			src_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		}
+
+		rhi->CmdPipelineBarrier(command_buffer, src_stage, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(shadow_atlas_texture, src_access, VK_ACCESS_SHADER_READ_BIT,
+				layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+	}
+
+	void LocalLightShadowPass::DrawViews(VkCommandBuffer command_buffer, VkFramebuffer framebuffer, bool is_static)
+	{
+		VkRenderPassBeginInfo render_pass_begin_info{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		render_pass_begin_info.renderPass = render_pass_;
+		render_pass_begin_info.framebuffer = framebuffer;
+		render_pass_begin_info.renderArea.offset = { 0, 0 };
+		render_pass_begin_info.renderArea.extent = { LOCAL_SHADOW_ATLAS_SIZE, LOCAL_SHADOW_ATLAS_SIZE };
+
+		vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+
+		for (uint32_t i = 0; i < view_count_; ++i)
+		{
+			const ViewPlan& plan = view_plans_[i];
+			const std::vector<const StaticMeshRenderData*>& casters = is_static ? plan.static_casters : plan.dynamic_casters;
+			if (is_static ? !plan.refresh_static : casters.empty())
+			{
+				continue;
+			}
+
+			const VkViewport viewport = { static_cast<float>(plan.tile.x), static_cast<float>(plan.tile.y),
+				static_cast<float>(plan.tile.size), static_cast<float>(plan.tile.size), 0.0f, 1.0f };
+			const VkRect2D scissor = { { static_cast<int32_t>(plan.tile.x), static_cast<int32_t>(plan.tile.y) }, { plan.tile.size, plan.tile.size } };
+			vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+			vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+			// the render pass loads the atlas, so a refreshed tile is cleared on its own
+			if (is_static)
+			{
+				VkClearAttachment clear_attachment = {};
+				clear_attachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+				clear_attachment.clearValue.depthStencil = { 1.0f, 0 };
+				const VkClearRect clear_rect = { scissor, 0, 1 };
+				vkCmdClearAttachments(command_buffer, 1, &clear_attachment, 1, &clear_rect);
+			}
+
+			for (const StaticMeshRenderData* caster : casters)
+			{
+				DirectionalShadowPass::DrawCaster(command_buffer, pipeline_layout_, *caster, plan.view_proj);
+			}
+		}
+
+		vkCmdEndRenderPass(command_buffer);
+	}
+
+	void LocalLightShadowPass::FillShadowAtlasTexture(TextureData& out_texture) const
+	{
+		out_texture.image = shadow_atlas_;
+		out_texture.image_view = shadow_atlas_view_;
+		out_texture.image_sampler = shadow_sampler_;
+		out_texture.width = LOCAL_SHADOW_ATLAS_SIZE;
+		out_texture.height = LOCAL_SHADOW_ATLAS_SIZE;
+		out_texture.channels = 1;
+		out_texture.levels = 1;
+		out_texture.layers = 1;
+		out_texture.pixels = nullptr;
+	}
+
+	void LocalLightShadowPass::ComputePointLightViews(const PointLight& light, std::array<glm::mat4, kMaxViewsPerLight>& out_view_projs)
+	{
+		// +x, -x, +y, -y, +z, -z, the lighting picks the face by the major axis of the light to fragment direction
+		static const glm::vec3 kFaceDirections[kMaxViewsPerLight] = { { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+			{ 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+		static const glm::vec3 kFaceUps[kMaxViewsPerLight] = { { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+			{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } };
+
+		const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, GetShadowNearPlane(light.radius), light.radius);
+		for (uint32_t face = 0; face < kMaxViewsPerLight; ++face)
+		{
+			out_view_projs[face] = projection * glm::lookAt(light.position, light.position + kFaceDirections[face], kFaceUps[face]);
+		}
+	}
+
+	glm::mat4 LocalLightShadowPass::ComputeSpotLightView(const SpotLight& light)
+	{
+		const float fov = std::min(2.0f * std::acos(glm::clamp(light.outer_cone_cos, -1.0f, 1.0f)), glm::radians(170.0f));
+		const glm::vec3 up = std::abs(light.direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		const glm::mat4 projection = glm::perspective(fov, 1.0f, GetShadowNearPlane(light.radius), light.radius);
+		return projection * glm::lookAt(light.position, light.position + light.direction, up);
+	}
+
+	void LocalLightShadowPass::ReleaseTiles(CachedLight& cached_light)
+	{
+		for (ShadowAtlasTile& tile : cached_light.tiles)
+		{
+			atlas_allocator_.Free(tile);
+			tile = ShadowAtlasTile();
+		}
+		cached_light.is_static_valid.fill(false);
+		cached_light.has_dynamic_casters.fill(false);
+	}
+
+	bool LocalLightShadowPass::AllocateTiles(CachedLight& cached_light, uint32_t view_count, uint32_t tile_size)
+	{
+		// fall back to smaller tiles when the atlas is full
+		for (; tile_size >= kMinTileSize; tile_size /= 2)
+		{
+			uint32_t allocated = 0;
+			while (allocated < view_count && atlas_allocator_.Allocate(tile_size, cached_light.tiles[allocated]))
+			{
+				++allocated;
+			}
+			if (allocated == view_count)
+			{
+				return true;
+			}
+			ReleaseTiles(cached_light);
+		}
+		return false;
+	}
+
+	void LocalLightShadowPass::CullCasters(const std::vector<std::shared_ptr<RenderData> >& render_data_list, ViewPlan& plan, uint64_t& out_static_hash) const
+	{
+		plan.static_casters.clear();
+		plan.dynamic_casters.clear();
+
+		std::array<glm::vec4, 6> frustum_planes;
+		ShadowCascades::ExtractFrustumPlanes(plan.view_proj, frustum_planes);
+
+		for (const auto& render_data : render_data_list)
+		{
+			const StaticMeshRenderData* mesh = static_cast<const StaticMeshRenderData*>(render_data.get());
+			if (!mesh->cast_shadow)
+			{
+				continue;
+			}
+
+			const glm::mat4& model = mesh->transform_ubo_data.model;
+			if (mesh->has_bounding_box)
+			{
+				glm::vec3 world_min;
+				glm::vec3 world_max;
+				ShadowCascades::TransformAabb(model, mesh->bounding_box_min, mesh->bounding_box_max, world_min, world_max);
+				if (!ShadowCascades::IsAabbInFrustum(frustum_planes, world_min, world_max))
+				{
+					continue;
+				}
+			}
+
+			if (mesh->is_static)
+			{
+				// a static caster entering, leaving or moving within the view invalidates the cached tile
+				out_static_hash = HashBytes(out_static_hash, &mesh, sizeof(mesh));
+				out_static_hash = HashBytes(out_static_hash, &model, sizeof(model));
+				plan.static_casters.push_back(mesh);
+			}
+			else
+			{
+				plan.dynamic_casters.push_back(mesh);
+			}
+		}
+	}
+
+	void LocalLightShadowPass::CreateShadowAtlases()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		static_atlas_ = rhi->CreateImage(LOCAL_SHADOW_ATLAS_SIZE, LOCAL_SHADOW_ATLAS_SIZE, 1, 1, 1, kShadowAtlasFormat,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		static_atlas_view_ = rhi->CreateImageView(static_atlas_.resource, kShadowAtlasFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 1);
+
+		shadow_atlas_ = rhi->CreateImage(LOCAL_SHADOW_ATLAS_SIZE, LOCAL_SHADOW_ATLAS_SIZE, 1, 1, 1, kShadowAtlasFormat,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		shadow_atlas_view_ = rhi->CreateImageView(shadow_atlas_.resource, kShadowAtlasFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 1);
+
+		// hardware pcf, the lighting clamps the taps to the tile of the view
+		VkSamplerCreateInfo create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.compareEnable = VK_TRUE;
+		create_info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		create_info.maxLod = 1.0f;
+		rhi->CreateSampler(&create_info, &shadow_sampler_);
+
+		// every tile is refreshed before it is first copied or sampled, so both atlases start in their resting layout
+		TextureData static_atlas_texture = {};
+		static_atlas_texture.image = static_atlas_;
+		TextureData shadow_atlas_texture;
+		FillShadowAtlasTexture(shadow_atlas_texture);
+
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			{ TextureMemoryBarrier(static_atlas_texture, 0, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT),
+			TextureMemoryBarrier(shadow_atlas_texture, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).AspectMask(VK_IMAGE_ASPECT_DEPTH_BIT) });
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+	}
+
+	void LocalLightShadowPass::CreateRenderPass()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// layout transitions and synchronization are done by the barriers in Render()
+		VkAttachmentDescription depth_attachment = {};
+		depth_attachment.format = kShadowAtlasFormat;
+		depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depth_reference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depth_reference;
+
+		VkRenderPassCreateInfo create_info = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		create_info.attachmentCount = 1;
+		create_info.pAttachments = &depth_attachment;
+		create_info.subpassCount = 1;
+		create_info.pSubpasses = &subpass;
+		rhi->CreateRenderPass(&create_info, &render_pass_);
+	}
+
+	void LocalLightShadowPass::CreateFramebuffers()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		VkFramebufferCreateInfo create_info = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+		create_info.renderPass = render_pass_;
+		create_info.attachmentCount = 1;
+		create_info.width = LOCAL_SHADOW_ATLAS_SIZE;
+		create_info.height = LOCAL_SHADOW_ATLAS_SIZE;
+		create_info.layers = 1;
+
+		create_info.pAttachments = &static_atlas_view_;
+		rhi->CreateFrameBuffer(&create_info, &static_atlas_framebuffer_);
+
+		create_info.pAttachments = &shadow_atlas_view_;
+		rhi->CreateFrameBuffer(&create_info, &shadow_atlas_framebuffer_);
+	}
+
+	void LocalLightShadowPass::CreatePipeline()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// both atlases use the same render pass, so one pipeline draws static and dynamic casters
+		pipeline_layout_ = rhi->CreatePipelineLayout({}, { {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPCO)} });
+		pipeline_ = DirectionalShadowPass::CreateDepthPipeline(rhi, render_pass_, pipeline_layout_);
+	}
+}
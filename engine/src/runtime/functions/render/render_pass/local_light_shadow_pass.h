@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <unordered_map>
+#include "../render_data.h"
+#include "../shadow_atlas.h"
+#include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_profiler.h"
+
+namespace peanut
+{
+	/**
+	* @brief point and spot light shadows in one depth atlas with cached static casters
+	*
+	* Shadowed lights get atlas tiles sized by their screen importance, a spot light one view and a
+	* point light one view per cube face. Static casters are rendered into a second atlas that is kept
+	* across frames, a tile is only rendered again when the light, its tile or the static casters it
+	* sees change. Every frame the cached tiles are copied into the sampled atlas where needed and only
+	* the dynamic casters are drawn on top of them.
+	*/
+	class LocalLightShadowPass
+	{
+	public:
+		LocalLightShadowPass();
+		~LocalLightShadowPass() = default;
+
+		void Initialize(std::weak_ptr<RHI> rhi, GpuProfiler* gpu_profiler = nullptr);
+		void Destroy();
+
+		// assign atlas tiles to the shadowed lights, write their shadow_index and their views to out_views
+		// (MAX_LOCAL_SHADOW_VIEW_NUM entries) and cull the casters of every view, returns the number of views
+		uint32_t Update(PointLight* point_lights, uint32_t point_light_num, SpotLight* spot_lights, uint32_t spot_light_num,
+			const glm::vec3& camera_position, const std::vector<std::shared_ptr<RenderData> >& render_data_list, LocalShadowView* out_views);
+
+		// record the views of the last Update(), outside of any render pass
+		void Render(VkCommandBuffer command_buffer);
+
+		// the sampled atlas and its comparison sampler
+		void FillShadowAtlasTexture(TextureData& out_texture) const;
+
+		// views of the last Update() whose static casters have to be rendered again
+		uint32_t GetStaticRefreshCount() const { return static_refresh_count_; }
+		uint32_t GetViewCount() const { return view_count_; }
+
+		LocalLightShadowPass(const LocalLightShadowPass&) = delete;
+		LocalLightShadowPass& operator=(const LocalLightShadowPass&) = delete;
+
+	private:
+		static constexpr uint32_t kMaxViewsPerLight = 6;
+
+		// a light that had a shadow in an earlier frame, keyed by its type and index
+		struct CachedLight
+		{
+			uint64_t light_hash = 0;
+			uint32_t view_count = 0;
+			uint32_t tile_size = 0;
+			bool is_used = false;
+
+			std::array<ShadowAtlasTile, kMaxViewsPerLight> tiles = {};
+			// static casters in the static atlas tile, valid once the tile was rendered
+			std::array<uint64_t, kMaxViewsPerLight> static_hashes = {};
+			std::array<bool, kMaxViewsPerLight> is_static_valid = {};
+			// the sampled tile still holds dynamic casters of an earlier frame
+			std::array<bool, kMaxViewsPerLight> has_dynamic_casters = {};
+		};
+
+		struct ShadowLight
+		{
+			uint64_t key = 0;
+			uint64_t light_hash = 0;
+			float importance = 0.0f;
+			uint32_t view_count = 0;
+			int* shadow_index = nullptr;
+			std::array<glm::mat4, kMaxViewsPerLight> view_projs;
+		};
+
+		// a view of this frame and what has to be drawn into its tile
+		struct ViewPlan
+		{
+			glm::mat4 view_proj{ 1.0f };
+			ShadowAtlasTile tile;
+			bool refresh_static = false;
+			bool copy_static = false;
+			std::vector<const StaticMeshRenderData*> static_casters;
+			std::vector<const StaticMeshRenderData*> dynamic_casters;
+		};
+
+		static void ComputePointLightViews(const PointLight& light, std::array<glm::mat4, kMaxViewsPerLight>& out_view_projs);
+		static glm::mat4 ComputeSpotLightView(const SpotLight& light);
+
+		void ReleaseTiles(CachedLight& cached_light);
+		bool AllocateTiles(CachedLight& cached_light, uint32_t view_count, uint32_t tile_size);
+		void CullCasters(const std::vector<std::shared_ptr<RenderData> >& render_data_list, ViewPlan& plan, uint64_t& out_static_hash) const;
+
+		void CreateShadowAtlases();
+		void CreateRenderPass();
+		void CreateFramebuffers();
+		void CreatePipeline();
+		void DrawViews(VkCommandBuffer command_buffer, VkFramebuffer framebuffer, bool is_static);
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
+
+		ShadowAtlas atlas_allocator_;
+		std::unordered_map<uint64_t, CachedLight> cached_lights_;
+		std::vector<ShadowLight> shadow_lights_;
+		std::vector<ViewPlan> view_plans_;
+		uint32_t view_count_ = 0;
+		uint32_t static_refresh_count_ = 0;
+
+		// static casters only, kept across frames
+		Resource<VkImage> static_atlas_;
+		VkImageView static_atlas_view_ = VK_NULL_HANDLE;
+		VkFramebuffer static_atlas_framebuffer_ = VK_NULL_HANDLE;
+
+		// cached tiles plus the dynamic casters of this frame, read by the lighting
+		Resource<VkImage> shadow_atlas_;
+		VkImageView shadow_atlas_view_ = VK_NULL_HANDLE;
+		VkFramebuffer shadow_atlas_framebuffer_ = VK_NULL_HANDLE;
+		VkSampler shadow_sampler_ = VK_NULL_HANDLE;
+
+		// loads and stores the atlas, tiles are cleared one by one
+		VkRenderPass render_pass_ = VK_NULL_HANDLE;
+		VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline pipeline_ = VK_NULL_HANDLE;
+
+		static constexpr VkFormat kShadowAtlasFormat = VK_FORMAT_D32_SFLOAT;
+		static constexpr uint32_t kMaxTileSize = LOCAL_SHADOW_ATLAS_SIZE / 4;
+		static constexpr uint32_t kMinTileSize = 64;
+	};
+}
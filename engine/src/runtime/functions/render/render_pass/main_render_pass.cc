@@ -1,19 +1,38 @@
 #include "main_render_pass.h"
 
 #include "functions/assets/mesh.h"
+#include "functions/render/render_utils.h"
 #include "functions/render/shader_manager.h"
+#include "functions/rhi/gpu_profiler.h"
+
+#include <algorithm>
+#include <cstring>
 
 namespace peanut
 {
-	void MainRenderPass::Initialize(PassInitInfo* init_info)
+	void DeferredRenderPass::Initialize(PassInitInfo* init_info)
 	{
 		IRenderPassBase::Initialize(init_info);
 
-		CreateUniformBuffer(sizeof(LightingUBO) + 128);
+		// the light arrays are bound as dynamic storage buffers
+		CreateFrameUniformBuffer(kFrameUniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		light_culling_pass_.Initialize(rhi_, frame_uniform_allocator_.GetBuffer(), gpu_profiler_);
+		directional_shadow_pass_.Initialize(rhi_, gpu_profiler_);
+		directional_shadow_pass_.FillShadowMapTexture(lighting_render_data_.directional_light_shadow_map);
+		local_light_shadow_pass_.Initialize(rhi_, gpu_profiler_);
+		local_light_shadow_pass_.FillShadowAtlasTexture(lighting_render_data_.local_light_shadow_atlas);
+		reflection_probe_pass_.Initialize(rhi_, lighting_render_data_.ibl_light_texture.ibl_prefilter_texture, gpu_profiler_);
+		reflection_probe_pass_.FillProbeArrayTexture(lighting_render_data_.reflection_probe_array);
+		post_process_pass_.Initialize(rhi_, std::static_pointer_cast<VulkanRHI>(rhi_.lock())->GetSwapChainImageFormat(), gpu_profiler_);
+		if (color_grading_render_data_.has_value())
+		{
+			post_process_pass_.SetColorGradingLut(color_grading_render_data_->color_grading_lut_texture);
+		}
+		UpdatePostProcessTargets();
 
+		UpdateObjectConstantsDescriptor();
 		UpdateDeferredLightDescriptor();
 		UpdateSkyboxDescriptor();
-		UpdateColorGradingDescriptor();
 
 		// temp: load static mesh render data
 
@@ -24,7 +43,61 @@ namespace peanut
 		// temp: load color grading render data
 	}
 
-	void MainRenderPass::Render()
+	void DeferredRenderPass::DeInitialize()
+	{
+		auto rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		if (shader_reload_listener_ != kInvalidListener)
+		{
+			ShaderManager::Get().RemoveReloadListener(shader_reload_listener_);
+			shader_reload_listener_ = kInvalidListener;
+		}
+
+		// background compiles still reference the pipeline layouts and the cache
+		WaitPendingPipelines();
+		for (uint32_t i = 0; i < RenderPipelineType::PipelineTypeCount; ++i)
+		{
+			DestroyPipelineVariants(static_cast<RenderPipelineType::Type>(i));
+		}
+		pipeline_compile_pool_.reset();
+
+		for (auto& render_pipeline : render_pipelines_)
+		{
+			if (render_pipeline.pipeline_ != VK_NULL_HANDLE)
+				rhi->DestroyPipeline(render_pipeline.pipeline_);
+			if (render_pipeline.pipeline_layout_ != VK_NULL_HANDLE)
+				rhi->DestroyPipelineLayout(render_pipeline.pipeline_layout_);
+		}
+		render_pipelines_.clear();
+
+		// flush everything compiled during this run before the cache goes away
+		DestroyPipelineCache();
+
+		for (auto& framebuffer : render_pass_framebuffer_)
+		{
+			rhi->DestroyFrameBuffer(framebuffer);
+		}
+		render_pass_framebuffer_.clear();
+
+		DestroyRenderTargets();
+		render_target_.reset();
+
+		if (render_pass_.has_value())
+		{
+			rhi->DestroyRenderPass(render_pass_.value());
+			render_pass_.reset();
+		}
+
+		post_process_pass_.Destroy();
+		reflection_probe_pass_.Destroy();
+		local_light_shadow_pass_.Destroy();
+		directional_shadow_pass_.Destroy();
+		light_culling_pass_.Destroy();
+		DestroyFrameUniformBuffer();
+	}
+
+	void DeferredRenderPass::Render()
 	{
 		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
 		assert(vulkan_rhi.get() != nullptr);
@@ -47,12 +120,36 @@ namespace peanut
 		clear_values[AttachmentType::GBufferC_BaseColor].color						= { { 0.0f, 0.0f, 0.0f, 0.0f } };
 		clear_values[AttachmentType::DepthImage].depthStencil						= { 1.0f, 0 };
 		clear_values[AttachmentType::BackupBuffer].color							= { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clear_values[AttachmentType::SwapChain].color								  = { { 0.0f, 0.0f, 0.0f, 0.0f } };
 
 		render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
 		render_pass_begin_info.pClearValues = clear_values.data();
 
+		// the previous frame of this slot has finished on the gpu, its constants can be overwritten
+		frame_uniform_allocator_.BeginFrame(current_frame_index);
+
+		const bool has_local_lights = PushLightingData(current_frame_index, frame_width, frame_height);
+
 		VkCommandBuffer command_buffer = vulkan_rhi->GetCommandBuffer();
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "DeferredRenderPass");
+
+		// bin the point and spot lights into clusters, dispatches are not allowed inside the render pass
+		if (has_local_lights)
+		{
+			light_culling_pass_.Dispatch(command_buffer, { lighting_dynamic_offsets_[0], lighting_dynamic_offsets_[1], lighting_dynamic_offsets_[2] });
+		}
+
+		// the shadow cascades are rendered in their own render pass before the lighting samples them
+		if (HasDirectionalShadow(lighting_render_data_.lighting_ubo_data[current_frame_index]))
+		{
+			directional_shadow_pass_.Render(command_buffer, render_data_);
+		}
+
+		// point and spot light shadows, only changed static tiles and dynamic casters are drawn
+		local_light_shadow_pass_.Render(command_buffer);
+
+		// at most a few faces of one reflection probe, within the capture time budget
+		reflection_probe_pass_.Render(command_buffer);
+
 		vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport;
@@ -69,16 +166,22 @@ namespace peanut
 		scissor.extent = { frame_width, frame_height };
 		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
+		// build both draw lists up front so all missing variants compile in parallel,
+		// opaque draws are grouped by state front to back, transparency is blended back to front
+		BuildDrawList(render_data_, RenderPipelineType::MeshGbuffer, SubpassType::BasePass, opaque_draw_list_);
+		BuildDrawList(transparency_render_data_, RenderPipelineType::ForwardLighting, SubpassType::ForwardLightingPass, transparency_draw_list_);
+
 		// mesh gbuffer render pass
-		for (const auto& render_data : render_data_)
-        {
-            RenderMesh(command_buffer, render_data);
-        }
+		{
+			PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "GBuffer");
+			RenderMeshes(command_buffer, opaque_draw_list_.GetCommands());
+		}
 
 		// deferred lighting render pass
 		vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
 		if (!render_data_.empty())
 		{
+			PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "DeferredLighting");
 			RenderDeferredLighting(command_buffer, current_frame_index);
 		}
 		
@@ -88,192 +191,439 @@ namespace peanut
 		// draw skybox
 		if (skybox_render_data_)
 		{
+			PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "Skybox");
+
 			// update skybox uniform buffer
-			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, render_pipelines_[RenderPipelineType::Skybox].pipeline_);
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GetPipeline(RenderPipelineType::Skybox));
 
 			// bind vertex
 			VkBuffer vertex_buffer[] = {skybox_render_data_->vertex_buffer.resource};
 			vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer, nullptr);
 			vkCmdBindIndexBuffer(command_buffer, skybox_render_data_->index_buffer.resource, 0, VK_INDEX_TYPE_UINT32);
 
-			// bind skybox descriptor
-			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				render_pipelines_[RenderPipelineType::Skybox].pipeline_layout_, 0, 1,
-				&render_descriptors_[DescriptorLayoutType::Skybox].descritptor_set_, 0, nullptr);
-			
-			// update push constant
-			std::vector<VkPushConstantRange> skybox_push_constant_range = { {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(TransformUBO)} };
-			UpdatePushConstants(command_buffer, render_pipelines_[RenderPipelineType::Skybox].pipeline_layout_,
-				{&skybox_render_data_->transform_ubo_data},skybox_push_constant_range);
-
-			vkCmdDrawIndexed(command_buffer, skybox_render_data_->index_counts, 1, 0, 0, 0);
-		}
-
-		// draw transparency objects
-		{
-			for (const auto& render_data : transparency_render_data_)
+			// bind skybox descriptor and its transform
+			UniformBufferAllocation skybox_transform;
+			if (frame_uniform_allocator_.Push(skybox_render_data_->transform_ubo_data, skybox_transform))
 			{
-				RenderMesh(command_buffer, render_data, true);
+				const VkDescriptorSet skybox_descriptor_sets[] = {
+					render_descriptors_[DescriptorLayoutType::Skybox].descritptor_set_,
+					render_descriptors_[DescriptorLayoutType::ObjectConstants].descritptor_set_ };
+				const uint32_t skybox_transform_offset = static_cast<uint32_t>(skybox_transform.descriptor_info.offset);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+					render_pipelines_[RenderPipelineType::Skybox].pipeline_layout_, 0, 2, skybox_descriptor_sets, 1, &skybox_transform_offset);
+
+				vkCmdDrawIndexed(command_buffer, skybox_render_data_->index_counts, 1, 0, 0, 0);
 			}
 		}
 
-		// color grading post process -- todo: remove to an single render pass
+		// draw transparency objects
 		{
-			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, render_pipelines_[RenderPipelineType::ColorGrading].pipeline_);
-
-			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				render_pipelines_[RenderPipelineType::ColorGrading].pipeline_layout_, 0, 1,
-				&render_descriptors_[RenderPipelineType::ColorGrading].descritptor_set_, 0, nullptr);
-
-			vkCmdDraw(command_buffer, 3, 1, 0, 0);
+			PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "Transparency");
+			RenderMeshes(command_buffer, transparency_draw_list_.GetCommands(), true);
 		}
 
 		vkCmdEndRenderPass(command_buffer);
+
+		// exposure, bloom, tone mapping and color grading of the backup buffer into the swapchain image
+		post_process_pass_.Render(command_buffer, current_frame_index, post_process_delta_time_);
 	}
 
-	void MainRenderPass::RenderMesh(VkCommandBuffer command_buffer, const std::shared_ptr<RenderData>& render_data, bool is_forward)
+	void DeferredRenderPass::BuildDrawList(const std::vector<std::shared_ptr<RenderData> >& render_data_list, RenderPipelineType::Type type,
+		SubpassType::Type subpass, DrawList& out_draw_list)
 	{
-		auto rhi = rhi_.lock();
-		assert(rhi.get() != nullptr);
+		out_draw_list.Clear();
+		for (const auto& render_data : render_data_list)
+		{
+			const StaticMeshRenderData* mesh = static_cast<const StaticMeshRenderData*>(render_data.get());
 
-		std::shared_ptr<StaticMeshRenderData> static_mesh_render_data = std::static_pointer_cast<StaticMeshRenderData>(render_data);
+			// clip space w of the mesh origin is its view space depth
+			const float view_depth = mesh->transform_ubo_data.model_view_projection[3][3];
 
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
-		if (!is_forward)
-		{
-			pipeline = render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_;
-			pipeline_layout = render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_layout_;
-		}
-		else
-		{
-			pipeline = render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_;
-			pipeline_layout = render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_layout_;
+			// the transform is written once per mesh and shared by all its submeshes
+			UniformBufferAllocation transform_allocation;
+			if (!frame_uniform_allocator_.Push(mesh->transform_ubo_data, transform_allocation))
+			{
+				continue;
+			}
+			const uint32_t object_offset = static_cast<uint32_t>(transform_allocation.descriptor_info.offset);
+
+			const uint32_t submesh_counts = static_cast<uint32_t>(mesh->index_counts.size());
+			for (uint32_t i = 0; i < submesh_counts; ++i)
+			{
+				const uint32_t feature_mask = GetMaterialFeatureMask(mesh->material_pcos[i]);
+				out_draw_list.Add({ mesh, i, feature_mask, object_offset }, subpass, GetMaterialId(mesh->pbr_materials[i]), view_depth);
+
+				// kick off compiles of new variants now, they are waited for on first draw
+				RequestPipelineVariant(type, feature_mask);
+			}
 		}
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		out_draw_list.Sort();
+	}
 
-		// bind vertex bufer and index buffer
-		VkBuffer vertex_buffer[] = { static_mesh_render_data->vertex_buffer.resource };
-		constexpr VkDeviceSize vertex_buffer_offset = { 0 };
-		vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer, vertex_buffer_offset);
-		vkCmdBindIndexBuffer(command_buffer, static_mesh_render_data->index_buffer.resource, 0, VK_INDEX_TYPE_UINT32);
+	void DeferredRenderPass::RenderMeshes(VkCommandBuffer command_buffer, const std::vector<MeshDrawCommand>& draw_commands, bool is_forward)
+	{
+		const RenderPipelineType::Type pipeline_type = is_forward ? RenderPipelineType::ForwardLighting : RenderPipelineType::MeshGbuffer;
+		VkPipelineLayout pipeline_layout = render_pipelines_[pipeline_type].pipeline_layout_;
 
-		uint32_t submesh_counts = static_mesh_render_data->index_counts.size();
-		for (uint32_t i = 0; i < submesh_counts; ++i)
+		VkPipeline bound_pipeline = VK_NULL_HANDLE;
+		const StaticMeshRenderData* bound_mesh = nullptr;
+		const PbrMaterial* bound_material = nullptr;
+		for (const MeshDrawCommand& draw_command : draw_commands)
 		{
-			if (!is_forward)
+			// opaque draws are sorted by variant, so this only rebinds when the material features change
+			VkPipeline pipeline = GetPipelineVariant(pipeline_type, draw_command.feature_mask);
+			if (pipeline != bound_pipeline)
 			{
-				UpdatePushConstants(command_buffer, pipeline_layout,
-					{ &static_mesh_render_data->transform_ubo_data, &static_mesh_render_data->material_pcos[i] },
-					all_push_constant_range_[RenderPipelineType::MeshGbuffer]);
+				// every pipeline variant is timed as one draw group
+				if (gpu_profiler_ != nullptr)
+				{
+					if (bound_pipeline != VK_NULL_HANDLE)
+					{
+						gpu_profiler_->EndScope(command_buffer);
+					}
+					gpu_profiler_->BeginScope(command_buffer, "variant_" + std::to_string(draw_command.feature_mask));
+				}
+
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				bound_pipeline = pipeline;
 			}
-			else
-			{
 
-				UpdatePushConstants(command_buffer, pipeline_layout,
-					{ &static_mesh_render_data->transform_ubo_data, &static_mesh_render_data->material_pcos[i] },
-					all_push_constant_range_[RenderPipelineType::ForwardLighting]);
+			// bind vertex bufer, index buffer and the object transform
+			const StaticMeshRenderData* static_mesh_render_data = draw_command.mesh;
+			if (static_mesh_render_data != bound_mesh)
+			{
+				VkBuffer vertex_buffer[] = { static_mesh_render_data->vertex_buffer.resource };
+				constexpr VkDeviceSize vertex_buffer_offset = { 0 };
+				vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer, &vertex_buffer_offset);
+				vkCmdBindIndexBuffer(command_buffer, static_mesh_render_data->index_buffer.resource, 0, VK_INDEX_TYPE_UINT32);
+
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1,
+					&render_descriptors_[DescriptorLayoutType::ObjectConstants].descritptor_set_, 1, &draw_command.object_offset);
+				bound_mesh = static_mesh_render_data;
 			}
 
+			const uint32_t i = draw_command.submesh_index;
+			UpdatePushConstants(command_buffer, pipeline_layout, { &static_mesh_render_data->material_pcos[i] },
+				all_push_constant_range_[pipeline_type]);
+
+			// all variants share the pipeline layout, so the material set stays bound across pipeline changes
 			const PbrMaterial& material = static_mesh_render_data->pbr_materials[i];
-			
-			if (!is_forward)
+			if (bound_material == nullptr || GetMaterialId(*bound_material) != GetMaterialId(material))
 			{
-				// allocate descriptor set
-				VkDescriptorSet mesh_descriptor_set = CreateGbufferDescriptor();
-				// update descriptor set
-				UpdateGbufferDescriptor(command_buffer, material, mesh_descriptor_set);
-				// bind descriptor set
-				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-					render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_layout_,
-					0, 1, &mesh_descriptor_set, 0, nullptr);
-			}
-			else
-			{
-				VkDescriptorSet forward_descriptor_set = CreateForwardLightDescriptor();
-				UpdateForwardLightDescriptor(command_buffer, material, forward_descriptor_set);
-				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-					render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_layout_,
-					0, 1, &forward_descriptor_set, 0, nullptr);
+				VkDescriptorSet material_descriptor_set = VK_NULL_HANDLE;
+				uint32_t dynamic_offset_count = 0;
+				if (!is_forward)
+				{
+					material_descriptor_set = CreateGbufferDescriptor();
+					UpdateGbufferDescriptor(command_buffer, material, material_descriptor_set);
+				}
+				else
+				{
+					// forward shading reads the lighting constants of this frame
+					material_descriptor_set = CreateForwardLightDescriptor();
+					UpdateForwardLightDescriptor(command_buffer, material, material_descriptor_set);
+					dynamic_offset_count = 1;
+				}
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout,
+					0, 1, &material_descriptor_set, dynamic_offset_count, lighting_dynamic_offsets_.data());
+				bound_material = &material;
 			}
 
 			// command draw
 			vkCmdDrawIndexed(command_buffer, static_mesh_render_data->index_counts[i], 1, static_mesh_render_data->index_offsets[i], 0, 0);
 		}
-		
+
+		if (gpu_profiler_ != nullptr && bound_pipeline != VK_NULL_HANDLE)
+		{
+			gpu_profiler_->EndScope(command_buffer);
+		}
+	}
+
+	bool DeferredRenderPass::PushLightingData(uint32_t current_frame_index, uint32_t frame_width, uint32_t frame_height)
+	{
+		LightingUBO lighting_ubo = lighting_render_data_.lighting_ubo_data[current_frame_index];
+		uint32_t point_light_num = std::min<uint32_t>(static_cast<uint32_t>(lighting_render_data_.point_lights.size()), MAX_POINT_LIGHT_NUM);
+		uint32_t spot_light_num = std::min<uint32_t>(static_cast<uint32_t>(lighting_render_data_.spot_lights.size()), MAX_SPOT_LIGHT_NUM);
+
+		// the descriptors bind the light arrays at their maximum size
+		UniformBufferAllocation point_light_allocation;
+		UniformBufferAllocation spot_light_allocation;
+		UniformBufferAllocation shadow_view_allocation;
+		if (frame_uniform_allocator_.Allocate(sizeof(PointLight) * MAX_POINT_LIGHT_NUM, point_light_allocation) &&
+			frame_uniform_allocator_.Allocate(sizeof(SpotLight) * MAX_SPOT_LIGHT_NUM, spot_light_allocation) &&
+			frame_uniform_allocator_.Allocate(sizeof(LocalShadowView) * MAX_LOCAL_SHADOW_VIEW_NUM, shadow_view_allocation))
+		{
+			std::memcpy(point_light_allocation.host_mem_ptr, lighting_render_data_.point_lights.data(), sizeof(PointLight) * point_light_num);
+			std::memcpy(spot_light_allocation.host_mem_ptr, lighting_render_data_.spot_lights.data(), sizeof(SpotLight) * spot_light_num);
+
+			// the shadow pass writes the shadow index of the copied lights
+			local_light_shadow_pass_.Update(point_light_allocation.as<PointLight>(), point_light_num, spot_light_allocation.as<SpotLight>(), spot_light_num,
+				lighting_ubo.camera_pos, render_data_, shadow_view_allocation.as<LocalShadowView>());
+
+			lighting_dynamic_offsets_[1] = static_cast<uint32_t>(point_light_allocation.descriptor_info.offset);
+			lighting_dynamic_offsets_[2] = static_cast<uint32_t>(spot_light_allocation.descriptor_info.offset);
+			lighting_dynamic_offsets_[3] = static_cast<uint32_t>(shadow_view_allocation.descriptor_info.offset);
+		}
+		else
+		{
+			point_light_num = 0;
+			spot_light_num = 0;
+		}
+
+		lighting_ubo.point_light_num = static_cast<int>(point_light_num);
+		lighting_ubo.spot_light_num = static_cast<int>(spot_light_num);
+		lighting_ubo.screen_params = glm::vec4(frame_width, frame_height, 1.0f / frame_width, 1.0f / frame_height);
+		LightCullingPass::FillClusterParams(lighting_ubo);
+		if (HasDirectionalShadow(lighting_ubo))
+		{
+			directional_shadow_pass_.UpdateCascades(lighting_ubo);
+		}
+		reflection_probe_pass_.Update(lighting_render_data_.reflection_probes, render_data_, lighting_ubo);
+
+		UniformBufferAllocation lighting_allocation;
+		if (!frame_uniform_allocator_.Push(lighting_ubo, lighting_allocation))
+		{
+			return false;
+		}
+		lighting_dynamic_offsets_[0] = static_cast<uint32_t>(lighting_allocation.descriptor_info.offset);
+		return point_light_num + spot_light_num > 0;
 	}
 
-	void MainRenderPass::RenderDeferredLighting(VkCommandBuffer command_buffer, uint32_t current_frame_index)
+	void DeferredRenderPass::RenderDeferredLighting(VkCommandBuffer command_buffer, uint32_t current_frame_index)
 	{
-		VkPipeline deferred_lighting_pipeline = render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_;
+		VkPipeline deferred_lighting_pipeline = GetPipeline(RenderPipelineType::DeferredLighting);
 		VkPipelineLayout pipeline_layout = render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_layout_;
 
 		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, deferred_lighting_pipeline);
 
-		// update lighting uniform buffer
-		auto lighting_data = lighting_render_data_.lighting_ubo_data[current_frame_index];
-		LightingUBO* light_ubo_data = lighting_data_uniform_buffer_->as<LightingUBO>(); // get uniform buffer
-		light_ubo_data->CopyFrom(lighting_data);
-
-		// bind descriptor set
+		// bind descriptor set, the lighting constants and lights were written to the frame uniform buffer in Render()
 		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, 
-			&render_descriptors_[DescriptorLayoutType::DeferredLighting].descritptor_set_, 0, nullptr);
+			&render_descriptors_[DescriptorLayoutType::DeferredLighting].descritptor_set_,
+			static_cast<uint32_t>(lighting_dynamic_offsets_.size()), lighting_dynamic_offsets_.data());
 
 		vkCmdDraw(command_buffer, 3, 1, 0, 0);
 	}
 
-	void MainRenderPass::CreateRenderTargets()
+	void DeferredRenderPass::ResizeSwapchainObject()
 	{
+		auto rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// pipelines use dynamic viewport and scissor and the attachment formats do not change,
+		// so only the render targets, framebuffers and the descriptors reading them are rebuilt
+		for (auto& framebuffer : render_pass_framebuffer_)
+		{
+			rhi->DestroyFrameBuffer(framebuffer);
+		}
+		render_pass_framebuffer_.clear();
+
+		DestroyRenderTargets();
+		CreateRenderTargets();
+		CreateFramebuffer();
+
+		UpdateDeferredLightDescriptor();
+		UpdatePostProcessTargets();
+	}
+
+	void DeferredRenderPass::UpdatePostProcessTargets()
+	{
+		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
+		const std::vector<VkImageView>& swapchain_image_views = vulkan_rhi->GetSwapchainImageView();
+
+		// every frame reads the one backup buffer, the render pass of the next frame waits for the chain to be done with it
+		const std::vector<VkImageView> scene_color_views(swapchain_image_views.size(),
+			render_target_->attachments_[AttachmentType::BackupBuffer].image_view_);
+		post_process_pass_.SetTargets(scene_color_views, swapchain_image_views, vulkan_rhi->GetDisplayWidth(), vulkan_rhi->GetDisplayHeight());
+	}
+
+	void DeferredRenderPass::CreateRenderTargets()
+	{
+		if (!render_target_.has_value())
+		{
+			render_target_.emplace();
+		}
+
 		std::vector<RenderPassAttachment>& render_attachments = render_target_->attachments_;
 		render_attachments.resize(AttachmentType::AttachmentTypeCount);
 
 		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
 		uint32_t frame_width = vulkan_rhi->GetDisplayWidth();
 		uint32_t frame_height = vulkan_rhi->GetDisplayHeight();
+		render_target_->width_ = static_cast<uint16_t>(frame_width);
+		render_target_->height_ = static_cast<uint16_t>(frame_height);
 
 		render_attachments[AttachmentType::GBufferA_Normal].format_ = VK_FORMAT_R8G8B8A8_UNORM;
 		render_attachments[AttachmentType::GBufferB_Metallic_Roughness_Occlusion].format_ = VK_FORMAT_R8G8B8A8_UNORM;
 		render_attachments[AttachmentType::GBufferC_BaseColor].format_ = VK_FORMAT_R8G8B8A8_UNORM;
 		render_attachments[AttachmentType::DepthImage].format_ = vulkan_rhi->GetDepthImageFormat();
-		render_attachments[AttachmentType::BackupBuffer].format_ = VK_FORMAT_R8G8B8A8_UNORM;
+		render_attachments[AttachmentType::BackupBuffer].format_ = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+		// every attachment but the backup buffer is produced and consumed inside the subpass chain,
+		// so none of them has to leave tile memory, the backup buffer is sampled by the post process chain
+		struct AttachmentUsage
+		{
+			VkImageUsageFlags usage;
+			VkImageAspectFlags aspect;
+			uint32_t first_subpass;
+			uint32_t last_subpass;
+		};
 
+		const std::array<AttachmentUsage, AttachmentType::AttachmentTypeCount> attachment_usages =
+		{{
+			{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+				SubpassType::BasePass, SubpassType::DeferredLightingPass }, // GBufferA_Normal
+			{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+				SubpassType::BasePass, SubpassType::DeferredLightingPass }, // GBufferB_Metallic_Roughness_Occlusion
+			{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+				SubpassType::BasePass, SubpassType::DeferredLightingPass }, // GBufferC_BaseColor
+			{ VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+				SubpassType::BasePass, SubpassType::ForwardLightingPass }, // DepthImage
+			{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+				SubpassType::DeferredLightingPass, SubpassType::SubpassTypeCount }, // BackupBuffer, in use until the post process chain
+		}};
+
+		std::vector<RGAliasRequest> alias_requests;
+		std::vector<uint32_t> alias_attachments;
 		for (uint32_t i = 0; i < AttachmentType::AttachmentTypeCount; i++)
 		{
-			// create image
-			Resource<VkImage> image;
-			if (i == AttachmentType::GBufferA_Normal)
+			const AttachmentUsage& attachment_usage = attachment_usages[i];
+			RenderPassAttachment& attachment = render_attachments[i];
+
+			attachment.image_ = {};
+			attachment.image_.resource = vulkan_rhi->CreateUnboundImage(frame_width, frame_height, 1, 1, 1, attachment.format_,
+				attachment_usage.usage);
+			assert(attachment.image_.resource != VK_NULL_HANDLE);
+
+			const VkMemoryRequirements requirements = vulkan_rhi->GetImageMemoryRequirements(attachment.image_.resource);
+
+			// tile based gpus only back lazily allocated memory if the attachment spills out of tile memory
+			if (attachment_usage.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
 			{
-				image = vulkan_rhi->CreateImage(frame_width, frame_height, 0, 1, 1, render_attachments[AttachmentType::GBufferA_Normal].format_,
-					VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-				render_attachments[AttachmentType::GBufferA_Normal].image_ = image;
+				VkDeviceMemory memory = vulkan_rhi->AllocateMemory(requirements, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+				if (memory != VK_NULL_HANDLE && vulkan_rhi->BindImageMemory(attachment.image_.resource, memory, 0))
+				{
+					attachment.image_.memory = memory;
+					attachment.image_.allocation_size = requirements.size;
+					continue;
+				}
+				vulkan_rhi->FreeMemory(memory);
 			}
-			else if (i == AttachmentType::DepthImage)
+
+			RGAliasRequest request;
+			request.size = requirements.size;
+			request.alignment = requirements.alignment;
+			request.memory_type_bits = requirements.memoryTypeBits;
+			request.first_pass = attachment_usage.first_subpass;
+			request.last_pass = attachment_usage.last_subpass;
+			alias_requests.push_back(request);
+			alias_attachments.push_back(i);
+		}
+
+		if (!alias_requests.empty())
+		{
+			AllocateAliasedRenderTargets(alias_requests, alias_attachments);
+		}
+
+		for (uint32_t i = 0; i < AttachmentType::AttachmentTypeCount; i++)
+		{
+			render_attachments[i].image_view_ = vulkan_rhi->CreateImageView(render_attachments[i].image_.resource, render_attachments[i].format_,
+				attachment_usages[i].aspect, 0, 1, 1);
+		}
+	}
+
+	void DeferredRenderPass::AllocateAliasedRenderTargets(const std::vector<RGAliasRequest>& alias_requests, const std::vector<uint32_t>& alias_attachments)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		std::vector<RenderPassAttachment>& render_attachments = render_target_->attachments_;
+
+		std::vector<RGAliasBlock> alias_blocks;
+		const std::vector<uint32_t> block_indices = RenderGraph::AssignAliasBlocks(alias_requests, alias_blocks);
+
+		// attachments with disjoint subpass ranges share a block, the blocks themselves are placed
+		// one after another in as few allocations as the memory types allow
+		std::vector<VkMemoryRequirements> allocations;
+		std::vector<uint32_t> block_allocations(alias_blocks.size());
+		std::vector<VkDeviceSize> block_offsets(alias_blocks.size());
+		for (uint32_t block_index = 0; block_index < alias_blocks.size(); ++block_index)
+		{
+			const RGAliasBlock& block = alias_blocks[block_index];
+
+			VkDeviceSize alignment = 1;
+			for (uint32_t request : block.requests)
 			{
-				image = vulkan_rhi->CreateImage(frame_width, frame_height, 0, 1, 1, render_attachments[AttachmentType::GBufferA_Normal].format_,
-					VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-				render_attachments[AttachmentType::DepthImage].image_ = image;
+				alignment = std::max(alignment, alias_requests[request].alignment);
 			}
-			else if (i == AttachmentType::SwapChain)
+
+			auto allocation = std::find_if(allocations.begin(), allocations.end(),
+				[&block](const VkMemoryRequirements& requirements) { return (requirements.memoryTypeBits & block.memory_type_bits) != 0; });
+			if (allocation == allocations.end())
 			{
-				PEANUT_LOG_INFO("Skip swapchain image creat");
-				continue;
+				allocations.push_back({ 0, 1, block.memory_type_bits });
+				allocation = allocations.end() - 1;
 			}
-			else
+
+			const VkDeviceSize offset = RenderUtils::RoundToPowerOfTwo(allocation->size, static_cast<int>(alignment));
+			allocation->size = offset + block.size;
+			allocation->alignment = std::max(allocation->alignment, alignment);
+			allocation->memoryTypeBits &= block.memory_type_bits;
+
+			block_allocations[block_index] = static_cast<uint32_t>(allocation - allocations.begin());
+			block_offsets[block_index] = offset;
+		}
+
+		const size_t first_memory = render_target_memory_.size();
+		for (const VkMemoryRequirements& requirements : allocations)
+		{
+			VkDeviceMemory memory = rhi->AllocateMemory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (memory == VK_NULL_HANDLE)
 			{
-				image = vulkan_rhi->CreateImage(frame_width, frame_height, 0, 1, 1, render_attachments[i].format_,
-					VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
-				render_attachments[i].image_ = image;
+				PEANUT_LOG_FATAL("Failed to allocate {0} bytes of render target memory", requirements.size);
 			}
+			render_target_memory_.push_back(memory);
+		}
 
-			assert(image.resource != VK_NULL_HANDLE);
-			
-			// create image view
-			render_attachments[i].image_view_ = vulkan_rhi->CreateImageView(image.resource, render_attachments[i].format_, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 1);
+		for (uint32_t i = 0; i < alias_attachments.size(); ++i)
+		{
+			const uint32_t block_index = block_indices[i];
+			RenderPassAttachment& attachment = render_attachments[alias_attachments[i]];
+			VkDeviceMemory memory = render_target_memory_[first_memory + block_allocations[block_index]];
+			if (!rhi->BindImageMemory(attachment.image_.resource, memory, block_offsets[block_index]))
+			{
+				PEANUT_LOG_FATAL("Failed to bind render target memory");
+			}
+
+			// the memory is owned by the pass, not by the image
+			attachment.image_.memory = VK_NULL_HANDLE;
+			attachment.image_.allocation_size = alias_requests[i].size;
 		}
+
+		PEANUT_LOG_INFO("Render targets fall back to {0} aliased allocation(s) for {1} attachment(s)", allocations.size(), alias_attachments.size());
+	}
+
+	void DeferredRenderPass::DestroyRenderTargets()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		if (render_target_.has_value())
+		{
+			for (auto& attachment : render_target_->attachments_)
+			{
+				rhi->DestroyImageView(attachment.image_view_);
+				rhi->DestroyImage(attachment.image_);
+			}
+			render_target_->attachments_.clear();
+		}
+
+		for (VkDeviceMemory memory : render_target_memory_)
+		{
+			rhi->FreeMemory(memory);
+		}
+		render_target_memory_.clear();
 	}
 	
-	void MainRenderPass::CreateFramebuffer()
+	void DeferredRenderPass::CreateFramebuffer()
 	{
 		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
 		uint32_t frame_width = vulkan_rhi->GetDisplayWidth();
@@ -294,7 +644,6 @@ namespace peanut
 				render_attachments[AttachmentType::DepthImage].image_view_,
 				render_attachments[AttachmentType::BackupBuffer].image_view_,
 				// render_attachments[AttachmentType::BackupBufferEven].image_view_,
-				swapchain_image_view[i]
 			};
 
 			VkFramebufferCreateInfo framebuffer_create_info{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
@@ -309,7 +658,7 @@ namespace peanut
 		}
 	}
 
-	void MainRenderPass::CreateRenderPass()
+	void DeferredRenderPass::CreateRenderPass()
 	{
 		std::vector<RenderPassAttachment>& render_attachments = render_target_->attachments_;
 		std::vector<VkAttachmentDescription> attachments;
@@ -322,7 +671,7 @@ namespace peanut
 			render_attachments[AttachmentType::GBufferA_Normal].format_,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_CLEAR, // load op
-			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // stencil load op
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_UNDEFINED,
@@ -361,7 +710,7 @@ namespace peanut
 			render_attachments[AttachmentType::DepthImage].format_,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_UNDEFINED,
@@ -374,7 +723,7 @@ namespace peanut
 			render_attachments[AttachmentType::BackupBuffer].format_,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_STORE, // sampled by the post process chain
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_UNDEFINED,
@@ -394,23 +743,8 @@ namespace peanut
 		//	VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 		//};
 
-		// create swapchain image description
 		auto rhi = rhi_.lock();
 
-		VulkanRHI* vulkan_rhi = reinterpret_cast<VulkanRHI*>(rhi.get());
-		attachments[AttachmentType::SwapChain] =
-		{
-			0,
-			vulkan_rhi->GetSwapChainImageFormat(),
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-		};
-
 		// setup subpass information
 		std::vector<VkSubpassDescription> subpasses_desc;
 		subpasses_desc.resize(SubpassType::SubpassTypeCount);
@@ -522,39 +856,16 @@ namespace peanut
 		//	nullptr // reserve attachment
 		//};
 
-		// create color grading subpass description
-		VkAttachmentReference color_grading_input_attachment_refs;
-		color_grading_input_attachment_refs.attachment = AttachmentType::BackupBuffer; // from tone mapping pass
-		color_grading_input_attachment_refs.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		VkAttachmentReference color_grading_color_attachment_refs;
-		color_grading_color_attachment_refs.attachment = AttachmentType::SwapChain; // to swap chain
-		color_grading_color_attachment_refs.layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		subpasses_desc[SubpassType::ColorGradingPass] =
-		{
-			0,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			1,		 // input attachment counts
-			&color_grading_input_attachment_refs, // input attachment
-			1,		// color attachment counts
-			&color_grading_color_attachment_refs,
-			nullptr, // resolve attachment
-			nullptr,  // depth attachment
-			0,		 // reserve attachment counts
-			nullptr // reserve attachment
-		};
-
 		// create subpass dependency
 		std::vector<VkSubpassDependency> subpass_dependencies{};
-		subpass_dependencies.resize(SubpassType::SubpassTypeCount);
+		subpass_dependencies.resize(SubpassType::SubpassTypeCount + 1);
 		
-		// fixme: need it?
+		// also keeps the backup buffer from being cleared while the post process chain of the last frame reads it
 		subpass_dependencies[0] =
 		{
 			VK_SUBPASS_EXTERNAL,
 			SubpassType::BasePass,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
 			VK_ACCESS_SHADER_READ_BIT,
 			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
@@ -583,15 +894,16 @@ namespace peanut
 			VK_DEPENDENCY_BY_REGION_BIT
 		};
 
+		// the post process chain samples the backup buffer in compute and fragment shaders
 		subpass_dependencies[3] =
 		{
 			SubpassType::ForwardLightingPass,
-			SubpassType::ColorGradingPass,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
-			VK_DEPENDENCY_BY_REGION_BIT
+			VK_SUBPASS_EXTERNAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT,
+			0
 		};
 
 		//subpass_dependencies[4] =
@@ -621,7 +933,7 @@ namespace peanut
 		render_pass_ = renderpass;
 	}
 
-	void MainRenderPass::CreateDescriptorSetLayouts()
+	void DeferredRenderPass::CreateDescriptorSetLayouts()
 	{
 		render_descriptors_.resize(DescriptorLayoutType::DescriptorLayoutTypeCount);
 
@@ -652,12 +964,18 @@ namespace peanut
 			{1, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // gbuffer b
 			{2, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // gbuffer c
 			{3, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // depth image
-			{4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // irradiance
+			// 4 was the irradiance map, the irradiance sh coefficients are part of the light uniform buffer
 			{5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // prefiltered
 			{6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // brdf lut
 			{7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // directonal light shadow
-			// {8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // point light shadow
-			{9, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // light uniform buffer
+			{8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // local light shadow atlas
+			{9, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // light uniform buffer
+			{10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // point lights
+			{11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // spot lights
+			{12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // cluster light counts
+			{13, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // cluster light indices
+			{14, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // local shadow views
+			{15, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // reflection probe array
 		};
 
 		render_descriptors_[DescriptorLayoutType::DeferredLighting].descriptor_set_layout_ =
@@ -670,12 +988,12 @@ namespace peanut
 			{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // metallic roughness occlusion texture
 			{2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // base color texture
 			{3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // emissive texture
-			{4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // irradiance
+			// 4 was the irradiance map, the irradiance sh coefficients are part of the light uniform buffer
 			{5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // prefiltered
 			{6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // brdf lut
 			{7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // directonal light shadow
 			// {8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // point light shadow
-			{9, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // light uniform buffer
+			{9, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // light uniform buffer
 		};
 
 		render_descriptors_[DescriptorLayoutType::ForwardLighting].descriptor_set_layout_ =
@@ -690,18 +1008,17 @@ namespace peanut
 		render_descriptors_[DescriptorLayoutType::Skybox].descriptor_set_layout_ =
 			rhi->CreateDescriptorSetLayout(skybox_descriptor_layout_binding);
 
-		// color grading descriptor layout
-		std::vector<VkDescriptorSetLayoutBinding> color_grading_descriptor_layout_binding =
+		// object constants layout, one descriptor for every object of the frame moved by its dynamic offset
+		std::vector<VkDescriptorSetLayoutBinding> object_constants_descriptor_layout_binding =
 		{
-			{0, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // backbuffer
-			{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr} // color grading lut
+			{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr} // transform ubo
 		};
 
-		render_descriptors_[DescriptorLayoutType::ColorGrading].descriptor_set_layout_ =
-			rhi->CreateDescriptorSetLayout(color_grading_descriptor_layout_binding);
+		render_descriptors_[DescriptorLayoutType::ObjectConstants].descriptor_set_layout_ =
+			rhi->CreateDescriptorSetLayout(object_constants_descriptor_layout_binding);
 	}
 
-	void MainRenderPass::CreatePipelineLayouts()
+	void DeferredRenderPass::CreatePipelineLayouts()
 	{
 		auto rhi = rhi_.lock();
 		if (!rhi)
@@ -710,36 +1027,39 @@ namespace peanut
 			return;
 		}
 
-		// mesh gbuffer pipeline layout
+		render_pipelines_.resize(RenderPipelineType::PipelineTypeCount);
+
+		// mesh gbuffer pipeline layout, the transform is read from the object constants set
+		// so the push constants stay within the guaranteed 128 bytes
 		std::vector<VkPushConstantRange> push_constant_range =
 		{
-			// transform ubo
-			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(TransformUBO)},
 			// material ubo
-			{VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(TransformUBO), sizeof(MaterialPCO)}
+			{VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MaterialPCO)}
 		};
 		
 		all_push_constant_range_.insert(std::make_pair(RenderPipelineType::MeshGbuffer, push_constant_range));
+		all_push_constant_range_.insert(std::make_pair(RenderPipelineType::ForwardLighting, push_constant_range));
 		
 		std::vector<VkDescriptorSetLayout> set_layouts;
 		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::MeshGbuffer].descriptor_set_layout_);
+		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::ObjectConstants].descriptor_set_layout_);
 		render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_layout_ =
 			rhi->CreatePipelineLayout(set_layouts, push_constant_range);
 
 		set_layouts.clear();
-		push_constant_range.clear();
 
-		// deferred lighting pipeline layout
-		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::DeferredLighting].descriptor_set_layout_);
-		render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_layout_ =
+		// forward lighting pipeline layout
+		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::ForwardLighting].descriptor_set_layout_);
+		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::ObjectConstants].descriptor_set_layout_);
+		render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_layout_ =
 			rhi->CreatePipelineLayout(set_layouts, push_constant_range);
 
 		set_layouts.clear();
 		push_constant_range.clear();
-		
-		// forward lighting pipeline layout
-		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::ForwardLighting].descriptor_set_layout_);
-		render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_layout_ =
+
+		// deferred lighting pipeline layout
+		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::DeferredLighting].descriptor_set_layout_);
+		render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_layout_ =
 			rhi->CreatePipelineLayout(set_layouts, push_constant_range);
 
 		set_layouts.clear();
@@ -747,22 +1067,22 @@ namespace peanut
 		
 		// skybox pipeline layout
 		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::Skybox].descriptor_set_layout_);
+		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::ObjectConstants].descriptor_set_layout_);
 		render_pipelines_[RenderPipelineType::Skybox].pipeline_layout_ =
 			rhi->CreatePipelineLayout(set_layouts, push_constant_range);
 
-		// color grading pipeline layout
-		set_layouts.clear();
-		set_layouts.push_back(render_descriptors_[DescriptorLayoutType::ColorGrading].descriptor_set_layout_);
-		render_pipelines_[RenderPipelineType::ColorGrading].pipeline_layout_ =
-			rhi->CreatePipelineLayout(set_layouts, push_constant_range);
-
 	}
 
-	void MainRenderPass::CreatePipelines()
+	void DeferredRenderPass::CreatePipelines()
 	{
 		auto rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
 
+		if (!pipeline_compile_pool_)
+		{
+			pipeline_compile_pool_ = std::make_unique<ThreadPool>();
+		}
+
 		std::vector<VkVertexInputBindingDescription> vertex_input_binding_descs;
 		vertex_input_binding_descs.resize(1, VkVertexInputBindingDescription());
 		vertex_input_binding_descs[0].binding = 0;
@@ -793,102 +1113,240 @@ namespace peanut
 		vertex_input_attribute_descs[3].format = VK_FORMAT_R32G32_SFLOAT;
 		vertex_input_attribute_descs[3].offset = offsetof(Mesh::Vertex, texcoord);
 
-		VkPipelineVertexInputStateCreateInfo vertex_input_ci{};
-		vertex_input_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertex_input_ci.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_input_binding_descs.size());
-		vertex_input_ci.pVertexBindingDescriptions = vertex_input_binding_descs.data();
-		vertex_input_ci.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_input_attribute_descs.size());
-		vertex_input_ci.pVertexAttributeDescriptions = vertex_input_attribute_descs.data();
-
-		std::vector<VkPipelineShaderStageCreateInfo> shader_stage_cis =
-		{
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "mesh.vert", VK_SHADER_STAGE_VERTEX_BIT),
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "mesh_gbuffer.frag", VK_SHADER_STAGE_FRAGMENT_BIT)
-		};
+		// every pipeline gets its own copy of the state, so the shared cis below can be edited
+		// for the next pipeline while the previous one is still compiling on a worker thread.
+		// shader modules are resolved here because ShaderManager is not thread safe.
 
+		// mesh gbuffer
 		for (int i = 0; i < 4; ++i)
 		{
 			color_blend_attachment_states.push_back(color_blend_attachment_states.front());
 		}
 
-		color_blend_state_ci.attachmentCount = static_cast<uint32_t>(color_blend_attachment_states.size());
-		color_blend_state_ci.pAttachments = color_blend_attachment_states.data();
-
-		// create pipeline 
-		pipeline_create_info_.stageCount = static_cast<uint32_t>(shader_stage_cis.size());
-		pipeline_create_info_.pStages = shader_stage_cis.data();
-		pipeline_create_info_.pVertexInputState = &vertex_input_ci;
-		pipeline_create_info_.renderPass = *render_pass_;
-		pipeline_create_info_.subpass = SubpassType::BasePass;
-		pipeline_create_info_.layout = render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_layout_;
-
-		// mesh gbuffer
-		render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_ = rhi->CreateGraphicsPipeline(pipeline_cache_, 1, &pipeline_create_info_);
+		GraphicsPipelineState& gbuffer_state = pipeline_states_[RenderPipelineType::MeshGbuffer];
+		gbuffer_state = SnapshotGraphicsPipelineState(render_pipelines_[RenderPipelineType::MeshGbuffer].pipeline_layout_, SubpassType::BasePass);
+		gbuffer_state.vertex_bindings = vertex_input_binding_descs;
+		gbuffer_state.vertex_attributes = vertex_input_attribute_descs;
+		AddShaderStage(gbuffer_state, "mesh.vert", VK_SHADER_STAGE_VERTEX_BIT);
+		AddShaderStage(gbuffer_state, "mesh_gbuffer.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
 
 		// foward lighting
-		color_blend_state_ci.attachmentCount = 1;
+		color_blend_attachment_states.resize(1);
 		color_blend_attachment_states[0].blendEnable = VK_TRUE;
-		shader_stage_cis[1] = ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "forward_lighting.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
-		pipeline_create_info_.layout = render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_layout_;
-		pipeline_create_info_.subpass = SubpassType::ForwardLightingPass;
-		render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_ = rhi->CreateGraphicsPipeline(pipeline_cache_, 1, &pipeline_create_info_);
+
+		GraphicsPipelineState& forward_state = pipeline_states_[RenderPipelineType::ForwardLighting];
+		forward_state = SnapshotGraphicsPipelineState(render_pipelines_[RenderPipelineType::ForwardLighting].pipeline_layout_, SubpassType::ForwardLightingPass);
+		forward_state.vertex_bindings = vertex_input_binding_descs;
+		forward_state.vertex_attributes = vertex_input_attribute_descs;
+		AddShaderStage(forward_state, "mesh.vert", VK_SHADER_STAGE_VERTEX_BIT);
+		AddShaderStage(forward_state, "forward_lighting.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
 
 		// skybox pipeline
-		shader_stage_cis =
-		{
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "skybox.vert", VK_SHADER_STAGE_VERTEX_BIT),
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "skybox.frag", VK_SHADER_STAGE_FRAGMENT_BIT)
-		};
 		color_blend_attachment_states[0].blendEnable = VK_FALSE;
 		depth_stencil_state_ci.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 		rasterization_state_ci.cullMode = VK_CULL_MODE_NONE;
-		pipeline_create_info_.layout = render_pipelines_[RenderPipelineType::Skybox].pipeline_layout_;
-		pipeline_create_info_.subpass = SubpassType::ForwardLightingPass;
-		render_pipelines_[RenderPipelineType::Skybox].pipeline_ = rhi->CreateGraphicsPipeline(pipeline_cache_, 1, &pipeline_create_info_);
 
-		// deferred lighting
-		shader_stage_cis = 
-		{
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "screen.vert", VK_SHADER_STAGE_VERTEX_BIT),
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "deferred_lighting.frag", VK_SHADER_STAGE_FRAGMENT_BIT)
-		};
-		rasterization_state_ci.cullMode = VK_CULL_MODE_NONE;
+		GraphicsPipelineState& skybox_state = pipeline_states_[RenderPipelineType::Skybox];
+		skybox_state = SnapshotGraphicsPipelineState(render_pipelines_[RenderPipelineType::Skybox].pipeline_layout_, SubpassType::ForwardLightingPass);
+		skybox_state.vertex_bindings = vertex_input_binding_descs;
+		skybox_state.vertex_attributes = vertex_input_attribute_descs;
+		AddShaderStage(skybox_state, "skybox.vert", VK_SHADER_STAGE_VERTEX_BIT);
+		AddShaderStage(skybox_state, "skybox.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+		// deferred lighting, full screen triangle without vertex input
 		depth_stencil_state_ci.depthTestEnable = VK_FALSE;
 		depth_stencil_state_ci.depthWriteEnable = VK_FALSE;
 
-		color_blend_state_ci.attachmentCount = 1;
-		color_blend_attachment_states[0].blendEnable = VK_FALSE;
+		GraphicsPipelineState& deferred_state = pipeline_states_[RenderPipelineType::DeferredLighting];
+		deferred_state = SnapshotGraphicsPipelineState(render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_layout_, SubpassType::DeferredLightingPass);
+		AddShaderStage(deferred_state, "screen.vert", VK_SHADER_STAGE_VERTEX_BIT);
+		AddShaderStage(deferred_state, "deferred_lighting.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-		VkPipelineVertexInputStateCreateInfo deferred_light_vertex_input_ci{};
-		deferred_light_vertex_input_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		for (uint32_t i = 0; i < RenderPipelineType::PipelineTypeCount; ++i)
+		{
+			pending_pipelines_[i] = CreateGraphicsPipelineAsync(*pipeline_compile_pool_, pipeline_states_[i]);
+		}
 
-		pipeline_create_info_.pVertexInputState = &deferred_light_vertex_input_ci;
-		pipeline_create_info_.layout = render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_layout_;
-		pipeline_create_info_.subpass = SubpassType::DeferredLightingPass;
+		if (shader_reload_listener_ == kInvalidListener)
+		{
+			shader_reload_listener_ = ShaderManager::Get().AddReloadListener(
+				[this](const std::string& shader_name) { RebuildPipelinesWithShader(shader_name); });
+		}
 
-		render_pipelines_[RenderPipelineType::DeferredLighting].pipeline_ = rhi->CreateGraphicsPipeline(pipeline_cache_, 1, &pipeline_create_info_);
+		// only the opaque deferred path is drawn by the first frame, skybox and forward
+		// pipelines keep compiling in the background and are waited for on first use
+		GetPipeline(RenderPipelineType::MeshGbuffer);
+		GetPipeline(RenderPipelineType::DeferredLighting);
+	}
 
-		// color grading -- todo: remove to post process pass
-		shader_stage_cis =
+	VkPipeline DeferredRenderPass::GetPipeline(RenderPipelineType::Type type)
+	{
+		std::future<VkPipeline>& pending_pipeline = pending_pipelines_[type];
+		if (pending_pipeline.valid())
 		{
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "screen.vert", VK_SHADER_STAGE_VERTEX_BIT),
-			ShaderManager::Get().GetShaderStageCreateInfo(rhi_, "color_grading.frag", VK_SHADER_STAGE_FRAGMENT_BIT)
-		};
+			render_pipelines_[type].pipeline_ = pending_pipeline.get();
+			if (render_pipelines_[type].pipeline_ == VK_NULL_HANDLE)
+			{
+				PEANUT_LOG_ERROR("Failed to create main render pass pipeline {0}", static_cast<uint32_t>(type));
+			}
+
+			// the last background compile is done, persist what it added to the cache
+			const bool all_resolved = std::none_of(pending_pipelines_.begin(), pending_pipelines_.end(),
+				[](const std::future<VkPipeline>& pipeline) { return pipeline.valid(); });
+			if (all_resolved)
+			{
+				SavePipelineCache();
+			}
+		}
+
+		return render_pipelines_[type].pipeline_;
+	}
+
+	void DeferredRenderPass::RebuildPipelinesWithShader(const std::string& shader_name)
+	{
+		auto rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		WaitPendingPipelines();
+
+		// recompile only the pipelines that reference the reloaded shader, in parallel
+		std::vector<RenderPipelineType::Type> rebuild_types;
+		for (uint32_t i = 0; i < RenderPipelineType::PipelineTypeCount; ++i)
+		{
+			GraphicsPipelineState& state = pipeline_states_[i];
+			if (std::find(state.shader_names.begin(), state.shader_names.end(), shader_name) == state.shader_names.end())
+			{
+				continue;
+			}
+
+			RefreshShaderStages(state);
+			pending_pipelines_[i] = CreateGraphicsPipelineAsync(*pipeline_compile_pool_, state);
+			rebuild_types.push_back(static_cast<RenderPipelineType::Type>(i));
+		}
+
+		// the device is idle during reload, so the old pipelines can go right away
+		for (RenderPipelineType::Type type : rebuild_types)
+		{
+			// variants are recompiled from the refreshed state on their next draw
+			DestroyPipelineVariants(type);
+
+			VkPipeline old_pipeline = render_pipelines_[type].pipeline_;
+			GetPipeline(type);
+			if (old_pipeline != VK_NULL_HANDLE && render_pipelines_[type].pipeline_ != VK_NULL_HANDLE)
+			{
+				rhi->DestroyPipeline(old_pipeline);
+			}
+			else if (render_pipelines_[type].pipeline_ == VK_NULL_HANDLE)
+			{
+				// keep rendering with the previous version if the new shader does not link
+				render_pipelines_[type].pipeline_ = old_pipeline;
+			}
+		}
+	}
+
+	void DeferredRenderPass::RequestPipelineVariant(RenderPipelineType::Type type, uint32_t feature_mask)
+	{
+		const uint64_t variant_key = GetPipelineVariantKey(type, feature_mask);
+		if (pipeline_variants_.count(variant_key) != 0 || pending_pipeline_variants_.count(variant_key) != 0)
+		{
+			return;
+		}
+
+		GraphicsPipelineState variant_state = pipeline_states_[type];
+		SetSpecializationConstant(variant_state, MATERIAL_FEATURE_CONSTANT_ID, feature_mask, VK_SHADER_STAGE_FRAGMENT_BIT);
+		if (feature_mask & MATERIAL_FEATURE_DOUBLE_SIDED)
+		{
+			variant_state.rasterization_state.cullMode = VK_CULL_MODE_NONE;
+		}
+
+		pending_pipeline_variants_[variant_key] = CreateGraphicsPipelineAsync(*pipeline_compile_pool_, std::move(variant_state));
+	}
+
+	VkPipeline DeferredRenderPass::GetPipelineVariant(RenderPipelineType::Type type, uint32_t feature_mask)
+	{
+		const uint64_t variant_key = GetPipelineVariantKey(type, feature_mask);
+
+		auto pending_variant = pending_pipeline_variants_.find(variant_key);
+		if (pending_variant == pending_pipeline_variants_.end() && pipeline_variants_.count(variant_key) == 0)
+		{
+			RequestPipelineVariant(type, feature_mask);
+			pending_variant = pending_pipeline_variants_.find(variant_key);
+		}
+
+		if (pending_variant != pending_pipeline_variants_.end())
+		{
+			VkPipeline pipeline = pending_variant->second.get();
+			pending_pipeline_variants_.erase(pending_variant);
+			if (pipeline == VK_NULL_HANDLE)
+			{
+				PEANUT_LOG_ERROR("Failed to create variant {0} of main render pass pipeline {1}", feature_mask, static_cast<uint32_t>(type));
+			}
+
+			// a failed variant is cached too, so it is not recompiled every frame
+			pipeline_variants_[variant_key] = pipeline;
+			if (pending_pipeline_variants_.empty())
+			{
+				SavePipelineCache();
+			}
+		}
 
-		pipeline_create_info_.layout = render_pipelines_[RenderPipelineType::ColorGrading].pipeline_layout_;
-		pipeline_create_info_.subpass = SubpassType::ColorGradingPass;
-		render_pipelines_[RenderPipelineType::ColorGrading].pipeline_ = rhi->CreateGraphicsPipeline(pipeline_cache_, 1, &pipeline_create_info_);
+		VkPipeline pipeline = pipeline_variants_[variant_key];
+		// the unspecialized pipeline enables every material feature
+		return pipeline != VK_NULL_HANDLE ? pipeline : GetPipeline(type);
 	}
 
-	void MainRenderPass::CreateDescriptorSets()
+	void DeferredRenderPass::DestroyPipelineVariants(RenderPipelineType::Type type)
+	{
+		auto rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		auto is_type = [type](uint64_t variant_key) { return (variant_key >> 32) == type; };
+
+		for (auto it = pending_pipeline_variants_.begin(); it != pending_pipeline_variants_.end();)
+		{
+			if (!is_type(it->first))
+			{
+				++it;
+				continue;
+			}
+
+			VkPipeline pipeline = it->second.get();
+			if (pipeline != VK_NULL_HANDLE)
+				rhi->DestroyPipeline(pipeline);
+			it = pending_pipeline_variants_.erase(it);
+		}
+
+		for (auto it = pipeline_variants_.begin(); it != pipeline_variants_.end();)
+		{
+			if (!is_type(it->first))
+			{
+				++it;
+				continue;
+			}
+
+			if (it->second != VK_NULL_HANDLE)
+				rhi->DestroyPipeline(it->second);
+			it = pipeline_variants_.erase(it);
+		}
+	}
+
+	void DeferredRenderPass::WaitPendingPipelines()
+	{
+		for (uint32_t i = 0; i < RenderPipelineType::PipelineTypeCount; ++i)
+		{
+			GetPipeline(static_cast<RenderPipelineType::Type>(i));
+		}
+	}
+
+	void DeferredRenderPass::CreateDescriptorSets()
 	{
 		CreateDeferredLightDescriptor();
 		CreateForwardLightDescriptor();
 		CreateSkyboxDescriptor();
-		CreateColorGradingDescriptor();
+		CreateObjectConstantsDescriptor();
 	}
 
-	VkDescriptorSet MainRenderPass::CreateGbufferDescriptor()
+	VkDescriptorSet DeferredRenderPass::CreateGbufferDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
@@ -896,10 +1354,10 @@ namespace peanut
 
 		render_descriptors_[DescriptorLayoutType::MeshGbuffer].descritptor_set_ =
 			rhi->AllocateDescriptor(render_descriptors_[DescriptorLayoutType::MeshGbuffer].descriptor_set_layout_);
-		return render_descriptors_[DescriptorLayoutType::ForwardLighting].descritptor_set_;
+		return render_descriptors_[DescriptorLayoutType::MeshGbuffer].descritptor_set_;
 	}
 
-	void MainRenderPass::CreateDeferredLightDescriptor()
+	void DeferredRenderPass::CreateDeferredLightDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
@@ -909,7 +1367,7 @@ namespace peanut
 			rhi->AllocateDescriptor(render_descriptors_[DescriptorLayoutType::DeferredLighting].descriptor_set_layout_);
 	}
 
-	VkDescriptorSet MainRenderPass::CreateForwardLightDescriptor()
+	VkDescriptorSet DeferredRenderPass::CreateForwardLightDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
@@ -920,7 +1378,7 @@ namespace peanut
 		return render_descriptors_[DescriptorLayoutType::ForwardLighting].descritptor_set_;
 	}
 
-	void MainRenderPass::CreateSkyboxDescriptor()
+	void DeferredRenderPass::CreateSkyboxDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
@@ -930,53 +1388,37 @@ namespace peanut
 			rhi->AllocateDescriptor(render_descriptors_[DescriptorLayoutType::Skybox].descriptor_set_layout_);
 	}
 
-	void MainRenderPass::CreateColorGradingDescriptor()
+	void DeferredRenderPass::CreateObjectConstantsDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
 		assert(rhi.get() != nullptr);
 
-		render_descriptors_[DescriptorLayoutType::ColorGrading].descritptor_set_ =
-			rhi->AllocateDescriptor(render_descriptors_[DescriptorLayoutType::ColorGrading].descriptor_set_layout_);
+		render_descriptors_[DescriptorLayoutType::ObjectConstants].descritptor_set_ =
+			rhi->AllocateDescriptor(render_descriptors_[DescriptorLayoutType::ObjectConstants].descriptor_set_layout_);
 	}
 
-	void MainRenderPass::UpdateColorGradingDescriptor()
+	void DeferredRenderPass::UpdateObjectConstantsDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
 		assert(rhi.get() != nullptr);
-		VulkanRHI* vulkan_rhi = reinterpret_cast<VulkanRHI*>(rhi.get());
 
-		VkDescriptorImageInfo color_image_info = {};
-		color_image_info.sampler = vulkan_rhi->GetOrCreateSampler(VulkanRHI::Linear);
-		color_image_info.imageView = render_target_->attachments_[AttachmentType::BackupBuffer].image_view_;
-		color_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		// written once, every draw selects its object with the dynamic offset
+		VkDescriptorBufferInfo transform_buffer_info = frame_uniform_allocator_.GetDescriptorInfo(sizeof(TransformUBO));
 
-		VkDescriptorImageInfo lut_image_info = {};
-		lut_image_info.sampler = color_grading_render_data_->color_grading_lut_texture.image_sampler; // todo: get lut image sampler
-		lut_image_info.imageView = color_grading_render_data_->color_grading_lut_texture.image_view; // todo: add lut image view
-		lut_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		VkWriteDescriptorSet descriptor_write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		descriptor_write.dstSet = render_descriptors_[DescriptorLayoutType::ObjectConstants].descritptor_set_;
+		descriptor_write.dstBinding = 0;
+		descriptor_write.dstArrayElement = 0;
+		descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		descriptor_write.descriptorCount = 1;
+		descriptor_write.pBufferInfo = &transform_buffer_info;
 
-
-		std::array<VkWriteDescriptorSet, 2> descriptor_writes = {};
-		descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_writes[0].descriptorCount = 1;
-		descriptor_writes[0].dstArrayElement = 0;
-		descriptor_writes[0].dstBinding = 0;
-		descriptor_writes[0].dstSet = render_descriptors_[DescriptorLayoutType::ColorGrading].descritptor_set_;
-		descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-
-		descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_writes[1].descriptorCount = 1;
-		descriptor_writes[1].dstArrayElement = 0;
-		descriptor_writes[1].dstBinding = 1;
-		descriptor_writes[1].dstSet = render_descriptors_[DescriptorLayoutType::ColorGrading].descritptor_set_;
-		descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-
-		vulkan_rhi->UpdateDescriptorSets(descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+		rhi->UpdateDescriptorSets(1, &descriptor_write, 0, nullptr);
 	}
 
-	void MainRenderPass::UpdateDeferredLightDescriptor()
+	void DeferredRenderPass::UpdateDeferredLightDescriptor()
 	{
 		auto rhi = rhi_.lock();
 
@@ -1003,12 +1445,6 @@ namespace peanut
 		depth_image_info.imageView = render_target_->attachments_[AttachmentType::DepthImage].image_view_;
 		depth_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		// ibl irradiance texture
-		VkDescriptorImageInfo irradiance_texture_info = {};
-		irradiance_texture_info.sampler = lighting_render_data_.ibl_light_texture.ibl_irradiance_texture.image_sampler;
-		irradiance_texture_info.imageView = lighting_render_data_.ibl_light_texture.ibl_irradiance_texture.image_view; // todo: get irradiance texture image view
-		irradiance_texture_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
 		// ibl prefiltered texture
 		VkDescriptorImageInfo prefiltered_texture_info = {};
 		prefiltered_texture_info.sampler = lighting_render_data_.ibl_light_texture.ibl_prefilter_texture.image_sampler;
@@ -1027,21 +1463,29 @@ namespace peanut
 		directional_light_shadow_info.imageView = lighting_render_data_.directional_light_shadow_map.image_view;
 		directional_light_shadow_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		// point light shadow texture
-		//VkDescriptorImageInfo point_light_shadow_info = {};
-		//point_light_shadow_info.sampler = vulkan_rhi->GetOrCreateSampler(VulkanRHI::Nearest);
-		//point_light_shadow_info.imageView = VK_NULL_HANDLE;
-		//point_light_shadow_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		// point and spot light shadow atlas
+		VkDescriptorImageInfo local_light_shadow_info = {};
+		local_light_shadow_info.sampler = lighting_render_data_.local_light_shadow_atlas.image_sampler;
+		local_light_shadow_info.imageView = lighting_render_data_.local_light_shadow_atlas.image_view;
+		local_light_shadow_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		// light uniform buffer
-		if (!lighting_data_uniform_buffer_.has_value())
-		{
-			lighting_data_uniform_buffer_ = AllocateSubstorageFromUniformBuffer<LightingUBO>();
-		}
-		
-		VkDescriptorBufferInfo& light_uniform_buffer_info = lighting_data_uniform_buffer_->descriptor_info;
+		// cube map array of the captured reflection probes
+		VkDescriptorImageInfo reflection_probe_info = {};
+		reflection_probe_info.sampler = lighting_render_data_.reflection_probe_array.image_sampler;
+		reflection_probe_info.imageView = lighting_render_data_.reflection_probe_array.image_view;
+		reflection_probe_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		std::array<VkWriteDescriptorSet, 9> descriptor_writes = {};
+		// light uniform buffer and lights, moved to the data of the current frame by dynamic offsets
+		VkDescriptorBufferInfo light_uniform_buffer_info = frame_uniform_allocator_.GetDescriptorInfo(sizeof(LightingUBO));
+		VkDescriptorBufferInfo point_lights_info = frame_uniform_allocator_.GetDescriptorInfo(sizeof(PointLight) * MAX_POINT_LIGHT_NUM);
+		VkDescriptorBufferInfo spot_lights_info = frame_uniform_allocator_.GetDescriptorInfo(sizeof(SpotLight) * MAX_SPOT_LIGHT_NUM);
+		VkDescriptorBufferInfo local_shadow_views_info = frame_uniform_allocator_.GetDescriptorInfo(sizeof(LocalShadowView) * MAX_LOCAL_SHADOW_VIEW_NUM);
+
+		// light lists of the clusters
+		VkDescriptorBufferInfo cluster_light_counts_info = light_culling_pass_.GetClusterLightCountsInfo();
+		VkDescriptorBufferInfo cluster_light_indices_info = light_culling_pass_.GetClusterLightIndicesInfo();
+
+		std::array<VkWriteDescriptorSet, 15> descriptor_writes = {};
 
 		descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptor_writes[0].dstSet = render_descriptors_[DescriptorLayoutType::DeferredLighting].descritptor_set_;
@@ -1076,39 +1520,61 @@ namespace peanut
 		descriptor_writes[3].pImageInfo = &depth_image_info;
 
 		descriptor_writes[4] = descriptor_writes[3];
-		descriptor_writes[4].dstBinding = 4;
+		descriptor_writes[4].dstBinding = 5;
 		descriptor_writes[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptor_writes[4].descriptorCount = 1;
-		descriptor_writes[4].pImageInfo = &irradiance_texture_info;
+		descriptor_writes[4].pImageInfo = &prefiltered_texture_info;
 
 		descriptor_writes[5] = descriptor_writes[4];
-		descriptor_writes[5].dstBinding = 5;
-		descriptor_writes[5].pImageInfo = &prefiltered_texture_info;
+		descriptor_writes[5].dstBinding = 6;
+		descriptor_writes[5].pImageInfo = &brdf_lut_info;
 
 		descriptor_writes[6] = descriptor_writes[4];
-		descriptor_writes[6].dstBinding = 6;
-		descriptor_writes[6].pImageInfo = &brdf_lut_info;
+		descriptor_writes[6].dstBinding = 7;
+		descriptor_writes[6].pImageInfo = &directional_light_shadow_info;
 
 		descriptor_writes[7] = descriptor_writes[4];
-		descriptor_writes[7].dstBinding = 7;
-		descriptor_writes[7].pImageInfo = &directional_light_shadow_info;
-
-		//descriptor_writes[8] = descriptor_writes[4];
-		//descriptor_writes[8].dstBinding = 8;
-		//descriptor_writes[8].pImageInfo = &point_light_shadow_info;
+		descriptor_writes[7].dstBinding = 8;
+		descriptor_writes[7].pImageInfo = &local_light_shadow_info;
 
 		descriptor_writes[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptor_writes[8].dstSet = render_descriptors_[DescriptorLayoutType::DeferredLighting].descritptor_set_;
 		descriptor_writes[8].dstBinding = 9;
 		descriptor_writes[8].dstArrayElement = 0;
-		descriptor_writes[8].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptor_writes[8].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		descriptor_writes[8].descriptorCount = 1;
 		descriptor_writes[8].pBufferInfo = &light_uniform_buffer_info;
 
+		descriptor_writes[9] = descriptor_writes[8];
+		descriptor_writes[9].dstBinding = 10;
+		descriptor_writes[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		descriptor_writes[9].pBufferInfo = &point_lights_info;
+
+		descriptor_writes[10] = descriptor_writes[9];
+		descriptor_writes[10].dstBinding = 11;
+		descriptor_writes[10].pBufferInfo = &spot_lights_info;
+
+		descriptor_writes[11] = descriptor_writes[8];
+		descriptor_writes[11].dstBinding = 12;
+		descriptor_writes[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptor_writes[11].pBufferInfo = &cluster_light_counts_info;
+
+		descriptor_writes[12] = descriptor_writes[11];
+		descriptor_writes[12].dstBinding = 13;
+		descriptor_writes[12].pBufferInfo = &cluster_light_indices_info;
+
+		descriptor_writes[13] = descriptor_writes[9];
+		descriptor_writes[13].dstBinding = 14;
+		descriptor_writes[13].pBufferInfo = &local_shadow_views_info;
+
+		descriptor_writes[14] = descriptor_writes[4];
+		descriptor_writes[14].dstBinding = 15;
+		descriptor_writes[14].pImageInfo = &reflection_probe_info;
+
 		vulkan_rhi->UpdateDescriptorSets(descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
 	}
 
-	void MainRenderPass::UpdateForwardLightDescriptor(VkCommandBuffer command_buffer, const PbrMaterial& material_data, VkDescriptorSet dst_descriptor_set)
+	void DeferredRenderPass::UpdateForwardLightDescriptor(VkCommandBuffer command_buffer, const PbrMaterial& material_data, VkDescriptorSet dst_descriptor_set)
 	{
 		// same as deffred lighting
 		auto rhi = rhi_.lock();
@@ -1139,12 +1605,6 @@ namespace peanut
 		emissive_image_info.sampler = vulkan_rhi->GetMipmapSampler(material_data.emissive_texture->width,
 			material_data.emissive_texture->height);
 
-		// ibl irradiance texture
-		VkDescriptorImageInfo irradiance_texture_info = {};
-		irradiance_texture_info.sampler = lighting_render_data_.ibl_light_texture.ibl_irradiance_texture.image_sampler;
-		irradiance_texture_info.imageView = lighting_render_data_.ibl_light_texture.ibl_irradiance_texture.image_view; // todo: get irradiance texture image view
-		irradiance_texture_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
 		// ibl prefiltered texture
 		VkDescriptorImageInfo prefiltered_texture_info = {};
 		prefiltered_texture_info.sampler = lighting_render_data_.ibl_light_texture.ibl_prefilter_texture.image_sampler;
@@ -1163,14 +1623,9 @@ namespace peanut
 		directional_light_shadow_info.imageView = lighting_render_data_.directional_light_shadow_map.image_view;
 		directional_light_shadow_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		if (!lighting_data_uniform_buffer_.has_value())
-		{
-			lighting_data_uniform_buffer_ = AllocateSubstorageFromUniformBuffer<LightingUBO>();
-		}
-
-		VkDescriptorBufferInfo& light_uniform_buffer_info = lighting_data_uniform_buffer_->descriptor_info;
+		VkDescriptorBufferInfo light_uniform_buffer_info = frame_uniform_allocator_.GetDescriptorInfo(sizeof(LightingUBO));
 
-		std::array<VkWriteDescriptorSet, 9> descriptor_writes = {};
+		std::array<VkWriteDescriptorSet, 8> descriptor_writes = {};
 
 		descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptor_writes[0].dstSet = render_descriptors_[DescriptorLayoutType::ForwardLighting].descritptor_set_;
@@ -1193,37 +1648,33 @@ namespace peanut
 		descriptor_writes[3].pImageInfo = &emissive_image_info;
 
 		descriptor_writes[4] = descriptor_writes[0];
-		descriptor_writes[4].dstBinding = 4;
-		descriptor_writes[4].pImageInfo = &irradiance_texture_info;
+		descriptor_writes[4].dstBinding = 5;
+		descriptor_writes[4].pImageInfo = &prefiltered_texture_info;
 
 		descriptor_writes[5] = descriptor_writes[0];
-		descriptor_writes[5].dstBinding = 5;
-		descriptor_writes[5].pImageInfo = &prefiltered_texture_info;
+		descriptor_writes[5].dstBinding = 6;
+		descriptor_writes[5].pImageInfo = &brdf_lut_info;
 
 		descriptor_writes[6] = descriptor_writes[0];
-		descriptor_writes[6].dstBinding = 6;
-		descriptor_writes[6].pImageInfo = &brdf_lut_info;
-
-		descriptor_writes[7] = descriptor_writes[0];
-		descriptor_writes[7].dstBinding = 7;
-		descriptor_writes[7].pImageInfo = &directional_light_shadow_info;
+		descriptor_writes[6].dstBinding = 7;
+		descriptor_writes[6].pImageInfo = &directional_light_shadow_info;
 
 		//descriptor_writes[8] = descriptor_writes[4];
 		//descriptor_writes[8].dstBinding = 8;
 		//descriptor_writes[8].pImageInfo = &point_light_shadow_info;
 
-		descriptor_writes[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_writes[8].dstSet = render_descriptors_[DescriptorLayoutType::ForwardLighting].descritptor_set_;
-		descriptor_writes[8].dstBinding = 9;
-		descriptor_writes[8].dstArrayElement = 0;
-		descriptor_writes[8].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptor_writes[8].descriptorCount = 1;
-		descriptor_writes[8].pBufferInfo = &light_uniform_buffer_info;
+		descriptor_writes[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_writes[7].dstSet = render_descriptors_[DescriptorLayoutType::ForwardLighting].descritptor_set_;
+		descriptor_writes[7].dstBinding = 9;
+		descriptor_writes[7].dstArrayElement = 0;
+		descriptor_writes[7].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		descriptor_writes[7].descriptorCount = 1;
+		descriptor_writes[7].pBufferInfo = &light_uniform_buffer_info;
 
 		vulkan_rhi->UpdateDescriptorSets(descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
 	}
 
-	void MainRenderPass::UpdateGbufferDescriptor(VkCommandBuffer command_buffer, const PbrMaterial& material_data, VkDescriptorSet dst_descriptor_set)
+	void DeferredRenderPass::UpdateGbufferDescriptor(VkCommandBuffer command_buffer, const PbrMaterial& material_data, VkDescriptorSet dst_descriptor_set)
 	{
 		auto rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
@@ -1277,7 +1728,7 @@ namespace peanut
 		vulkan_rhi->UpdateDescriptorSets(4, write_descriptor_set, 0, nullptr);
 	}
 
-	void MainRenderPass::UpdateSkyboxDescriptor()
+	void DeferredRenderPass::UpdateSkyboxDescriptor()
 	{
 		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
 		VkDescriptorImageInfo skybox_image_info = {};
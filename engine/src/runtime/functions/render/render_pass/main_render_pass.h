@@ -1,9 +1,18 @@
 #pragma once
 
 #include "render_pass_base.h"
+#include "light_culling_pass.h"
+#include "directional_shadow_pass.h"
+#include "local_light_shadow_pass.h"
+#include "reflection_probe_pass.h"
+#include "post_process_pass.h"
+#include "../render_graph/render_graph.h"
+#include "../draw_list.h"
+#include "runtime/core/thread/thread_pool.h"
 
 #include <array>
 #include <map>
+#include <unordered_map>
 
 namespace peanut
 {
@@ -15,7 +24,6 @@ namespace peanut
 			DeferredLighting,
 			ForwardLighting,
 			Skybox,
-			ColorGrading,
 			// Axis,
 			PipelineTypeCount
 		};
@@ -31,7 +39,7 @@ namespace peanut
 			DeferredLighting,
 			ForwardLighting,
 			Skybox,
-			ColorGrading,
+			ObjectConstants, // per object transform, bound as set 1 with a dynamic offset
 			// Axis,
 			DescriptorLayoutTypeCount
 		};
@@ -46,10 +54,9 @@ namespace peanut
 			// todo: emissive color 
 			GBufferC_BaseColor,	  // albedo (base color)
 			DepthImage,
-			BackupBuffer,
+			BackupBuffer,	  // hdr scene color, read by the post process chain after the pass
 			// BackupBufferOdd,
 			// BackupBufferEven,
-			SwapChain,
 			AttachmentTypeCount
 		};
 	}
@@ -61,8 +68,6 @@ namespace peanut
 			BasePass = 0,
 			DeferredLightingPass,
 			ForwardLightingPass,
-			// ToneMappingPass,
-			ColorGradingPass,
 			// FXAAPass,
 			// UIPass, // combine ui
 			SubpassTypeCount
@@ -75,13 +80,14 @@ namespace peanut
 
 	};
 
-	class MainRenderPass : public IRenderPassBase
+	// deferred and forward subpasses of the scene, named apart from the MainRenderPass of render_pass.h that the render system runs
+	class DeferredRenderPass : public IRenderPassBase
 	{
 	public:
 
 	public:
-		MainRenderPass() = default;
-		virtual ~MainRenderPass() {}
+		DeferredRenderPass() = default;
+		virtual ~DeferredRenderPass() {}
 
 		void Initialize(PassInitInfo* init_info) override;
 		void DeInitialize() override;
@@ -94,24 +100,57 @@ namespace peanut
 		void CreatePipelineLayouts() override;
 		void CreatePipelines() override;
 		void CreateFramebuffer() override;
-		void ResizeSwapchainObject() override { /* todo: implement */ }
+		void ResizeSwapchainObject() override;
+
+		std::string GetPassName() const override { return "main_render_pass"; }
+
+		// settings of the post process chain and the time since the last frame, for the exposure adaptation
+		void SetPostProcessFrameData(const PostProcessSettings& settings, float delta_time)
+		{
+			post_process_pass_.SetSettings(settings);
+			post_process_delta_time_ = delta_time;
+		}
 
 	protected:
 		VkDescriptorSet CreateGbufferDescriptor();
 		void CreateDeferredLightDescriptor();
 		VkDescriptorSet CreateForwardLightDescriptor();
 		void CreateSkyboxDescriptor();
-		void CreateColorGradingDescriptor();
+		void CreateObjectConstantsDescriptor();
+
+		// bind the attachments that got no lazily allocated memory, attachments whose subpass ranges do not overlap share memory
+		void AllocateAliasedRenderTargets(const std::vector<RGAliasRequest>& alias_requests, const std::vector<uint32_t>& alias_attachments);
+		void DestroyRenderTargets();
 
 		void UpdateGbufferDescriptor(VkCommandBuffer command_buffer, const PbrMaterial& material_data, VkDescriptorSet dst_descriptor_set);
 		void UpdateForwardLightDescriptor(VkCommandBuffer command_buffer, const PbrMaterial& material_data, VkDescriptorSet dst_descriptor_set);
 		void UpdateDeferredLightDescriptor();
 		void UpdateSkyboxDescriptor();
-		void UpdateColorGradingDescriptor();
+		void UpdateObjectConstantsDescriptor();
+		// the backup buffer and swapchain images of the post process chain, again after a resize
+		void UpdatePostProcessTargets();
+
+		// write this frame's lighting constants and lights to the frame uniform buffer, true if there are lights to cull
+		bool PushLightingData(uint32_t current_frame_index, uint32_t frame_width, uint32_t frame_height);
+		static bool HasDirectionalShadow(const LightingUBO& lighting_ubo) { return lighting_ubo.has_directional_light && lighting_ubo.directional_light.cast_shadow; }
 		
-		void RenderMesh(VkCommandBuffer command_buffer, const std::shared_ptr<RenderData>& render_data, bool is_forward = false);
+		// collect the submeshes of the render data into the draw list, request their pipeline variants and sort them
+		void BuildDrawList(const std::vector<std::shared_ptr<RenderData> >& render_data_list, RenderPipelineType::Type type,
+			SubpassType::Type subpass, DrawList& out_draw_list);
+		void RenderMeshes(VkCommandBuffer command_buffer, const std::vector<MeshDrawCommand>& draw_commands, bool is_forward = false);
 		void RenderDeferredLighting(VkCommandBuffer command_buffer, uint32_t current_frame_index);
 
+		// resolve a pipeline that may still be compiling, blocks until it is ready
+		VkPipeline GetPipeline(RenderPipelineType::Type type);
+		void WaitPendingPipelines();
+		void RebuildPipelinesWithShader(const std::string& shader_name);
+
+		// material permutations of the mesh pipelines, specialized by MATERIAL_FEATURE_* bits
+		static uint64_t GetPipelineVariantKey(RenderPipelineType::Type type, uint32_t feature_mask) { return (static_cast<uint64_t>(type) << 32) | feature_mask; }
+		void RequestPipelineVariant(RenderPipelineType::Type type, uint32_t feature_mask);
+		VkPipeline GetPipelineVariant(RenderPipelineType::Type type, uint32_t feature_mask);
+		void DestroyPipelineVariants(RenderPipelineType::Type type);
+
 		std::vector<std::shared_ptr<RenderData> > transparency_render_data_;
 
 		// setup from render system
@@ -120,7 +159,33 @@ namespace peanut
 		std::optional<ColorGradingRenderData> color_grading_render_data_;
 	
 	private:
-		std::optional<SubstorageUniformBuffer> lighting_data_uniform_buffer_;
+		// dynamic offsets of this frame's LightingUBO, point lights, spot lights and local shadow views in the frame uniform buffer
+		std::array<uint32_t, 4> lighting_dynamic_offsets_ = {};
+		LightCullingPass light_culling_pass_;
+		DirectionalShadowPass directional_shadow_pass_;
+		LocalLightShadowPass local_light_shadow_pass_;
+		ReflectionProbePass reflection_probe_pass_;
+		PostProcessPass post_process_pass_;
+		float post_process_delta_time_ = 0.0f;
 		std::map<RenderPipelineType::Type, std::vector<VkPushConstantRange> > all_push_constant_range_;
+
+		std::unique_ptr<ThreadPool> pipeline_compile_pool_;
+		std::array<std::future<VkPipeline>, RenderPipelineType::PipelineTypeCount> pending_pipelines_;
+		std::array<GraphicsPipelineState, RenderPipelineType::PipelineTypeCount> pipeline_states_;
+
+		std::unordered_map<uint64_t, VkPipeline> pipeline_variants_;
+		std::unordered_map<uint64_t, std::future<VkPipeline> > pending_pipeline_variants_;
+		DrawList opaque_draw_list_{ DrawSortOrder::FrontToBack };
+		DrawList transparency_draw_list_{ DrawSortOrder::BackToFront };
+
+		// memory of the render targets that could not use lazily allocated memory
+		std::vector<VkDeviceMemory> render_target_memory_;
+
+		// lighting, lights and object constants of one frame, the light arrays and shadow views take 120 KiB,
+		// the rest holds a few thousand objects at 256 byte alignment
+		static constexpr VkDeviceSize kFrameUniformBufferSize = 1 << 20;
+
+		static constexpr uint32_t kInvalidListener = UINT32_MAX;
+		uint32_t shader_reload_listener_ = kInvalidListener;
 	};
 }
@@ -0,0 +1,660 @@
+#include "post_process_pass.h"
+#include "../shader_manager.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peanut
+{
+	namespace
+	{
+		constexpr uint32_t kHistogramGroupSize = 16;
+		constexpr uint32_t kBloomGroupSize = 8;
+
+		uint32_t DivideRoundUp(uint32_t value, uint32_t divisor)
+		{
+			return (value + divisor - 1) / divisor;
+		}
+
+		// formats that encode on write, the composite hands them linear colors
+		bool IsSrgbFormat(VkFormat format)
+		{
+			return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+		}
+
+		void ComputeBarrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask)
+		{
+			VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(command_buffer, src_stage_mask, dst_stage_mask, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	void PostProcessPass::Initialize(std::weak_ptr<RHI> rhi, VkFormat output_format, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+		encode_srgb_ = !IsSrgbFormat(output_format);
+
+		CreateBuffers();
+		CreateRenderPass(output_format);
+		CreateDescriptorSetLayouts();
+		CreatePipelines();
+
+		is_initialized = true;
+	}
+
+	void PostProcessPass::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		DestroyTargets();
+
+		for (VkPipeline* pipeline : { &histogram_pipeline_, &exposure_average_pipeline_, &bloom_downsample_pipeline_,
+			&bloom_upsample_pipeline_, &composite_pipeline_ })
+		{
+			if (*pipeline != VK_NULL_HANDLE)
+			{
+				rhi->DestroyPipeline(*pipeline);
+				*pipeline = VK_NULL_HANDLE;
+			}
+		}
+
+		for (VkPipelineLayout* pipeline_layout : { &exposure_pipeline_layout_, &bloom_pipeline_layout_, &composite_pipeline_layout_ })
+		{
+			if (*pipeline_layout != VK_NULL_HANDLE)
+			{
+				rhi->DestroyPipelineLayout(*pipeline_layout);
+				*pipeline_layout = VK_NULL_HANDLE;
+			}
+		}
+
+		for (VkDescriptorSetLayout* descriptor_layout : { &compute_descriptor_layout_, &composite_descriptor_layout_ })
+		{
+			if (*descriptor_layout != VK_NULL_HANDLE)
+			{
+				vkDestroyDescriptorSetLayout(rhi->GetDevice(), *descriptor_layout, nullptr);
+				*descriptor_layout = VK_NULL_HANDLE;
+			}
+		}
+
+		if (render_pass_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyRenderPass(render_pass_);
+			render_pass_ = VK_NULL_HANDLE;
+		}
+
+		if (sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&sampler_);
+			sampler_ = VK_NULL_HANDLE;
+		}
+
+		for (Resource<VkBuffer>* buffer : { &luminance_histogram_, &exposure_state_ })
+		{
+			if (buffer->resource != VK_NULL_HANDLE)
+			{
+				rhi->DestroyBuffer(*buffer);
+				*buffer = Resource<VkBuffer>();
+			}
+		}
+
+		is_initialized = false;
+	}
+
+	void PostProcessPass::SetTargets(const std::vector<VkImageView>& scene_color_views, const std::vector<VkImageView>& output_views,
+		uint32_t width, uint32_t height)
+	{
+		assert(is_initialized);
+		assert(scene_color_views.size() == output_views.size());
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		DestroyTargets();
+
+		width_ = width;
+		height_ = height;
+		scene_color_views_ = scene_color_views;
+
+		output_framebuffers_.resize(output_views.size(), VK_NULL_HANDLE);
+		for (size_t i = 0; i < output_views.size(); ++i)
+		{
+			VkFramebufferCreateInfo create_info = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+			create_info.renderPass = render_pass_;
+			create_info.attachmentCount = 1;
+			create_info.pAttachments = &output_views[i];
+			create_info.width = width_;
+			create_info.height = height_;
+			create_info.layers = 1;
+			rhi->CreateFrameBuffer(&create_info, &output_framebuffers_[i]);
+		}
+
+		CreateBloomTexture();
+		CreateDescriptorSets();
+	}
+
+	void PostProcessPass::SetColorGradingLut(const TextureData& lut_texture)
+	{
+		color_grading_lut_ = lut_texture;
+		if (is_initialized && descriptor_pool_ != VK_NULL_HANDLE)
+		{
+			UpdateCompositeLut();
+		}
+	}
+
+	void PostProcessPass::Render(VkCommandBuffer command_buffer, uint32_t frame_index, float delta_time)
+	{
+		if (!is_initialized || frame_index >= output_framebuffers_.size())
+		{
+			return;
+		}
+
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "PostProcess");
+
+		const std::vector<PostProcessEffect> effects = ResolveEffects(settings_.effects, color_grading_lut_.image_view != VK_NULL_HANDLE);
+		const auto has_effect = [&effects](PostProcessEffect effect)
+		{
+			return std::find(effects.begin(), effects.end(), effect) != effects.end();
+		};
+
+		// the last frame may still read the bloom chain and the exposure in its composite
+		ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		// the exposure is measured before the bloom prefilter runs whatever the order, the prefilter thresholds
+		// exposed colors and reads the exposure of this frame that way
+		const bool use_exposure = has_effect(PostProcessEffect::AutoExposure);
+		if (use_exposure)
+		{
+			RenderAutoExposure(command_buffer, frame_index, delta_time);
+			ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+
+		// the chain has all levels the targets allow, the settings choose how many of them run
+		const uint32_t bloom_level_num = GetActiveBloomLevelCount(settings_, width_, height_, bloom_level_num_);
+		if (has_effect(PostProcessEffect::Bloom) && bloom_level_num > 0)
+		{
+			RenderBloom(command_buffer, frame_index, use_exposure, bloom_level_num);
+		}
+
+		ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		RenderComposite(command_buffer, frame_index, effects, bloom_level_num);
+	}
+
+	void PostProcessPass::RenderAutoExposure(VkCommandBuffer command_buffer, uint32_t frame_index, float delta_time)
+	{
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "PostAutoExposure");
+
+		const uint32_t grid_width = DivideRoundUp(width_, LUMINANCE_HISTOGRAM_SCALE);
+		const uint32_t grid_height = DivideRoundUp(height_, LUMINANCE_HISTOGRAM_SCALE);
+
+		PostExposurePCO exposure_pco = {};
+		exposure_pco.min_log_luminance = settings_.min_log_luminance;
+		exposure_pco.log_luminance_range = std::max(settings_.max_log_luminance - settings_.min_log_luminance, 1e-3f);
+		exposure_pco.sample_num = grid_width * grid_height;
+		exposure_pco.delta_time = delta_time;
+		exposure_pco.adaptation_speed = settings_.adaptation_speed;
+		exposure_pco.exposure_compensation = settings_.exposure_compensation;
+
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, exposure_pipeline_layout_, 0,
+			1, &scene_descriptor_sets_[frame_index], 0, nullptr);
+		vkCmdPushConstants(command_buffer, exposure_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostExposurePCO), &exposure_pco);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, histogram_pipeline_);
+		vkCmdDispatch(command_buffer, DivideRoundUp(grid_width, kHistogramGroupSize), DivideRoundUp(grid_height, kHistogramGroupSize), 1);
+
+		ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		// one workgroup of a bin per invocation, it also clears the histogram for the next frame
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, exposure_average_pipeline_);
+		vkCmdDispatch(command_buffer, 1, 1, 1);
+	}
+
+	void PostProcessPass::RenderBloom(VkCommandBuffer command_buffer, uint32_t frame_index, bool use_exposure, uint32_t bloom_level_num)
+	{
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "PostBloom");
+
+		PostBloomPCO bloom_pco = {};
+		bloom_pco.threshold = settings_.bloom_threshold;
+		bloom_pco.knee = std::max(settings_.bloom_knee, 1e-4f);
+		bloom_pco.radius = settings_.bloom_radius;
+		bloom_pco.use_exposure = use_exposure ? 1 : 0;
+
+		const auto get_level_width = [this](uint32_t level) { return std::max(1u, (width_ / 2) >> level); };
+		const auto get_level_height = [this](uint32_t level) { return std::max(1u, (height_ / 2) >> level); };
+
+		// down the chain, the first level reads the scene
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloom_downsample_pipeline_);
+		for (uint32_t level = 0; level < bloom_level_num; ++level)
+		{
+			const uint32_t source_width = level == 0 ? width_ : get_level_width(level - 1);
+			const uint32_t source_height = level == 0 ? height_ : get_level_height(level - 1);
+			bloom_pco.inv_source_size = glm::vec2(1.0f / static_cast<float>(source_width), 1.0f / static_cast<float>(source_height));
+			bloom_pco.inv_output_size = glm::vec2(1.0f / static_cast<float>(get_level_width(level)), 1.0f / static_cast<float>(get_level_height(level)));
+			bloom_pco.is_prefilter = level == 0 ? 1 : 0;
+
+			// the first level is written through the scene set of the frame, it holds the first bloom level as output
+			const VkDescriptorSet descriptor_set = level == 0 ? scene_descriptor_sets_[frame_index] : bloom_downsample_sets_[level];
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloom_pipeline_layout_, 0, 1, &descriptor_set, 0, nullptr);
+			vkCmdPushConstants(command_buffer, bloom_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostBloomPCO), &bloom_pco);
+			vkCmdDispatch(command_buffer, DivideRoundUp(get_level_width(level), kBloomGroupSize), DivideRoundUp(get_level_height(level), kBloomGroupSize), 1);
+
+			ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+
+		// and back up, every level adds the blurred level below it
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloom_upsample_pipeline_);
+		for (uint32_t level = bloom_level_num - 1; level > 0; --level)
+		{
+			const uint32_t output_level = level - 1;
+			bloom_pco.inv_source_size = glm::vec2(1.0f / static_cast<float>(get_level_width(level)), 1.0f / static_cast<float>(get_level_height(level)));
+			bloom_pco.inv_output_size = glm::vec2(1.0f / static_cast<float>(get_level_width(output_level)),
+				1.0f / static_cast<float>(get_level_height(output_level)));
+			bloom_pco.is_prefilter = 0;
+
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloom_pipeline_layout_, 0, 1,
+				&bloom_upsample_sets_[output_level], 0, nullptr);
+			vkCmdPushConstants(command_buffer, bloom_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostBloomPCO), &bloom_pco);
+			vkCmdDispatch(command_buffer, DivideRoundUp(get_level_width(output_level), kBloomGroupSize),
+				DivideRoundUp(get_level_height(output_level), kBloomGroupSize), 1);
+
+			ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+	}
+
+	void PostProcessPass::RenderComposite(VkCommandBuffer command_buffer, uint32_t frame_index, const std::vector<PostProcessEffect>& effects,
+		uint32_t bloom_level_num)
+	{
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "PostComposite");
+
+		PostCompositePCO composite_pco = {};
+		for (size_t i = 0; i < effects.size(); ++i)
+		{
+			composite_pco.effects[i] = static_cast<int>(effects[i]);
+		}
+		composite_pco.effect_num = static_cast<int>(effects.size());
+		// without levels there is no bloom to add, the first level still holds an older frame's
+		composite_pco.bloom_intensity = bloom_level_num > 0 ? settings_.bloom_intensity : 0.0f;
+		composite_pco.encode_srgb = encode_srgb_ ? 1 : 0;
+
+		VkRenderPassBeginInfo render_pass_begin_info{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		render_pass_begin_info.renderPass = render_pass_;
+		render_pass_begin_info.framebuffer = output_framebuffers_[frame_index];
+		render_pass_begin_info.renderArea.offset = { 0, 0 };
+		render_pass_begin_info.renderArea.extent = { width_, height_ };
+		vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+		const VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(width_), static_cast<float>(height_), 0.0f, 1.0f };
+		const VkRect2D scissor = { { 0, 0 }, { width_, height_ } };
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, composite_pipeline_);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, composite_pipeline_layout_, 0,
+			1, &composite_descriptor_sets_[frame_index], 0, nullptr);
+		vkCmdPushConstants(command_buffer, composite_pipeline_layout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PostCompositePCO), &composite_pco);
+		vkCmdDraw(command_buffer, 3, 1, 0, 0);
+
+		vkCmdEndRenderPass(command_buffer);
+	}
+
+	std::vector<PostProcessEffect> PostProcessPass::ResolveEffects(const std::vector<PostProcessEffect>& effects, bool has_color_grading_lut)
+	{
+		std::vector<PostProcessEffect> resolved_effects;
+		for (PostProcessEffect effect : effects)
+		{
+			if (static_cast<uint32_t>(effect) >= POST_EFFECT_NUM)
+			{
+				continue;
+			}
+			if (effect == PostProcessEffect::ColorGrading && !has_color_grading_lut)
+			{
+				continue;
+			}
+			if (std::find(resolved_effects.begin(), resolved_effects.end(), effect) != resolved_effects.end())
+			{
+				continue;
+			}
+			resolved_effects.push_back(effect);
+		}
+		return resolved_effects;
+	}
+
+	uint32_t PostProcessPass::GetBloomLevelCount(uint32_t width, uint32_t height, uint32_t max_levels)
+	{
+		uint32_t level_width = width / 2;
+		uint32_t level_height = height / 2;
+		uint32_t level_num = 0;
+		while (level_num < std::min(max_levels, static_cast<uint32_t>(BLOOM_MAX_LEVELS)) && level_width > 0 && level_height > 0)
+		{
+			++level_num;
+			level_width /= 2;
+			level_height /= 2;
+		}
+		return level_num;
+	}
+
+	uint32_t PostProcessPass::GetActiveBloomLevelCount(const PostProcessSettings& settings, uint32_t width, uint32_t height, uint32_t allocated_levels)
+	{
+		return std::min(GetBloomLevelCount(width, height, settings.bloom_levels), allocated_levels);
+	}
+
+	uint32_t PostProcessPass::GetHistogramBin(float luminance, float min_log_luminance, float log_luminance_range)
+	{
+		if (luminance < std::exp2(min_log_luminance))
+		{
+			return 0;
+		}
+
+		const float position = std::clamp((std::log2(luminance) - min_log_luminance) / log_luminance_range, 0.0f, 1.0f);
+		return static_cast<uint32_t>(position * static_cast<float>(LUMINANCE_HISTOGRAM_BIN_NUM - 2) + 1.0f);
+	}
+
+	float PostProcessPass::ComputeAverageLuminance(const std::array<uint32_t, LUMINANCE_HISTOGRAM_BIN_NUM>& histogram, uint32_t sample_num,
+		float min_log_luminance, float log_luminance_range)
+	{
+		float weighted_count = 0.0f;
+		for (uint32_t bin = 0; bin < LUMINANCE_HISTOGRAM_BIN_NUM; ++bin)
+		{
+			weighted_count += static_cast<float>(histogram[bin]) * static_cast<float>(bin);
+		}
+
+		const float lit_num = static_cast<float>(sample_num) - static_cast<float>(histogram[0]);
+		const float log_average = lit_num > 0.0f ? weighted_count / lit_num - 1.0f : 0.0f;
+		return std::exp2(log_average / static_cast<float>(LUMINANCE_HISTOGRAM_BIN_NUM - 2) * log_luminance_range + min_log_luminance);
+	}
+
+	float PostProcessPass::AdaptLuminance(float last_luminance, float average_luminance, float delta_time, float adaptation_speed)
+	{
+		if (last_luminance <= 0.0f)
+		{
+			return average_luminance;
+		}
+		return last_luminance + (average_luminance - last_luminance) * (1.0f - std::exp(-delta_time * adaptation_speed));
+	}
+
+	float PostProcessPass::ComputeExposure(float adapted_luminance, float exposure_compensation)
+	{
+		return static_cast<float>(POST_EXPOSURE_KEY) * std::exp2(exposure_compensation) / adapted_luminance;
+	}
+
+	void PostProcessPass::CreateBuffers()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		luminance_histogram_ = rhi->CreateBuffer(sizeof(uint32_t) * LUMINANCE_HISTOGRAM_BIN_NUM,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		exposure_state_ = rhi->CreateBuffer(sizeof(PostExposureState),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		// an empty histogram and an exposure of one until the first frame is measured
+		PostExposureState exposure_state = {};
+		exposure_state.exposure = 1.0f;
+
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		vkCmdFillBuffer(command_buffer, luminance_histogram_.resource, 0, VK_WHOLE_SIZE, 0);
+		vkCmdUpdateBuffer(command_buffer, exposure_state_.resource, 0, sizeof(PostExposureState), &exposure_state);
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+
+		VkSamplerCreateInfo create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		rhi->CreateSampler(&create_info, &sampler_);
+	}
+
+	void PostProcessPass::CreateRenderPass(VkFormat output_format)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// every texel is written, the image is handed to the presentation
+		VkAttachmentDescription attachment = {};
+		attachment.format = output_format;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachment.finalLayout = rhi->GetPresentImageLayout();
+
+		VkAttachmentReference color_reference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &color_reference;
+
+		// the output image may still be presented or read back, the acquire waits at this stage
+		VkSubpassDependency dependency = {};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.srcAccessMask = 0;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		VkRenderPassCreateInfo create_info = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		create_info.attachmentCount = 1;
+		create_info.pAttachments = &attachment;
+		create_info.subpassCount = 1;
+		create_info.pSubpasses = &subpass;
+		create_info.dependencyCount = 1;
+		create_info.pDependencies = &dependency;
+		rhi->CreateRenderPass(&create_info, &render_pass_);
+	}
+
+	void PostProcessPass::CreateDescriptorSetLayouts()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// one layout for the compute stages, a stage leaves out the bindings it does not declare
+		compute_descriptor_layout_ = rhi->CreateDescriptorSetLayout({
+			{ SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &sampler_ },
+			{ OUTPUT_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ LUMINANCE_HISTOGRAM, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ EXPOSURE_STATE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		});
+
+		composite_descriptor_layout_ = rhi->CreateDescriptorSetLayout({
+			{ COMPOSITE_SCENE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &sampler_ },
+			{ COMPOSITE_BLOOM_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &sampler_ },
+			{ COMPOSITE_COLOR_GRADING_LUT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ COMPOSITE_EXPOSURE_STATE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+		});
+	}
+
+	void PostProcessPass::CreatePipelines()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		exposure_pipeline_layout_ = rhi->CreatePipelineLayout({ compute_descriptor_layout_ },
+			{ {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostExposurePCO)} });
+		histogram_pipeline_ = rhi->CreateComputePipeline(
+			ShaderManager::Get().GetShaderModule(rhi, "post_luminance_histogram.comp"), exposure_pipeline_layout_);
+		exposure_average_pipeline_ = rhi->CreateComputePipeline(
+			ShaderManager::Get().GetShaderModule(rhi, "post_exposure_average.comp"), exposure_pipeline_layout_);
+
+		bloom_pipeline_layout_ = rhi->CreatePipelineLayout({ compute_descriptor_layout_ },
+			{ {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostBloomPCO)} });
+		bloom_downsample_pipeline_ = rhi->CreateComputePipeline(
+			ShaderManager::Get().GetShaderModule(rhi, "post_bloom_downsample.comp"), bloom_pipeline_layout_);
+		bloom_upsample_pipeline_ = rhi->CreateComputePipeline(
+			ShaderManager::Get().GetShaderModule(rhi, "post_bloom_upsample.comp"), bloom_pipeline_layout_);
+
+		composite_pipeline_layout_ = rhi->CreatePipelineLayout({ composite_descriptor_layout_ },
+			{ {VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PostCompositePCO)} });
+		VkShaderModule screen_vs = ShaderManager::Get().GetShaderModule(rhi, "screen.vert");
+		VkShaderModule composite_fs = ShaderManager::Get().GetShaderModule(rhi, "post_composite.frag");
+		composite_pipeline_ = rhi->CreateGraphicsPipeline(render_pass_, 0, screen_vs, composite_fs, composite_pipeline_layout_);
+	}
+
+	void PostProcessPass::CreateBloomTexture()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// as many levels as the size allows, independent of the settings so that they can change without new targets
+		bloom_level_num_ = GetBloomLevelCount(width_, height_, BLOOM_MAX_LEVELS);
+		if (bloom_level_num_ == 0)
+		{
+			// a texel to bind, the composite adds nothing from it
+			bloom_texture_ = rhi->CreateTexture(1, 1, 1, 1, kBloomFormat, VK_IMAGE_USAGE_STORAGE_BIT);
+		}
+		else
+		{
+			bloom_texture_ = rhi->CreateTexture(width_ / 2, height_ / 2, 1, bloom_level_num_, kBloomFormat, VK_IMAGE_USAGE_STORAGE_BIT);
+			for (uint32_t level = 0; level < bloom_level_num_; ++level)
+			{
+				bloom_level_views_.push_back(rhi->CreateTextureView(bloom_texture_, kBloomFormat, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+			}
+		}
+
+		// the chain is written and sampled in general layout, the barriers between the stages only order memory
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(*bloom_texture_, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_GENERAL) });
+		if (bloom_level_num_ == 0)
+		{
+			const VkClearColorValue clear_color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vkCmdClearColorImage(command_buffer, bloom_texture_->image.resource, VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1, &range);
+		}
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+	}
+
+	void PostProcessPass::CreateDescriptorSets()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		const uint32_t frame_num = static_cast<uint32_t>(scene_color_views_.size());
+		const uint32_t bloom_set_num = bloom_level_num_ > 0 ? 2 * bloom_level_num_ - 1 : 0;
+		const uint32_t compute_set_num = frame_num + bloom_set_num;
+
+		const std::vector<VkDescriptorPoolSize> pool_sizes = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, compute_set_num + 3 * frame_num },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, compute_set_num },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * compute_set_num + frame_num },
+		};
+		VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_create_info.maxSets = compute_set_num + frame_num;
+		pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_create_info.pPoolSizes = pool_sizes.data();
+		rhi->CreateDescriptorPool(&pool_create_info, &descriptor_pool_);
+
+		const VkDescriptorBufferInfo histogram_info = { luminance_histogram_.resource, 0, VK_WHOLE_SIZE };
+		const VkDescriptorBufferInfo exposure_info = { exposure_state_.resource, 0, VK_WHOLE_SIZE };
+		const auto allocate_compute_set = [&](VkImageView source_view, VkImageLayout source_layout, VkImageView output_view)
+		{
+			VkDescriptorSet descriptor_set = rhi->AllocateDescriptor(descriptor_pool_, compute_descriptor_layout_);
+			rhi->UpdateImageDescriptorSet(descriptor_set, SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				{ { sampler_, source_view, source_layout } });
+			rhi->UpdateImageDescriptorSet(descriptor_set, OUTPUT_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				{ { VK_NULL_HANDLE, output_view, VK_IMAGE_LAYOUT_GENERAL } });
+			rhi->UpdateBufferDescriptorSet(descriptor_set, LUMINANCE_HISTOGRAM, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { histogram_info });
+			rhi->UpdateBufferDescriptorSet(descriptor_set, EXPOSURE_STATE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { exposure_info });
+			return descriptor_set;
+		};
+
+		// the scene set of a frame writes the first bloom level, without levels the 1x1 placeholder stands in
+		const VkImageView first_level_view = bloom_level_num_ > 0 ? bloom_level_views_[0] : bloom_texture_->image_view;
+		for (uint32_t frame = 0; frame < frame_num; ++frame)
+		{
+			scene_descriptor_sets_.push_back(allocate_compute_set(scene_color_views_[frame], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, first_level_view));
+
+			VkDescriptorSet composite_set = rhi->AllocateDescriptor(descriptor_pool_, composite_descriptor_layout_);
+			rhi->UpdateImageDescriptorSet(composite_set, COMPOSITE_SCENE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				{ { sampler_, scene_color_views_[frame], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
+			rhi->UpdateImageDescriptorSet(composite_set, COMPOSITE_BLOOM_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				{ { sampler_, first_level_view, VK_IMAGE_LAYOUT_GENERAL } });
+			rhi->UpdateBufferDescriptorSet(composite_set, COMPOSITE_EXPOSURE_STATE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { exposure_info });
+			composite_descriptor_sets_.push_back(composite_set);
+		}
+		UpdateCompositeLut();
+
+		// level 0 is written from the scene sets, the smallest level is not upsampled into
+		bloom_downsample_sets_.resize(bloom_level_num_, VK_NULL_HANDLE);
+		bloom_upsample_sets_.resize(bloom_level_num_, VK_NULL_HANDLE);
+		for (uint32_t level = 1; level < bloom_level_num_; ++level)
+		{
+			bloom_downsample_sets_[level] = allocate_compute_set(bloom_level_views_[level - 1], VK_IMAGE_LAYOUT_GENERAL, bloom_level_views_[level]);
+			bloom_upsample_sets_[level - 1] = allocate_compute_set(bloom_level_views_[level], VK_IMAGE_LAYOUT_GENERAL, bloom_level_views_[level - 1]);
+		}
+	}
+
+	void PostProcessPass::UpdateCompositeLut()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// the bloom placeholder is bound while there is no lut, the effect is dropped from the chain then
+		VkDescriptorImageInfo lut_info = { color_grading_lut_.image_sampler, color_grading_lut_.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		if (lut_info.imageView == VK_NULL_HANDLE)
+		{
+			lut_info = { sampler_, bloom_texture_->image_view, VK_IMAGE_LAYOUT_GENERAL };
+		}
+		else if (lut_info.sampler == VK_NULL_HANDLE)
+		{
+			lut_info.sampler = sampler_;
+		}
+
+		for (VkDescriptorSet composite_set : composite_descriptor_sets_)
+		{
+			rhi->UpdateImageDescriptorSet(composite_set, COMPOSITE_COLOR_GRADING_LUT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, { lut_info });
+		}
+	}
+
+	void PostProcessPass::DestroyTargets()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// the sets go with their pool
+		if (descriptor_pool_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(rhi->GetDevice(), descriptor_pool_, nullptr);
+			descriptor_pool_ = VK_NULL_HANDLE;
+		}
+		scene_descriptor_sets_.clear();
+		composite_descriptor_sets_.clear();
+		bloom_downsample_sets_.clear();
+		bloom_upsample_sets_.clear();
+
+		for (VkFramebuffer& framebuffer : output_framebuffers_)
+		{
+			if (framebuffer != VK_NULL_HANDLE)
+			{
+				rhi->DestroyFrameBuffer(framebuffer);
+			}
+		}
+		output_framebuffers_.clear();
+
+		for (VkImageView image_view : bloom_level_views_)
+		{
+			rhi->DestroyImageView(image_view);
+		}
+		bloom_level_views_.clear();
+		bloom_level_num_ = 0;
+
+		if (bloom_texture_ != nullptr)
+		{
+			rhi->DestroyTexture(bloom_texture_);
+			bloom_texture_ = nullptr;
+		}
+
+		scene_color_views_.clear();
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include "../render_data.h"
+#include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_profiler.h"
+
+namespace peanut
+{
+	// ids match the POST_EFFECT_* constants of the shaders
+	enum class PostProcessEffect : uint8_t
+	{
+		AutoExposure = POST_EFFECT_AUTO_EXPOSURE,
+		Bloom = POST_EFFECT_BLOOM,
+		ToneMapping = POST_EFFECT_TONE_MAPPING,
+		ColorGrading = POST_EFFECT_COLOR_GRADING,
+	};
+
+	struct PostProcessSettings
+	{
+		// effects applied to the hdr scene color in this order, effects that are not listed are off;
+		// bloom before auto exposure has the bloom exposed together with the scene
+		std::vector<PostProcessEffect> effects = { PostProcessEffect::Bloom, PostProcessEffect::AutoExposure,
+			PostProcessEffect::ToneMapping, PostProcessEffect::ColorGrading };
+
+		// log2 luminance range of the histogram, darker texels are left out of the average
+		float min_log_luminance = -8.0f;
+		float max_log_luminance = 4.0f;
+		float adaptation_speed = 1.5f;       // per second, higher adapts faster
+		float exposure_compensation = 0.0f;  // in stops
+
+		float bloom_threshold = 1.0f;        // exposed luminance the bloom starts at
+		float bloom_knee = 0.5f;
+		float bloom_intensity = 0.05f;
+		float bloom_radius = 1.0f;
+		uint32_t bloom_levels = BLOOM_MAX_LEVELS;
+	};
+
+	/**
+	* @brief post process chain from the hdr scene color to the display image
+	*
+	* Auto exposure builds a luminance histogram of the scene at quarter resolution and reduces it to an adapted
+	* average in compute; bloom is a compute chain of downsamples from half resolution and tent upsamples back.
+	* The full resolution work of all effects, exposure, bloom, tone mapping and the lut color grade, is one
+	* fullscreen pass in the configured order into the output image, a swapchain image can not be written by compute.
+	*/
+	class PostProcessPass
+	{
+	public:
+		PostProcessPass() = default;
+		~PostProcessPass() = default;
+
+		// output_format is the format of the images the chain ends in, the passes are timed if a gpu profiler is given
+		void Initialize(std::weak_ptr<RHI> rhi, VkFormat output_format, GpuProfiler* gpu_profiler = nullptr);
+		void Destroy();
+
+		// the scene colors to read and the images to write, one of each per frame, again after a resize
+		void SetTargets(const std::vector<VkImageView>& scene_color_views, const std::vector<VkImageView>& output_views,
+			uint32_t width, uint32_t height);
+
+		// record the chain of a frame, the scene color is in shader read only layout and the output ends in present layout
+		void Render(VkCommandBuffer command_buffer, uint32_t frame_index, float delta_time);
+
+		// the lut of the color grading effect, without one the effect is skipped
+		void SetColorGradingLut(const TextureData& lut_texture);
+
+		void SetSettings(const PostProcessSettings& settings) { settings_ = settings; }
+		const PostProcessSettings& GetSettings() const { return settings_; }
+
+		// the effects of the settings that run, in order, without repeats and without a color grade that has no lut
+		static std::vector<PostProcessEffect> ResolveEffects(const std::vector<PostProcessEffect>& effects, bool has_color_grading_lut);
+		// levels of the bloom chain from half resolution down, none of them smaller than a texel
+		static uint32_t GetBloomLevelCount(uint32_t width, uint32_t height, uint32_t max_levels);
+		// levels of the chain a frame runs, the bloom_levels of the settings within the allocated ones
+		static uint32_t GetActiveBloomLevelCount(const PostProcessSettings& settings, uint32_t width, uint32_t height, uint32_t allocated_levels);
+
+		// cpu mirrors of post_luminance_histogram.comp and post_exposure_average.comp
+		static uint32_t GetHistogramBin(float luminance, float min_log_luminance, float log_luminance_range);
+		static float ComputeAverageLuminance(const std::array<uint32_t, LUMINANCE_HISTOGRAM_BIN_NUM>& histogram, uint32_t sample_num,
+			float min_log_luminance, float log_luminance_range);
+		static float AdaptLuminance(float last_luminance, float average_luminance, float delta_time, float adaptation_speed);
+		static float ComputeExposure(float adapted_luminance, float exposure_compensation);
+
+		PostProcessPass(const PostProcessPass&) = delete;
+		PostProcessPass& operator=(const PostProcessPass&) = delete;
+
+	private:
+		enum DescriptorBinding : uint8_t
+		{
+			SOURCE_TEXTURE = 0,
+			OUTPUT_IMAGE,
+			LUMINANCE_HISTOGRAM,
+			EXPOSURE_STATE,
+		};
+
+		enum CompositeBinding : uint8_t
+		{
+			COMPOSITE_SCENE_TEXTURE = 0,
+			COMPOSITE_BLOOM_TEXTURE,
+			COMPOSITE_COLOR_GRADING_LUT,
+			COMPOSITE_EXPOSURE_STATE,
+		};
+
+		void CreateBuffers();
+		void CreateRenderPass(VkFormat output_format);
+		void CreateDescriptorSetLayouts();
+		void CreatePipelines();
+		void CreateBloomTexture();
+		void CreateDescriptorSets();
+		void UpdateCompositeLut();
+		void DestroyTargets();
+
+		void RenderAutoExposure(VkCommandBuffer command_buffer, uint32_t frame_index, float delta_time);
+		void RenderBloom(VkCommandBuffer command_buffer, uint32_t frame_index, bool use_exposure, uint32_t bloom_level_num);
+		void RenderComposite(VkCommandBuffer command_buffer, uint32_t frame_index, const std::vector<PostProcessEffect>& effects,
+			uint32_t bloom_level_num);
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
+
+		PostProcessSettings settings_;
+		TextureData color_grading_lut_;
+		bool encode_srgb_ = false;
+
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		std::vector<VkImageView> scene_color_views_;
+		std::vector<VkFramebuffer> output_framebuffers_;
+
+		Resource<VkBuffer> luminance_histogram_;
+		Resource<VkBuffer> exposure_state_;
+
+		// half resolution chain, kept in general layout, levels are written through their own views
+		std::shared_ptr<TextureData> bloom_texture_;
+		std::vector<VkImageView> bloom_level_views_;
+		uint32_t bloom_level_num_ = 0;  // allocated, see GetActiveBloomLevelCount() for the ones that run
+
+		VkSampler sampler_ = VK_NULL_HANDLE;
+		VkRenderPass render_pass_ = VK_NULL_HANDLE;
+
+		// recreated with the targets, every set depends on their views
+		VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout compute_descriptor_layout_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout composite_descriptor_layout_ = VK_NULL_HANDLE;
+		// per frame, the histogram, the exposure average and the bloom prefilter read the scene through it
+		std::vector<VkDescriptorSet> scene_descriptor_sets_;
+		std::vector<VkDescriptorSet> composite_descriptor_sets_;
+		// per bloom level, downsample into the level and upsample into it
+		std::vector<VkDescriptorSet> bloom_downsample_sets_;
+		std::vector<VkDescriptorSet> bloom_upsample_sets_;
+
+		VkPipelineLayout exposure_pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipelineLayout bloom_pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipelineLayout composite_pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline histogram_pipeline_ = VK_NULL_HANDLE;
+		VkPipeline exposure_average_pipeline_ = VK_NULL_HANDLE;
+		VkPipeline bloom_downsample_pipeline_ = VK_NULL_HANDLE;
+		VkPipeline bloom_upsample_pipeline_ = VK_NULL_HANDLE;
+		VkPipeline composite_pipeline_ = VK_NULL_HANDLE;
+
+		static constexpr VkFormat kBloomFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+	};
+}
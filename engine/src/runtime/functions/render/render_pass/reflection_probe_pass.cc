@@ -0,0 +1,850 @@
+#include "reflection_probe_pass.h"
+#include "../shader_manager.h"
+#include "../shadow_cascades.h"
+#include "../ibl_prefilter.h"
+#include "functions/assets/mesh.h"
+
+#include <algorithm>
+
+namespace peanut
+{
+	namespace
+	{
+		constexpr uint64_t kHashOffset = 14695981039346656037ull;
+
+		uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return hash;
+		}
+
+		float GetBoxVolume(const ReflectionProbe& probe)
+		{
+			const glm::vec3 extent = glm::max(probe.box_max - probe.box_min, glm::vec3(0.0f));
+			return extent.x * extent.y * extent.z;
+		}
+	}
+
+	void ReflectionProbePass::Initialize(std::weak_ptr<RHI> rhi, const TextureData& sky_texture, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+
+		CreateTextures();
+		CreateRenderPass();
+		CreateFramebuffers();
+		CreateDescriptors();
+		CreatePipelines();
+
+		is_initialized = true;
+		SetSkyTexture(sky_texture);
+	}
+
+	void ReflectionProbePass::SetSkyTexture(const TextureData& sky_texture)
+	{
+		sky_texture_ = sky_texture;
+		if (!is_initialized || sky_texture_.image_view == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		rhi->UpdateImageDescriptorSet(capture_descriptor_set_, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			{ { sky_texture_.image_sampler, sky_texture_.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
+	}
+
+	void ReflectionProbePass::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		for (VkPipeline* pipeline : { &sky_pipeline_, &mesh_pipeline_, &prefilter_pipeline_ })
+		{
+			if (*pipeline != VK_NULL_HANDLE)
+			{
+				rhi->DestroyPipeline(*pipeline);
+				*pipeline = VK_NULL_HANDLE;
+			}
+		}
+
+		for (VkPipelineLayout* pipeline_layout : { &capture_pipeline_layout_, &prefilter_pipeline_layout_ })
+		{
+			if (*pipeline_layout != VK_NULL_HANDLE)
+			{
+				rhi->DestroyPipelineLayout(*pipeline_layout);
+				*pipeline_layout = VK_NULL_HANDLE;
+			}
+		}
+
+		for (VkDescriptorSetLayout* descriptor_layout : { &capture_descriptor_layout_, &prefilter_descriptor_layout_ })
+		{
+			if (*descriptor_layout != VK_NULL_HANDLE)
+			{
+				vkDestroyDescriptorSetLayout(rhi->GetDevice(), *descriptor_layout, nullptr);
+				*descriptor_layout = VK_NULL_HANDLE;
+			}
+		}
+
+		// the sets go with their pool
+		if (descriptor_pool_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(rhi->GetDevice(), descriptor_pool_, nullptr);
+			descriptor_pool_ = VK_NULL_HANDLE;
+		}
+		capture_descriptor_set_ = VK_NULL_HANDLE;
+		prefilter_descriptor_sets_.fill(VK_NULL_HANDLE);
+
+		for (VkFramebuffer& framebuffer : capture_framebuffers_)
+		{
+			if (framebuffer != VK_NULL_HANDLE)
+			{
+				rhi->DestroyFrameBuffer(framebuffer);
+				framebuffer = VK_NULL_HANDLE;
+			}
+		}
+
+		if (render_pass_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyRenderPass(render_pass_);
+			render_pass_ = VK_NULL_HANDLE;
+		}
+
+		if (sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&sampler_);
+			sampler_ = VK_NULL_HANDLE;
+		}
+
+		for (VkImageView image_view : probe_level_views_)
+		{
+			rhi->DestroyImageView(image_view);
+		}
+		probe_level_views_.clear();
+
+		for (VkImageView& image_view : capture_face_views_)
+		{
+			if (image_view != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImageView(image_view);
+				image_view = VK_NULL_HANDLE;
+			}
+		}
+
+		for (VkImageView* image_view : { &capture_depth_view_, &probe_array_view_ })
+		{
+			if (*image_view != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImageView(*image_view);
+				*image_view = VK_NULL_HANDLE;
+			}
+		}
+
+		for (Resource<VkImage>* image : { &capture_depth_, &probe_array_ })
+		{
+			if (image->resource != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImage(*image);
+				*image = Resource<VkImage>();
+			}
+		}
+
+		if (capture_cube_ != nullptr)
+		{
+			rhi->DestroyTexture(capture_cube_);
+			capture_cube_ = nullptr;
+		}
+
+		if (capture_ub_.resource != VK_NULL_HANDLE)
+		{
+			rhi->DestroyBuffer(capture_ub_);
+			capture_ub_ = Resource<VkBuffer>();
+		}
+
+		// the captured cubes are gone with the array
+		probe_states_.fill(ProbeState());
+		probe_num_ = 0;
+		capture_probe_ = -1;
+		planned_steps_.clear();
+
+		is_initialized = false;
+	}
+
+	void ReflectionProbePass::Update(const std::vector<ReflectionProbe>& probes, const std::vector<std::shared_ptr<RenderData> >& render_data_list,
+		LightingUBO& lighting_ubo)
+	{
+		planned_steps_.clear();
+		capture_meshes_.clear();
+
+		if (gpu_profiler_ != nullptr)
+		{
+			for (const GpuScopeStats& stats : gpu_profiler_->GetScopeStats())
+			{
+				if (stats.name == "ReflectionProbeFace" && stats.last_ms > 0.0)
+				{
+					face_cost_ms_ = stats.last_ms;
+				}
+				else if (stats.name == "ReflectionProbePrefilter" && stats.last_ms > 0.0)
+				{
+					prefilter_cost_ms_ = stats.last_ms;
+				}
+			}
+		}
+
+		// everything a capture sees besides the probe placement: the lights and the static meshes
+		capture_ubo_.sky_light = lighting_ubo.sky_light;
+		capture_ubo_.has_sky_light = lighting_ubo.has_sky_light;
+		capture_ubo_.has_directional_light = lighting_ubo.has_directional_light;
+		capture_ubo_.light_direction = lighting_ubo.directional_light.direction;
+		capture_ubo_.light_color = lighting_ubo.directional_light.color;
+
+		uint64_t scene_hash = HashBytes(kHashOffset, &capture_ubo_.sky_light.color, sizeof(capture_ubo_.sky_light.color));
+		scene_hash = HashBytes(scene_hash, capture_ubo_.sky_light.irradiance_sh, sizeof(capture_ubo_.sky_light.irradiance_sh));
+		scene_hash = HashBytes(scene_hash, &capture_ubo_.light_direction, sizeof(capture_ubo_.light_direction));
+		scene_hash = HashBytes(scene_hash, &capture_ubo_.has_directional_light, sizeof(capture_ubo_.has_directional_light));
+		scene_hash = HashBytes(scene_hash, &capture_ubo_.light_color, sizeof(capture_ubo_.light_color));
+		scene_hash = HashBytes(scene_hash, &capture_ubo_.has_sky_light, sizeof(capture_ubo_.has_sky_light));
+
+		// dynamic meshes are left out, they would capture every probe again whenever they move
+		for (const auto& render_data : render_data_list)
+		{
+			const StaticMeshRenderData* mesh = static_cast<const StaticMeshRenderData*>(render_data.get());
+			if (!mesh->is_static)
+			{
+				continue;
+			}
+			scene_hash = HashBytes(scene_hash, &mesh, sizeof(mesh));
+			scene_hash = HashBytes(scene_hash, &mesh->transform_ubo_data.model, sizeof(mesh->transform_ubo_data.model));
+			capture_meshes_.push_back(mesh);
+		}
+
+		probe_num_ = std::min(static_cast<uint32_t>(probes.size()), static_cast<uint32_t>(MAX_REFLECTION_PROBE_NUM));
+		std::array<uint64_t, MAX_REFLECTION_PROBE_NUM> content_hashes = {};
+		for (uint32_t i = 0; i < MAX_REFLECTION_PROBE_NUM; ++i)
+		{
+			if (i >= probe_num_)
+			{
+				probe_states_[i] = ProbeState();
+				continue;
+			}
+
+			const ReflectionProbe& probe = probes[i];
+			content_hashes[i] = HashBytes(scene_hash, &probe.position, sizeof(probe.position));
+			content_hashes[i] = HashBytes(content_hashes[i], &probe.box_min, sizeof(probe.box_min));
+			content_hashes[i] = HashBytes(content_hashes[i], &probe.box_max, sizeof(probe.box_max));
+		}
+
+		// a change in the middle of a capture starts it over, the faces rendered so far are stale
+		if (capture_probe_ >= static_cast<int>(probe_num_))
+		{
+			capture_probe_ = -1;
+		}
+		else if (capture_probe_ >= 0 && content_hashes[capture_probe_] != capture_hash_)
+		{
+			StartCapture(capture_probe_, content_hashes[capture_probe_], probes[capture_probe_].position);
+		}
+
+		// probes without any cube first, then the one closest to the camera
+		if (capture_probe_ < 0)
+		{
+			float best_distance = 0.0f;
+			bool best_is_captured = true;
+			for (uint32_t i = 0; i < probe_num_; ++i)
+			{
+				const ProbeState& state = probe_states_[i];
+				if (state.is_captured && state.content_hash == content_hashes[i])
+				{
+					continue;
+				}
+
+				const ReflectionProbe& probe = probes[i];
+				const float distance = glm::distance(lighting_ubo.camera_pos, glm::clamp(lighting_ubo.camera_pos, probe.box_min, probe.box_max));
+				if (capture_probe_ < 0 || (best_is_captured && !state.is_captured) ||
+					(best_is_captured == state.is_captured && distance < best_distance))
+				{
+					capture_probe_ = static_cast<int>(i);
+					best_distance = distance;
+					best_is_captured = state.is_captured;
+				}
+			}
+
+			if (capture_probe_ >= 0)
+			{
+				StartCapture(capture_probe_, content_hashes[capture_probe_], probes[capture_probe_].position);
+			}
+		}
+
+		// the credit saves up for a step that costs more than the budget of one frame, but never more than that
+		if (capture_probe_ >= 0)
+		{
+			planned_probe_ = capture_probe_;
+			budget_credit_ms_ = std::min(budget_credit_ms_ + settings_.time_budget_ms,
+				std::max(static_cast<double>(settings_.time_budget_ms), GetStepCost(capture_step_)));
+			while (capture_probe_ >= 0 && planned_steps_.size() < settings_.max_steps_per_frame && budget_credit_ms_ >= GetStepCost(capture_step_))
+			{
+				budget_credit_ms_ -= GetStepCost(capture_step_);
+				planned_steps_.push_back(capture_step_);
+
+				if (capture_step_ == kPrefilterStep)
+				{
+					// the prefilter is recorded before the lighting of this frame reads the probe
+					probe_states_[capture_probe_].content_hash = capture_hash_;
+					probe_states_[capture_probe_].is_captured = true;
+					capture_probe_ = -1;
+				}
+				else
+				{
+					++capture_step_;
+				}
+			}
+		}
+		else
+		{
+			budget_credit_ms_ = 0.0;
+		}
+
+		// the lighting accumulates the smaller boxes first, they are the more local probes
+		std::array<uint32_t, MAX_REFLECTION_PROBE_NUM> captured_probes = {};
+		uint32_t captured_num = 0;
+		for (uint32_t i = 0; i < probe_num_; ++i)
+		{
+			if (probe_states_[i].is_captured)
+			{
+				captured_probes[captured_num++] = i;
+			}
+		}
+		std::stable_sort(captured_probes.begin(), captured_probes.begin() + captured_num,
+			[&probes](uint32_t a, uint32_t b) { return GetBoxVolume(probes[a]) < GetBoxVolume(probes[b]); });
+
+		lighting_ubo.reflection_probe_num = static_cast<int>(captured_num);
+		for (uint32_t i = 0; i < captured_num; ++i)
+		{
+			lighting_ubo.reflection_probes[i] = probes[captured_probes[i]];
+			lighting_ubo.reflection_probes[i].array_index = static_cast<int>(captured_probes[i]);
+		}
+	}
+
+	void ReflectionProbePass::Render(VkCommandBuffer command_buffer)
+	{
+		if (!is_initialized || planned_steps_.empty())
+		{
+			return;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "ReflectionProbe");
+
+		// the constants of the capture live in their own buffer, the faces of the last capture read it before
+		VkBufferMemoryBarrier buffer_barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+		buffer_barrier.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+		buffer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		buffer_barrier.buffer = capture_ub_.resource;
+		buffer_barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+
+		vkCmdUpdateBuffer(command_buffer, capture_ub_.resource, 0, sizeof(ReflectionProbeCaptureUBO), &capture_ubo_);
+
+		buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		buffer_barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+
+		for (uint32_t step : planned_steps_)
+		{
+			if (step == kPrefilterStep)
+			{
+				PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "ReflectionProbePrefilter");
+				Prefilter(command_buffer);
+			}
+			else
+			{
+				PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "ReflectionProbeFace");
+				RenderFace(command_buffer, step);
+			}
+		}
+	}
+
+	void ReflectionProbePass::RenderFace(VkCommandBuffer command_buffer, uint32_t face)
+	{
+		// the render pass leaves the face ready to be blitted into the mip chain
+		const VkClearValue clear_values[2] = { { { { 0.0f, 0.0f, 0.0f, 1.0f } } }, { { { 1.0f, 0 } } } };
+		VkRenderPassBeginInfo render_pass_begin_info{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		render_pass_begin_info.renderPass = render_pass_;
+		render_pass_begin_info.framebuffer = capture_framebuffers_[face];
+		render_pass_begin_info.renderArea.offset = { 0, 0 };
+		render_pass_begin_info.renderArea.extent = { REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE };
+		render_pass_begin_info.clearValueCount = 2;
+		render_pass_begin_info.pClearValues = clear_values;
+
+		vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+		const VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(REFLECTION_PROBE_SIZE), static_cast<float>(REFLECTION_PROBE_SIZE), 0.0f, 1.0f };
+		const VkRect2D scissor = { { 0, 0 }, { REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE } };
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, capture_pipeline_layout_, 0, 1, &capture_descriptor_set_, 0, nullptr);
+
+		ReflectionProbeCapturePCO capture_pco = {};
+		capture_pco.face = static_cast<int>(face);
+
+		// the sky behind everything, without depth; the clear color stands in until the sky is bound
+		if (sky_texture_.image_view != VK_NULL_HANDLE)
+		{
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sky_pipeline_);
+			vkCmdPushConstants(command_buffer, capture_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				0, sizeof(ReflectionProbeCapturePCO), &capture_pco);
+			vkCmdDraw(command_buffer, 3, 1, 0, 0);
+		}
+
+		std::array<glm::vec4, 6> frustum_planes;
+		ShadowCascades::ExtractFrustumPlanes(capture_ubo_.face_view_projs[face], frustum_planes);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_);
+		for (const StaticMeshRenderData* mesh : capture_meshes_)
+		{
+			capture_pco.model = mesh->transform_ubo_data.model;
+			if (mesh->has_bounding_box)
+			{
+				glm::vec3 world_min;
+				glm::vec3 world_max;
+				ShadowCascades::TransformAabb(capture_pco.model, mesh->bounding_box_min, mesh->bounding_box_max, world_min, world_max);
+				if (!ShadowCascades::IsAabbInFrustum(frustum_planes, world_min, world_max))
+				{
+					continue;
+				}
+			}
+
+			VkBuffer vertex_buffer[] = { mesh->vertex_buffer.resource };
+			constexpr VkDeviceSize vertex_buffer_offset = { 0 };
+			vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer, &vertex_buffer_offset);
+			vkCmdBindIndexBuffer(command_buffer, mesh->index_buffer.resource, 0, VK_INDEX_TYPE_UINT32);
+
+			// blended submeshes are left out like in the shadows, a probe only sees opaque surfaces
+			const uint32_t submesh_counts = static_cast<uint32_t>(mesh->index_counts.size());
+			for (uint32_t i = 0; i < submesh_counts; ++i)
+			{
+				if (i < mesh->material_pcos.size())
+				{
+					if (mesh->material_pcos[i].is_blend)
+					{
+						continue;
+					}
+					capture_pco.base_color_factor = mesh->material_pcos[i].base_color_factor;
+					capture_pco.emissive_factor = mesh->material_pcos[i].emissive_factor;
+				}
+				else
+				{
+					capture_pco.base_color_factor = glm::vec4(1.0f);
+					capture_pco.emissive_factor = glm::vec4(0.0f);
+				}
+
+				vkCmdPushConstants(command_buffer, capture_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+					0, sizeof(ReflectionProbeCapturePCO), &capture_pco);
+				vkCmdDrawIndexed(command_buffer, mesh->index_counts[i], 1, mesh->index_offsets[i], 0, 0);
+			}
+		}
+
+		vkCmdEndRenderPass(command_buffer);
+	}
+
+	void ReflectionProbePass::Prefilter(VkCommandBuffer command_buffer)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		const uint32_t first_layer = static_cast<uint32_t>(planned_probe_) * kFaceStepNum;
+		TextureData probe_array_texture;
+		FillProbeArrayTexture(probe_array_texture);
+
+		// mip chain of the captured cube, the prefilter samples it by the pdf of every sample like the sky
+		for (uint32_t level = 1; level < REFLECTION_PROBE_MIP_LEVELS; ++level)
+		{
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				{ TextureMemoryBarrier(*capture_cube_, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL).MipLevels(level, 1) });
+
+			VkImageBlit region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, kFaceStepNum };
+			region.srcOffsets[1] = { static_cast<int32_t>(REFLECTION_PROBE_SIZE >> (level - 1)), static_cast<int32_t>(REFLECTION_PROBE_SIZE >> (level - 1)), 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, kFaceStepNum };
+			region.dstOffsets[1] = { static_cast<int32_t>(REFLECTION_PROBE_SIZE >> level), static_cast<int32_t>(REFLECTION_PROBE_SIZE >> level), 1 };
+			vkCmdBlitImage(command_buffer, capture_cube_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				capture_cube_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				{ TextureMemoryBarrier(*capture_cube_, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).MipLevels(level, 1) });
+		}
+
+		// the old cube of the slot is dropped, the lighting of earlier frames is done reading it
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			{ TextureMemoryBarrier(probe_array_texture, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL).MipLevels(0, 1).ArrayLayers(first_layer, kFaceStepNum),
+			TextureMemoryBarrier(probe_array_texture, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_GENERAL).MipLevels(1, REFLECTION_PROBE_MIP_LEVELS - 1).ArrayLayers(first_layer, kFaceStepNum) });
+
+		// a mirror reflection is the capture itself
+		VkImageCopy copy_region = {};
+		copy_region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, kFaceStepNum };
+		copy_region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, first_layer, kFaceStepNum };
+		copy_region.extent = { REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE, 1 };
+		vkCmdCopyImage(command_buffer, capture_cube_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			probe_array_.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			{ TextureMemoryBarrier(*capture_cube_, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(0, REFLECTION_PROBE_MIP_LEVELS) });
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, prefilter_pipeline_);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, prefilter_pipeline_layout_, 0,
+			1, &prefilter_descriptor_sets_[planned_probe_], 0, nullptr);
+
+		const float delta_roughness = 1.0f / static_cast<float>(REFLECTION_PROBE_MIP_LEVELS - 1);
+		for (uint32_t level = 1; level < REFLECTION_PROBE_MIP_LEVELS; ++level)
+		{
+			const uint32_t num_groups = std::max(1u, static_cast<uint32_t>(REFLECTION_PROBE_SIZE >> level) / 32);
+			const float roughness = static_cast<float>(level) * delta_roughness;
+			const SpecularFilterPushConstants push_constant = { level - 1, roughness, IblPrefilter::GetSampleCount(roughness) };
+			vkCmdPushConstants(command_buffer, prefilter_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SpecularFilterPushConstants), &push_constant);
+			vkCmdDispatch(command_buffer, num_groups, num_groups, kFaceStepNum);
+		}
+
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(probe_array_texture, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(0, 1).ArrayLayers(first_layer, kFaceStepNum),
+			TextureMemoryBarrier(probe_array_texture, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(1, REFLECTION_PROBE_MIP_LEVELS - 1).ArrayLayers(first_layer, kFaceStepNum) });
+	}
+
+	void ReflectionProbePass::FillProbeArrayTexture(TextureData& out_texture) const
+	{
+		out_texture.image = probe_array_;
+		out_texture.image_view = probe_array_view_;
+		out_texture.image_sampler = sampler_;
+		out_texture.width = REFLECTION_PROBE_SIZE;
+		out_texture.height = REFLECTION_PROBE_SIZE;
+		out_texture.channels = 4;
+		out_texture.levels = REFLECTION_PROBE_MIP_LEVELS;
+		out_texture.layers = kFaceStepNum * MAX_REFLECTION_PROBE_NUM;
+		out_texture.pixels = nullptr;
+	}
+
+	void ReflectionProbePass::SetStepCosts(double face_ms, double prefilter_ms)
+	{
+		face_cost_ms_ = face_ms;
+		prefilter_cost_ms_ = prefilter_ms;
+	}
+
+	uint32_t ReflectionProbePass::GetCapturedProbeCount() const
+	{
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < probe_num_; ++i)
+		{
+			count += probe_states_[i].is_captured ? 1 : 0;
+		}
+		return count;
+	}
+
+	glm::mat4 ReflectionProbePass::ComputeFaceViewProj(const glm::vec3& position, uint32_t face)
+	{
+		// +x, -x, +y, -y, +z, -z with the ups of the cube map faces, the texel rows run down the face
+		static const glm::vec3 kFaceDirections[kFaceStepNum] = { { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+			{ 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+		static const glm::vec3 kFaceUps[kFaceStepNum] = { { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+			{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } };
+
+		const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, kCaptureNearPlane, kCaptureFarPlane);
+		return projection * glm::lookAt(position, position + kFaceDirections[face], kFaceUps[face]);
+	}
+
+	double ReflectionProbePass::GetStepCost(uint32_t step) const
+	{
+		return step == kPrefilterStep ? prefilter_cost_ms_ : face_cost_ms_;
+	}
+
+	void ReflectionProbePass::StartCapture(int probe, uint64_t content_hash, const glm::vec3& position)
+	{
+		capture_probe_ = probe;
+		capture_step_ = 0;
+		capture_hash_ = content_hash;
+		for (uint32_t face = 0; face < kFaceStepNum; ++face)
+		{
+			capture_ubo_.face_view_projs[face] = ComputeFaceViewProj(position, face);
+		}
+	}
+
+	void ReflectionProbePass::CreateTextures()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		capture_cube_ = rhi->CreateTexture(REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE, kFaceStepNum, REFLECTION_PROBE_MIP_LEVELS,
+			kProbeFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+		for (uint32_t face = 0; face < kFaceStepNum; ++face)
+		{
+			capture_face_views_[face] = rhi->CreateImageLayerView(capture_cube_->image.resource, kProbeFormat, VK_IMAGE_ASPECT_COLOR_BIT, face);
+		}
+
+		capture_depth_ = rhi->CreateImage(REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE, 1, 1, 1, kDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		capture_depth_view_ = rhi->CreateImageView(capture_depth_.resource, kDepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 1);
+
+		capture_ub_ = rhi->CreateBuffer(sizeof(ReflectionProbeCaptureUBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		probe_array_ = rhi->CreateImage(REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE, kFaceStepNum * MAX_REFLECTION_PROBE_NUM, REFLECTION_PROBE_MIP_LEVELS, 1,
+			kProbeFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		probe_array_view_ = rhi->CreateCubeImageView(probe_array_.resource, kProbeFormat, 0, REFLECTION_PROBE_MIP_LEVELS, 0, MAX_REFLECTION_PROBE_NUM);
+		for (uint32_t slot = 0; slot < MAX_REFLECTION_PROBE_NUM; ++slot)
+		{
+			for (uint32_t level = 1; level < REFLECTION_PROBE_MIP_LEVELS; ++level)
+			{
+				probe_level_views_.push_back(rhi->CreateCubeImageView(probe_array_.resource, kProbeFormat, level, 1, slot * kFaceStepNum, 1));
+			}
+		}
+
+		// trilinear, the lighting and the prefilter pick the level by roughness and sample pdf
+		VkSamplerCreateInfo create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.maxLod = VK_LOD_CLAMP_NONE;
+		rhi->CreateSampler(&create_info, &sampler_);
+
+		// the lighting only samples captured slots, but the whole array is bound from the first frame
+		TextureData probe_array_texture;
+		FillProbeArrayTexture(probe_array_texture);
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(probe_array_texture, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(0, REFLECTION_PROBE_MIP_LEVELS).ArrayLayers(0, kFaceStepNum * MAX_REFLECTION_PROBE_NUM) });
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+	}
+
+	void ReflectionProbePass::CreateRenderPass()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// every face is rendered from scratch and handed to the mip chain blits of the prefilter step
+		std::array<VkAttachmentDescription, 2> attachments = {};
+		attachments[0].format = kProbeFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		attachments[1].format = kDepthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference color_reference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depth_reference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &color_reference;
+		subpass.pDepthStencilAttachment = &depth_reference;
+
+		// the cube may still be read by the blits, copy and prefilter of the last capture
+		std::array<VkSubpassDependency, 2> dependencies = {};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		VkRenderPassCreateInfo create_info = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+		create_info.pAttachments = attachments.data();
+		create_info.subpassCount = 1;
+		create_info.pSubpasses = &subpass;
+		create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		create_info.pDependencies = dependencies.data();
+		rhi->CreateRenderPass(&create_info, &render_pass_);
+	}
+
+	void ReflectionProbePass::CreateFramebuffers()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		for (uint32_t face = 0; face < kFaceStepNum; ++face)
+		{
+			const VkImageView attachments[2] = { capture_face_views_[face], capture_depth_view_ };
+			VkFramebufferCreateInfo create_info = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+			create_info.renderPass = render_pass_;
+			create_info.attachmentCount = 2;
+			create_info.pAttachments = attachments;
+			create_info.width = REFLECTION_PROBE_SIZE;
+			create_info.height = REFLECTION_PROBE_SIZE;
+			create_info.layers = 1;
+			rhi->CreateFrameBuffer(&create_info, &capture_framebuffers_[face]);
+		}
+	}
+
+	void ReflectionProbePass::CreateDescriptors()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// one capture set plus a prefilter set per slot, the global pool has no storage images
+		const std::vector<VkDescriptorPoolSize> pool_sizes = {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + MAX_REFLECTION_PROBE_NUM },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_REFLECTION_PROBE_NUM * (REFLECTION_PROBE_MIP_LEVELS - 1) },
+		};
+		VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_create_info.maxSets = 1 + MAX_REFLECTION_PROBE_NUM;
+		pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_create_info.pPoolSizes = pool_sizes.data();
+		rhi->CreateDescriptorPool(&pool_create_info, &descriptor_pool_);
+
+		capture_descriptor_layout_ = rhi->CreateDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+		});
+		capture_descriptor_set_ = rhi->AllocateDescriptor(descriptor_pool_, capture_descriptor_layout_);
+		rhi->UpdateBufferDescriptorSet(capture_descriptor_set_, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			{ { capture_ub_.resource, 0, sizeof(ReflectionProbeCaptureUBO) } });
+
+		// the bindings of spmap_cs, every slot writes its levels through its own views
+		prefilter_descriptor_layout_ = rhi->CreateDescriptorSetLayout({
+			{ PREFILTER_INPUT_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &sampler_ },
+			{ PREFILTER_OUTPUT_MIP_TAILS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, REFLECTION_PROBE_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		});
+		for (uint32_t slot = 0; slot < MAX_REFLECTION_PROBE_NUM; ++slot)
+		{
+			prefilter_descriptor_sets_[slot] = rhi->AllocateDescriptor(descriptor_pool_, prefilter_descriptor_layout_);
+			rhi->UpdateImageDescriptorSet(prefilter_descriptor_sets_[slot], PREFILTER_INPUT_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				{ { sampler_, capture_cube_->image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
+
+			std::vector<VkDescriptorImageInfo> mip_tails;
+			for (uint32_t level = 1; level < REFLECTION_PROBE_MIP_LEVELS; ++level)
+			{
+				mip_tails.push_back({ sampler_, probe_level_views_[slot * (REFLECTION_PROBE_MIP_LEVELS - 1) + level - 1], VK_IMAGE_LAYOUT_GENERAL });
+			}
+			rhi->UpdateImageDescriptorSet(prefilter_descriptor_sets_[slot], PREFILTER_OUTPUT_MIP_TAILS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, mip_tails);
+		}
+	}
+
+	void ReflectionProbePass::CreatePipelines()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		capture_pipeline_layout_ = rhi->CreatePipelineLayout({ capture_descriptor_layout_ },
+			{ {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ReflectionProbeCapturePCO)} });
+		sky_pipeline_ = CreateCapturePipeline(rhi, "screen.vert", "reflection_probe_sky.frag", false);
+		mesh_pipeline_ = CreateCapturePipeline(rhi, "reflection_probe_capture.vert", "reflection_probe_capture.frag", true);
+
+		prefilter_pipeline_layout_ = rhi->CreatePipelineLayout({ prefilter_descriptor_layout_ },
+			{ {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SpecularFilterPushConstants)} });
+		VkShaderModule prefilter_cs = ShaderManager::Get().GetShaderModule(rhi, "prefiltered_env_map.comp");
+		const VkSpecializationMapEntry map_entry = { 0, 0, sizeof(uint32_t) };
+		const uint32_t mip_levels = REFLECTION_PROBE_MIP_LEVELS - 1;
+		const VkSpecializationInfo specialization_info = { 1, &map_entry, sizeof(uint32_t), &mip_levels };
+		prefilter_pipeline_ = rhi->CreateComputePipeline(prefilter_cs, prefilter_pipeline_layout_, &specialization_info);
+	}
+
+	VkPipeline ReflectionProbePass::CreateCapturePipeline(const std::shared_ptr<RHI>& rhi, const char* vs_name, const char* fs_name, bool draws_meshes)
+	{
+		VkShaderModule vs = ShaderManager::Get().GetShaderModule(rhi, vs_name);
+		VkShaderModule fs = ShaderManager::Get().GetShaderModule(rhi, fs_name);
+		const VkPipelineShaderStageCreateInfo shader_stages[2] = {
+			{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_VERTEX_BIT, vs, "main", nullptr },
+			{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main", nullptr } };
+
+		// meshes read position and normal, the sky is a full screen triangle without vertices
+		const VkVertexInputBindingDescription vertex_binding = { 0, sizeof(Mesh::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+		const VkVertexInputAttributeDescription vertex_attributes[2] = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Mesh::Vertex, position) },
+			{ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Mesh::Vertex, normal) } };
+		VkPipelineVertexInputStateCreateInfo vertex_input_state = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		if (draws_meshes)
+		{
+			vertex_input_state.vertexBindingDescriptionCount = 1;
+			vertex_input_state.pVertexBindingDescriptions = &vertex_binding;
+			vertex_input_state.vertexAttributeDescriptionCount = 2;
+			vertex_input_state.pVertexAttributeDescriptions = vertex_attributes;
+		}
+
+		VkPipelineInputAssemblyStateCreateInfo input_assembly_state = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		input_assembly_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineViewportStateCreateInfo viewport_state = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewport_state.viewportCount = 1;
+		viewport_state.scissorCount = 1;
+
+		// the cube face projections mirror the winding of some faces, so nothing is culled
+		VkPipelineRasterizationStateCreateInfo rasterization_state = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterization_state.cullMode = VK_CULL_MODE_NONE;
+		rasterization_state.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rasterization_state.lineWidth = 1.0f;
+
+		VkPipelineMultisampleStateCreateInfo multisample_state = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineDepthStencilStateCreateInfo depth_stencil_state = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depth_stencil_state.depthTestEnable = draws_meshes ? VK_TRUE : VK_FALSE;
+		depth_stencil_state.depthWriteEnable = draws_meshes ? VK_TRUE : VK_FALSE;
+		depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		VkPipelineColorBlendAttachmentState color_blend_attachment = {};
+		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkPipelineColorBlendStateCreateInfo color_blend_state = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+		color_blend_state.attachmentCount = 1;
+		color_blend_state.pAttachments = &color_blend_attachment;
+
+		const VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamic_state = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+		dynamic_state.dynamicStateCount = 2;
+		dynamic_state.pDynamicStates = dynamic_states;
+
+		VkGraphicsPipelineCreateInfo create_info = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		create_info.stageCount = 2;
+		create_info.pStages = shader_stages;
+		create_info.pVertexInputState = &vertex_input_state;
+		create_info.pInputAssemblyState = &input_assembly_state;
+		create_info.pViewportState = &viewport_state;
+		create_info.pRasterizationState = &rasterization_state;
+		create_info.pMultisampleState = &multisample_state;
+		create_info.pDepthStencilState = &depth_stencil_state;
+		create_info.pColorBlendState = &color_blend_state;
+		create_info.pDynamicState = &dynamic_state;
+		create_info.layout = capture_pipeline_layout_;
+		create_info.renderPass = render_pass_;
+		create_info.subpass = 0;
+		return rhi->CreateGraphicsPipeline(VK_NULL_HANDLE, 1, &create_info);
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include "../render_data.h"
+#include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_profiler.h"
+
+namespace peanut
+{
+	/**
+	* @brief local reflection probes captured from the static scene into one cube map array
+	*
+	* A probe is captured again when its placement, the static meshes or the sky and directional
+	* light change. Captures are time sliced: every frame spends a gpu time budget on the steps of
+	* one probe, a step renders one cube face or prefilters the finished cube into the array with the
+	* prefilter shader of the sky light. The lighting only reads probes that were captured once, a
+	* probe being captured again keeps its last cube until the new one is prefiltered.
+	*/
+	class ReflectionProbePass
+	{
+	public:
+		struct Settings
+		{
+			float time_budget_ms = 0.5f;    // gpu time spent on captures per frame on average
+			uint32_t max_steps_per_frame = 1;
+		};
+
+		// six face steps, then the prefilter step
+		static constexpr uint32_t kFaceStepNum = 6;
+		static constexpr uint32_t kPrefilterStep = kFaceStepNum;
+
+		ReflectionProbePass() = default;
+		~ReflectionProbePass() = default;
+
+		void Initialize(std::weak_ptr<RHI> rhi, const TextureData& sky_texture, GpuProfiler* gpu_profiler = nullptr);
+		void Destroy();
+
+		// plan the capture steps of this frame and write the captured probes, smallest influence box first,
+		// to lighting_ubo; the sky and directional light of lighting_ubo light the captures
+		void Update(const std::vector<ReflectionProbe>& probes, const std::vector<std::shared_ptr<RenderData> >& render_data_list,
+			LightingUBO& lighting_ubo);
+
+		// record the steps of the last Update(), outside of any render pass
+		void Render(VkCommandBuffer command_buffer);
+
+		// the sky behind the captured meshes, faces are captured without sky until there is one
+		void SetSkyTexture(const TextureData& sky_texture);
+
+		// the cube map array of all probe slots and its trilinear sampler
+		void FillProbeArrayTexture(TextureData& out_texture) const;
+
+		void SetSettings(const Settings& settings) { settings_ = settings; }
+		const Settings& GetSettings() const { return settings_; }
+
+		// gpu time of a face and of a prefilter step, Update() takes them from the gpu profiler when there is one
+		void SetStepCosts(double face_ms, double prefilter_ms);
+
+		// steps of the last Update(), kPrefilterStep for the prefilter
+		const std::vector<uint32_t>& GetPlannedSteps() const { return planned_steps_; }
+		// probe of the running capture, -1 when every probe is up to date
+		int GetCaptureProbe() const { return capture_probe_; }
+		uint32_t GetCapturedProbeCount() const;
+
+		static glm::mat4 ComputeFaceViewProj(const glm::vec3& position, uint32_t face);
+
+		ReflectionProbePass(const ReflectionProbePass&) = delete;
+		ReflectionProbePass& operator=(const ReflectionProbePass&) = delete;
+
+	private:
+		struct ProbeState
+		{
+			uint64_t content_hash = 0;
+			bool is_captured = false;
+		};
+
+		enum PrefilterBinding
+		{
+			PREFILTER_INPUT_TEXTURE = 0,
+			PREFILTER_OUTPUT_MIP_TAILS = 2,
+		};
+
+		double GetStepCost(uint32_t step) const;
+		void StartCapture(int probe, uint64_t content_hash, const glm::vec3& position);
+
+		void CreateTextures();
+		void CreateRenderPass();
+		void CreateFramebuffers();
+		void CreateDescriptors();
+		void CreatePipelines();
+		VkPipeline CreateCapturePipeline(const std::shared_ptr<RHI>& rhi, const char* vs_name, const char* fs_name, bool draws_meshes);
+		void RenderFace(VkCommandBuffer command_buffer, uint32_t face);
+		void Prefilter(VkCommandBuffer command_buffer);
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
+		TextureData sky_texture_;
+
+		Settings settings_;
+		double face_cost_ms_ = 0.1;
+		double prefilter_cost_ms_ = 0.2;
+		double budget_credit_ms_ = 0.0;
+
+		std::array<ProbeState, MAX_REFLECTION_PROBE_NUM> probe_states_ = {};
+		uint32_t probe_num_ = 0;
+
+		// the capture in flight, its hash is committed to the probe once the prefilter step is planned
+		int capture_probe_ = -1;
+		uint32_t capture_step_ = 0;
+		uint64_t capture_hash_ = 0;
+		ReflectionProbeCaptureUBO capture_ubo_ = {};
+		// the probe whose steps Render() records
+		int planned_probe_ = -1;
+		std::vector<uint32_t> planned_steps_;
+		std::vector<const StaticMeshRenderData*> capture_meshes_;
+
+		// one cube rendered face by face, mip mapped and copied into its array slot before the prefilter
+		std::shared_ptr<TextureData> capture_cube_;
+		std::array<VkImageView, kFaceStepNum> capture_face_views_ = {};
+		std::array<VkFramebuffer, kFaceStepNum> capture_framebuffers_ = {};
+		Resource<VkImage> capture_depth_;
+		VkImageView capture_depth_view_ = VK_NULL_HANDLE;
+		Resource<VkBuffer> capture_ub_;
+
+		Resource<VkImage> probe_array_;
+		VkImageView probe_array_view_ = VK_NULL_HANDLE;
+		// storage views of the prefiltered levels, per slot and level
+		std::vector<VkImageView> probe_level_views_;
+		VkSampler sampler_ = VK_NULL_HANDLE;
+
+		VkRenderPass render_pass_ = VK_NULL_HANDLE;
+		VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout capture_descriptor_layout_ = VK_NULL_HANDLE;
+		VkDescriptorSet capture_descriptor_set_ = VK_NULL_HANDLE;
+		VkPipelineLayout capture_pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline sky_pipeline_ = VK_NULL_HANDLE;
+		VkPipeline mesh_pipeline_ = VK_NULL_HANDLE;
+
+		VkDescriptorSetLayout prefilter_descriptor_layout_ = VK_NULL_HANDLE;
+		std::array<VkDescriptorSet, MAX_REFLECTION_PROBE_NUM> prefilter_descriptor_sets_ = {};
+		VkPipelineLayout prefilter_pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline prefilter_pipeline_ = VK_NULL_HANDLE;
+
+		static constexpr VkFormat kProbeFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		static constexpr VkFormat kDepthFormat = VK_FORMAT_D32_SFLOAT;
+		static constexpr float kCaptureNearPlane = 0.05f;
+		static constexpr float kCaptureFarPlane = 1000.0f;
+	};
+}
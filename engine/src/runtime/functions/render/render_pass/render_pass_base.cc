@@ -1,11 +1,18 @@
 #include "render_pass_base.h"
 #include "../render_utils.h"
+#include "../shader_manager.h"
+#include "runtime/core/profile/cpu_profiler.h"
+#include "runtime/core/thread/thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
 
 namespace peanut
 {
 	void IRenderPassBase::Initialize(PassInitInfo* init_info)
 	{
 		rhi_ = init_info->rhi_;
+		gpu_profiler_ = init_info->gpu_profiler_;
 
 		CreateRenderTargets();
 		CreateRenderPass();
@@ -15,6 +22,88 @@ namespace peanut
 		CreatePipelineLayouts();
 		CreatePipelineCache();
 		CreatePipelines();
+
+		// new pipelines may have been compiled into the cache, write it back right away
+		// instead of only at shutdown so a crash does not lose them
+		SavePipelineCache();
+	}
+
+	bool IRenderPassBase::LoadPipelineCacheData(std::vector<char>& out_data)
+	{
+		const std::string cache_path = GetPipelineCachePath();
+		if (!RenderUtils::ReadBinaryFile(cache_path, out_data))
+		{
+			PEANUT_LOG_INFO("No pipeline cache found at {0}, start with an empty cache", cache_path);
+			return false;
+		}
+
+		// the driver rejects (or worse, trusts) a blob produced by another device or driver version,
+		// so validate the header against the current physical device before handing it over
+		VkPipelineCacheHeaderVersionOne header{};
+		if (out_data.size() < sizeof(header))
+		{
+			PEANUT_LOG_WARN("Pipeline cache {0} is truncated, discard it", cache_path);
+			out_data.clear();
+			return false;
+		}
+		std::memcpy(&header, out_data.data(), sizeof(header));
+
+		const VkPhysicalDeviceProperties& properties = rhi_.lock()->GetPhysicalDevice().properties;
+		if (header.headerSize < sizeof(header) ||
+			header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+			header.vendorID != properties.vendorID ||
+			header.deviceID != properties.deviceID ||
+			std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			PEANUT_LOG_WARN("Pipeline cache {0} was created by another device or driver, discard it", cache_path);
+			out_data.clear();
+			return false;
+		}
+
+		return true;
+	}
+
+	void IRenderPassBase::SavePipelineCache()
+	{
+		auto rhi = rhi_.lock();
+		if (rhi.get() == nullptr || pipeline_cache_ == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		std::vector<char> cache_data;
+		if (!rhi->GetPipelineCacheData(pipeline_cache_, cache_data) || cache_data.empty())
+		{
+			return;
+		}
+
+		// the cache only grows, skip the write if nothing has been added since the last save
+		if (cache_data.size() == pipeline_cache_saved_size_)
+		{
+			return;
+		}
+
+		const std::string cache_path = GetPipelineCachePath();
+		if (!RenderUtils::WriteBinaryFile(cache_path, cache_data.data(), cache_data.size()))
+		{
+			PEANUT_LOG_WARN("Failed to write pipeline cache to {0}", cache_path);
+			return;
+		}
+
+		pipeline_cache_saved_size_ = cache_data.size();
+	}
+
+	void IRenderPassBase::DestroyPipelineCache()
+	{
+		SavePipelineCache();
+
+		auto rhi = rhi_.lock();
+		if (rhi.get() != nullptr && pipeline_cache_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineCache(pipeline_cache_);
+		}
+		pipeline_cache_ = VK_NULL_HANDLE;
+		pipeline_cache_saved_size_ = 0;
 	}
 
 	void IRenderPassBase::CreatePipelineCache()
@@ -22,9 +111,24 @@ namespace peanut
 		auto rhi = rhi_.lock();
 		assert(rhi.get() != nullptr);
 
+		std::vector<char> initial_data;
 		VkPipelineCacheCreateInfo pipeline_cache_ci { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+		if (LoadPipelineCacheData(initial_data))
+		{
+			pipeline_cache_ci.initialDataSize = initial_data.size();
+			pipeline_cache_ci.pInitialData = initial_data.data();
+		}
 		pipeline_cache_ = rhi->CreatePipelineCache(&pipeline_cache_ci);
 
+		if (pipeline_cache_ == VK_NULL_HANDLE && pipeline_cache_ci.initialDataSize > 0)
+		{
+			// a corrupted blob that passed header validation, fall back to an empty cache
+			pipeline_cache_ci.initialDataSize = 0;
+			pipeline_cache_ci.pInitialData = nullptr;
+			pipeline_cache_ = rhi->CreatePipelineCache(&pipeline_cache_ci);
+		}
+		pipeline_cache_saved_size_ = pipeline_cache_ci.initialDataSize;
+
 		// pipeline create info
 		input_assembly_state_ci.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		input_assembly_state_ci.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -40,9 +144,10 @@ namespace peanut
 		rasterization_state_ci.lineWidth = 1.0f;
 		
 		multisample_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisample_state_ci.sampleShadingEnable = VK_TRUE;
+		// a single sample is shaded once per pixel anyway, sample shading only adds the requirement on the device feature
+		multisample_state_ci.sampleShadingEnable = VK_FALSE;
 		multisample_state_ci.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisample_state_ci.minSampleShading = 0.2f;
+		multisample_state_ci.minSampleShading = 1.0f;
 
 		depth_stencil_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 		depth_stencil_state_ci.depthTestEnable = VK_TRUE;
@@ -88,79 +193,135 @@ namespace peanut
 
 	}
 
-	void IRenderPassBase::UpdatePushConstants(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout,
-		const std::vector<const void*>& pcos, std::vector<VkPushConstantRange> push_constant_ranges)
+	GraphicsPipelineState IRenderPassBase::SnapshotGraphicsPipelineState(VkPipelineLayout layout, uint32_t subpass) const
 	{
-		assert(pcos.size() == push_constant_ranges.size());
-		
-		for (size_t i = 0; i < push_constant_ranges.size(); i++)
-		{
-			const VkPushConstantRange& push_constant_range = push_constant_ranges[i];
-			vkCmdPushConstants(command_buffer, pipeline_layout, push_constant_range.stageFlags, 
-				push_constant_range.offset, push_constant_range.size, pcos[i]);
-		}
+		GraphicsPipelineState state;
+		state.input_assembly_state = input_assembly_state_ci;
+		state.rasterization_state = rasterization_state_ci;
+		state.multisample_state = multisample_state_ci;
+		state.depth_stencil_state = depth_stencil_state_ci;
+		state.viewport_state = viewport_state_ci;
+		state.color_blend_attachments = color_blend_attachment_states;
+		state.color_blend_state = color_blend_state_ci;
+		state.dynamic_states = dynamic_states;
+		state.layout = layout;
+		state.render_pass = render_pass_.has_value() ? render_pass_.value() : VK_NULL_HANDLE;
+		state.subpass = subpass;
+		return state;
 	}
 
-	void IRenderPassBase::CreateUniformBuffer(uint32_t buffer_size)
+	void IRenderPassBase::AddShaderStage(GraphicsPipelineState& state, const std::string& shader_name, VkShaderStageFlagBits stage)
 	{
-		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
-		if (!uniform_buffer_.has_value())
+		state.shader_stages.push_back(ShaderManager::Get().GetShaderStageCreateInfo(rhi_, shader_name, stage));
+		state.shader_names.push_back(shader_name);
+	}
+
+	void IRenderPassBase::RefreshShaderStages(GraphicsPipelineState& state)
+	{
+		assert(state.shader_stages.size() == state.shader_names.size());
+		for (size_t i = 0; i < state.shader_stages.size(); ++i)
 		{
-			uniform_buffer_ = UniformBuffer();
+			state.shader_stages[i].module = ShaderManager::Get().GetShaderModule(rhi_, state.shader_names[i]);
 		}
-
-		uniform_buffer_->buffer = vulkan_rhi->CreateBuffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		uniform_buffer_->capacity = buffer_size;
-		uniform_buffer_->cursor = 0;
-		vulkan_rhi->MapMemory(uniform_buffer_->buffer.memory, 0, VK_WHOLE_SIZE, 0,&uniform_buffer_->host_mem_ptr);
 	}
 
-	void IRenderPassBase::DestoryUniformBuffer()
+	void IRenderPassBase::SetSpecializationConstant(GraphicsPipelineState& state, uint32_t constant_id, uint32_t value, VkShaderStageFlags stages)
 	{
-		std::shared_ptr<VulkanRHI> vulkan_rhi = std::static_pointer_cast<VulkanRHI>(rhi_.lock());
-		if (uniform_buffer_->host_mem_ptr != nullptr &&
-			uniform_buffer_->buffer.memory != VK_NULL_HANDLE)
+		auto entry = std::find_if(state.specialization_entries.begin(), state.specialization_entries.end(),
+			[constant_id](const VkSpecializationMapEntry& map_entry) { return map_entry.constantID == constant_id; });
+		if (entry == state.specialization_entries.end())
 		{
-			vulkan_rhi->UnMapMemory(uniform_buffer_->buffer.memory);
+			const uint32_t offset = static_cast<uint32_t>(state.specialization_data.size());
+			state.specialization_entries.push_back({ constant_id, offset, sizeof(uint32_t) });
+			state.specialization_data.resize(offset + sizeof(uint32_t));
+			entry = state.specialization_entries.end() - 1;
 		}
 
-		vulkan_rhi->DestroyBuffer(uniform_buffer_->buffer);
+		std::memcpy(state.specialization_data.data() + entry->offset, &value, sizeof(uint32_t));
+		state.specialization_stages |= stages;
 	}
 
-	template<typename T>
-	SubstorageUniformBuffer IRenderPassBase::AllocateSubstorageFromUniformBuffer()
+	std::future<VkPipeline> IRenderPassBase::CreateGraphicsPipelineAsync(ThreadPool& thread_pool, GraphicsPipelineState state)
 	{
-		uint32_t buffer_size = sizeof(T);
-		auto rhi = rhi_.lock();
-		assert(rhi.get() != nullptr);
+		std::weak_ptr<RHI> weak_rhi = rhi_;
+		VkPipelineCache pipeline_cache = pipeline_cache_;
 
-		const auto& properties = rhi->GetPhysicalDevice().properties;
-		const VkDeviceSize min_alignment = properties.limits.minUniformBufferOffsetAlignment;
-		const VkDeviceSize align_size = RenderUtils::RoundToPowerOfTwo(size, min_alignment);
-		if (align_size > properties.limits.maxUniformBufferRange)
+		return thread_pool.Submit([weak_rhi, pipeline_cache, state = std::move(state)]() mutable -> VkPipeline
 		{
-			PEANUT_LOG_FATAL(
-				"Request uniform buffer sub-allocation size exceeds "
-				"maxUniformBufferRange of current physical device");
-		}
+			PEANUT_PROFILE_SCOPE("CompileGraphicsPipeline");
+			auto rhi = weak_rhi.lock();
+			if (rhi.get() == nullptr)
+			{
+				return VK_NULL_HANDLE;
+			}
+
+			// patch the internal pointers now that the state lives in this job
+			VkPipelineVertexInputStateCreateInfo vertex_input_ci{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+			vertex_input_ci.vertexBindingDescriptionCount = static_cast<uint32_t>(state.vertex_bindings.size());
+			vertex_input_ci.pVertexBindingDescriptions = state.vertex_bindings.data();
+			vertex_input_ci.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.vertex_attributes.size());
+			vertex_input_ci.pVertexAttributeDescriptions = state.vertex_attributes.data();
+
+			state.color_blend_state.attachmentCount = static_cast<uint32_t>(state.color_blend_attachments.size());
+			state.color_blend_state.pAttachments = state.color_blend_attachments.data();
 
-		if (buffer.cursor + align_size > buffer.capacity)
+			VkPipelineDynamicStateCreateInfo dynamic_state_ci{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+			dynamic_state_ci.dynamicStateCount = static_cast<uint32_t>(state.dynamic_states.size());
+			dynamic_state_ci.pDynamicStates = state.dynamic_states.data();
+
+			VkSpecializationInfo specialization_info{};
+			specialization_info.mapEntryCount = static_cast<uint32_t>(state.specialization_entries.size());
+			specialization_info.pMapEntries = state.specialization_entries.data();
+			specialization_info.dataSize = state.specialization_data.size();
+			specialization_info.pData = state.specialization_data.data();
+			for (auto& shader_stage : state.shader_stages)
+			{
+				shader_stage.pSpecializationInfo = (shader_stage.stage & state.specialization_stages) ? &specialization_info : nullptr;
+			}
+
+			VkGraphicsPipelineCreateInfo pipeline_ci{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+			pipeline_ci.stageCount = static_cast<uint32_t>(state.shader_stages.size());
+			pipeline_ci.pStages = state.shader_stages.data();
+			pipeline_ci.pVertexInputState = &vertex_input_ci;
+			pipeline_ci.pInputAssemblyState = &state.input_assembly_state;
+			pipeline_ci.pViewportState = &state.viewport_state;
+			pipeline_ci.pRasterizationState = &state.rasterization_state;
+			pipeline_ci.pMultisampleState = &state.multisample_state;
+			pipeline_ci.pDepthStencilState = &state.depth_stencil_state;
+			pipeline_ci.pColorBlendState = &state.color_blend_state;
+			pipeline_ci.pDynamicState = &dynamic_state_ci;
+			pipeline_ci.layout = state.layout;
+			pipeline_ci.renderPass = state.render_pass;
+			pipeline_ci.subpass = state.subpass;
+
+			return rhi->CreateGraphicsPipeline(pipeline_cache, 1, &pipeline_ci);
+		});
+	}
+
+	void IRenderPassBase::UpdatePushConstants(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout,
+		const std::vector<const void*>& pcos, std::vector<VkPushConstantRange> push_constant_ranges)
+	{
+		assert(pcos.size() == push_constant_ranges.size());
+		
+		for (size_t i = 0; i < push_constant_ranges.size(); i++)
 		{
-			PEANUT_LOG_FATAL("Failed to allocate with out-of-capacity unifor buffer");
+			const VkPushConstantRange& push_constant_range = push_constant_ranges[i];
+			vkCmdPushConstants(command_buffer, pipeline_layout, push_constant_range.stageFlags, 
+				push_constant_range.offset, push_constant_range.size, pcos[i]);
 		}
+	}
 
-		SubstorageUniformBuffer substorage;
-		substorage.descriptor_info.buffer = buffer.buffer.resource;
-		substorage.descriptor_info.offset = buffer.cursor;
-		substorage.descriptor_info.range = align_size;
-		substorage.host_mem_ptr = reinterpret_cast<uint8_t*>(buffer.host_mem_ptr) + buffer.cursor;
+	void IRenderPassBase::CreateFrameUniformBuffer(VkDeviceSize frame_capacity, VkBufferUsageFlags usage)
+	{
+		auto rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
 
-		buffer.cursor += align_size;
-		return substorage;
+		frame_uniform_allocator_.Initialize(rhi_, frame_capacity, rhi->GetNumberFrames(), usage);
 	}
 
-	
+	void IRenderPassBase::DestroyFrameUniformBuffer()
+	{
+		frame_uniform_allocator_.Destroy();
+	}
 
 } // namespace peanut
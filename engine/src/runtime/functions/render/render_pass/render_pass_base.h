@@ -1,16 +1,54 @@
 #pragma once
 
 #include "../render_data.h"
+#include "runtime/functions/rhi/frame_uniform_allocator.h"
 #include "runtime/functions/rhi/vulkan/vulkan_rhi.h"
+#include <future>
 #include <memory>
+#include <string>
 
 namespace peanut
 {
+    class GpuProfiler;
+
     struct PassInitInfo
     {
         std::weak_ptr<RHI> rhi_;
+        GpuProfiler* gpu_profiler_ = nullptr; // optional, scopes are not timed without it
     };
 
+    /**
+     * Self-contained copy of everything a graphics pipeline create info points to.
+     * The pass state cis are edited in place between pipelines, so a pipeline that
+     * is compiled on a worker thread has to own its state instead of pointing at them.
+     */
+    struct GraphicsPipelineState
+    {
+        std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+        std::vector<std::string> shader_names; // parallel to shader_stages, to rebuild on shader reload
+        std::vector<VkVertexInputBindingDescription> vertex_bindings;
+        std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+        VkPipelineInputAssemblyStateCreateInfo input_assembly_state{};
+        VkPipelineRasterizationStateCreateInfo rasterization_state{};
+        VkPipelineMultisampleStateCreateInfo multisample_state{};
+        VkPipelineDepthStencilStateCreateInfo depth_stencil_state{};
+        VkPipelineViewportStateCreateInfo viewport_state{};
+        std::vector<VkPipelineColorBlendAttachmentState> color_blend_attachments;
+        VkPipelineColorBlendStateCreateInfo color_blend_state{};
+        std::vector<VkDynamicState> dynamic_states;
+
+        // specialization constants, applied to every stage in specialization_stages
+        std::vector<VkSpecializationMapEntry> specialization_entries;
+        std::vector<uint8_t> specialization_data;
+        VkShaderStageFlags specialization_stages = 0;
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        uint32_t subpass = 0;
+    };
+
+    class ThreadPool;
+
     class IRenderPassBase
     {
     public:
@@ -31,26 +69,45 @@ namespace peanut
         virtual void UpdatePushConstants(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, 
                                          const std::vector<const void*>& pcos, std::vector<VkPushConstantRange> push_constant_ranges);
         virtual void CreatePipelineCache();
+
+        // serialize the pipeline cache to disk so the next launch can skip pipeline compilation
+        void SavePipelineCache();
+        void DestroyPipelineCache();
+
+        virtual std::string GetPassName() const { return "render_pass"; }
         
         void PrepareRenderPassData(const std::vector<std::shared_ptr<RenderData> >& render_data) { render_data_ = render_data; }
 
         void SetViewSettings(const ViewSettings& view_settings) { view_settings_ = view_settings; }
         void SetSceneSettings(const SceneSettings& scene_settings) { scene_settings_ = scene_settings; }
 
-        template<typename T>
-        SubstorageUniformBuffer AllocateSubstorageFromUniformBuffer();
-
     protected:
-        void CreateUniformBuffer(uint32_t buffer_size);
-        void DestoryUniformBuffer();
+        // per frame constants, rewound at the start of every frame of the slot
+        void CreateFrameUniformBuffer(VkDeviceSize frame_capacity, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        void DestroyFrameUniformBuffer();
+
+        // copy the current pass pipeline state, ready to be modified for one pipeline
+        GraphicsPipelineState SnapshotGraphicsPipelineState(VkPipelineLayout layout, uint32_t subpass) const;
+
+        void AddShaderStage(GraphicsPipelineState& state, const std::string& shader_name, VkShaderStageFlagBits stage);
+        // query the current modules again, e.g. after a shader has been hot reloaded
+        void RefreshShaderStages(GraphicsPipelineState& state);
+        static void SetSpecializationConstant(GraphicsPipelineState& state, uint32_t constant_id, uint32_t value, VkShaderStageFlags stages);
+
+        // compile on a worker thread, pipeline_cache_ is internally synchronized by the driver
+        std::future<VkPipeline> CreateGraphicsPipelineAsync(ThreadPool& thread_pool, GraphicsPipelineState state);
+
+        std::string GetPipelineCachePath() const { return "./cache/pipeline/" + GetPassName() + ".bin"; }
+        bool LoadPipelineCacheData(std::vector<char>& out_data);
 
     protected:
         std::weak_ptr<RHI> rhi_;
+        GpuProfiler* gpu_profiler_ = nullptr;
 
         ViewSettings view_settings_;
         SceneSettings scene_settings_;
 
-        std::optional<UniformBuffer> uniform_buffer_;
+        FrameUniformAllocator frame_uniform_allocator_;
         std::optional<RenderPassTarget> render_target_;
         std::optional<VkRenderPass> render_pass_;
 
@@ -61,6 +118,7 @@ namespace peanut
 
         // pipeline data
         VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+        size_t pipeline_cache_saved_size_ = 0;
         VkGraphicsPipelineCreateInfo pipeline_create_info_{};
         VkPipelineInputAssemblyStateCreateInfo input_assembly_state_ci{};
         VkPipelineRasterizationStateCreateInfo rasterization_state_ci{};
@@ -0,0 +1,298 @@
+#include "temporal_aa_pass.h"
+#include "../shader_manager.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peanut
+{
+	namespace
+	{
+		uint32_t DivideRoundUp(uint32_t value, uint32_t divisor)
+		{
+			return (value + divisor - 1) / divisor;
+		}
+
+		void ComputeBarrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask)
+		{
+			VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(command_buffer, src_stage_mask, dst_stage_mask, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	void TemporalAAPass::Initialize(std::weak_ptr<RHI> rhi, GpuProfiler* gpu_profiler)
+	{
+		rhi_ = rhi;
+		gpu_profiler_ = gpu_profiler;
+
+		std::shared_ptr<RHI> locked_rhi = rhi_.lock();
+		assert(locked_rhi.get() != nullptr);
+
+		// the neighborhood and the motion vectors are fetched by texel, only the history is filtered
+		VkSamplerCreateInfo create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		locked_rhi->CreateSampler(&create_info, &sampler_);
+
+		descriptor_layout_ = locked_rhi->CreateDescriptorSetLayout({
+			{ SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &sampler_ },
+			{ MOTION_VECTOR_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &sampler_ },
+			{ HISTORY_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &sampler_ },
+			{ OUTPUT_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		});
+
+		pipeline_layout_ = locked_rhi->CreatePipelineLayout({ descriptor_layout_ },
+			{ {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalAAPCO)} });
+		resolve_pipeline_ = locked_rhi->CreateComputePipeline(
+			ShaderManager::Get().GetShaderModule(locked_rhi, "taa_resolve.comp"), pipeline_layout_);
+		sharpen_pipeline_ = locked_rhi->CreateComputePipeline(
+			ShaderManager::Get().GetShaderModule(locked_rhi, "taa_sharpen.comp"), pipeline_layout_);
+
+		is_initialized = true;
+	}
+
+	void TemporalAAPass::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		DestroyTargets();
+
+		for (VkPipeline* pipeline : { &resolve_pipeline_, &sharpen_pipeline_ })
+		{
+			if (*pipeline != VK_NULL_HANDLE)
+			{
+				rhi->DestroyPipeline(*pipeline);
+				*pipeline = VK_NULL_HANDLE;
+			}
+		}
+
+		if (pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(pipeline_layout_);
+			pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (descriptor_layout_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorSetLayout(rhi->GetDevice(), descriptor_layout_, nullptr);
+			descriptor_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&sampler_);
+			sampler_ = VK_NULL_HANDLE;
+		}
+
+		is_initialized = false;
+	}
+
+	void TemporalAAPass::SetTargets(const std::vector<VkImageView>& scene_color_views, const std::vector<VkImageView>& motion_vector_views,
+		uint32_t width, uint32_t height)
+	{
+		assert(is_initialized);
+		assert(scene_color_views.size() == motion_vector_views.size());
+
+		DestroyTargets();
+
+		width_ = width;
+		height_ = height;
+		scene_color_views_ = scene_color_views;
+		motion_vector_views_ = motion_vector_views;
+
+		CreateTextures();
+		CreateDescriptorSets();
+		has_history_ = false;
+	}
+
+	void TemporalAAPass::Render(VkCommandBuffer command_buffer, uint32_t frame_index)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		if (!is_initialized || frame_index >= resolve_descriptor_sets_.size())
+		{
+			return;
+		}
+
+		PEANUT_GPU_PROFILE_SCOPE(gpu_profiler_, command_buffer, "TemporalAA");
+
+		TemporalAAPCO taa_pco = {};
+		taa_pco.inv_size = glm::vec2(1.0f / static_cast<float>(width_), 1.0f / static_cast<float>(height_));
+		taa_pco.blend_factor = std::clamp(settings_.blend_factor, 0.01f, 1.0f);
+		taa_pco.sharpness = std::max(settings_.sharpness, 0.0f);
+		taa_pco.has_history = has_history_ ? 1 : 0;
+
+		// the last frame may still sharpen from the history written now and the post process may still read the output
+		ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			{ TextureMemoryBarrier(*output_texture_, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL) });
+
+		const uint32_t write_index = history_index_ ^ 1;
+		const uint32_t group_count_x = DivideRoundUp(width_, TAA_GROUP_SIZE);
+		const uint32_t group_count_y = DivideRoundUp(height_, TAA_GROUP_SIZE);
+
+		vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalAAPCO), &taa_pco);
+
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1,
+			&resolve_descriptor_sets_[frame_index][write_index], 0, nullptr);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, resolve_pipeline_);
+		vkCmdDispatch(command_buffer, group_count_x, group_count_y, 1);
+
+		ComputeBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1,
+			&sharpen_descriptor_sets_[write_index], 0, nullptr);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sharpen_pipeline_);
+		vkCmdDispatch(command_buffer, group_count_x, group_count_y, 1);
+
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(*output_texture_, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) });
+
+		history_index_ = write_index;
+		has_history_ = true;
+	}
+
+	float TemporalAAPass::GetHaltonValue(uint32_t index, uint32_t base)
+	{
+		float value = 0.0f;
+		float fraction = 1.0f;
+		while (index > 0)
+		{
+			fraction /= static_cast<float>(base);
+			value += fraction * static_cast<float>(index % base);
+			index /= base;
+		}
+		return value;
+	}
+
+	glm::vec2 TemporalAAPass::GetJitter(uint64_t frame_index, uint32_t sample_count, uint32_t width, uint32_t height)
+	{
+		// the sequence starts at 1, index 0 would be the texel corner
+		const uint32_t index = static_cast<uint32_t>(frame_index % std::max(sample_count, 1u)) + 1;
+		const glm::vec2 texel_offset(GetHaltonValue(index, 2) - 0.5f, GetHaltonValue(index, 3) - 0.5f);
+		return texel_offset * glm::vec2(2.0f / static_cast<float>(std::max(width, 1u)), 2.0f / static_cast<float>(std::max(height, 1u)));
+	}
+
+	glm::mat4 TemporalAAPass::ApplyJitter(const glm::mat4& projection, const glm::vec2& jitter)
+	{
+		return glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * projection;
+	}
+
+	glm::vec3 TemporalAAPass::ClipToAabb(const glm::vec3& history, const glm::vec3& center, const glm::vec3& extent)
+	{
+		const glm::vec3 offset = history - center;
+		const glm::vec3 units = glm::abs(offset / glm::max(extent, glm::vec3(1e-4f)));
+		const float max_unit = std::max(units.x, std::max(units.y, units.z));
+		return max_unit > 1.0f ? center + offset / max_unit : history;
+	}
+
+	void TemporalAAPass::CreateTextures()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		for (std::shared_ptr<TextureData>& history_texture : history_textures_)
+		{
+			history_texture = rhi->CreateTexture(width_, height_, 1, 1, kHistoryFormat, VK_IMAGE_USAGE_STORAGE_BIT);
+		}
+		output_texture_ = rhi->CreateTexture(width_, height_, 1, 1, kHistoryFormat, VK_IMAGE_USAGE_STORAGE_BIT);
+
+		// the histories are written and sampled in general layout, the output is read by the post process between frames
+		VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			{ TextureMemoryBarrier(*history_textures_[0], 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_GENERAL),
+			TextureMemoryBarrier(*history_textures_[1], 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_GENERAL),
+			TextureMemoryBarrier(*output_texture_, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) });
+		rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+	}
+
+	void TemporalAAPass::CreateDescriptorSets()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		const uint32_t frame_num = static_cast<uint32_t>(scene_color_views_.size());
+		const uint32_t set_num = 2 * frame_num + 2;
+
+		const std::vector<VkDescriptorPoolSize> pool_sizes = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * set_num },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, set_num },
+		};
+		VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_create_info.maxSets = set_num;
+		pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_create_info.pPoolSizes = pool_sizes.data();
+		rhi->CreateDescriptorPool(&pool_create_info, &descriptor_pool_);
+
+		resolve_descriptor_sets_.resize(frame_num);
+		for (uint32_t frame = 0; frame < frame_num; ++frame)
+		{
+			for (uint32_t write_index = 0; write_index < 2; ++write_index)
+			{
+				VkDescriptorSet descriptor_set = rhi->AllocateDescriptor(descriptor_pool_, descriptor_layout_);
+				rhi->UpdateImageDescriptorSet(descriptor_set, SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					{ { sampler_, scene_color_views_[frame], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
+				rhi->UpdateImageDescriptorSet(descriptor_set, MOTION_VECTOR_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					{ { sampler_, motion_vector_views_[frame], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
+				rhi->UpdateImageDescriptorSet(descriptor_set, HISTORY_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					{ { sampler_, history_textures_[write_index ^ 1]->image_view, VK_IMAGE_LAYOUT_GENERAL } });
+				rhi->UpdateImageDescriptorSet(descriptor_set, OUTPUT_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					{ { VK_NULL_HANDLE, history_textures_[write_index]->image_view, VK_IMAGE_LAYOUT_GENERAL } });
+				resolve_descriptor_sets_[frame][write_index] = descriptor_set;
+			}
+		}
+
+		// the sharpening reads the source and writes the output only
+		for (uint32_t history = 0; history < 2; ++history)
+		{
+			VkDescriptorSet descriptor_set = rhi->AllocateDescriptor(descriptor_pool_, descriptor_layout_);
+			rhi->UpdateImageDescriptorSet(descriptor_set, SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				{ { sampler_, history_textures_[history]->image_view, VK_IMAGE_LAYOUT_GENERAL } });
+			rhi->UpdateImageDescriptorSet(descriptor_set, OUTPUT_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				{ { VK_NULL_HANDLE, output_texture_->image_view, VK_IMAGE_LAYOUT_GENERAL } });
+			sharpen_descriptor_sets_[history] = descriptor_set;
+		}
+	}
+
+	void TemporalAAPass::DestroyTargets()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// the sets go with their pool
+		if (descriptor_pool_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(rhi->GetDevice(), descriptor_pool_, nullptr);
+			descriptor_pool_ = VK_NULL_HANDLE;
+		}
+		resolve_descriptor_sets_.clear();
+		sharpen_descriptor_sets_ = {};
+
+		for (std::shared_ptr<TextureData>* texture : { &history_textures_[0], &history_textures_[1], &output_texture_ })
+		{
+			if (*texture != nullptr)
+			{
+				rhi->DestroyTexture(*texture);
+				*texture = nullptr;
+			}
+		}
+
+		scene_color_views_.clear();
+		motion_vector_views_.clear();
+		has_history_ = false;
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include "../render_data.h"
+#include "functions/rhi/vulkan/vulkan_rhi.h"
+#include "functions/rhi/gpu_profiler.h"
+
+namespace peanut
+{
+	enum class AntiAliasingMode : uint8_t
+	{
+		MSAA,           // the scene is rendered with the most samples the device supports
+		TemporalAA,     // one sample, jittered over the frames and accumulated in a history
+	};
+
+	struct TemporalAASettings
+	{
+		float blend_factor = 0.1f;          // weight of the current frame, lower is smoother and ghosts longer
+		float sharpness = 0.25f;            // of the resolved frame, 0 leaves it as is
+		uint32_t jitter_sample_count = 8;   // length of the halton sequence the jitter repeats
+	};
+
+	/**
+	* @brief temporal anti-aliasing of the scene color rendered with a jittered projection
+	*
+	* The resolve reprojects the history with the motion vectors of the scene, clips it to the variance box of
+	* the neighborhood of the current frame and blends the two, the histories of the last and this frame alternate.
+	* A sharpening pass writes the resolved frame to the output the post process chain reads.
+	*/
+	class TemporalAAPass
+	{
+	public:
+		TemporalAAPass() = default;
+		~TemporalAAPass() = default;
+
+		// the passes are timed if a gpu profiler is given
+		void Initialize(std::weak_ptr<RHI> rhi, GpuProfiler* gpu_profiler = nullptr);
+		void Destroy();
+
+		// the scene colors and motion vectors to read, one of each per frame, again after a resize, which also drops the history
+		void SetTargets(const std::vector<VkImageView>& scene_color_views, const std::vector<VkImageView>& motion_vector_views,
+			uint32_t width, uint32_t height);
+
+		// record the resolve of a frame, the inputs are in shader read only layout and so is the output after it
+		void Render(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+		// the history is not reprojected in the next frame, e.g. after a camera cut
+		void ResetHistory() { has_history_ = false; }
+
+		// the anti-aliased scene color
+		VkImageView GetOutputView() const { return output_texture_ != nullptr ? output_texture_->image_view : VK_NULL_HANDLE; }
+
+		void SetSettings(const TemporalAASettings& settings) { settings_ = settings; }
+		const TemporalAASettings& GetSettings() const { return settings_; }
+
+		// element of the halton low discrepancy sequence of a base, index starts at 1
+		static float GetHaltonValue(uint32_t index, uint32_t base);
+		// sub-pixel offset of the projection of a frame in ndc, a halton (2, 3) point around the texel center
+		static glm::vec2 GetJitter(uint64_t frame_index, uint32_t sample_count, uint32_t width, uint32_t height);
+		// move the projection by the jitter in ndc, the offset is scaled by w so that it is the same at every depth
+		static glm::mat4 ApplyJitter(const glm::mat4& projection, const glm::vec2& jitter);
+		// cpu mirror of the history clipping of taa_resolve.comp
+		static glm::vec3 ClipToAabb(const glm::vec3& history, const glm::vec3& center, const glm::vec3& extent);
+
+		TemporalAAPass(const TemporalAAPass&) = delete;
+		TemporalAAPass& operator=(const TemporalAAPass&) = delete;
+
+	private:
+		enum DescriptorBinding : uint8_t
+		{
+			SOURCE_TEXTURE = 0,
+			MOTION_VECTOR_TEXTURE,
+			HISTORY_TEXTURE,
+			OUTPUT_IMAGE,
+		};
+
+		void CreateTextures();
+		void CreateDescriptorSets();
+		void DestroyTargets();
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+		GpuProfiler* gpu_profiler_ = nullptr;
+
+		TemporalAASettings settings_;
+
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		std::vector<VkImageView> scene_color_views_;
+		std::vector<VkImageView> motion_vector_views_;
+
+		// kept in general layout, the last frame's history is read while this frame's is written
+		std::array<std::shared_ptr<TextureData>, 2> history_textures_;
+		uint32_t history_index_ = 0;
+		bool has_history_ = false;
+		std::shared_ptr<TextureData> output_texture_;
+
+		VkSampler sampler_ = VK_NULL_HANDLE;
+
+		// recreated with the targets, every set depends on their views
+		VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptor_layout_ = VK_NULL_HANDLE;
+		// per frame and per history written, the resolve reads the other one
+		std::vector<std::array<VkDescriptorSet, 2> > resolve_descriptor_sets_;
+		// per history, sharpened into the output
+		std::array<VkDescriptorSet, 2> sharpen_descriptor_sets_ = {};
+
+		VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+		VkPipeline resolve_pipeline_ = VK_NULL_HANDLE;
+		VkPipeline sharpen_pipeline_ = VK_NULL_HANDLE;
+
+		static constexpr VkFormat kHistoryFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+	};
+}
@@ -10,5 +10,7 @@ public:
     virtual void preparePassData() = 0;
     virtual void RenderTick(const ViewSettings& view,
                             const SceneSettings& scene) = 0;
+    // rebuild the size dependent objects after the swapchain was recreated
+    virtual void ResizeSwapchainObject() = 0;
 };
 }  // namespace peanut
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "runtime/functions/render/render_system.h"
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "runtime/core/profile/cpu_profiler.h"
 #include "runtime/functions/render/render_utils.h"
+#include "runtime/functions/render/shader_manager.h"
 
 namespace peanut {
 RenderSystem::RenderSystem()
@@ -13,12 +18,18 @@ RenderSystem::RenderSystem()
 void RenderSystem::Initialize(const std::shared_ptr<WindowSystem>& window_system) 
 {
     PEANUT_LOG_INFO("Intialize Render system");
+    ShaderManager::Get().SetHotReloadEnabled(shader_hot_reload_enabled_);
     rhi_->Init(window_system);
+    readback_.Initialize(rhi_);
+    gpu_profiler_.Initialize(rhi_, rhi_->GetNumberFrames());
+    mip_downsampler_.Initialize(rhi_);
+    rhi_->SetMipGenerator(&mip_downsampler_);
     main_render_pass_->Initialize();
     InitViewSettingAndSceneSetting();
 
     window_system->PushEventCallback([this](Event& e) 
     {
+        PEANUT_PROFILE_SCOPE("RenderSystem::HandleEvent");
         EventDispatcher dispatcher(e);
         dispatcher.Dispatch<MouseButtonEvent>(
             BIND_EVENT_FN(RenderSystem::HandleMouseButtonEvent));
@@ -27,18 +38,122 @@ void RenderSystem::Initialize(const std::shared_ptr<WindowSystem>& window_system
         dispatcher.Dispatch<MouseScrolledEvent>(
             BIND_EVENT_FN(RenderSystem::HandleMouseScrollEvent));
         dispatcher.Dispatch<KeyEvent>(BIND_EVENT_FN(RenderSystem::HandleKeyEvent));
+        dispatcher.Dispatch<WindowResizeEvent>(
+            BIND_EVENT_FN(RenderSystem::HandleWindowResizeEvent));
     });
 
     window_system_ = window_system;
 }
 
+void RenderSystem::InitializeHeadless(uint32_t width, uint32_t height)
+{
+    PEANUT_LOG_INFO("Intialize headless Render system ({0}, {1})", width, height);
+    ShaderManager::Get().SetHotReloadEnabled(shader_hot_reload_enabled_);
+    rhi_->InitHeadless(width, height);
+    readback_.Initialize(rhi_);
+    gpu_profiler_.Initialize(rhi_, rhi_->GetNumberFrames());
+    mip_downsampler_.Initialize(rhi_);
+    rhi_->SetMipGenerator(&mip_downsampler_);
+    main_render_pass_->Initialize();
+    InitViewSettingAndSceneSetting();
+}
+
+bool RenderSystem::SaveFrame(const std::string& file_path)
+{
+    // presented swapchain images belong to the presentation engine, only offscreen frames can be read back
+    if (!rhi_->IsHeadless())
+    {
+        PEANUT_LOG_WARN("Frames can only be saved in headless mode, skip {0}", file_path);
+        return false;
+    }
+
+    VulkanRHI* vulkan_rhi = static_cast<VulkanRHI*>(rhi_.get());
+    ReadbackImageDesc desc;
+    desc.width = vulkan_rhi->GetDisplayWidth();
+    desc.height = vulkan_rhi->GetDisplayHeight();
+    desc.bytes_per_pixel = GpuReadback::GetFormatTexelSize(vulkan_rhi->GetSwapChainImageFormat());
+
+    // the copy is queued behind the last frame, wait for it since the file is written right away
+    ReadbackFuture frame = readback_.ReadbackImage(vulkan_rhi->GetLastPresentedImage(),
+                                                   rhi_->GetPresentImageLayout(), desc);
+    if (!frame.Wait())
+    {
+        return false;
+    }
+    std::vector<uint8_t> pixels(frame.Data(), frame.Data() + frame.Size());
+
+    // frames are stored as B8G8R8A8 like the swapchain images
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        std::swap(pixels[i], pixels[i + 2]);
+    }
+
+    if (!stbi_write_png(file_path.c_str(), desc.width, desc.height, 4, pixels.data(), desc.width * 4))
+    {
+        PEANUT_LOG_ERROR("Failed to write frame to {0}", file_path);
+        return false;
+    }
+    return true;
+}
+
 void RenderSystem::Shutdown() 
 {
-    rhi_->Shutdown();
+    // everything created on the device goes before it, the pass still references the cached shader modules
+    rhi_->WaitIdle();
     main_render_pass_->DeInitialize();
+    ShaderManager::Get().DestroyShaderModules(rhi_);
+    readback_.Destroy();
+    gpu_profiler_.Destroy();
+    rhi_->SetMipGenerator(nullptr);
+    mip_downsampler_.Destroy();
+    rhi_->Shutdown();
+}
+
+void RenderSystem::Tick() 
+{
+    PEANUT_PROFILE_FUNCTION();
+    {
+        PEANUT_PROFILE_SCOPE("PollShaderChanges");
+        ShaderManager::Get().PollShaderChanges(rhi_);
+    }
+    {
+        PEANUT_PROFILE_SCOPE("PollReadbacks");
+        readback_.Poll();
+    }
+    if (!UpdateSwapchain())
+    {
+        return;
+    }
+    main_render_pass_->RenderTick(view_, scene_);
 }
 
-void RenderSystem::Tick() { main_render_pass_->RenderTick(view_, scene_); }
+bool RenderSystem::UpdateSwapchain()
+{
+    if (!swapchain_resize_pending_ && !rhi_->IsSwapchainOutOfDate())
+    {
+        return true;
+    }
+
+    PEANUT_PROFILE_SCOPE("RecreateSwapchain");
+
+    auto window_system = window_system_.lock();
+    const uint32_t width = window_system->GetWidth();
+    const uint32_t height = window_system->GetHeight();
+
+    // minimized, keep the pending resize until the window is restored
+    if (width == 0 || height == 0)
+    {
+        return false;
+    }
+
+    if (rhi_->RecreateSwapchain(width, height))
+    {
+        main_render_pass_->ResizeSwapchainObject();
+    }
+    swapchain_resize_pending_ = false;
+
+    return !rhi_->IsSwapchainOutOfDate();
+}
 
 void RenderSystem::InitViewSettingAndSceneSetting()
 {
@@ -132,6 +247,14 @@ bool RenderSystem::HandleMouseScrollEvent(MouseScrolledEvent& e) {
   return true;
 }
 
+bool RenderSystem::HandleWindowResizeEvent(WindowResizeEvent& e) {
+  PEANUT_LOG_INFO("Handle window resize ({0}, {1})", e.GetWidth(), e.GetHeight());
+  swapchain_resize_pending_ = true;
+
+  // other listeners may need the new size as well
+  return false;
+}
+
 bool RenderSystem::HandleKeyEvent(KeyEvent& e) {
   KeyCode code = e.GetKeyCode();
   PEANUT_LOG_INFO("Get key event ({0}) in render system, change light config",
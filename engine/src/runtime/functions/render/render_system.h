@@ -1,14 +1,21 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include "runtime/functions/rhi/rhi.h"
 #include "runtime/functions/rhi/vulkan/vulkan_rhi.h"
+#include "runtime/functions/rhi/gpu_readback.h"
+#include "runtime/functions/rhi/gpu_profiler.h"
 #include "runtime/core/event/mouse_event.h"
 #include "runtime/core/event/key_event.h"
+#include "runtime/core/event/window_event.h"
 
 #include "runtime/functions/render/render_pass_base.h"
+#include "runtime/functions/render/render_pass/post_process_pass.h"
+#include "runtime/functions/render/render_pass/temporal_aa_pass.h"
 #include "runtime/functions/render/render_pass.h"
+#include "runtime/functions/render/single_pass_downsampler.h"
 
 namespace peanut {
 class RenderSystem {
@@ -23,10 +30,32 @@ class RenderSystem {
   RenderSystem();
   ~RenderSystem() {}
   void Initialize(const std::shared_ptr<WindowSystem>& window_system);
+  // render into offscreen images without a window, input events are not handled
+  void InitializeHeadless(uint32_t width, uint32_t height);
   void Shutdown();
   void Tick();
 
   std::shared_ptr<RHI> GetRHI() { return rhi_; };
+  // asynchronous copies of gpu resources into host memory, resolved every tick
+  GpuReadback& GetReadback() { return readback_; }
+  // timestamp scopes of the render passes, disabled if the device has no timestamp support
+  GpuProfiler& GetGpuProfiler() { return gpu_profiler_; }
+  // compute mip generation of the RHI, see RHI::SetMipGenerationMode()
+  SinglePassDownsampler& GetMipDownsampler() { return mip_downsampler_; }
+  // effect chain between the hdr scene color and the display image, read by the render pass every frame
+  void SetPostProcessSettings(const PostProcessSettings& settings) { post_process_settings_ = settings; }
+  const PostProcessSettings& GetPostProcessSettings() const { return post_process_settings_; }
+  // read when the render pass is initialized, the attachments of the scene depend on it
+  void SetAntiAliasingMode(AntiAliasingMode mode) { anti_aliasing_mode_ = mode; }
+  AntiAliasingMode GetAntiAliasingMode() const { return anti_aliasing_mode_; }
+  // read by the render pass every frame if temporal anti-aliasing is enabled
+  void SetTemporalAASettings(const TemporalAASettings& settings) { temporal_aa_settings_ = settings; }
+  const TemporalAASettings& GetTemporalAASettings() const { return temporal_aa_settings_; }
+  // applied to the shader manager when the render system is initialized
+  void SetShaderHotReloadEnabled(bool enabled) { shader_hot_reload_enabled_ = enabled; }
+
+  // read back the last rendered frame and write it as png, blocks until the device is idle
+  bool SaveFrame(const std::string& file_path);
 
  protected:
   void InitViewSettingAndSceneSetting();
@@ -35,11 +64,22 @@ class RenderSystem {
   bool HandleMouseButtonEvent(MouseButtonEvent& e);
   bool HandleMouseScrollEvent(MouseScrolledEvent& e);
   bool HandleKeyEvent(KeyEvent& e);
+  bool HandleWindowResizeEvent(WindowResizeEvent& e);
+
+  // recreate the swapchain if the window was resized, returns false if there is nothing to render to
+  bool UpdateSwapchain();
 
  private:
   std::shared_ptr<RHI> rhi_;
   std::unique_ptr<RenderPassBase> main_render_pass_;
   std::weak_ptr<WindowSystem> window_system_;
+  GpuReadback readback_;
+  GpuProfiler gpu_profiler_;
+  SinglePassDownsampler mip_downsampler_;
+  PostProcessSettings post_process_settings_;
+  AntiAliasingMode anti_aliasing_mode_ = AntiAliasingMode::MSAA;
+  TemporalAASettings temporal_aa_settings_;
+  bool shader_hot_reload_enabled_ = false;
 
   // todo: register window event
   ViewSettings view_;
@@ -49,6 +89,9 @@ class RenderSystem {
   double last_mouse_pos_x_;
   double last_mouse_pos_y_;
 
+  // resize events only mark the swapchain dirty, a drag resize is applied once per frame
+  bool swapchain_resize_pending_ = false;
+
   // TODO: viewport default config
   static constexpr float kViewDistance = 150.0f;
   static constexpr float kViewFOV = 45.0f;
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -40,6 +42,19 @@ class RenderUtils {
     return std::abs(value - 0.0f) <= std::numeric_limits<float>::epsilon();
   }
 
+    // 64-bit FNV-1a, stable across runs and platforms so it can key on-disk caches
+    static uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
     static bool ReadBinaryFile(const std::string& path,
                                 std::vector<char>& output) 
     {
@@ -57,5 +72,34 @@ class RenderUtils {
         file.read(output.data(), size);
         return true;
     }
+
+    // write to a temporary file first and rename it, so a crash during writing
+    // never leaves a truncated file behind for the next launch
+    static bool WriteBinaryFile(const std::string& path, const void* data, size_t size)
+    {
+        std::error_code error;
+        const std::filesystem::path file_path(path);
+        if (file_path.has_parent_path())
+        {
+            std::filesystem::create_directories(file_path.parent_path(), error);
+        }
+
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+            if (!file.is_open())
+            {
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+            if (!file.good())
+            {
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temp_path, file_path, error);
+        return !error;
+    }
 };
 }  // namespace peanut
@@ -0,0 +1,299 @@
+#include "shader_compiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifdef PEANUT_WITH_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+#include "runtime/core/base/logger.h"
+#include "runtime/functions/render/render_utils.h"
+
+#define PEANUT_XSTR(s) PEANUT_STR(s)
+#define PEANUT_STR(s) #s
+
+namespace peanut
+{
+	namespace
+	{
+		// bump when the compile options change so stale spirv is not picked up
+		constexpr uint64_t kShaderCacheVersion = 1;
+
+		const char* GetStageName(VkShaderStageFlagBits stage)
+		{
+			switch (stage)
+			{
+			case VK_SHADER_STAGE_VERTEX_BIT: return "vert";
+			case VK_SHADER_STAGE_FRAGMENT_BIT: return "frag";
+			case VK_SHADER_STAGE_COMPUTE_BIT: return "comp";
+			case VK_SHADER_STAGE_GEOMETRY_BIT: return "geom";
+			case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return "tesc";
+			case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return "tese";
+			default: return nullptr;
+			}
+		}
+
+		bool ReadTextFile(const std::string& path, std::string& out_text)
+		{
+			std::ifstream file(path);
+			if (!file.is_open())
+			{
+				return false;
+			}
+
+			std::stringstream stream;
+			stream << file.rdbuf();
+			out_text = stream.str();
+			return true;
+		}
+	}
+
+	ShaderCompiler::ShaderCompiler()
+		: cache_directory_("./cache/spirv")
+	{
+#ifdef PEANUT_SHADER_SOURCE_DIR
+		AddIncludeDirectory(std::string(PEANUT_XSTR(PEANUT_SHADER_SOURCE_DIR)) + "/include");
+#endif
+	}
+
+	void ShaderCompiler::AddIncludeDirectory(const std::string& include_directory)
+	{
+		if (std::find(include_directories_.begin(), include_directories_.end(), include_directory) == include_directories_.end())
+		{
+			include_directories_.push_back(include_directory);
+		}
+	}
+
+	VkShaderStageFlagBits ShaderCompiler::DeduceStage(const std::string& source_path)
+	{
+		const std::filesystem::path path(source_path);
+		const std::string extension = path.extension().string();
+		const std::string stem = path.stem().string();
+
+		if (extension == ".vert") return VK_SHADER_STAGE_VERTEX_BIT;
+		if (extension == ".frag") return VK_SHADER_STAGE_FRAGMENT_BIT;
+		if (extension == ".comp") return VK_SHADER_STAGE_COMPUTE_BIT;
+
+		auto ends_with = [&stem](const char* suffix)
+		{
+			const std::string suffix_str(suffix);
+			return stem.size() >= suffix_str.size() && stem.compare(stem.size() - suffix_str.size(), suffix_str.size(), suffix_str) == 0;
+		};
+		if (ends_with("_vs")) return VK_SHADER_STAGE_VERTEX_BIT;
+		if (ends_with("_fs")) return VK_SHADER_STAGE_FRAGMENT_BIT;
+		if (ends_with("_cs")) return VK_SHADER_STAGE_COMPUTE_BIT;
+
+		return VK_SHADER_STAGE_ALL;
+	}
+
+	bool ShaderCompiler::ResolveInclude(const std::string& including_file, const std::string& include_name, std::string& out_path) const
+	{
+		std::error_code error;
+		const std::filesystem::path local_path = std::filesystem::path(including_file).parent_path() / include_name;
+		if (std::filesystem::exists(local_path, error))
+		{
+			out_path = local_path.lexically_normal().string();
+			return true;
+		}
+
+		for (const auto& include_directory : include_directories_)
+		{
+			const std::filesystem::path include_path = std::filesystem::path(include_directory) / include_name;
+			if (std::filesystem::exists(include_path, error))
+			{
+				out_path = include_path.lexically_normal().string();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool ShaderCompiler::ExpandIncludes(const std::string& source_path, std::string& out_source, std::vector<std::string>& visited_files) const
+	{
+		// every header is guarded, so expanding it once is enough for hashing
+		if (std::find(visited_files.begin(), visited_files.end(), source_path) != visited_files.end())
+		{
+			return true;
+		}
+		visited_files.push_back(source_path);
+
+		std::string source;
+		if (!ReadTextFile(source_path, source))
+		{
+			PEANUT_LOG_ERROR("Failed to read shader source {0}", source_path);
+			return false;
+		}
+
+		std::istringstream lines(source);
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			const size_t include_pos = line.find("#include");
+			const size_t open_quote = line.find('"');
+			const size_t close_quote = open_quote == std::string::npos ? std::string::npos : line.find('"', open_quote + 1);
+			if (include_pos == std::string::npos || close_quote == std::string::npos || line.find_first_not_of(" \t") != include_pos)
+			{
+				out_source += line;
+				out_source += '\n';
+				continue;
+			}
+
+			const std::string include_name = line.substr(open_quote + 1, close_quote - open_quote - 1);
+			std::string include_path;
+			if (!ResolveInclude(source_path, include_name, include_path))
+			{
+				PEANUT_LOG_ERROR("Failed to resolve #include \"{0}\" in {1}", include_name, source_path);
+				return false;
+			}
+
+			if (!ExpandIncludes(include_path, out_source, visited_files))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	uint64_t ShaderCompiler::ComputeCacheKey(const ShaderCompileDesc& desc, const std::string& expanded_source) const
+	{
+		uint64_t key = RenderUtils::HashBytes(&kShaderCacheVersion, sizeof(kShaderCacheVersion));
+		key = RenderUtils::HashBytes(expanded_source.data(), expanded_source.size(), key);
+		key = RenderUtils::HashBytes(&desc.stage, sizeof(desc.stage), key);
+
+		// define order must not produce a different variant
+		std::vector<std::string> defines;
+		for (const auto& define : desc.defines)
+		{
+			defines.push_back(define.name + "=" + define.value);
+		}
+		std::sort(defines.begin(), defines.end());
+		for (const auto& define : defines)
+		{
+			key = RenderUtils::HashBytes(define.data(), define.size() + 1, key);
+		}
+
+		return key;
+	}
+
+	bool ShaderCompiler::CompileToCache(const ShaderCompileDesc& desc, std::string& out_spirv_path, std::vector<std::string>* out_dependencies)
+	{
+		const VkShaderStageFlagBits stage = desc.stage != VK_SHADER_STAGE_ALL ? desc.stage : DeduceStage(desc.source_path);
+		if (GetStageName(stage) == nullptr)
+		{
+			PEANUT_LOG_ERROR("Can not deduce shader stage of {0}", desc.source_path);
+			return false;
+		}
+
+		ShaderCompileDesc stage_desc = desc;
+		stage_desc.stage = stage;
+
+		std::string expanded_source;
+		std::vector<std::string> visited_files;
+		if (!ExpandIncludes(desc.source_path, expanded_source, visited_files))
+		{
+			return false;
+		}
+
+		if (out_dependencies != nullptr)
+		{
+			*out_dependencies = visited_files;
+		}
+
+		char key_string[17];
+		std::snprintf(key_string, sizeof(key_string), "%016llx", static_cast<unsigned long long>(ComputeCacheKey(stage_desc, expanded_source)));
+
+		const std::filesystem::path spirv_path = std::filesystem::path(cache_directory_) / (std::filesystem::path(desc.source_path).stem().string() + "_" + key_string + ".spv");
+		out_spirv_path = spirv_path.string();
+
+		std::error_code error;
+		if (std::filesystem::exists(spirv_path, error))
+		{
+			return true;
+		}
+
+		std::filesystem::create_directories(cache_directory_, error);
+		if (!Compile(stage_desc, expanded_source, out_spirv_path))
+		{
+			PEANUT_LOG_ERROR("Failed to compile shader {0}", desc.source_path);
+			return false;
+		}
+
+		PEANUT_LOG_INFO("Compile shader {0} to {1}", desc.source_path, out_spirv_path);
+		return true;
+	}
+
+#ifdef PEANUT_WITH_SHADERC
+	bool ShaderCompiler::Compile(const ShaderCompileDesc& desc, const std::string& expanded_source, const std::string& output_path) const
+	{
+		shaderc_shader_kind shader_kind = shaderc_glsl_infer_from_source;
+		switch (desc.stage)
+		{
+		case VK_SHADER_STAGE_VERTEX_BIT: shader_kind = shaderc_glsl_vertex_shader; break;
+		case VK_SHADER_STAGE_FRAGMENT_BIT: shader_kind = shaderc_glsl_fragment_shader; break;
+		case VK_SHADER_STAGE_COMPUTE_BIT: shader_kind = shaderc_glsl_compute_shader; break;
+		case VK_SHADER_STAGE_GEOMETRY_BIT: shader_kind = shaderc_glsl_geometry_shader; break;
+		case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: shader_kind = shaderc_glsl_tess_control_shader; break;
+		case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: shader_kind = shaderc_glsl_tess_evaluation_shader; break;
+		default: break;
+		}
+
+		shaderc::CompileOptions options;
+		options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+		options.SetOptimizationLevel(shaderc_optimization_level_performance);
+		for (const auto& define : desc.defines)
+		{
+			options.AddMacroDefinition(define.name, define.value);
+		}
+
+		// includes are already expanded, so no includer callback is needed
+		shaderc::Compiler compiler;
+		shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(expanded_source, shader_kind, desc.source_path.c_str(), options);
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+		{
+			PEANUT_LOG_ERROR("{0}", result.GetErrorMessage());
+			return false;
+		}
+
+		const std::vector<uint32_t> spirv(result.cbegin(), result.cend());
+		return RenderUtils::WriteBinaryFile(output_path, spirv.data(), spirv.size() * sizeof(uint32_t));
+	}
+#else
+	bool ShaderCompiler::Compile(const ShaderCompileDesc& desc, const std::string& expanded_source, const std::string& output_path) const
+	{
+#ifdef PEANUT_GLSLANG_VALIDATOR
+		// the validator resolves the includes itself, expanded_source is only used for the cache key
+		std::string command = std::string("\"") + PEANUT_XSTR(PEANUT_GLSLANG_VALIDATOR) + "\" -V -S " + GetStageName(desc.stage);
+		for (const auto& include_directory : include_directories_)
+		{
+			command += " \"-I" + include_directory + "\"";
+		}
+		for (const auto& define : desc.defines)
+		{
+			command += " -D" + define.name + (define.value.empty() ? "" : "=" + define.value);
+		}
+
+		const std::string temp_path = output_path + ".tmp";
+		command += " -o \"" + temp_path + "\" \"" + desc.source_path + "\"";
+
+		if (std::system(command.c_str()) != 0)
+		{
+			return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, output_path, error);
+		return !error;
+#else
+		PEANUT_LOG_ERROR("No runtime shader compiler available, build with shaderc or glslangValidator");
+		return false;
+#endif
+	}
+#endif
+} // namespace peanut
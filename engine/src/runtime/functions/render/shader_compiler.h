@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace peanut
+{
+	struct ShaderDefine
+	{
+		std::string name;
+		std::string value;
+	};
+
+	struct ShaderCompileDesc
+	{
+		std::string source_path;
+		VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+		std::vector<ShaderDefine> defines; // permutation defines, e.g. {"HAS_NORMAL_TEXTURE", "1"}
+	};
+
+	/**
+	 * @brief compiles glsl to spirv at runtime and keeps the results in an on-disk cache
+	 *
+	 * The cache key hashes the source with all of its #include files expanded, the stage and
+	 * the defines, so editing host_device_structs.h invalidates every shader that includes it.
+	 * Uses shaderc when the engine is built with PEANUT_WITH_SHADERC, otherwise falls back to
+	 * the glslangValidator shipped in 3rdparty/VulkanSDK.
+	 */
+	class ShaderCompiler
+	{
+	public:
+		ShaderCompiler();
+
+		void AddIncludeDirectory(const std::string& include_directory);
+		void SetCacheDirectory(const std::string& cache_directory) { cache_directory_ = cache_directory; }
+
+		/**
+		 * Get the spirv file of the shader, compiling it only when the cache has no entry for it.
+		 * @param desc shader source, stage and permutation defines
+		 * @param out_spirv_path path of the cached spirv file
+		 * @param out_dependencies optional, the source file and every file it includes
+		 * @return false if the source can not be read or fails to compile
+		 */
+		bool CompileToCache(const ShaderCompileDesc& desc, std::string& out_spirv_path, std::vector<std::string>* out_dependencies = nullptr);
+
+		// deduce the stage from mesh.vert / mesh_gbuffer.frag or irmap_cs.glsl style names
+		static VkShaderStageFlagBits DeduceStage(const std::string& source_path);
+
+	private:
+		bool ExpandIncludes(const std::string& source_path, std::string& out_source, std::vector<std::string>& visited_files) const;
+		bool ResolveInclude(const std::string& including_file, const std::string& include_name, std::string& out_path) const;
+		uint64_t ComputeCacheKey(const ShaderCompileDesc& desc, const std::string& expanded_source) const;
+		bool Compile(const ShaderCompileDesc& desc, const std::string& expanded_source, const std::string& output_path) const;
+
+		std::vector<std::string> include_directories_;
+		std::string cache_directory_;
+	};
+} // namespace peanut
@@ -1,33 +1,155 @@
 #include "shader_manager.h"
 
+#include <algorithm>
+
+#include "runtime/core/file/mapped_file.h"
+#include "runtime/functions/render/render_utils.h"
+
+#define PEANUT_XSTR(s) PEANUT_STR(s)
+#define PEANUT_STR(s) #s
+
 namespace peanut
 {
 	ShaderManager* ShaderManager::s_Instance = nullptr;
 	std::once_flag ShaderManager::s_Flag = {};
 
-	VkPipelineShaderStageCreateInfo ShaderManager::GetShaderStageCreateInfo(std::weak_ptr<RHI> rhi, const std::string& shader_name, VkShaderStageFlagBits stage)
+	void ShaderManager::RegisterShader(const std::string& shader_name, const std::string& shader_path)
 	{
-		if (shader_files_name_to_path.find(shader_name) == shader_files_name_to_path.end())
+		shader_files_name_to_path[shader_name] = shader_path;
+		shader_sources_.erase(shader_name);
+	}
+
+	void ShaderManager::RegisterShaderSource(const std::string& shader_name, const std::string& source_path,
+		VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines)
+	{
+		ShaderCompileDesc desc;
+		desc.source_path = source_path;
+		desc.stage = stage;
+		desc.defines = defines;
+		shader_sources_[shader_name] = std::move(desc);
+		shader_files_name_to_path.erase(shader_name);
+	}
+
+	std::string ShaderManager::RegisterShaderVariant(const std::string& shader_name, const std::vector<ShaderDefine>& defines)
+	{
+		auto source = shader_sources_.find(shader_name);
+		if (source == shader_sources_.end())
 		{
-			PEANUT_LOG_ERROR("Failed to find shader file: {0}", shader_name);
-			return {};
+			PEANUT_LOG_ERROR("Failed to register variant, {0} is not a shader source", shader_name);
+			return shader_name;
+		}
+
+		std::vector<ShaderDefine> sorted_defines = defines;
+		std::sort(sorted_defines.begin(), sorted_defines.end(),
+			[](const ShaderDefine& lhs, const ShaderDefine& rhs) { return lhs.name < rhs.name; });
+
+		std::string variant_name = shader_name;
+		for (const auto& define : sorted_defines)
+		{
+			variant_name += "|" + define.name + "=" + define.value;
+		}
+
+		if (shader_sources_.find(variant_name) == shader_sources_.end())
+		{
+			ShaderCompileDesc variant_desc = source->second;
+			variant_desc.defines.insert(variant_desc.defines.end(), sorted_defines.begin(), sorted_defines.end());
+			shader_sources_[variant_name] = std::move(variant_desc);
 		}
 
-		VkShaderModule shader_module;
-		if (loaded_shader_modules.find(shader_name) != loaded_shader_modules.end())
+		return variant_name;
+	}
+
+	void ShaderManager::RegisterEngineShaders()
+	{
+#ifdef PEANUT_SHADER_SOURCE_DIR
+		const std::string shader_dir = std::string(PEANUT_XSTR(PEANUT_SHADER_SOURCE_DIR)) + "/";
+
+		RegisterShaderSource("mesh.vert", shader_dir + "mesh.vert");
+		RegisterShaderSource("mesh_gbuffer.frag", shader_dir + "mesh_gbuffer.frag");
+		RegisterShaderSource("screen.vert", shader_dir + "deferred_light.vert");
+		RegisterShaderSource("deferred_lighting.frag", shader_dir + "deferred_light.frag");
+		RegisterShaderSource("light_culling.comp", shader_dir + "light_culling.comp");
+		RegisterShaderSource("shadow_depth.vert", shader_dir + "shadow_depth.vert");
+		RegisterShaderSource("reflection_probe_capture.vert", shader_dir + "reflection_probe_capture.vert");
+		RegisterShaderSource("reflection_probe_capture.frag", shader_dir + "reflection_probe_capture.frag");
+		RegisterShaderSource("reflection_probe_sky.frag", shader_dir + "reflection_probe_sky.frag");
+		RegisterShaderSource("post_luminance_histogram.comp", shader_dir + "post_luminance_histogram.comp");
+		RegisterShaderSource("post_exposure_average.comp", shader_dir + "post_exposure_average.comp");
+		RegisterShaderSource("post_bloom_downsample.comp", shader_dir + "post_bloom_downsample.comp");
+		RegisterShaderSource("post_bloom_upsample.comp", shader_dir + "post_bloom_upsample.comp");
+		RegisterShaderSource("post_composite.frag", shader_dir + "post_composite.frag");
+		RegisterShaderSource("taa_resolve.comp", shader_dir + "taa_resolve.comp");
+		RegisterShaderSource("taa_sharpen.comp", shader_dir + "taa_sharpen.comp");
+
+		RegisterShaderSource("equirect2cube.comp", shader_dir + "equirect2cube_cs.glsl");
+		RegisterShaderSource("irradiance_sh.comp", shader_dir + "irradiance_sh.comp");
+		RegisterShaderSource("prefiltered_env_map.comp", shader_dir + "spmap_cs.glsl");
+		RegisterShaderSource("brdf_lut.comp", shader_dir + "spbrdf_cs.glsl");
+		RegisterShaderSource("spd_downsample.comp", shader_dir + "spd_downsample.comp");
+#endif
+	}
+
+	bool ShaderManager::ResolveShaderSource(const std::string& shader_name)
+	{
+		auto source = shader_sources_.find(shader_name);
+		if (source == shader_sources_.end())
+		{
+			return shader_files_name_to_path.find(shader_name) != shader_files_name_to_path.end();
+		}
+
+		std::string spirv_path;
+		std::vector<std::string> dependencies;
+		if (!compiler_.CompileToCache(source->second, spirv_path, &dependencies))
 		{
-			shader_module = loaded_shader_modules[shader_name];
+			return false;
 		}
-		else
+
+		shader_files_name_to_path[shader_name] = spirv_path;
+		shader_dependencies_[shader_name] = std::move(dependencies);
+		return true;
+	}
+
+	std::filesystem::file_time_type ShaderManager::GetShaderWriteTime(const std::string& shader_name, std::error_code& error) const
+	{
+		// a source shader is as new as the newest file it includes
+		auto dependencies = shader_dependencies_.find(shader_name);
+		if (shader_sources_.count(shader_name) != 0 && dependencies != shader_dependencies_.end())
 		{
-			shader_module = rhi.lock()->CreateShaderModule(shader_files_name_to_path[shader_name]);
-			if (shader_module == VK_NULL_HANDLE)
+			std::filesystem::file_time_type newest_time = std::filesystem::file_time_type::min();
+			for (const auto& dependency : dependencies->second)
 			{
-				PEANUT_LOG_ERROR("Failed to create shader module: {0}", shader_name);
-				return {};
+				const auto write_time = std::filesystem::last_write_time(dependency, error);
+				if (error)
+				{
+					return newest_time;
+				}
+				newest_time = std::max(newest_time, write_time);
 			}
+			return newest_time;
+		}
 
-			loaded_shader_modules[shader_name] = shader_module;
+		auto shader_path = shader_files_name_to_path.find(shader_name);
+		if (shader_path == shader_files_name_to_path.end())
+		{
+			error = std::make_error_code(std::errc::no_such_file_or_directory);
+			return std::filesystem::file_time_type::min();
+		}
+		return std::filesystem::last_write_time(shader_path->second, error);
+	}
+
+	VkPipelineShaderStageCreateInfo ShaderManager::GetShaderStageCreateInfo(std::weak_ptr<RHI> rhi, const std::string& shader_name, VkShaderStageFlagBits stage)
+	{
+		if (shader_files_name_to_path.find(shader_name) == shader_files_name_to_path.end() &&
+			shader_sources_.find(shader_name) == shader_sources_.end())
+		{
+			PEANUT_LOG_ERROR("Failed to find shader file: {0}", shader_name);
+			return {};
+		}
+
+		VkShaderModule shader_module = GetShaderModule(rhi, shader_name);
+		if (shader_module == VK_NULL_HANDLE)
+		{
+			return {};
 		}
 
 		VkPipelineShaderStageCreateInfo shader_stage_info = {};
@@ -41,23 +163,206 @@ namespace peanut
 
 	VkShaderModule ShaderManager::GetShaderModule(std::weak_ptr<RHI> rhi, const std::string& shader_name)
 	{
-		VkShaderModule shader_module = VK_NULL_HANDLE;
-		if (loaded_shader_modules.find(shader_name) != loaded_shader_modules.end())
+		auto loaded_module = loaded_shader_modules.find(shader_name);
+		if (loaded_module != loaded_shader_modules.end())
 		{
-			shader_module = loaded_shader_modules[shader_name];
+			return loaded_module->second;
 		}
-		else
+
+		return LoadShaderModule(rhi, shader_name);
+	}
+
+	VkShaderModule ShaderManager::LoadShaderModule(std::weak_ptr<RHI> rhi, const std::string& shader_name)
+	{
+		auto rhi_ptr = rhi.lock();
+		assert(rhi_ptr.get() != nullptr);
+
+		if (!ResolveShaderSource(shader_name))
+		{
+			PEANUT_LOG_ERROR("Failed to find shader file: {0}", shader_name);
+			return VK_NULL_HANDLE;
+		}
+
+		const std::string& shader_path = shader_files_name_to_path[shader_name];
+		MappedFile shader_file;
+		if (!shader_file.Open(shader_path))
+		{
+			PEANUT_LOG_ERROR("Failed to read shader file {0}", shader_path);
+			return VK_NULL_HANDLE;
+		}
+
+		uint64_t content_hash = 0;
+		VkShaderModule shader_module = AcquireShaderModule(rhi_ptr,
+			reinterpret_cast<const uint32_t*>(shader_file.Data()), shader_file.Size(), content_hash);
+		if (shader_module == VK_NULL_HANDLE)
 		{
-			shader_module = rhi.lock()->CreateShaderModule(shader_files_name_to_path[shader_name]);
-			if (shader_module == VK_NULL_HANDLE)
+			PEANUT_LOG_ERROR("Failed to create shader module: {0}", shader_name);
+			return VK_NULL_HANDLE;
+		}
+
+		loaded_shader_modules[shader_name] = shader_module;
+		shader_content_hashes_[shader_name] = content_hash;
+
+		std::error_code error;
+		shader_write_times_[shader_name] = GetShaderWriteTime(shader_name, error);
+
+		return shader_module;
+	}
+
+	VkShaderModule ShaderManager::AcquireShaderModule(const std::shared_ptr<RHI>& rhi, const uint32_t* code, size_t code_size, uint64_t& out_hash)
+	{
+		out_hash = RenderUtils::HashBytes(code, code_size);
+
+		auto cached_module = shader_modules_by_hash_.find(out_hash);
+		if (cached_module != shader_modules_by_hash_.end())
+		{
+			cached_module->second.ref_count++;
+			return cached_module->second.module;
+		}
+
+		VkShaderModule shader_module = rhi->CreateShaderModule(code, code_size);
+		if (shader_module != VK_NULL_HANDLE)
+		{
+			shader_modules_by_hash_[out_hash] = { shader_module, 1 };
+		}
+
+		return shader_module;
+	}
+
+	void ShaderManager::ReleaseShaderModule(const std::shared_ptr<RHI>& rhi, uint64_t hash)
+	{
+		auto cached_module = shader_modules_by_hash_.find(hash);
+		if (cached_module == shader_modules_by_hash_.end())
+		{
+			return;
+		}
+
+		if (--cached_module->second.ref_count == 0)
+		{
+			rhi->DestroyShaderModule(cached_module->second.module);
+			shader_modules_by_hash_.erase(cached_module);
+		}
+	}
+
+	void ShaderManager::DestroyShaderModules(std::weak_ptr<RHI> rhi)
+	{
+		auto rhi_ptr = rhi.lock();
+		assert(rhi_ptr.get() != nullptr);
+
+		for (auto& cached_module : shader_modules_by_hash_)
+		{
+			rhi_ptr->DestroyShaderModule(cached_module.second.module);
+		}
+
+		shader_modules_by_hash_.clear();
+		shader_content_hashes_.clear();
+		shader_write_times_.clear();
+		loaded_shader_modules.clear();
+	}
+
+	uint32_t ShaderManager::AddReloadListener(ShaderReloadCallback callback)
+	{
+		const uint32_t listener_id = next_listener_id_++;
+		reload_listeners_.emplace_back(listener_id, std::move(callback));
+		return listener_id;
+	}
+
+	void ShaderManager::RemoveReloadListener(uint32_t listener_id)
+	{
+		reload_listeners_.erase(std::remove_if(reload_listeners_.begin(), reload_listeners_.end(),
+			[listener_id](const std::pair<uint32_t, ShaderReloadCallback>& listener) { return listener.first == listener_id; }),
+			reload_listeners_.end());
+	}
+
+	void ShaderManager::PollShaderChanges(std::weak_ptr<RHI> rhi)
+	{
+		if (!hot_reload_enabled_)
+		{
+			return;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		if (now - last_poll_time_ < kPollInterval)
+		{
+			return;
+		}
+		last_poll_time_ = now;
+
+		auto rhi_ptr = rhi.lock();
+		assert(rhi_ptr.get() != nullptr);
+
+		struct ReloadedShader
+		{
+			std::string name;
+			VkShaderModule module;
+			uint64_t hash;
+		};
+		std::vector<ReloadedShader> reloaded_shaders;
+
+		for (const auto& loaded_module : loaded_shader_modules)
+		{
+			const std::string& shader_name = loaded_module.first;
+
+			std::error_code error;
+			const auto write_time = GetShaderWriteTime(shader_name, error);
+			if (error || write_time == shader_write_times_[shader_name])
+			{
+				continue;
+			}
+
+			if (shader_sources_.count(shader_name) != 0 && !ResolveShaderSource(shader_name))
+			{
+				// keep the previous module until the source compiles again
+				shader_write_times_[shader_name] = write_time;
+				continue;
+			}
+
+			const std::string& shader_path = shader_files_name_to_path[shader_name];
+			MappedFile shader_file;
+			if (!shader_file.Open(shader_path) || shader_file.Size() % sizeof(uint32_t) != 0)
 			{
-				PEANUT_LOG_ERROR("Failed to create shader module: {0}", shader_name);
-				return {};
+				// the compiler may still be writing the file, try again on the next poll
+				continue;
 			}
+			shader_write_times_[shader_name] = write_time;
 
-			loaded_shader_modules[shader_name] = shader_module;
+			const uint64_t content_hash = RenderUtils::HashBytes(shader_file.Data(), shader_file.Size());
+			if (content_hash == shader_content_hashes_[shader_name])
+			{
+				continue;
+			}
+
+			uint64_t new_hash = 0;
+			VkShaderModule new_module = AcquireShaderModule(rhi_ptr,
+				reinterpret_cast<const uint32_t*>(shader_file.Data()), shader_file.Size(), new_hash);
+			if (new_module == VK_NULL_HANDLE)
+			{
+				PEANUT_LOG_ERROR("Failed to reload shader {0}, keep the previous module", shader_name);
+				continue;
+			}
+
+			reloaded_shaders.push_back({ shader_name, new_module, new_hash });
 		}
 
-		return shader_module;
+		if (reloaded_shaders.empty())
+		{
+			return;
+		}
+
+		// old modules may still be referenced by pipelines of frames in flight
+		rhi_ptr->WaitIdle();
+
+		for (const auto& reloaded_shader : reloaded_shaders)
+		{
+			ReleaseShaderModule(rhi_ptr, shader_content_hashes_[reloaded_shader.name]);
+			loaded_shader_modules[reloaded_shader.name] = reloaded_shader.module;
+			shader_content_hashes_[reloaded_shader.name] = reloaded_shader.hash;
+
+			PEANUT_LOG_INFO("Reload shader {0}", reloaded_shader.name);
+			for (const auto& listener : reload_listeners_)
+			{
+				listener.second(reloaded_shader.name);
+			}
+		}
 	}
 }
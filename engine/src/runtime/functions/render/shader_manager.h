@@ -1,7 +1,11 @@
 #pragma once
 
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <mutex>
 #include "runtime/functions/rhi/vulkan/vulkan_rhi.h"
+#include "runtime/functions/render/shader_compiler.h"
 #include <unordered_map>
 
 namespace peanut
@@ -9,32 +13,77 @@ namespace peanut
 	class ShaderManager
 	{
 	public:
+		using ShaderReloadCallback = std::function<void(const std::string& shader_name)>;
+
 		static ShaderManager& Get()
 		{
-			std::call_once(s_Flag, &ShaderManager::InitSingleton);
+			std::call_once(s_Flag, []() { s_Instance = new ShaderManager(); });
 			return *s_Instance;
 		}
 
+		// register a precompiled spirv file
+		void RegisterShader(const std::string& shader_name, const std::string& shader_path);
+		// register a glsl source, compiled to spirv through the shader cache when first requested
+		void RegisterShaderSource(const std::string& shader_name, const std::string& source_path,
+			VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL, const std::vector<ShaderDefine>& defines = {});
+		// register a permutation of an already registered source, returns the name of the variant
+		std::string RegisterShaderVariant(const std::string& shader_name, const std::vector<ShaderDefine>& defines);
+
+		ShaderCompiler& GetCompiler() { return compiler_; }
+
 		VkPipelineShaderStageCreateInfo GetShaderStageCreateInfo(std::weak_ptr<RHI> rhi, const std::string& shader_name, VkShaderStageFlagBits stage);
 		VkShaderModule GetShaderModule(std::weak_ptr<RHI> rhi, const std::string& shader_name);
 
+		void DestroyShaderModules(std::weak_ptr<RHI> rhi);
+
+		// hot reload: poll the spirv files of loaded shaders and notify listeners about changed ones
+		void SetHotReloadEnabled(bool enabled) { hot_reload_enabled_ = enabled; }
+		uint32_t AddReloadListener(ShaderReloadCallback callback);
+		void RemoveReloadListener(uint32_t listener_id);
+		void PollShaderChanges(std::weak_ptr<RHI> rhi);
+
 	private:
+		struct ShaderModuleEntry
+		{
+			VkShaderModule module = VK_NULL_HANDLE;
+			uint32_t ref_count = 0;
+		};
+
+		// creates the module, or shares an existing one when another shader has the same spirv
+		VkShaderModule AcquireShaderModule(const std::shared_ptr<RHI>& rhi, const uint32_t* code, size_t code_size, uint64_t& out_hash);
+		void ReleaseShaderModule(const std::shared_ptr<RHI>& rhi, uint64_t hash);
+		VkShaderModule LoadShaderModule(std::weak_ptr<RHI> rhi, const std::string& shader_name);
+		// compile a registered source if needed and point the shader at its cached spirv
+		bool ResolveShaderSource(const std::string& shader_name);
+		std::filesystem::file_time_type GetShaderWriteTime(const std::string& shader_name, std::error_code& error) const;
+		void RegisterEngineShaders();
+
 		std::unordered_map<std::string, std::string> shader_files_name_to_path;
 		std::unordered_map<std::string, VkShaderModule> loaded_shader_modules;
 
+		std::unordered_map<std::string, uint64_t> shader_content_hashes_;
+		std::unordered_map<uint64_t, ShaderModuleEntry> shader_modules_by_hash_;
+		std::unordered_map<std::string, std::filesystem::file_time_type> shader_write_times_;
+
+		ShaderCompiler compiler_;
+		std::unordered_map<std::string, ShaderCompileDesc> shader_sources_;
+		std::unordered_map<std::string, std::vector<std::string> > shader_dependencies_;
+
+		bool hot_reload_enabled_ = false;
+		uint32_t next_listener_id_ = 0;
+		std::vector<std::pair<uint32_t, ShaderReloadCallback> > reload_listeners_;
+		std::chrono::steady_clock::time_point last_poll_time_;
+
+		static constexpr std::chrono::milliseconds kPollInterval{ 500 };
+
 	private:
-		ShaderManager() {}
+		ShaderManager() { RegisterEngineShaders(); }
 
 		ShaderManager(const ShaderManager&) = delete;
 		ShaderManager& operator=(const ShaderManager&) = delete;
 
-		ShaderManager* InitSingleton()
-		{
-			return new ShaderManager();
-		}
-
 		static ShaderManager* s_Instance;
 		static std::once_flag s_Flag;
 	};
 
-} // namespace peanut
\ No newline at end of file
+} // namespace peanut
@@ -0,0 +1,167 @@
+#include "shadow_atlas.h"
+
+#include <algorithm>
+
+namespace peanut
+{
+	namespace
+	{
+		uint32_t RoundUpPowerOfTwo(uint32_t value)
+		{
+			uint32_t power = 1;
+			while (power < value)
+			{
+				power <<= 1;
+			}
+			return power;
+		}
+
+		uint32_t Log2(uint32_t power_of_two)
+		{
+			uint32_t log = 0;
+			while ((1u << log) < power_of_two)
+			{
+				++log;
+			}
+			return log;
+		}
+	}
+
+	void ShadowAtlas::Reset(uint32_t atlas_size, uint32_t min_tile_size)
+	{
+		atlas_size_ = RoundUpPowerOfTwo(atlas_size);
+		min_tile_size_ = std::min(RoundUpPowerOfTwo(min_tile_size), atlas_size_);
+		allocated_area_ = 0;
+
+		const uint32_t level_count = Log2(atlas_size_ / min_tile_size_) + 1;
+		nodes_.assign(level_count, {});
+		for (uint32_t level = 0; level < level_count; ++level)
+		{
+			nodes_[level].assign(static_cast<size_t>(1u << level) * (1u << level), NodeState::Free);
+		}
+	}
+
+	bool ShadowAtlas::Allocate(uint32_t tile_size, ShadowAtlasTile& out_tile)
+	{
+		if (nodes_.empty())
+		{
+			return false;
+		}
+
+		tile_size = std::clamp(RoundUpPowerOfTwo(tile_size), min_tile_size_, atlas_size_);
+		const uint32_t target_level = Log2(atlas_size_ / tile_size);
+		if (!AllocateNode(0, 0, 0, target_level, out_tile))
+		{
+			return false;
+		}
+
+		allocated_area_ += static_cast<uint64_t>(out_tile.size) * out_tile.size;
+		return true;
+	}
+
+	bool ShadowAtlas::AllocateNode(uint32_t level, uint32_t x, uint32_t y, uint32_t target_level, ShadowAtlasTile& out_tile)
+	{
+		NodeState& node = GetNode(level, x, y);
+		if (level == target_level)
+		{
+			if (node != NodeState::Free)
+			{
+				return false;
+			}
+			node = NodeState::Used;
+
+			const uint32_t node_size = atlas_size_ >> level;
+			out_tile = { x * node_size, y * node_size, node_size };
+			return true;
+		}
+
+		if (node == NodeState::Used)
+		{
+			return false;
+		}
+
+		const bool was_free = node == NodeState::Free;
+		node = NodeState::Split;
+		for (uint32_t child = 0; child < 4; ++child)
+		{
+			if (AllocateNode(level + 1, x * 2 + (child & 1), y * 2 + (child >> 1), target_level, out_tile))
+			{
+				return true;
+			}
+		}
+
+		// nothing fit below a node that was free, which only happens if the target level does not exist
+		if (was_free)
+		{
+			node = NodeState::Free;
+		}
+		return false;
+	}
+
+	void ShadowAtlas::Free(const ShadowAtlasTile& tile)
+	{
+		if (!tile.IsValid() || nodes_.empty())
+		{
+			return;
+		}
+
+		uint32_t level = Log2(atlas_size_ / tile.size);
+		uint32_t x = tile.x / tile.size;
+		uint32_t y = tile.y / tile.size;
+		if (level >= nodes_.size() || GetNode(level, x, y) != NodeState::Used)
+		{
+			return;
+		}
+
+		GetNode(level, x, y) = NodeState::Free;
+		allocated_area_ -= static_cast<uint64_t>(tile.size) * tile.size;
+
+		// merge four free siblings into their parent
+		while (level > 0)
+		{
+			const uint32_t parent_x = x / 2;
+			const uint32_t parent_y = y / 2;
+			for (uint32_t child = 0; child < 4; ++child)
+			{
+				if (GetNode(level, parent_x * 2 + (child & 1), parent_y * 2 + (child >> 1)) != NodeState::Free)
+				{
+					return;
+				}
+			}
+
+			--level;
+			x = parent_x;
+			y = parent_y;
+			GetNode(level, x, y) = NodeState::Free;
+		}
+	}
+
+	uint32_t ShadowAtlas::GetTileSizeForImportance(float importance, uint32_t max_tile_size, uint32_t min_tile_size)
+	{
+		// every halving of the importance halves the resolution
+		uint32_t tile_size = max_tile_size;
+		float threshold = 0.5f;
+		while (tile_size > min_tile_size && importance < threshold)
+		{
+			tile_size >>= 1;
+			threshold *= 0.5f;
+		}
+		return tile_size;
+	}
+
+	float ShadowAtlas::ComputeLightImportance(const glm::vec3& light_position, float light_radius, const glm::vec3& camera_position)
+	{
+		const float distance = glm::length(light_position - camera_position);
+		if (distance <= light_radius)
+		{
+			return 1.0f;
+		}
+		return std::min(light_radius / distance, 1.0f);
+	}
+
+	glm::vec4 ShadowAtlas::GetTileRect(const ShadowAtlasTile& tile) const
+	{
+		const float inv_atlas_size = 1.0f / static_cast<float>(atlas_size_);
+		return glm::vec4(tile.x, tile.y, tile.size, tile.size) * inv_atlas_size;
+	}
+} // namespace peanut
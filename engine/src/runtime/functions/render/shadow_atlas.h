@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "render_data.h"
+
+namespace peanut
+{
+	struct ShadowAtlasTile
+	{
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t size = 0; // texels of a side, 0 for no tile
+
+		bool IsValid() const { return size != 0; }
+		bool operator==(const ShadowAtlasTile& other) const { return x == other.x && y == other.y && size == other.size; }
+		bool operator!=(const ShadowAtlasTile& other) const { return !(*this == other); }
+	};
+
+	/**
+	 * @brief quadtree allocator of square power of two tiles in a shadow atlas
+	 *
+	 * Level 0 is the whole atlas, every level splits the nodes of the one above into four.
+	 * Allocating splits free nodes down to the requested size, freeing merges four free
+	 * siblings back, so tiles of lights that keep their size stay where they are.
+	 */
+	class ShadowAtlas
+	{
+	public:
+		// atlas_size and min_tile_size are powers of two, every tile is freed
+		void Reset(uint32_t atlas_size, uint32_t min_tile_size);
+
+		// tile_size is rounded up to a power of two and clamped to [min tile size, atlas size]
+		bool Allocate(uint32_t tile_size, ShadowAtlasTile& out_tile);
+		void Free(const ShadowAtlasTile& tile);
+
+		uint32_t GetAtlasSize() const { return atlas_size_; }
+		uint32_t GetMinTileSize() const { return min_tile_size_; }
+		// texels covered by tiles
+		uint64_t GetAllocatedArea() const { return allocated_area_; }
+
+		// the size a light deserves for the fraction of the screen its radius covers, larger lights get sharper shadows
+		static uint32_t GetTileSizeForImportance(float importance, uint32_t max_tile_size, uint32_t min_tile_size);
+
+		// approximate screen coverage of a light sphere seen from the camera, 1 when the camera is inside
+		static float ComputeLightImportance(const glm::vec3& light_position, float light_radius, const glm::vec3& camera_position);
+
+		// atlas uv offset and scale of a tile
+		glm::vec4 GetTileRect(const ShadowAtlasTile& tile) const;
+
+	private:
+		enum class NodeState : uint8_t
+		{
+			Free = 0,
+			Split,
+			Used
+		};
+
+		bool AllocateNode(uint32_t level, uint32_t x, uint32_t y, uint32_t target_level, ShadowAtlasTile& out_tile);
+		NodeState& GetNode(uint32_t level, uint32_t x, uint32_t y) { return nodes_[level][y * (1u << level) + x]; }
+
+		uint32_t atlas_size_ = 0;
+		uint32_t min_tile_size_ = 0;
+		uint64_t allocated_area_ = 0;
+		std::vector<std::vector<NodeState> > nodes_; // per level, row major
+	};
+} // namespace peanut
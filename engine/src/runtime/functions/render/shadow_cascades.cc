@@ -0,0 +1,150 @@
+#include "shadow_cascades.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peanut
+{
+	void ShadowCascades::ComputeSplitDepths(float near_depth, float far_depth, float split_lambda,
+		std::array<float, SHADOW_CASCADE_NUM>& out_split_depths)
+	{
+		const float depth_ratio = far_depth / near_depth;
+		for (uint32_t i = 0; i < SHADOW_CASCADE_NUM; ++i)
+		{
+			const float t = static_cast<float>(i + 1) / static_cast<float>(SHADOW_CASCADE_NUM);
+			const float log_split = near_depth * std::pow(depth_ratio, t);
+			const float uniform_split = near_depth + (far_depth - near_depth) * t;
+			out_split_depths[i] = split_lambda * log_split + (1.0f - split_lambda) * uniform_split;
+		}
+	}
+
+	void ShadowCascades::ComputeCascades(const glm::mat4& inv_camera_view_proj, float near_depth, float far_depth,
+		const glm::vec3& light_direction, const ShadowCascadeSettings& settings, Cascades& out_cascades)
+	{
+		const float shadow_far_depth = std::min(far_depth, settings.shadow_distance);
+		std::array<float, SHADOW_CASCADE_NUM> split_depths;
+		ComputeSplitDepths(near_depth, shadow_far_depth, settings.split_lambda, split_depths);
+
+		// world space frustum edges from the near to the far plane, a point on an edge moves linearly in view depth
+		std::array<glm::vec3, 4> near_corners;
+		std::array<glm::vec3, 4> far_corners;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			const glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+			const glm::vec4 near_corner = inv_camera_view_proj * glm::vec4(ndc, 0.0f, 1.0f);
+			const glm::vec4 far_corner = inv_camera_view_proj * glm::vec4(ndc, 1.0f, 1.0f);
+			near_corners[i] = glm::vec3(near_corner) / near_corner.w;
+			far_corners[i] = glm::vec3(far_corner) / far_corner.w;
+		}
+
+		const glm::vec3 direction = glm::normalize(light_direction);
+		const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		const float texels_per_unit_ndc = static_cast<float>(settings.resolution) * 0.5f;
+
+		float slice_near_depth = near_depth;
+		for (uint32_t cascade_index = 0; cascade_index < SHADOW_CASCADE_NUM; ++cascade_index)
+		{
+			const float slice_far_depth = split_depths[cascade_index];
+			const float t0 = (slice_near_depth - near_depth) / (far_depth - near_depth);
+			const float t1 = (slice_far_depth - near_depth) / (far_depth - near_depth);
+
+			std::array<glm::vec3, 8> slice_corners;
+			glm::vec3 center(0.0f);
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				slice_corners[i] = glm::mix(near_corners[i], far_corners[i], t0);
+				slice_corners[i + 4] = glm::mix(near_corners[i], far_corners[i], t1);
+				center += slice_corners[i] + slice_corners[i + 4];
+			}
+			center /= 8.0f;
+
+			// the bounding sphere does not depend on the camera orientation, rounding keeps float noise out of its size
+			float radius = 0.0f;
+			for (const glm::vec3& corner : slice_corners)
+			{
+				radius = std::max(radius, glm::length(corner - center));
+			}
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+
+			const glm::vec3 eye = center - direction * (radius + settings.caster_distance);
+			const glm::mat4 view = glm::lookAt(eye, center, up);
+			glm::mat4 proj = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + settings.caster_distance);
+
+			// move the projection so the world origin lands on a texel, the cascade then only moves in whole texels
+			const glm::vec4 origin = proj * view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			const glm::vec2 origin_texels = glm::vec2(origin) * texels_per_unit_ndc;
+			const glm::vec2 snap_offset = (glm::round(origin_texels) - origin_texels) / texels_per_unit_ndc;
+			proj[3][0] += snap_offset.x;
+			proj[3][1] += snap_offset.y;
+
+			ShadowCascade& cascade = out_cascades[cascade_index];
+			cascade.view_proj = proj * view;
+			cascade.split_depth = slice_far_depth;
+			ExtractFrustumPlanes(cascade.view_proj, cascade.frustum_planes);
+
+			slice_near_depth = slice_far_depth;
+		}
+	}
+
+	void ShadowCascades::FillDirectionalLight(const Cascades& cascades, DirectionalLight& out_light)
+	{
+		for (uint32_t i = 0; i < SHADOW_CASCADE_NUM; ++i)
+		{
+			out_light.cascade_view_projs[i] = cascades[i].view_proj;
+			out_light.cascade_splits[i] = cascades[i].split_depth;
+		}
+	}
+
+	void ShadowCascades::ExtractFrustumPlanes(const glm::mat4& view_proj, std::array<glm::vec4, 6>& out_planes)
+	{
+		// rows of the matrix, clip space depth is in [0, w]
+		const glm::vec4 row0(view_proj[0][0], view_proj[1][0], view_proj[2][0], view_proj[3][0]);
+		const glm::vec4 row1(view_proj[0][1], view_proj[1][1], view_proj[2][1], view_proj[3][1]);
+		const glm::vec4 row2(view_proj[0][2], view_proj[1][2], view_proj[2][2], view_proj[3][2]);
+		const glm::vec4 row3(view_proj[0][3], view_proj[1][3], view_proj[2][3], view_proj[3][3]);
+
+		out_planes[0] = row3 + row0; // left
+		out_planes[1] = row3 - row0; // right
+		out_planes[2] = row3 + row1; // bottom
+		out_planes[3] = row3 - row1; // top
+		out_planes[4] = row2;        // near
+		out_planes[5] = row3 - row2; // far
+
+		for (glm::vec4& plane : out_planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+	}
+
+	bool ShadowCascades::IsAabbInFrustum(const std::array<glm::vec4, 6>& planes, const glm::vec3& aabb_min, const glm::vec3& aabb_max)
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			// the corner furthest along the plane normal
+			const glm::vec3 corner(plane.x >= 0.0f ? aabb_max.x : aabb_min.x,
+				plane.y >= 0.0f ? aabb_max.y : aabb_min.y,
+				plane.z >= 0.0f ? aabb_max.z : aabb_min.z);
+			if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void ShadowCascades::TransformAabb(const glm::mat4& transform, const glm::vec3& aabb_min, const glm::vec3& aabb_max,
+		glm::vec3& out_min, glm::vec3& out_max)
+	{
+		const glm::vec3 center = glm::vec3(transform * glm::vec4((aabb_min + aabb_max) * 0.5f, 1.0f));
+		const glm::vec3 extent = (aabb_max - aabb_min) * 0.5f;
+
+		glm::vec3 transformed_extent(0.0f);
+		for (int column = 0; column < 3; ++column)
+		{
+			transformed_extent += glm::abs(glm::vec3(transform[column])) * extent[column];
+		}
+
+		out_min = center - transformed_extent;
+		out_max = center + transformed_extent;
+	}
+} // namespace peanut
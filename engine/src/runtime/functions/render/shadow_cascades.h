@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "render_data.h"
+
+namespace peanut
+{
+	struct ShadowCascadeSettings
+	{
+		float shadow_distance = 100.0f;   // the last cascade ends here or at the camera far plane
+		float split_lambda = 0.75f;       // 0 uniform splits, 1 logarithmic splits
+		float caster_distance = 50.0f;    // how far towards the light casters in front of a cascade are still rendered
+		uint32_t resolution = 2048;       // texels of a cascade side, cascades move in whole texels
+	};
+
+	struct ShadowCascade
+	{
+		glm::mat4 view_proj{ 1.0f };
+		float split_depth = 0.0f; // view space depth where the cascade ends
+
+		// world space planes of the light frustum, a point is inside if dot(plane, vec4(p, 1)) >= 0 for all of them
+		std::array<glm::vec4, 6> frustum_planes;
+	};
+
+	/**
+	 * @brief stable cascades of a directional light shadow map
+	 *
+	 * Splits blend uniform and logarithmic distribution (the practical split scheme). Every cascade
+	 * bounds its slice of the view frustum with a sphere, so its size does not change when the camera
+	 * rotates, and its projection is snapped to whole shadow map texels, so it does not shimmer when
+	 * the camera moves.
+	 */
+	class ShadowCascades
+	{
+	public:
+		using Cascades = std::array<ShadowCascade, SHADOW_CASCADE_NUM>;
+
+		// far view space depth of every cascade
+		static void ComputeSplitDepths(float near_depth, float far_depth, float split_lambda, std::array<float, SHADOW_CASCADE_NUM>& out_split_depths);
+
+		// the camera is given by its inverse view projection with depth in [0, 1] and its near and far view depth
+		static void ComputeCascades(const glm::mat4& inv_camera_view_proj, float near_depth, float far_depth,
+			const glm::vec3& light_direction, const ShadowCascadeSettings& settings, Cascades& out_cascades);
+
+		// write the cascades to the light constants the lighting shaders read
+		static void FillDirectionalLight(const Cascades& cascades, DirectionalLight& out_light);
+
+		static void ExtractFrustumPlanes(const glm::mat4& view_proj, std::array<glm::vec4, 6>& out_planes);
+		static bool IsAabbInFrustum(const std::array<glm::vec4, 6>& planes, const glm::vec3& aabb_min, const glm::vec3& aabb_max);
+
+		// bounds of a transformed box
+		static void TransformAabb(const glm::mat4& transform, const glm::vec3& aabb_min, const glm::vec3& aabb_max,
+			glm::vec3& out_min, glm::vec3& out_max);
+	};
+} // namespace peanut
@@ -0,0 +1,419 @@
+#include "single_pass_downsampler.h"
+
+#include <algorithm>
+
+#include "shader_manager.h"
+
+namespace peanut
+{
+	void SinglePassDownsampler::Initialize(std::weak_ptr<RHI> rhi)
+	{
+		rhi_ = rhi;
+
+		std::shared_ptr<RHI> rhi_ptr = rhi_.lock();
+		assert(rhi_ptr.get() != nullptr);
+
+		// one set rewritten per texture, the global pool has no storage images
+		const std::vector<VkDescriptorPoolSize> pool_sizes = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kMaxLevels + 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+		};
+		VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_create_info.maxSets = 1;
+		pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_create_info.pPoolSizes = pool_sizes.data();
+		rhi_ptr->CreateDescriptorPool(&pool_create_info, &descriptor_pool_);
+
+		descriptor_layout_ = rhi_ptr->CreateDescriptorSetLayout({
+			{ SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ OUTPUT_LEVELS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kMaxLevels, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ SHARED_LEVEL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ GROUP_COUNTERS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		});
+		descriptor_set_ = rhi_ptr->AllocateDescriptor(descriptor_pool_, descriptor_layout_);
+		pipeline_layout_ = rhi_ptr->CreatePipelineLayout({ descriptor_layout_ },
+			{ { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants) } });
+
+		// level 0 is only fetched by texel
+		VkSamplerCreateInfo sampler_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		sampler_info.minFilter = VK_FILTER_NEAREST;
+		sampler_info.magFilter = VK_FILTER_NEAREST;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		rhi_ptr->CreateSampler(&sampler_info, &sampler_);
+
+		group_counters_ = rhi_ptr->CreateBuffer(sizeof(uint32_t) * kMaxLayers,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		rhi_ptr->UpdateBufferDescriptorSet(descriptor_set_, GROUP_COUNTERS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			{ { group_counters_.resource, 0, sizeof(uint32_t) * kMaxLayers } });
+
+		is_initialized = true;
+	}
+
+	void SinglePassDownsampler::Destroy()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		if (!is_initialized || rhi.get() == nullptr)
+		{
+			return;
+		}
+
+		DestroyScratch();
+		if (source_view_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyImageView(source_view_);
+			source_view_ = VK_NULL_HANDLE;
+		}
+
+		for (auto& pipeline : pipelines_)
+		{
+			rhi->DestroyPipeline(pipeline.second);
+		}
+		pipelines_.clear();
+
+		if (pipeline_layout_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyPipelineLayout(pipeline_layout_);
+			pipeline_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (descriptor_layout_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorSetLayout(rhi->GetDevice(), descriptor_layout_, nullptr);
+			descriptor_layout_ = VK_NULL_HANDLE;
+		}
+
+		if (descriptor_pool_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(rhi->GetDevice(), descriptor_pool_, nullptr);
+			descriptor_pool_ = VK_NULL_HANDLE;
+		}
+		descriptor_set_ = VK_NULL_HANDLE;
+
+		if (sampler_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroySampler(&sampler_);
+			sampler_ = VK_NULL_HANDLE;
+		}
+
+		if (group_counters_.resource != VK_NULL_HANDLE)
+		{
+			rhi->DestroyBuffer(group_counters_);
+			group_counters_ = Resource<VkBuffer>();
+		}
+
+		is_initialized = false;
+	}
+
+	VkFormat SinglePassDownsampler::GetStorageFormat(VkFormat format)
+	{
+		// the formats every device can use as storage image, sRGB levels are written through their unorm twin
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			return VK_FORMAT_R8G8B8A8_UNORM;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return VK_FORMAT_R16G16B16A16_SFLOAT;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return VK_FORMAT_R32G32B32A32_SFLOAT;
+		default:
+			return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	bool SinglePassDownsampler::IsSrgbFormat(VkFormat format)
+	{
+		return format == VK_FORMAT_R8G8B8A8_SRGB;
+	}
+
+	bool SinglePassDownsampler::IsSupported(const TextureData& texture)
+	{
+		if (texture.levels < 2 || texture.levels - 1 > kMaxLevels || texture.layers == 0 || texture.layers > kMaxLayers)
+		{
+			return false;
+		}
+		if (GetStorageFormat(texture.format) == VK_FORMAT_UNDEFINED)
+		{
+			return false;
+		}
+
+		// the last workgroup reduces level 6 as a single tile
+		return texture.levels - 1 <= kTileLevels || std::max(texture.width, texture.height) <= (kTileSize << kTileLevels);
+	}
+
+	SinglePassDownsampler::DispatchSetup SinglePassDownsampler::ComputeDispatchSetup(uint32_t width, uint32_t height, uint32_t levels)
+	{
+		DispatchSetup setup;
+		setup.group_count_x = (width + kTileSize - 1) / kTileSize;
+		setup.group_count_y = (height + kTileSize - 1) / kTileSize;
+		setup.level_num = levels > 1 ? std::min(levels - 1, kMaxLevels) : 0;
+		return setup;
+	}
+
+	bool SinglePassDownsampler::CmdGenerateMipmaps(VkCommandBuffer command_buffer, const TextureData& texture)
+	{
+		if (!is_initialized || !IsSupported(texture))
+		{
+			return false;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		VkPipeline pipeline = GetPipeline(texture.format);
+		if (pipeline == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+
+		const DispatchSetup setup = ComputeDispatchSetup(texture.width, texture.height, texture.levels);
+		PrepareScratch(texture, GetStorageFormat(texture.format), setup.level_num);
+
+		// level 0 is read through an array view, also for 2d and cube textures
+		if (source_view_ != VK_NULL_HANDLE)
+		{
+			rhi->DestroyImageView(source_view_);
+		}
+		source_view_ = rhi->CreateImageArrayView(texture.image.resource, texture.format, 0, 1, texture.layers);
+
+		// the unused levels repeat the smallest one, the shader never writes past level_num
+		std::vector<VkDescriptorImageInfo> output_levels(kMaxLevels);
+		for (uint32_t level = 0; level < kMaxLevels; ++level)
+		{
+			output_levels[level] = { VK_NULL_HANDLE, scratch_level_views_[std::min(level, setup.level_num - 1)], VK_IMAGE_LAYOUT_GENERAL };
+		}
+		const VkImageView shared_level_view = scratch_level_views_[std::min(kTileLevels, setup.level_num) - 1];
+
+		rhi->UpdateImageDescriptorSet(descriptor_set_, SOURCE_TEXTURE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			{ { sampler_, source_view_, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
+		rhi->UpdateImageDescriptorSet(descriptor_set_, OUTPUT_LEVELS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, output_levels);
+		rhi->UpdateImageDescriptorSet(descriptor_set_, SHARED_LEVEL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			{ { VK_NULL_HANDLE, shared_level_view, VK_IMAGE_LAYOUT_GENERAL } });
+
+		// every layer counts its finished workgroups from zero
+		vkCmdFillBuffer(command_buffer, group_counters_.resource, 0, sizeof(uint32_t) * texture.layers, 0);
+		VkBufferMemoryBarrier counters_barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+		counters_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		counters_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		counters_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		counters_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		counters_barrier.buffer = group_counters_.resource;
+		counters_barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 1, &counters_barrier, 0, nullptr);
+
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {
+				TextureMemoryBarrier(texture, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(0, 1),
+				TextureMemoryBarrier(*scratch_, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+					VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL) });
+
+		PushConstants push_constants;
+		push_constants.source_size[0] = static_cast<int32_t>(texture.width);
+		push_constants.source_size[1] = static_cast<int32_t>(texture.height);
+		push_constants.level_num = setup.level_num;
+		push_constants.group_num = setup.group_count_x * setup.group_count_y;
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &descriptor_set_, 0, nullptr);
+		vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &push_constants);
+		vkCmdDispatch(command_buffer, setup.group_count_x, setup.group_count_y, texture.layers);
+
+		// copy the scratch levels into the levels below level 0
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, {
+			TextureMemoryBarrier(*scratch_, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+			TextureMemoryBarrier(texture, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL).MipLevels(1, setup.level_num) });
+
+		std::vector<VkImageCopy> regions(setup.level_num);
+		for (uint32_t level = 0; level < setup.level_num; ++level)
+		{
+			VkImageCopy& region = regions[level];
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, texture.layers };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level + 1, 0, texture.layers };
+			region.extent = { std::max(texture.width >> (level + 1), 1u), std::max(texture.height >> (level + 1), 1u), 1 };
+		}
+		vkCmdCopyImage(command_buffer, scratch_->image.resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			texture.image.resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+		rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {
+			TextureMemoryBarrier(texture, VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(1, setup.level_num) });
+
+		return true;
+	}
+
+	VkPipeline SinglePassDownsampler::GetPipeline(VkFormat format)
+	{
+		auto found = pipelines_.find(format);
+		if (found != pipelines_.end())
+		{
+			return found->second;
+		}
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		const VkFormat storage_format = GetStorageFormat(format);
+		const char* image_format = storage_format == VK_FORMAT_R8G8B8A8_UNORM ? "rgba8" :
+			(storage_format == VK_FORMAT_R16G16B16A16_SFLOAT ? "rgba16f" : "rgba32f");
+		const std::string variant = ShaderManager::Get().RegisterShaderVariant("spd_downsample.comp",
+			{ { "SPD_FORMAT", image_format }, { "SPD_SRGB", IsSrgbFormat(format) ? "1" : "0" } });
+
+		VkShaderModule shader = ShaderManager::Get().GetShaderModule(rhi_, variant);
+		if (shader == VK_NULL_HANDLE)
+		{
+			PEANUT_LOG_ERROR("Failed to load {0}, mip maps are blitted", variant);
+			pipelines_[format] = VK_NULL_HANDLE;
+			return VK_NULL_HANDLE;
+		}
+
+		VkPipeline pipeline = rhi->CreateComputePipeline(shader, pipeline_layout_);
+		pipelines_[format] = pipeline;
+		return pipeline;
+	}
+
+	void SinglePassDownsampler::PrepareScratch(const TextureData& texture, VkFormat storage_format, uint32_t level_num)
+	{
+		const uint32_t width = std::max(texture.width >> 1, 1u);
+		const uint32_t height = std::max(texture.height >> 1, 1u);
+		if (scratch_ && scratch_->width == width && scratch_->height == height && scratch_->layers == texture.layers &&
+			scratch_->levels == level_num && scratch_->format == storage_format)
+		{
+			return;
+		}
+
+		DestroyScratch();
+
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		// level i of the scratch image is level i + 1 of the texture
+		scratch_ = rhi->CreateTexture(width, height, texture.layers, level_num, storage_format,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		for (uint32_t level = 0; level < level_num; ++level)
+		{
+			scratch_level_views_[level] = rhi->CreateImageArrayView(scratch_->image.resource, storage_format, level, 1, texture.layers);
+		}
+	}
+
+	void SinglePassDownsampler::DestroyScratch()
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		for (VkImageView& image_view : scratch_level_views_)
+		{
+			if (image_view != VK_NULL_HANDLE)
+			{
+				rhi->DestroyImageView(image_view);
+				image_view = VK_NULL_HANDLE;
+			}
+		}
+
+		if (scratch_)
+		{
+			rhi->DestroyTexture(scratch_);
+			scratch_.reset();
+		}
+	}
+
+	void SinglePassDownsampler::LogBenchmark(uint32_t iterations)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		if (!is_initialized || rhi.get() == nullptr || iterations == 0)
+		{
+			return;
+		}
+		if (rhi->GetTimestampValidBits() == 0)
+		{
+			PEANUT_LOG_WARN("The device has no timestamp support, skip the mip generation benchmark");
+			return;
+		}
+
+		struct BenchmarkTexture
+		{
+			const char* name;
+			uint32_t size;
+			uint32_t layers;
+			VkFormat format;
+		};
+		const BenchmarkTexture benchmark_textures[] = {
+			{ "2d 2048 rgba8 srgb", 2048, 1, VK_FORMAT_R8G8B8A8_SRGB },
+			{ "cube 1024 rgba16f", 1024, 6, VK_FORMAT_R16G16B16A16_SFLOAT },
+		};
+
+		for (const BenchmarkTexture& benchmark_texture : benchmark_textures)
+		{
+			std::shared_ptr<TextureData> texture = rhi->CreateTexture(benchmark_texture.size, benchmark_texture.size,
+				benchmark_texture.layers, 0, benchmark_texture.format, 0);
+
+			// the timings do not depend on the texels, level 0 only needs a layout every run starts from
+			VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {
+				TextureMemoryBarrier(*texture, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL).MipLevels(0, 1) });
+			rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+
+			const double blit_ms = TimeMipGeneration(*texture, MipGenerationMode::Blit, iterations);
+			const double compute_ms = TimeMipGeneration(*texture, MipGenerationMode::SinglePassCompute, iterations);
+			PEANUT_LOG_INFO("Mip generation of a {0} texture ({1} levels): blit {2:.3f} ms, single pass compute {3:.3f} ms",
+				benchmark_texture.name, texture->levels, blit_ms, compute_ms);
+
+			rhi->DestroyTexture(texture);
+		}
+	}
+
+	double SinglePassDownsampler::TimeMipGeneration(const TextureData& texture, MipGenerationMode mode, uint32_t iterations)
+	{
+		std::shared_ptr<RHI> rhi = rhi_.lock();
+		assert(rhi.get() != nullptr);
+
+		VkQueryPool query_pool = rhi->CreateQueryPool(iterations * 2);
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+		{
+			VkCommandBuffer command_buffer = rhi->BeginImmediateComputePassCommandBuffer();
+			vkCmdResetQueryPool(command_buffer, query_pool, iteration * 2, 2);
+			rhi->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {
+				TextureMemoryBarrier(texture, 0, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).MipLevels(0, 1) });
+
+			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, iteration * 2);
+			if (mode == MipGenerationMode::SinglePassCompute)
+			{
+				CmdGenerateMipmaps(command_buffer, texture);
+			}
+			else
+			{
+				rhi->CmdGenerateMipmaps(command_buffer, texture, MipGenerationMode::Blit);
+			}
+			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, iteration * 2 + 1);
+
+			// waits for the queue, so the timestamps are available right after
+			rhi->ExecImmediateComputePassCommandBuffer(command_buffer);
+		}
+
+		std::vector<uint64_t> timestamps;
+		const bool has_results = rhi->GetQueryPoolResults(query_pool, 0, iterations * 2, timestamps);
+		rhi->DestroyQueryPool(query_pool);
+		if (!has_results)
+		{
+			return 0.0;
+		}
+
+		const uint32_t valid_bits = rhi->GetTimestampValidBits();
+		const uint64_t timestamp_mask = valid_bits >= 64 ? ~0ull : ((1ull << valid_bits) - 1);
+		double total_ms = 0.0;
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+		{
+			const uint64_t ticks = ((timestamps[iteration * 2 + 1] & timestamp_mask) - (timestamps[iteration * 2] & timestamp_mask)) & timestamp_mask;
+			total_ms += static_cast<double>(ticks) * rhi->GetTimestampPeriod() * 1e-6;
+		}
+		return total_ms / iterations;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+#include "render_data.h"
+#include "functions/rhi/rhi.h"
+
+namespace peanut
+{
+	/**
+	 * @brief mip generation of a whole chain in one compute dispatch, in the style of FidelityFX SPD
+	 *
+	 * A workgroup reduces a 64x64 tile of level 0 to six levels through shared memory, the last
+	 * workgroup of a layer, found with an atomic counter, reduces the level 6 texels of all tiles to
+	 * the remaining levels. Levels are averaged in linear space, also for sRGB textures. Since sRGB
+	 * formats can not be storage images and textures are not created with storage usage, the levels
+	 * are written to a scratch image of a storage format and copied into the texture.
+	 *
+	 * The scratch image and descriptors are reused by the next texture, so the recorded commands have
+	 * to be executed before the next call, as RHI::GenerateMipmaps() does.
+	 */
+	class SinglePassDownsampler : public MipGenerator
+	{
+	public:
+		static constexpr uint32_t kMaxLevels = 12;      // levels written below level 0
+		static constexpr uint32_t kTileSize = 64;       // level 0 texels of a workgroup per axis
+		static constexpr uint32_t kTileLevels = 6;      // levels a workgroup reduces its tile by
+		static constexpr uint32_t kMaxLayers = 64;
+
+		struct DispatchSetup
+		{
+			uint32_t group_count_x = 0;
+			uint32_t group_count_y = 0;
+			uint32_t level_num = 0;     // levels written below level 0
+		};
+
+		SinglePassDownsampler() = default;
+		virtual ~SinglePassDownsampler() = default;
+
+		void Initialize(std::weak_ptr<RHI> rhi);
+		void Destroy();
+
+		virtual bool CmdGenerateMipmaps(VkCommandBuffer command_buffer, const TextureData& texture) override;
+
+		// time the blit and the single pass generation on a 2d and a cube texture and log the averages
+		void LogBenchmark(uint32_t iterations = 8);
+
+		// VK_FORMAT_UNDEFINED if the levels of the format can not be written by the shader
+		static VkFormat GetStorageFormat(VkFormat format);
+		static bool IsSrgbFormat(VkFormat format);
+		static bool IsSupported(const TextureData& texture);
+		static DispatchSetup ComputeDispatchSetup(uint32_t width, uint32_t height, uint32_t levels);
+
+		SinglePassDownsampler(const SinglePassDownsampler&) = delete;
+		SinglePassDownsampler& operator=(const SinglePassDownsampler&) = delete;
+
+	private:
+		enum Binding
+		{
+			SOURCE_TEXTURE = 0,
+			OUTPUT_LEVELS = 1,
+			SHARED_LEVEL = 2,
+			GROUP_COUNTERS = 3,
+		};
+
+		struct PushConstants
+		{
+			int32_t source_size[2];
+			uint32_t level_num;
+			uint32_t group_num;
+		};
+
+		VkPipeline GetPipeline(VkFormat format);
+		// recreate the scratch levels if the texture does not fit the current ones
+		void PrepareScratch(const TextureData& texture, VkFormat storage_format, uint32_t level_num);
+		void DestroyScratch();
+		double TimeMipGeneration(const TextureData& texture, MipGenerationMode mode, uint32_t iterations);
+
+		bool is_initialized = false;
+
+		std::weak_ptr<RHI> rhi_;
+
+		VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptor_layout_ = VK_NULL_HANDLE;
+		VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+		VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+		// per texture format, compiled on first use
+		std::unordered_map<VkFormat, VkPipeline> pipelines_;
+		VkSampler sampler_ = VK_NULL_HANDLE;
+		Resource<VkBuffer> group_counters_;
+
+		VkImageView source_view_ = VK_NULL_HANDLE;
+		std::shared_ptr<TextureData> scratch_;
+		std::array<VkImageView, kMaxLevels> scratch_level_views_ = {};
+	};
+}
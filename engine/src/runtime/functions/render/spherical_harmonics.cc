@@ -0,0 +1,185 @@
+#include "spherical_harmonics.h"
+
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PEANUT_SH_USE_SSE 1
+#endif
+
+namespace peanut
+{
+	namespace
+	{
+		struct alignas(16) SHSum
+		{
+			float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		};
+
+		// sum += value * scale, the product is rounded before the sum
+		template <bool kUseSse>
+		inline void MultiplyAdd(SHSum& sum, const SHSum& value, const SHSum& scale)
+		{
+#ifdef PEANUT_SH_USE_SSE
+			if constexpr (kUseSse)
+			{
+				_mm_store_ps(sum.values, _mm_add_ps(_mm_load_ps(sum.values), _mm_mul_ps(_mm_load_ps(value.values), _mm_load_ps(scale.values))));
+				return;
+			}
+#endif
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				const float product = value.values[i] * scale.values[i];
+				sum.values[i] = sum.values[i] + product;
+			}
+		}
+
+		template <bool kUseSse>
+		inline void Add(SHSum& sum, const SHSum& value)
+		{
+#ifdef PEANUT_SH_USE_SSE
+			if constexpr (kUseSse)
+			{
+				_mm_store_ps(sum.values, _mm_add_ps(_mm_load_ps(sum.values), _mm_load_ps(value.values)));
+				return;
+			}
+#endif
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				sum.values[i] = sum.values[i] + value.values[i];
+			}
+		}
+
+		// the summation of ProjectIrradiance(), both paths round the same operations in the same order
+		template <bool kUseSse>
+		void ProjectIrradianceSums(const glm::vec4* texels, uint32_t face_size, SphericalHarmonics::Coefficients& out_coefficients)
+		{
+			const uint32_t face_texel_num = face_size * face_size;
+			const uint32_t group_size = SH_PROJECTION_GROUP_SIZE;
+
+			// the partial sums of the shader invocations
+			std::vector<SHSum> partial_sums(group_size * SH_IRRADIANCE_COEFFICIENT_NUM);
+			for (uint32_t thread = 0; thread < group_size; ++thread)
+			{
+				SHSum* sums = &partial_sums[thread * SH_IRRADIANCE_COEFFICIENT_NUM];
+				for (uint32_t texel = thread; texel < face_texel_num * 6; texel += group_size)
+				{
+					const uint32_t face = texel / face_texel_num;
+					const uint32_t face_texel = texel - face * face_texel_num;
+					const glm::vec2 st = (glm::vec2(face_texel % face_size, face_texel / face_size) + 0.5f) / static_cast<float>(face_size);
+
+					const glm::vec3 dir = SphericalHarmonics::GetCubeTexelDirection(face, st);
+					const float weight = SphericalHarmonics::GetCubeTexelWeight(st);
+					const glm::vec4& radiance = texels[texel];
+
+					SHSum weighted_radiance;
+					weighted_radiance.values[0] = radiance.r * weight;
+					weighted_radiance.values[1] = radiance.g * weight;
+					weighted_radiance.values[2] = radiance.b * weight;
+					weighted_radiance.values[3] = weight;
+
+					float basis[SH_IRRADIANCE_COEFFICIENT_NUM];
+					SphericalHarmonics::EvaluateBasis(dir, basis);
+					for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i)
+					{
+						SHSum scale;
+						scale.values[0] = basis[i];
+						scale.values[1] = basis[i];
+						scale.values[2] = basis[i];
+						scale.values[3] = 1.0f;
+						MultiplyAdd<kUseSse>(sums[i], weighted_radiance, scale);
+					}
+				}
+			}
+
+			for (uint32_t stride = group_size / 2; stride > 0; stride >>= 1)
+			{
+				for (uint32_t thread = 0; thread < stride; ++thread)
+				{
+					for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i)
+					{
+						Add<kUseSse>(partial_sums[thread * SH_IRRADIANCE_COEFFICIENT_NUM + i], partial_sums[(thread + stride) * SH_IRRADIANCE_COEFFICIENT_NUM + i]);
+					}
+				}
+			}
+
+			// the texel weights are normalized to the solid angle of the sphere
+			const float normalization = 4.0f * static_cast<float>(PI) / partial_sums[0].values[3];
+			for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i)
+			{
+				const SHSum& sum = partial_sums[i];
+				const float scale = normalization * SphericalHarmonics::GetCosineLobeBand(i);
+				out_coefficients[i] = glm::vec4(sum.values[0] * scale, sum.values[1] * scale, sum.values[2] * scale, 0.0f);
+			}
+		}
+	}
+
+	void SphericalHarmonics::EvaluateBasis(const glm::vec3& dir, float* out_basis)
+	{
+		out_basis[0] = 0.282095f;
+		out_basis[1] = 0.488603f * dir.y;
+		out_basis[2] = 0.488603f * dir.z;
+		out_basis[3] = 0.488603f * dir.x;
+		out_basis[4] = 1.092548f * dir.x * dir.y;
+		out_basis[5] = 1.092548f * dir.y * dir.z;
+		out_basis[6] = 0.315392f * (3.0f * dir.z * dir.z - 1.0f);
+		out_basis[7] = 1.092548f * dir.x * dir.z;
+		out_basis[8] = 0.546274f * (dir.x * dir.x - dir.y * dir.y);
+	}
+
+	float SphericalHarmonics::GetCosineLobeBand(uint32_t index)
+	{
+		return index == 0 ? 1.0f : (index < 4 ? 2.0f / 3.0f : 0.25f);
+	}
+
+	glm::vec3 SphericalHarmonics::GetCubeTexelDirection(uint32_t face, const glm::vec2& st)
+	{
+		const glm::vec2 uv(2.0f * st.x - 1.0f, 1.0f - 2.0f * st.y);
+		glm::vec3 dir;
+		switch (face)
+		{
+		case 0: dir = glm::vec3(1.0f, uv.y, -uv.x); break;
+		case 1: dir = glm::vec3(-1.0f, uv.y, uv.x); break;
+		case 2: dir = glm::vec3(uv.x, 1.0f, -uv.y); break;
+		case 3: dir = glm::vec3(uv.x, -1.0f, uv.y); break;
+		case 4: dir = glm::vec3(uv.x, uv.y, 1.0f); break;
+		default: dir = glm::vec3(-uv.x, uv.y, -1.0f); break;
+		}
+		return glm::normalize(dir);
+	}
+
+	float SphericalHarmonics::GetCubeTexelWeight(const glm::vec2& st)
+	{
+		const glm::vec2 uv = 2.0f * st - 1.0f;
+		const float distance_square = 1.0f + glm::dot(uv, uv);
+		return 1.0f / (distance_square * std::sqrt(distance_square));
+	}
+
+	void SphericalHarmonics::ProjectIrradiance(const glm::vec4* texels, uint32_t face_size, Coefficients& out_coefficients)
+	{
+#ifdef PEANUT_SH_USE_SSE
+		ProjectIrradianceSums<true>(texels, face_size, out_coefficients);
+#else
+		ProjectIrradianceSums<false>(texels, face_size, out_coefficients);
+#endif
+	}
+
+	void SphericalHarmonics::ProjectIrradianceScalar(const glm::vec4* texels, uint32_t face_size, Coefficients& out_coefficients)
+	{
+		ProjectIrradianceSums<false>(texels, face_size, out_coefficients);
+	}
+
+	glm::vec3 SphericalHarmonics::EvaluateIrradiance(const Coefficients& coefficients, const glm::vec3& normal)
+	{
+		float basis[SH_IRRADIANCE_COEFFICIENT_NUM];
+		EvaluateBasis(normal, basis);
+
+		glm::vec3 irradiance(0.0f);
+		for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i)
+		{
+			irradiance += glm::vec3(coefficients[i]) * basis[i];
+		}
+		return glm::max(irradiance, glm::vec3(0.0f));
+	}
+} // namespace peanut
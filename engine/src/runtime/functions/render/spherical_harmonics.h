@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "render_data.h"
+
+namespace peanut
+{
+	/**
+	 * @brief l2 spherical harmonics of the diffuse sky light
+	 *
+	 * Cpu side of shaders/glsl/include/spherical_harmonics.h, same coefficient order and cube map
+	 * conventions. ProjectIrradiance() is the reference of irradiance_sh.comp: it sums the texels in
+	 * the order of the shader invocations and reduces the partial sums in the same tree, with the
+	 * same operations in the sse and the scalar path.
+	 */
+	class SphericalHarmonics
+	{
+	public:
+		// rgb coefficients of the irradiance divided by PI, the layout of SkyLight::irradiance_sh
+		using Coefficients = std::array<glm::vec4, SH_IRRADIANCE_COEFFICIENT_NUM>;
+
+		static void EvaluateBasis(const glm::vec3& dir, float* out_basis);
+		// the clamped cosine lobe divided by PI in the band of a coefficient
+		static float GetCosineLobeBand(uint32_t index);
+
+		// direction through a texel center st in [0, 1] of a cube face, faces are ordered +x -x +y -y +z -z
+		static glm::vec3 GetCubeTexelDirection(uint32_t face, const glm::vec2& st);
+		// solid angle of a texel relative to the one in the center of the face
+		static float GetCubeTexelWeight(const glm::vec2& st);
+
+		// rgba texels of the six faces, face after face and row by row
+		static void ProjectIrradiance(const glm::vec4* texels, uint32_t face_size, Coefficients& out_coefficients);
+		// the scalar path of ProjectIrradiance() whatever the build supports, bit exact with the sse path
+		static void ProjectIrradianceScalar(const glm::vec4* texels, uint32_t face_size, Coefficients& out_coefficients);
+
+		// irradiance divided by PI around a normal
+		static glm::vec3 EvaluateIrradiance(const Coefficients& coefficients, const glm::vec3& normal);
+	};
+} // namespace peanut
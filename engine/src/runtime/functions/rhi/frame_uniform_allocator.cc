@@ -0,0 +1,109 @@
+#include "runtime/functions/rhi/frame_uniform_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "runtime/core/base/logger.h"
+#include "runtime/functions/rhi/vulkan/vulkan_rhi.h"
+
+namespace peanut
+{
+namespace
+{
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+FrameUniformAllocator::~FrameUniformAllocator()
+{
+    Destroy();
+}
+
+void FrameUniformAllocator::Initialize(std::weak_ptr<RHI> rhi, VkDeviceSize frame_capacity, uint32_t frames_in_flight,
+    VkBufferUsageFlags usage)
+{
+    rhi_ = rhi;
+
+    std::shared_ptr<RHI> rhi_ptr = rhi_.lock();
+    assert(rhi_ptr.get() != nullptr);
+
+    // both alignments are powers of two, so the larger one satisfies both usages
+    const VkPhysicalDeviceLimits limits = rhi_ptr->GetPhysicalDevice().properties.limits;
+    VkDeviceSize alignment = 1;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+    {
+        alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+    {
+        alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+    }
+    SetLayout(frame_capacity, frames_in_flight, alignment);
+
+    buffer_ = rhi_ptr->CreateBuffer(frame_capacity_ * frame_count_, usage,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    void* host_mem_ptr = nullptr;
+    rhi_ptr->MapMemory(buffer_.memory, 0, VK_WHOLE_SIZE, 0, &host_mem_ptr);
+    host_mem_ptr_ = static_cast<uint8_t*>(host_mem_ptr);
+}
+
+void FrameUniformAllocator::Destroy()
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    if (rhi && buffer_.resource != VK_NULL_HANDLE)
+    {
+        if (host_mem_ptr_ != nullptr)
+        {
+            rhi->UnMapMemory(buffer_.memory);
+        }
+        rhi->DestroyBuffer(buffer_);
+    }
+
+    buffer_ = Resource<VkBuffer>();
+    host_mem_ptr_ = nullptr;
+    frame_begin_ = 0;
+    cursor_ = 0;
+    rhi_.reset();
+}
+
+void FrameUniformAllocator::SetLayout(VkDeviceSize frame_capacity, uint32_t frame_count, VkDeviceSize alignment)
+{
+    alignment_ = std::max<VkDeviceSize>(alignment, 1);
+    // every region starts aligned, so the offsets inside it only depend on the region cursor
+    frame_capacity_ = AlignUp(frame_capacity, alignment_);
+    frame_count_ = std::max(frame_count, 1u);
+    frame_begin_ = 0;
+    cursor_ = 0;
+}
+
+void FrameUniformAllocator::BeginFrame(uint32_t frame_slot)
+{
+    frame_begin_ = static_cast<VkDeviceSize>(frame_slot % frame_count_) * frame_capacity_;
+    cursor_ = frame_begin_;
+}
+
+bool FrameUniformAllocator::Allocate(VkDeviceSize size, UniformBufferAllocation& out_allocation)
+{
+    const VkDeviceSize aligned_size = AlignUp(size, alignment_);
+    if (cursor_ + aligned_size > frame_begin_ + frame_capacity_)
+    {
+        if (!overflow_reported_)
+        {
+            PEANUT_LOG_ERROR("Frame uniform buffer of {0} bytes is exhausted, increase its capacity", frame_capacity_);
+            overflow_reported_ = true;
+        }
+        return false;
+    }
+
+    out_allocation.descriptor_info.buffer = buffer_.resource;
+    out_allocation.descriptor_info.offset = cursor_;
+    out_allocation.descriptor_info.range = size;
+    out_allocation.host_mem_ptr = host_mem_ptr_ != nullptr ? host_mem_ptr_ + cursor_ : nullptr;
+
+    cursor_ += aligned_size;
+    return true;
+}
+} // namespace peanut
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+#include "runtime/functions/render/render_data.h"
+
+namespace peanut
+{
+class RHI;
+
+/**
+ * @brief per frame linear allocator of uniform and storage buffer space
+ *
+ * One persistently mapped buffer is split into a region per frame in flight. BeginFrame()
+ * rewinds the region of the frame slot, which the gpu finished reading once the slot's
+ * submission fence was waited for, so constants written during a frame stay valid until the
+ * same slot comes around again. Allocations are aligned to the min offset alignment of the buffer
+ * usages and meant to be bound through VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC or
+ * VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC descriptors whose buffer info has offset 0:
+ * descriptor_info.offset of an allocation is its dynamic offset.
+ */
+class FrameUniformAllocator
+{
+public:
+    FrameUniformAllocator() = default;
+    ~FrameUniformAllocator();
+
+    FrameUniformAllocator(const FrameUniformAllocator&) = delete;
+    FrameUniformAllocator& operator=(const FrameUniformAllocator&) = delete;
+
+    void Initialize(std::weak_ptr<RHI> rhi, VkDeviceSize frame_capacity, uint32_t frames_in_flight,
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    void Destroy();
+
+    // partition the regions without creating a buffer, Initialize() calls it with the device limits
+    void SetLayout(VkDeviceSize frame_capacity, uint32_t frame_count, VkDeviceSize alignment);
+
+    // rewind the region of the frame slot, every allocation made in it the last time is released
+    void BeginFrame(uint32_t frame_slot);
+
+    // false and nothing allocated if the frame region is exhausted
+    bool Allocate(VkDeviceSize size, UniformBufferAllocation& out_allocation);
+
+    // allocate and copy the data, the usual way to write the constants of an object once per frame
+    template <typename T>
+    bool Push(const T& data, UniformBufferAllocation& out_allocation)
+    {
+        if (!Allocate(sizeof(T), out_allocation))
+        {
+            return false;
+        }
+        if (out_allocation.host_mem_ptr != nullptr)
+        {
+            std::memcpy(out_allocation.host_mem_ptr, &data, sizeof(T));
+        }
+        return true;
+    }
+
+    // descriptor info to write into dynamic descriptors, the range is the largest allocation bound through it
+    VkDescriptorBufferInfo GetDescriptorInfo(VkDeviceSize range) const { return { buffer_.resource, 0, range }; }
+
+    VkBuffer GetBuffer() const { return buffer_.resource; }
+    VkDeviceSize GetAlignment() const { return alignment_; }
+    VkDeviceSize GetFrameCapacity() const { return frame_capacity_; }
+    // bytes allocated in the current frame region
+    VkDeviceSize GetUsedSize() const { return cursor_ - frame_begin_; }
+
+private:
+    std::weak_ptr<RHI> rhi_;
+    Resource<VkBuffer> buffer_;
+    uint8_t* host_mem_ptr_ = nullptr;
+
+    VkDeviceSize alignment_ = 1;
+    VkDeviceSize frame_capacity_ = 0;
+    uint32_t frame_count_ = 0;
+
+    VkDeviceSize frame_begin_ = 0;
+    VkDeviceSize cursor_ = 0;
+    bool overflow_reported_ = false;
+};
+} // namespace peanut
@@ -0,0 +1,308 @@
+#include "runtime/functions/rhi/gpu_profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <json11.hpp>
+
+#include "runtime/core/base/logger.h"
+#include "runtime/functions/rhi/rhi.h"
+
+namespace peanut
+{
+namespace
+{
+// every scope writes a begin and an end timestamp
+constexpr uint32_t kQueriesPerScope = 2;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    Destroy();
+}
+
+void GpuProfiler::Initialize(std::weak_ptr<RHI> rhi, uint32_t frames_in_flight)
+{
+    rhi_ = rhi;
+
+    std::shared_ptr<RHI> rhi_ptr = rhi_.lock();
+    assert(rhi_ptr.get() != nullptr);
+
+    const uint32_t valid_bits = rhi_ptr->GetTimestampValidBits();
+    if (valid_bits == 0)
+    {
+        PEANUT_LOG_WARN("The graphics queue does not support timestamps, gpu profiling is disabled");
+        return;
+    }
+
+    timestamp_mask_ = valid_bits >= 64 ? ~0ull : ((1ull << valid_bits) - 1);
+    timestamp_period_ns_ = rhi_ptr->GetTimestampPeriod();
+    frame_slots_.resize(std::max(frames_in_flight, 1u));
+
+    const uint32_t query_count = static_cast<uint32_t>(frame_slots_.size()) * kMaxScopesPerFrame * kQueriesPerScope;
+    query_pool_ = rhi_ptr->CreateQueryPool(query_count);
+    if (query_pool_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // queries must be reset before their first use, also by scopes recorded before the first frame
+    VkCommandBuffer command_buffer = rhi_ptr->BeginImmediateComputePassCommandBuffer();
+    vkCmdResetQueryPool(command_buffer, query_pool_, 0, query_count);
+    rhi_ptr->ExecImmediateComputePassCommandBuffer(command_buffer);
+}
+
+void GpuProfiler::Destroy()
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    if (rhi && query_pool_ != VK_NULL_HANDLE)
+    {
+        rhi->DestroyQueryPool(query_pool_);
+    }
+
+    query_pool_ = VK_NULL_HANDLE;
+    frame_slots_.clear();
+    scope_stack_.clear();
+    rhi_.reset();
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_slot)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    if (!scope_stack_.empty())
+    {
+        PEANUT_LOG_WARN("{0} gpu profile scopes were not ended before the next frame", scope_stack_.size());
+        scope_stack_.clear();
+    }
+
+    current_slot_ = frame_slot % static_cast<uint32_t>(frame_slots_.size());
+    FrameSlot& slot = frame_slots_[current_slot_];
+    ResolveSlot(slot, current_slot_);
+
+    const uint32_t queries_per_slot = kMaxScopesPerFrame * kQueriesPerScope;
+    vkCmdResetQueryPool(command_buffer, query_pool_, current_slot_ * queries_per_slot, queries_per_slot);
+
+    slot.scopes.clear();
+    slot.query_count = 0;
+    slot.frame = frame_count_++;
+}
+
+void GpuProfiler::BeginScope(VkCommandBuffer command_buffer, const std::string& name)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    FrameSlot& slot = frame_slots_[current_slot_];
+    if (slot.scopes.size() >= kMaxScopesPerFrame)
+    {
+        if (!overflow_reported_)
+        {
+            PEANUT_LOG_WARN("More than {0} gpu profile scopes in one frame, the others are not timed", kMaxScopesPerFrame);
+            overflow_reported_ = true;
+        }
+        scope_stack_.push_back(UINT32_MAX);
+        return;
+    }
+
+    GpuScopeRecord record;
+    record.name = name;
+    record.depth = static_cast<uint32_t>(scope_stack_.size());
+    record.begin_query = slot.query_count;
+    record.end_query = slot.query_count + 1;
+    slot.query_count += kQueriesPerScope;
+
+    const uint32_t query_base = current_slot_ * kMaxScopesPerFrame * kQueriesPerScope;
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool_, query_base + record.begin_query);
+
+    scope_stack_.push_back(static_cast<uint32_t>(slot.scopes.size()));
+    slot.scopes.push_back(std::move(record));
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer command_buffer)
+{
+    if (!IsEnabled() || scope_stack_.empty())
+    {
+        return;
+    }
+
+    const uint32_t scope = scope_stack_.back();
+    scope_stack_.pop_back();
+    if (scope == UINT32_MAX)
+    {
+        return;
+    }
+
+    const uint32_t query_base = current_slot_ * kMaxScopesPerFrame * kQueriesPerScope;
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool_,
+        query_base + frame_slots_[current_slot_].scopes[scope].end_query);
+}
+
+void GpuProfiler::ResolvePendingFrames()
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> slot_order(frame_slots_.size());
+    for (uint32_t i = 0; i < slot_order.size(); ++i)
+    {
+        slot_order[i] = i;
+    }
+    std::sort(slot_order.begin(), slot_order.end(),
+        [this](uint32_t lhs, uint32_t rhs) { return frame_slots_[lhs].frame < frame_slots_[rhs].frame; });
+
+    for (uint32_t slot_index : slot_order)
+    {
+        ResolveSlot(frame_slots_[slot_index], slot_index);
+    }
+}
+
+void GpuProfiler::ResolveSlot(FrameSlot& slot, uint32_t slot_index)
+{
+    if (slot.scopes.empty())
+    {
+        return;
+    }
+
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    assert(rhi.get() != nullptr);
+
+    // the fence of the slot was waited for, results that are still missing belong to a frame that was never submitted
+    std::vector<uint64_t> timestamps;
+    const uint32_t query_base = slot_index * kMaxScopesPerFrame * kQueriesPerScope;
+    if (!rhi->GetQueryPoolResults(query_pool_, query_base, slot.query_count, timestamps))
+    {
+        return;
+    }
+
+    std::vector<GpuProfileEvent> events;
+    ResolveScopes(slot.scopes, timestamps, timestamp_period_ns_, timestamp_mask_, slot.frame, timestamp_origin_, events);
+    AccumulateEvents(events);
+
+    // the queries stay valid until the slot is reset, make sure they are only counted once
+    slot.scopes.clear();
+}
+
+void GpuProfiler::AccumulateEvents(const std::vector<GpuProfileEvent>& events)
+{
+    for (const GpuProfileEvent& event : events)
+    {
+        auto stats_index = scope_stats_index_.find(event.name);
+        if (stats_index == scope_stats_index_.end())
+        {
+            GpuScopeStats stats;
+            stats.name = event.name;
+            stats.depth = event.depth;
+            stats.min_ms = event.duration_ms;
+            stats_index = scope_stats_index_.emplace(event.name, scope_stats_.size()).first;
+            scope_stats_.push_back(stats);
+        }
+
+        GpuScopeStats& stats = scope_stats_[stats_index->second];
+        stats.count++;
+        stats.total_ms += event.duration_ms;
+        stats.min_ms = std::min(stats.min_ms, event.duration_ms);
+        stats.max_ms = std::max(stats.max_ms, event.duration_ms);
+        stats.last_ms = event.duration_ms;
+
+        // keep the start of a capture, later events only update the table
+        if (trace_events_.size() < kMaxTraceEvents)
+        {
+            trace_events_.push_back(event);
+        }
+    }
+}
+
+void GpuProfiler::LogTimingTable() const
+{
+    if (scope_stats_.empty())
+    {
+        PEANUT_LOG_INFO("No gpu timings were recorded");
+        return;
+    }
+
+    PEANUT_LOG_INFO("Gpu timings over {0} frames:", frame_count_);
+    PEANUT_LOG_INFO("{0:<40} {1:>10} {2:>10} {3:>10} {4:>8}", "scope", "avg ms", "min ms", "max ms", "count");
+    for (const GpuScopeStats& stats : scope_stats_)
+    {
+        const std::string label = std::string(stats.depth * 2, ' ') + stats.name;
+        PEANUT_LOG_INFO("{0:<40} {1:>10.3f} {2:>10.3f} {3:>10.3f} {4:>8}", label,
+            stats.total_ms / static_cast<double>(stats.count), stats.min_ms, stats.max_ms, stats.count);
+    }
+}
+
+bool GpuProfiler::WriteChromeTrace(const std::string& file_path) const
+{
+    std::ofstream file(file_path, std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+        PEANUT_LOG_ERROR("Failed to open gpu trace file {0}", file_path);
+        return false;
+    }
+
+    file << FormatChromeTrace(trace_events_);
+    PEANUT_LOG_INFO("Write {0} gpu profile events to {1}", trace_events_.size(), file_path);
+    return true;
+}
+
+void GpuProfiler::ResolveScopes(const std::vector<GpuScopeRecord>& scopes, const std::vector<uint64_t>& timestamps,
+                                double timestamp_period_ns, uint64_t valid_mask, uint64_t frame, uint64_t& origin,
+                                std::vector<GpuProfileEvent>& out_events)
+{
+    const double ms_per_tick = timestamp_period_ns / 1000000.0;
+    for (const GpuScopeRecord& scope : scopes)
+    {
+        if (scope.begin_query >= timestamps.size() || scope.end_query >= timestamps.size())
+        {
+            continue;
+        }
+
+        const uint64_t begin = timestamps[scope.begin_query] & valid_mask;
+        const uint64_t end = timestamps[scope.end_query] & valid_mask;
+        if (origin == 0)
+        {
+            origin = begin;
+        }
+
+        GpuProfileEvent event;
+        event.name = scope.name;
+        event.depth = scope.depth;
+        event.frame = frame;
+        event.start_ms = begin >= origin ? static_cast<double>(begin - origin) * ms_per_tick : 0.0;
+        event.duration_ms = end >= begin ? static_cast<double>(end - begin) * ms_per_tick : 0.0;
+        out_events.push_back(std::move(event));
+    }
+}
+
+std::string GpuProfiler::FormatChromeTrace(const std::vector<GpuProfileEvent>& events)
+{
+    // complete events in microseconds, nesting is derived from the time ranges by the viewer
+    json11::Json::array trace_events;
+    trace_events.reserve(events.size());
+    for (const GpuProfileEvent& event : events)
+    {
+        trace_events.push_back(json11::Json::object{
+            {"name", event.name},
+            {"cat", "gpu"},
+            {"ph", "X"},
+            {"ts", event.start_ms * 1000.0},
+            {"dur", event.duration_ms * 1000.0},
+            {"pid", 1},
+            {"tid", 1},
+            {"args", json11::Json::object{{"frame", static_cast<double>(event.frame)}}},
+        });
+    }
+
+    return json11::Json(json11::Json::object{
+        {"traceEvents", trace_events},
+        {"displayTimeUnit", "ms"},
+    }).dump();
+}
+}  // namespace peanut
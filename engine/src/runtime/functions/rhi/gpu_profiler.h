@@ -0,0 +1,157 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace peanut
+{
+class RHI;
+
+// timestamps of one scope, the query indices are relative to the frame slot
+struct GpuScopeRecord
+{
+    std::string name;
+    uint32_t depth = 0;
+    uint32_t begin_query = 0;
+    uint32_t end_query = 0;
+};
+
+// a resolved scope, start is relative to the first resolved timestamp
+struct GpuProfileEvent
+{
+    std::string name;
+    uint32_t depth = 0;
+    uint64_t frame = 0;
+    double start_ms = 0.0;
+    double duration_ms = 0.0;
+};
+
+struct GpuScopeStats
+{
+    std::string name;
+    uint32_t depth = 0;
+    uint64_t count = 0;
+    double total_ms = 0.0;
+    double min_ms = 0.0;
+    double max_ms = 0.0;
+    double last_ms = 0.0;
+};
+
+/**
+ * @brief gpu timings of nested scopes from timestamp queries
+ *
+ * Every frame in flight owns a range of the query pool. BeginFrame() reads the timestamps the
+ * slot recorded frames_in_flight frames ago, whose submission fence was already waited for, and
+ * never blocks: results which are not available yet are dropped. Scopes recorded outside of a
+ * frame, e.g. one time compute dispatches, land in the current slot and are read back with it.
+ */
+class GpuProfiler
+{
+public:
+    GpuProfiler() = default;
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    void Initialize(std::weak_ptr<RHI> rhi, uint32_t frames_in_flight);
+    void Destroy();
+
+    // false if the queue can not write timestamps, all scopes are ignored then
+    bool IsEnabled() const { return query_pool_ != VK_NULL_HANDLE; }
+
+    // resolve the frame previously recorded into the slot and reset its queries, must be outside of a render pass
+    void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_slot);
+
+    void BeginScope(VkCommandBuffer command_buffer, const std::string& name);
+    void EndScope(VkCommandBuffer command_buffer);
+
+    // resolve the frames still in flight in submission order, call once the device is idle
+    void ResolvePendingFrames();
+
+    const std::vector<GpuScopeStats>& GetScopeStats() const { return scope_stats_; }
+
+    // log the average, min and max time of every scope
+    void LogTimingTable() const;
+
+    // write the resolved events as chrome://tracing / perfetto json
+    bool WriteChromeTrace(const std::string& file_path) const;
+
+    /**
+     * Turn the raw timestamps of one frame slot into events.
+     * @param origin first timestamp ever resolved, set from the first valid scope if it is 0
+     */
+    static void ResolveScopes(const std::vector<GpuScopeRecord>& scopes, const std::vector<uint64_t>& timestamps,
+                              double timestamp_period_ns, uint64_t valid_mask, uint64_t frame, uint64_t& origin,
+                              std::vector<GpuProfileEvent>& out_events);
+
+    static std::string FormatChromeTrace(const std::vector<GpuProfileEvent>& events);
+
+private:
+    struct FrameSlot
+    {
+        std::vector<GpuScopeRecord> scopes;
+        uint32_t query_count = 0;
+        uint64_t frame = 0;
+    };
+
+    void ResolveSlot(FrameSlot& slot, uint32_t slot_index);
+    void AccumulateEvents(const std::vector<GpuProfileEvent>& events);
+
+    std::weak_ptr<RHI> rhi_;
+    VkQueryPool query_pool_ = VK_NULL_HANDLE;
+    double timestamp_period_ns_ = 1.0;
+    uint64_t timestamp_mask_ = ~0ull;
+
+    std::vector<FrameSlot> frame_slots_;
+    uint32_t current_slot_ = 0;
+    uint64_t frame_count_ = 0;
+    std::vector<uint32_t> scope_stack_;
+    bool overflow_reported_ = false;
+
+    uint64_t timestamp_origin_ = 0;
+    std::vector<GpuProfileEvent> trace_events_;
+    std::vector<GpuScopeStats> scope_stats_;
+    std::unordered_map<std::string, size_t> scope_stats_index_;
+
+    static constexpr uint32_t kMaxScopesPerFrame = 256;
+    static constexpr size_t kMaxTraceEvents = 1 << 16;
+};
+
+// times the enclosing block on the gpu, the profiler may be null
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler* profiler, VkCommandBuffer command_buffer, const std::string& name)
+        : profiler_(profiler), command_buffer_(command_buffer)
+    {
+        if (profiler_)
+        {
+            profiler_->BeginScope(command_buffer_, name);
+        }
+    }
+
+    ~GpuProfileScope()
+    {
+        if (profiler_)
+        {
+            profiler_->EndScope(command_buffer_);
+        }
+    }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    GpuProfiler* profiler_;
+    VkCommandBuffer command_buffer_;
+};
+}  // namespace peanut
+
+#define PEANUT_GPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define PEANUT_GPU_PROFILE_CONCAT(a, b) PEANUT_GPU_PROFILE_CONCAT_INNER(a, b)
+#define PEANUT_GPU_PROFILE_SCOPE(profiler, command_buffer, name) \
+    ::peanut::GpuProfileScope PEANUT_GPU_PROFILE_CONCAT(gpu_profile_scope_, __LINE__)(profiler, command_buffer, name)
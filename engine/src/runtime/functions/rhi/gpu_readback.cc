@@ -0,0 +1,410 @@
+#include "runtime/functions/rhi/gpu_readback.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+#include "runtime/core/base/logger.h"
+#include "runtime/functions/rhi/rhi.h"
+
+namespace peanut
+{
+bool ReadbackFuture::IsReady() const
+{
+    if (!state_)
+    {
+        return false;
+    }
+
+    if (!state_->ready && state_->owner)
+    {
+        state_->owner->Poll();
+    }
+    return state_->ready;
+}
+
+bool ReadbackFuture::Wait() const
+{
+    if (!state_)
+    {
+        return false;
+    }
+
+    if (!state_->ready && state_->owner)
+    {
+        state_->owner->Wait(*state_);
+    }
+    return state_->ready && state_->data != nullptr;
+}
+
+const uint8_t* ReadbackFuture::Data() const
+{
+    return Wait() ? state_->data : nullptr;
+}
+
+const std::vector<ReadbackSubresource>& ReadbackFuture::GetSubresources() const
+{
+    static const std::vector<ReadbackSubresource> no_subresources;
+    return state_ ? state_->subresources : no_subresources;
+}
+
+GpuReadback::~GpuReadback()
+{
+    Destroy();
+}
+
+void GpuReadback::Initialize(std::weak_ptr<RHI> rhi)
+{
+    rhi_ = rhi;
+
+    std::shared_ptr<RHI> rhi_ptr = rhi_.lock();
+    assert(rhi_ptr.get() != nullptr);
+
+    // cached memory makes reading the copies on the cpu fast, it is not coherent on every device
+    memory_flags_ = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    if (!rhi_ptr->HasMemoryType(memory_flags_))
+    {
+        memory_flags_ = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+}
+
+void GpuReadback::Destroy()
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    if (!rhi)
+    {
+        return;
+    }
+
+    // finish the copies so the futures which are still waited on resolve
+    for (PendingReadback& pending : pending_)
+    {
+        rhi->WaitForFence(pending.fence);
+    }
+    Poll();
+
+    for (StagingBuffer& staging_buffer : staging_buffers_)
+    {
+        if (std::shared_ptr<ReadbackState> state = staging_buffer.lease.lock())
+        {
+            state->owner = nullptr;
+            state->data = nullptr;
+        }
+        rhi->UnMapMemory(staging_buffer.buffer.memory);
+        rhi->DestroyBuffer(staging_buffer.buffer);
+    }
+    staging_buffers_.clear();
+
+    for (VkCommandBuffer command_buffer : free_command_buffers_)
+    {
+        rhi->FreeCommandBuffer(command_buffer);
+    }
+    free_command_buffers_.clear();
+
+    for (VkFence fence : free_fences_)
+    {
+        rhi->DestroyFence(fence);
+    }
+    free_fences_.clear();
+
+    rhi_.reset();
+}
+
+ReadbackFuture GpuReadback::ReadbackImage(VkImage image, VkImageLayout layout, const ReadbackImageDesc& desc)
+{
+    std::vector<ReadbackSubresource> subresources;
+    const VkDeviceSize size = ComputeImageLayout(desc, subresources);
+    if (image == VK_NULL_HANDLE || size == 0)
+    {
+        PEANUT_LOG_ERROR("Invalid image readback of size ({0}, {1})", desc.width, desc.height);
+        return ReadbackFuture();
+    }
+
+    const uint32_t staging_buffer = AcquireStagingBuffer(size);
+    VkCommandBuffer command_buffer = BeginCommandBuffer();
+
+    VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = layout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {desc.aspect, desc.base_level, desc.levels, 0, desc.layers};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    std::vector<VkBufferImageCopy> copy_regions;
+    copy_regions.reserve(subresources.size());
+    for (const ReadbackSubresource& subresource : subresources)
+    {
+        VkBufferImageCopy copy_region = {};
+        copy_region.bufferOffset = subresource.offset;
+        copy_region.imageSubresource = {desc.aspect, subresource.level, 0, desc.layers};
+        copy_region.imageExtent = {subresource.width, subresource.height, 1};
+        copy_regions.push_back(copy_region);
+    }
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        staging_buffers_[staging_buffer].buffer.resource, static_cast<uint32_t>(copy_regions.size()), copy_regions.data());
+
+    VkBufferMemoryBarrier host_barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.buffer = staging_buffers_[staging_buffer].buffer.resource;
+    host_barrier.size = VK_WHOLE_SIZE;
+
+    // give the image back in the layout the following work expects
+    const bool restore_layout = layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = layout;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 1, &host_barrier, restore_layout ? 1 : 0, &barrier);
+
+    return Submit(command_buffer, staging_buffer, size, std::move(subresources));
+}
+
+ReadbackFuture GpuReadback::ReadbackBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (buffer == VK_NULL_HANDLE || size == 0)
+    {
+        PEANUT_LOG_ERROR("Invalid buffer readback of size {0}", size);
+        return ReadbackFuture();
+    }
+
+    const uint32_t staging_buffer = AcquireStagingBuffer(size);
+    VkCommandBuffer command_buffer = BeginCommandBuffer();
+
+    VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    const VkBufferCopy copy_region = {offset, 0, size};
+    vkCmdCopyBuffer(command_buffer, buffer, staging_buffers_[staging_buffer].buffer.resource, 1, &copy_region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.buffer = staging_buffers_[staging_buffer].buffer.resource;
+    barrier.offset = 0;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    return Submit(command_buffer, staging_buffer, size, {});
+}
+
+void GpuReadback::Poll()
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    if (!rhi)
+    {
+        return;
+    }
+
+    // copies finish in submission order, stop at the first one still running
+    size_t resolved = 0;
+    while (resolved < pending_.size() && rhi->IsFenceSignaled(pending_[resolved].fence))
+    {
+        Resolve(pending_[resolved]);
+        ++resolved;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + resolved);
+}
+
+void GpuReadback::Wait(const ReadbackState& state)
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    assert(rhi.get() != nullptr);
+
+    auto pending = std::find_if(pending_.begin(), pending_.end(),
+        [&state](const PendingReadback& readback) { return readback.state.get() == &state; });
+    if (pending != pending_.end())
+    {
+        rhi->WaitForFence(pending->fence);
+    }
+    Poll();
+}
+
+void GpuReadback::Resolve(PendingReadback& pending)
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    assert(rhi.get() != nullptr);
+
+    const StagingBuffer& staging_buffer = staging_buffers_[pending.state->staging_buffer_index];
+    if ((memory_flags_ & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+    {
+        rhi->InvalidateMappedMemory(staging_buffer.buffer.memory);
+    }
+
+    pending.state->data = staging_buffer.mapped;
+    pending.state->ready = true;
+
+    rhi->ResetFence(pending.fence);
+    free_fences_.push_back(pending.fence);
+    free_command_buffers_.push_back(pending.command_buffer);
+}
+
+uint32_t GpuReadback::AcquireStagingBuffer(VkDeviceSize size)
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    assert(rhi.get() != nullptr);
+
+    // a buffer is free once every future of its last readback is gone
+    const VkDeviceSize buffer_size = GetStagingBufferSize(size);
+    for (uint32_t i = 0; i < staging_buffers_.size(); ++i)
+    {
+        if (staging_buffers_[i].size == buffer_size && staging_buffers_[i].lease.expired())
+        {
+            return i;
+        }
+    }
+
+    StagingBuffer staging_buffer;
+    staging_buffer.buffer = rhi->CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memory_flags_);
+    staging_buffer.size = buffer_size;
+
+    void* mapped = nullptr;
+    rhi->MapMemory(staging_buffer.buffer.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    staging_buffer.mapped = static_cast<uint8_t*>(mapped);
+
+    staging_buffers_.push_back(staging_buffer);
+    return static_cast<uint32_t>(staging_buffers_.size() - 1);
+}
+
+VkCommandBuffer GpuReadback::BeginCommandBuffer()
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    assert(rhi.get() != nullptr);
+
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    if (!free_command_buffers_.empty())
+    {
+        command_buffer = free_command_buffers_.back();
+        free_command_buffers_.pop_back();
+    }
+    else
+    {
+        command_buffer = rhi->AllocateCommandBuffer();
+    }
+
+    // the command pool resets command buffers when they are begun again
+    VkCommandBufferBeginInfo begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VKFAILED(vkBeginCommandBuffer(command_buffer, &begin_info)))
+    {
+        PEANUT_LOG_FATAL("Failed to begin readback command buffer");
+    }
+    return command_buffer;
+}
+
+ReadbackFuture GpuReadback::Submit(VkCommandBuffer command_buffer, uint32_t staging_buffer, VkDeviceSize size,
+                                   std::vector<ReadbackSubresource> subresources)
+{
+    std::shared_ptr<RHI> rhi = rhi_.lock();
+    assert(rhi.get() != nullptr);
+
+    if (VKFAILED(vkEndCommandBuffer(command_buffer)))
+    {
+        PEANUT_LOG_FATAL("Failed to end readback command buffer");
+    }
+
+    VkFence fence = VK_NULL_HANDLE;
+    if (!free_fences_.empty())
+    {
+        fence = free_fences_.back();
+        free_fences_.pop_back();
+    }
+    else
+    {
+        fence = rhi->CreateFence();
+    }
+    rhi->SubmitCommandBuffer(command_buffer, fence);
+
+    std::shared_ptr<ReadbackState> state = std::make_shared<ReadbackState>();
+    state->owner = this;
+    state->staging_buffer_index = staging_buffer;
+    state->size = size;
+    state->subresources = std::move(subresources);
+
+    staging_buffers_[staging_buffer].lease = state;
+    pending_.push_back({state, command_buffer, fence});
+    return ReadbackFuture(state);
+}
+
+VkDeviceSize GpuReadback::ComputeImageLayout(const ReadbackImageDesc& desc, std::vector<ReadbackSubresource>& out_subresources)
+{
+    out_subresources.clear();
+    if (desc.width == 0 || desc.height == 0 || desc.layers == 0 || desc.levels == 0 || desc.bytes_per_pixel == 0)
+    {
+        return 0;
+    }
+
+    // buffer offsets of image copies must be multiples of the texel size and of 4
+    const VkDeviceSize alignment = std::lcm(static_cast<VkDeviceSize>(desc.bytes_per_pixel), VkDeviceSize(4));
+
+    VkDeviceSize size = 0;
+    for (uint32_t level = desc.base_level; level < desc.base_level + desc.levels; ++level)
+    {
+        ReadbackSubresource subresource;
+        subresource.level = level;
+        subresource.width = std::max(desc.width >> level, 1u);
+        subresource.height = std::max(desc.height >> level, 1u);
+        subresource.offset = (size + alignment - 1) / alignment * alignment;
+        subresource.layer_size = static_cast<VkDeviceSize>(subresource.width) * subresource.height * desc.bytes_per_pixel;
+
+        size = subresource.offset + subresource.layer_size * desc.layers;
+        out_subresources.push_back(subresource);
+    }
+    return size;
+}
+
+VkDeviceSize GpuReadback::GetStagingBufferSize(VkDeviceSize size)
+{
+    VkDeviceSize buffer_size = kMinStagingBufferSize;
+    while (buffer_size < size)
+    {
+        buffer_size <<= 1;
+    }
+    return buffer_size;
+}
+
+uint32_t GpuReadback::GetFormatTexelSize(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8_UNORM:
+        return 1;
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R16_SFLOAT:
+        return 2;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_R32_UINT:
+        return 4;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+        return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    default:
+        return 0;
+    }
+}
+}  // namespace peanut
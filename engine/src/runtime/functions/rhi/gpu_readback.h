@@ -0,0 +1,156 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "runtime/functions/render/render_data.h"
+
+namespace peanut
+{
+class RHI;
+class GpuReadback;
+
+struct ReadbackImageDesc
+{
+    uint32_t width = 0;     // size of the base level
+    uint32_t height = 0;
+    uint32_t layers = 1;
+    uint32_t base_level = 0;
+    uint32_t levels = 1;
+    uint32_t bytes_per_pixel = 4;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+// placement of one mip level in the readback data, the layers of a level are stored back to back
+struct ReadbackSubresource
+{
+    uint32_t level = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkDeviceSize offset = 0;
+    VkDeviceSize layer_size = 0;
+};
+
+// shared between a readback future and the pool, the staging buffer is leased while it is alive
+struct ReadbackState
+{
+    GpuReadback* owner = nullptr;
+    uint32_t staging_buffer_index = 0;
+    const uint8_t* data = nullptr;
+    VkDeviceSize size = 0;
+    std::vector<ReadbackSubresource> subresources;
+    bool ready = false;
+};
+
+/**
+ * @brief result of an asynchronous readback, resolves once the fence of the copy submission signals
+ *
+ * The data points into the persistently mapped staging buffer, no copy is made. The buffer goes
+ * back to the pool when the last future referring to it is destroyed.
+ */
+class ReadbackFuture
+{
+public:
+    ReadbackFuture() = default;
+
+    bool IsValid() const { return state_ != nullptr; }
+
+    // does not block, polls the fence of the copy
+    bool IsReady() const;
+
+    // block until the copy finished, false if the readback failed or its pool was destroyed
+    bool Wait() const;
+
+    // waits for the copy, nullptr if it failed
+    const uint8_t* Data() const;
+    VkDeviceSize Size() const { return state_ ? state_->size : 0; }
+    const std::vector<ReadbackSubresource>& GetSubresources() const;
+
+private:
+    friend class GpuReadback;
+    explicit ReadbackFuture(std::shared_ptr<ReadbackState> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<ReadbackState> state_;
+};
+
+/**
+ * @brief copies images and buffers into a pool of persistently mapped host buffers
+ *
+ * Every readback is recorded into its own command buffer and submitted with its own fence on the
+ * queue of the frame submissions, so it is ordered after the frames that wrote the resource and
+ * never waits for the frame in flight. Poll() once per frame resolves the finished copies.
+ */
+class GpuReadback
+{
+public:
+    GpuReadback() = default;
+    ~GpuReadback();
+
+    GpuReadback(const GpuReadback&) = delete;
+    GpuReadback& operator=(const GpuReadback&) = delete;
+
+    void Initialize(std::weak_ptr<RHI> rhi);
+    void Destroy();
+
+    /**
+     * Copy the mip levels [base_level, base_level + levels) of all layers of an image.
+     * @param layout layout of the image when the copy executes, the image is returned to it afterwards
+     */
+    ReadbackFuture ReadbackImage(VkImage image, VkImageLayout layout, const ReadbackImageDesc& desc);
+
+    ReadbackFuture ReadbackBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+
+    // resolve the readbacks whose copies finished
+    void Poll();
+
+    uint32_t GetPendingCount() const { return static_cast<uint32_t>(pending_.size()); }
+
+    /**
+     * Tightly packed placement of the requested mip levels, level offsets are aligned for vkCmdCopyImageToBuffer.
+     * @return total size of the readback data
+     */
+    static VkDeviceSize ComputeImageLayout(const ReadbackImageDesc& desc, std::vector<ReadbackSubresource>& out_subresources);
+
+    // staging buffers are pooled in power of two sizes so they can be reused by readbacks of similar size
+    static VkDeviceSize GetStagingBufferSize(VkDeviceSize size);
+
+    // size of one texel of the uncompressed color formats used by the renderer, 0 if unknown
+    static uint32_t GetFormatTexelSize(VkFormat format);
+
+private:
+    friend class ReadbackFuture;
+
+    struct StagingBuffer
+    {
+        Resource<VkBuffer> buffer;
+        uint8_t* mapped = nullptr;
+        VkDeviceSize size = 0;
+        std::weak_ptr<ReadbackState> lease;
+    };
+
+    struct PendingReadback
+    {
+        std::shared_ptr<ReadbackState> state;
+        VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    };
+
+    uint32_t AcquireStagingBuffer(VkDeviceSize size);
+    VkCommandBuffer BeginCommandBuffer();
+    ReadbackFuture Submit(VkCommandBuffer command_buffer, uint32_t staging_buffer, VkDeviceSize size,
+                          std::vector<ReadbackSubresource> subresources);
+    void Resolve(PendingReadback& pending);
+    void Wait(const ReadbackState& state);
+
+    std::weak_ptr<RHI> rhi_;
+    VkMemoryPropertyFlags memory_flags_ = 0;
+
+    std::vector<StagingBuffer> staging_buffers_;
+    std::vector<PendingReadback> pending_;
+    std::vector<VkCommandBuffer> free_command_buffers_;
+    std::vector<VkFence> free_fences_;
+
+    static constexpr VkDeviceSize kMinStagingBufferSize = 64 * 1024;
+};
+}  // namespace peanut
@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <vector>
 
 #include "runtime/functions/render/render_data.h"
 #include "runtime/functions/window/window_system.h"
@@ -14,11 +15,44 @@
 namespace peanut 
 {
 struct VulkanPhysicalDevice;
+
+// presentation of the swapchain images, unsupported modes fall back to Fifo which every device supports
+enum class PresentMode : uint8_t
+{
+    Fifo,       // vsync, frames queue up behind the vertical blank
+    Mailbox,    // vsync without queueing, a newer frame replaces the waiting one
+    Immediate,  // no vsync, lowest latency but may tear
+};
+
+// how the mip chain of a texture is generated from its level 0
+enum class MipGenerationMode : uint8_t
+{
+    Blit,               // one blit and barrier per level
+    SinglePassCompute,  // all levels in one dispatch of the mip generator, unsupported textures are blitted
+};
+
+// records the levels below level 0 of a texture, see RHI::SetMipGenerator()
+class MipGenerator
+{
+public:
+    virtual ~MipGenerator() {}
+
+    // level 0 is in TRANSFER_SRC_OPTIMAL and every level ends in SHADER_READ_ONLY_OPTIMAL,
+    // returns false without recording anything if the texture is not supported
+    virtual bool CmdGenerateMipmaps(VkCommandBuffer command_buffer, const TextureData& texture) = 0;
+};
+
 class RHI 
 {
 public:
     virtual ~RHI() {}
     virtual void Init(const std::shared_ptr<WindowSystem>& window_system) = 0;
+
+    /**
+     * Init without a window, surface or swapchain extension, frames are rendered into offscreen
+     * images of the given size which stand in for the swapchain images.
+     */
+    virtual void InitHeadless(uint32_t width, uint32_t height) = 0;
     virtual void Shutdown() = 0;
 
     // TODO: set vulkan irrelevant
@@ -28,17 +62,41 @@ public:
     virtual VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_mask,
                                         uint32_t base_mip_level, uint32_t num_mip_levels, uint32_t layers) = 0;
 
+    // view of a single array layer, e.g. to render into one layer of an array texture
+    virtual VkImageView CreateImageLayerView(VkImage image, VkFormat format, VkImageAspectFlags aspect_mask, uint32_t layer) = 0;
+
+    // cube view of the six layers from base_layer on, a cube array view if cube_count is larger than one
+    virtual VkImageView CreateCubeImageView(VkImage image, VkFormat format, uint32_t base_mip_level, uint32_t num_mip_levels,
+                                            uint32_t base_layer, uint32_t cube_count) = 0;
+
+    // 2d array view of all layers, also for images with a single layer or six layers
+    virtual VkImageView CreateImageArrayView(VkImage image, VkFormat format, uint32_t base_mip_level, uint32_t num_mip_levels,
+                                             uint32_t layers) = 0;
+
     virtual void DestroyImage(Resource<VkImage> image) = 0;
 
     virtual void DestroyImageView(VkImageView image_view) = 0;
 
+    // image without memory, the caller binds it, e.g. to alias transient render targets
+    virtual VkImage CreateUnboundImage(uint32_t width, uint32_t height, uint32_t layers, uint32_t levels,
+                                       uint32_t samples, VkFormat format, VkImageUsageFlags usage) = 0;
+
+    virtual VkMemoryRequirements GetImageMemoryRequirements(VkImage image) = 0;
+
+    // returns VK_NULL_HANDLE if no memory type has the required property flags
+    virtual VkDeviceMemory AllocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags memory_flags) = 0;
+
+    virtual bool BindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) = 0;
+
+    virtual void FreeMemory(VkDeviceMemory memory) = 0;
+
     virtual Resource<VkBuffer> CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags) = 0;
 
     /**
      * Create an empty texture data according to the given width and height.
      * @param width width of the created texture
      * @param height height of the created texture
-     * @param layers array layers of the image, if it be set 6, we will create an cube image with flag VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT
+     * @param layers array layers of the image, if it is a multiple of 6 and the image is square, we will create a cube (array) image with flag VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT
      * @param levels mip levels, default is 0, which means levels will be computed from width and height
      * @param format image format, like VK_FORMAT_R8G8B8A8_UNORM
      * @param additional_usage image usage layout, except VK_IMAGE_USAGE_SAMPLED_BIT and VK_IMAGE_USAGE_TRANSFER_DST_BIT
@@ -74,8 +132,17 @@ public:
 
     virtual void DestroyBuffer(Resource<VkBuffer> buffer) = 0;
 
+    // generate the mip chain with the mip generation mode and wait for it, level 0 has to be in TRANSFER_SRC_OPTIMAL
     virtual void GenerateMipmaps(const TextureData& texture) = 0;
 
+    // record the mip chain generation with the given mode, the layouts are the ones of GenerateMipmaps()
+    virtual void CmdGenerateMipmaps(VkCommandBuffer command_buffer, const TextureData& texture, MipGenerationMode mode) = 0;
+
+    // the generator of MipGenerationMode::SinglePassCompute, owned by the caller, every texture is blitted without one
+    virtual void SetMipGenerator(MipGenerator* mip_generator) = 0;
+    virtual void SetMipGenerationMode(MipGenerationMode mode) = 0;
+    virtual MipGenerationMode GetMipGenerationMode() const = 0;
+
     virtual void CreateSampler(VkSamplerCreateInfo* create_info,
                                 VkSampler* out_sampler) = 0;
 
@@ -118,16 +185,21 @@ public:
 
     virtual void DestroyRenderPass(VkRenderPass& renderpass) = 0;
 
-    // pipeline
+    // pipeline, every color attachment of the subpass is written without blending
     virtual VkPipeline CreateGraphicsPipeline(VkRenderPass renderpass, uint32_t subpass, VkShaderModule vs_shader_module, VkShaderModule fs_shader_module,
         VkPipelineLayout pipeline_layout,const std::vector<VkVertexInputBindingDescription>* vertex_input_bindings = nullptr,
         const std::vector<VkVertexInputAttributeDescription>* vertex_attributes = nullptr, const VkPipelineMultisampleStateCreateInfo* multisample_state = nullptr,
-        const VkPipelineDepthStencilStateCreateInfo* depth_stencil_stat = nullptr) = 0;
+        const VkPipelineDepthStencilStateCreateInfo* depth_stencil_stat = nullptr, uint32_t color_attachment_count = 1) = 0;
 
     virtual VkPipeline CreateGraphicsPipeline(VkPipelineCache pipeline_cache, uint32_t createinfo_counts, VkGraphicsPipelineCreateInfo* pcreate_infos) = 0;
 
     virtual VkPipelineCache CreatePipelineCache(VkPipelineCacheCreateInfo* pcreate_info) = 0;
 
+    // retrieve the serialized pipeline cache blob, which starts with a VkPipelineCacheHeaderVersionOne
+    virtual bool GetPipelineCacheData(VkPipelineCache pipeline_cache, std::vector<char>& out_data) = 0;
+
+    virtual void DestroyPipelineCache(VkPipelineCache pipeline_cache) = 0;
+
     virtual VkPipeline CreateComputePipeline(VkShaderModule cs_shader, VkPipelineLayout layout, const VkSpecializationInfo* specialize_info = nullptr) = 0;
 
     virtual void DestroyPipeline(VkPipeline) = 0;
@@ -148,6 +220,9 @@ public:
     virtual VkShaderModule CreateShaderModule(
         const std::string& shader_file_path) = 0;
 
+    // code_size in bytes, must be a multiple of 4
+    virtual VkShaderModule CreateShaderModule(const uint32_t* code, size_t code_size) = 0;
+
     virtual void DestroyShaderModule(VkShaderModule shader_module) = 0;
 
     virtual void QueueSubmit(uint32_t submit_count, uint32_t current_frame_index,
@@ -155,5 +230,60 @@ public:
     virtual void PresentFrame() = 0;
 
     virtual void AcquireNextImage() = 0;
+
+    // set when present or acquire reported the swapchain no longer matches the surface
+    virtual bool IsSwapchainOutOfDate() const = 0;
+
+    /**
+     * Recreate the swapchain for the new surface size, the old swapchain is handed to the driver
+     * so it can reuse its resources. Nothing is recreated while the surface is zero sized or
+     * already matches the swapchain.
+     * @return true if the swapchain was recreated and size dependent objects must be rebuilt
+     */
+    virtual bool RecreateSwapchain(uint32_t width, uint32_t height) = 0;
+
+    // applied when the swapchain is created, a change after Init() marks the swapchain out of date
+    virtual void SetPresentMode(PresentMode present_mode) = 0;
+    virtual PresentMode GetPresentMode() const = 0;
+
+    // block until the device has finished all submitted work
+    virtual void WaitIdle() = 0;
+
+    virtual bool IsHeadless() const = 0;
+
+    // layout the frame image is left in at the end of a frame, the offscreen images of the headless mode are kept readable
+    virtual VkImageLayout GetPresentImageLayout() const = 0;
+
+    // command buffers and fences for work that completes independently of the frames
+    virtual VkCommandBuffer AllocateCommandBuffer() = 0;
+    virtual void FreeCommandBuffer(VkCommandBuffer command_buffer) = 0;
+    virtual VkFence CreateFence() = 0;
+    virtual void DestroyFence(VkFence fence) = 0;
+    virtual bool IsFenceSignaled(VkFence fence) = 0;
+    virtual void WaitForFence(VkFence fence) = 0;
+    virtual void ResetFence(VkFence fence) = 0;
+
+    // submit on the queue of the frames without waiting, the fence signals once the command buffer finished
+    virtual void SubmitCommandBuffer(VkCommandBuffer command_buffer, VkFence fence) = 0;
+
+    // whether any memory type has all of the property flags, e.g. to prefer host cached memory
+    virtual bool HasMemoryType(VkMemoryPropertyFlags memory_flags) = 0;
+
+    // make device writes to non coherent mapped memory visible to the host
+    virtual void InvalidateMappedMemory(VkDeviceMemory memory) = 0;
+
+    // timestamp query pools, the queries have to be reset with vkCmdResetQueryPool before they are written
+    virtual VkQueryPool CreateQueryPool(uint32_t query_count) = 0;
+    virtual void DestroyQueryPool(VkQueryPool query_pool) = 0;
+
+    // never blocks, false if any of the queries is not available yet
+    virtual bool GetQueryPoolResults(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count,
+                                     std::vector<uint64_t>& out_results) = 0;
+
+    // nanoseconds per timestamp tick
+    virtual float GetTimestampPeriod() const = 0;
+
+    // number of meaningful timestamp bits on the queues frames and compute passes run on, 0 if unsupported
+    virtual uint32_t GetTimestampValidBits() const = 0;
 };
 }  // namespace peanut
\ No newline at end of file
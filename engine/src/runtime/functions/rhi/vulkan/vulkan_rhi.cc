@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <map>
 #include <iostream>
 #include <math.h>
@@ -9,6 +10,7 @@
 #include <glm/glm.hpp>
 
 #include "runtime/core/base/logger.h"
+#include "runtime/core/file/mapped_file.h"
 #include "runtime/functions/render/render_utils.h"
 
 #define PEANUT_XSTR(s) PEANUT_STR(s)
@@ -25,8 +27,6 @@ void VulkanRHI::Init(const std::shared_ptr<WindowSystem>& window_system)
         return;
     }
 
-    required_device_features_.shaderStorageImageExtendedFormats = VK_TRUE;
-    required_device_features_.samplerAnisotropy = VK_TRUE;
     window_width_ = window_system->GetWidth();
     window_height_ = window_system->GetHeight();
 
@@ -40,6 +40,34 @@ void VulkanRHI::Init(const std::shared_ptr<WindowSystem>& window_system)
 
     CreateSwapChain();
 
+    SetupFrameResources();
+}
+
+void VulkanRHI::InitHeadless(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        PEANUT_LOG_ERROR("Headless vulkan rhi needs a non zero frame size");
+        return;
+    }
+
+    headless_ = true;
+    window_width_ = width;
+    window_height_ = height;
+
+    SetupInstance();
+
+    SetupPhysicalDevice();
+
+    SetupLogicDevice();
+
+    CreateHeadlessImages();
+
+    SetupFrameResources();
+}
+
+void VulkanRHI::SetupFrameResources()
+{
     CreateCommandPoolAndCommandBuffers();
 
     CreateDescriptorPool();
@@ -54,8 +82,8 @@ void VulkanRHI::Init(const std::shared_ptr<WindowSystem>& window_system)
     tole_frame_count_ = 0;
     // current_frame_index_ = 0;
 
-    PEANUT_LOG_INFO("Vulkan init finished [{0}]",
-                    physical_device_.properties.deviceName);
+    PEANUT_LOG_INFO("Vulkan init finished [{0}]{1}",
+                    physical_device_.properties.deviceName, headless_ ? " headless" : "");
 }
 
 void VulkanRHI::Shutdown()
@@ -65,14 +93,18 @@ void VulkanRHI::Shutdown()
 
     vkDestroyDescriptorPool(vk_device_, descriptor_pool_, nullptr);
     vkDestroyCommandPool(vk_device_, command_pool_, nullptr);
-    vkDestroySwapchainKHR(vk_device_, swapchain_, nullptr);
-    vkDestroySurfaceKHR(vk_instance_, window_surface_, nullptr);
+    if (!headless_)
+    {
+        vkDestroySwapchainKHR(vk_device_, swapchain_, nullptr);
+        vkDestroySurfaceKHR(vk_instance_, window_surface_, nullptr);
+    }
 
     vkDestroyFence(vk_device_, acquire_next_image_fence_, nullptr);
     for (int i = 0; i < frame_in_flight_numbers_; ++i) {
     vkDestroyFence(vk_device_, frame_submit_fences_[i], nullptr);
     vkDestroyImageView(vk_device_, swapchain_image_views_[i], nullptr);
     }
+    DestroyHeadlessImages();
 
     vkDestroyDevice(vk_device_, nullptr);
     vkDestroyInstance(vk_instance_, nullptr);
@@ -82,15 +114,48 @@ Resource<VkImage> VulkanRHI::CreateImage(uint32_t width, uint32_t height,
                                          uint32_t layers, uint32_t levels,
                                          uint32_t samples, VkFormat format,
                                          VkImageUsageFlags usage) 
+{
+    Resource<VkImage> vkImage;
+
+    vkImage.resource = CreateUnboundImage(width, height, layers, levels, samples, format, usage);
+    if (vkImage.resource == VK_NULL_HANDLE)
+    {
+        return vkImage;
+    }
+
+    VkMemoryRequirements requirements = GetImageMemoryRequirements(vkImage.resource);
+
+    vkImage.memory = AllocateMemory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (vkImage.memory == VK_NULL_HANDLE) 
+    {
+        vkDestroyImage(vk_device_, vkImage.resource, nullptr);
+        PEANUT_LOG_FATAL("Failed to allocate memory to image");
+    }
+    if (!BindImageMemory(vkImage.resource, vkImage.memory, 0)) 
+    {
+        vkDestroyImage(vk_device_, vkImage.resource, nullptr);
+        vkFreeMemory(vk_device_, vkImage.memory, nullptr);
+        PEANUT_LOG_FATAL("Failed to bind memory to vulkan image");
+    }
+
+    vkImage.allocation_size = requirements.size;
+    vkImage.memory_type_index = FindMemoryType(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    return vkImage;
+}
+
+VkImage VulkanRHI::CreateUnboundImage(uint32_t width, uint32_t height,
+                                      uint32_t layers, uint32_t levels,
+                                      uint32_t samples, VkFormat format,
+                                      VkImageUsageFlags usage)
 {
     assert(width > 0 && height > 0);
     assert(levels > 0);
     assert(samples > 0 && samples < 64);
 
-    Resource<VkImage> vkImage;
-
     VkImageCreateInfo create_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
-    create_info.flags = (layers == 6) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+    // cube arrays take six layers per cube, cube faces have to be square
+    create_info.flags = (layers % 6 == 0 && width == height) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
     create_info.imageType = VK_IMAGE_TYPE_2D;
     create_info.format = format;
     create_info.extent = {width, height, 1};
@@ -102,37 +167,36 @@ Resource<VkImage> VulkanRHI::CreateImage(uint32_t width, uint32_t height,
     create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    if (VKFAILED(vkCreateImage(vk_device_, &create_info, nullptr,
-                                &vkImage.resource))) 
+    VkImage image = VK_NULL_HANDLE;
+    if (VKFAILED(vkCreateImage(vk_device_, &create_info, nullptr, &image))) 
     {
         PEANUT_LOG_ERROR("Failed to create vulkan image");
-        return vkImage;
+        return VK_NULL_HANDLE;
     }
 
-    VkMemoryRequirements requirements;
-    vkGetImageMemoryRequirements(vk_device_, vkImage.resource, &requirements);
+    return image;
+}
 
-    VkMemoryAllocateInfo mem_alloc_info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-    mem_alloc_info.allocationSize = requirements.size;
-    mem_alloc_info.memoryTypeIndex =
-        FindMemoryType(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    if (VKFAILED(vkAllocateMemory(vk_device_, &mem_alloc_info, nullptr,
-                                &vkImage.memory))) 
+VkDeviceMemory VulkanRHI::AllocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags memory_flags)
+{
+    const uint32_t memory_type_index = FindMemoryType(requirements, memory_flags);
+    if (memory_type_index == static_cast<uint32_t>(-1))
     {
-        vkDestroyImage(vk_device_, vkImage.resource, nullptr);
-        PEANUT_LOG_FATAL("Failed to allocate memory to image");
+        return VK_NULL_HANDLE;
     }
-    if (VKFAILED(vkBindImageMemory(vk_device_, vkImage.resource, vkImage.memory, 0))) 
+
+    VkMemoryAllocateInfo mem_alloc_info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    mem_alloc_info.allocationSize = requirements.size;
+    mem_alloc_info.memoryTypeIndex = memory_type_index;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (VKFAILED(vkAllocateMemory(vk_device_, &mem_alloc_info, nullptr, &memory)))
     {
-        vkDestroyImage(vk_device_, vkImage.resource, nullptr);
-        vkFreeMemory(vk_device_, vkImage.memory, nullptr);
-        PEANUT_LOG_FATAL("Failed to bind memory to vulkan image");
+        PEANUT_LOG_ERROR("Failed to allocate {0} bytes of device memory", requirements.size);
+        return VK_NULL_HANDLE;
     }
 
-    vkImage.allocation_size = mem_alloc_info.allocationSize;
-    vkImage.memory_type_index = mem_alloc_info.memoryTypeIndex;
-
-    return vkImage;
+    return memory;
 }
 
 VkImageView VulkanRHI::CreateImageView(VkImage image, VkFormat format,
@@ -143,7 +207,8 @@ VkImageView VulkanRHI::CreateImageView(VkImage image, VkFormat format,
   VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
   view_info.image = image;
   view_info.viewType =
-      (layers == 6) ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
+      (layers == 6) ? VK_IMAGE_VIEW_TYPE_CUBE
+                    : (layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D);
   view_info.format = format;
   view_info.subresourceRange.aspectMask = aspect_mask;
   view_info.subresourceRange.baseMipLevel = base_mip_level;
@@ -159,6 +224,73 @@ VkImageView VulkanRHI::CreateImageView(VkImage image, VkFormat format,
   return view;
 }
 
+VkImageView VulkanRHI::CreateImageLayerView(VkImage image, VkFormat format,
+                                            VkImageAspectFlags aspect_mask,
+                                            uint32_t layer) {
+  VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  view_info.image = image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = aspect_mask;
+  view_info.subresourceRange.baseMipLevel = 0;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.baseArrayLayer = layer;
+  view_info.subresourceRange.layerCount = 1;
+
+  VkImageView view;
+  if (VKFAILED(vkCreateImageView(vk_device_, &view_info, nullptr, &view))) {
+    PEANUT_LOG_FATAL("Failed to create image layer view");
+  }
+
+  return view;
+}
+
+VkImageView VulkanRHI::CreateCubeImageView(VkImage image, VkFormat format,
+                                           uint32_t base_mip_level,
+                                           uint32_t num_mip_levels,
+                                           uint32_t base_layer,
+                                           uint32_t cube_count) {
+  VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  view_info.image = image;
+  view_info.viewType =
+      (cube_count > 1) ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.baseMipLevel = base_mip_level;
+  view_info.subresourceRange.levelCount = num_mip_levels;
+  view_info.subresourceRange.baseArrayLayer = base_layer;
+  view_info.subresourceRange.layerCount = cube_count * 6;
+
+  VkImageView view;
+  if (VKFAILED(vkCreateImageView(vk_device_, &view_info, nullptr, &view))) {
+    PEANUT_LOG_FATAL("Failed to create cube image view");
+  }
+
+  return view;
+}
+
+VkImageView VulkanRHI::CreateImageArrayView(VkImage image, VkFormat format,
+                                            uint32_t base_mip_level,
+                                            uint32_t num_mip_levels,
+                                            uint32_t layers) {
+  VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  view_info.image = image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.baseMipLevel = base_mip_level;
+  view_info.subresourceRange.levelCount = num_mip_levels;
+  view_info.subresourceRange.baseArrayLayer = 0;
+  view_info.subresourceRange.layerCount = layers;
+
+  VkImageView view;
+  if (VKFAILED(vkCreateImageView(vk_device_, &view_info, nullptr, &view))) {
+    PEANUT_LOG_FATAL("Failed to create array image view");
+  }
+
+  return view;
+}
+
 Resource<VkBuffer> VulkanRHI::CreateBuffer(VkDeviceSize size,
                                            VkBufferUsageFlags usage,
                                            VkMemoryPropertyFlags memoryFlags) 
@@ -287,6 +419,18 @@ void VulkanRHI::GenerateMipmaps(const TextureData& texture)
     assert(texture.levels > 1);
 
     auto command_buffer = BeginImmediateComputePassCommandBuffer();
+    CmdGenerateMipmaps(command_buffer, texture, mip_generation_mode_);
+    ExecImmediateComputePassCommandBuffer(command_buffer);
+}
+
+void VulkanRHI::CmdGenerateMipmaps(VkCommandBuffer command_buffer, const TextureData& texture,
+                                   MipGenerationMode mode)
+{
+    if (mode == MipGenerationMode::SinglePassCompute && mip_generator_ &&
+        mip_generator_->CmdGenerateMipmaps(command_buffer, texture))
+    {
+        return;
+    }
 
     int32_t width = static_cast<int32_t>(texture.width);
     int32_t height = static_cast<int32_t>(texture.height);
@@ -331,8 +475,6 @@ void VulkanRHI::GenerateMipmaps(const TextureData& texture)
     
     CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, {barrier});
-
-    ExecImmediateComputePassCommandBuffer(command_buffer);
 }
 
 void VulkanRHI::CreateSampler(VkSamplerCreateInfo* create_info,
@@ -479,10 +621,9 @@ VkPipeline VulkanRHI::CreateGraphicsPipeline(VkRenderPass renderpass, uint32_t s
                                             const std::vector<VkVertexInputBindingDescription>* vertex_input_bindings,
                                             const std::vector<VkVertexInputAttributeDescription>* vertex_attributes,
                                             const VkPipelineMultisampleStateCreateInfo* multisample_state,
-                                            const VkPipelineDepthStencilStateCreateInfo* depth_stencil_stat) 
+                                            const VkPipelineDepthStencilStateCreateInfo* depth_stencil_stat,
+                                            uint32_t color_attachment_count) 
 {
-    const VkViewport default_viewport = {0.0f, 0.0f, (float)window_width_, (float)window_height_, 0.0f, 1.0f};
-    const VkRect2D default_scissor = {0, 0, window_width_, window_height_};
     const VkPipelineMultisampleStateCreateInfo default_multisample_state = 
     {
         VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
@@ -528,8 +669,14 @@ VkPipeline VulkanRHI::CreateGraphicsPipeline(VkRenderPass renderpass, uint32_t s
       VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
   viewport_state_create_info.viewportCount = 1;
   viewport_state_create_info.scissorCount = 1;
-  viewport_state_create_info.pViewports = &default_viewport;
-  viewport_state_create_info.pScissors = &default_scissor;
+
+  // viewport and scissor are set when recording so the pipeline survives swapchain resizes
+  const VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                           VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamic_state_create_info = {
+      VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
+  dynamic_state_create_info.dynamicStateCount = 2;
+  dynamic_state_create_info.pDynamicStates = dynamic_states;
 
   VkPipelineRasterizationStateCreateInfo rasteriz_state_create_info = {
       VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO};
@@ -538,13 +685,13 @@ VkPipeline VulkanRHI::CreateGraphicsPipeline(VkRenderPass renderpass, uint32_t s
   rasteriz_state_create_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
   rasteriz_state_create_info.lineWidth = 1.0f;
 
-  const VkPipelineColorBlendAttachmentState attachment_states[] = {
-      default_color_blend_attachment_state};
+  const std::vector<VkPipelineColorBlendAttachmentState> attachment_states(
+      color_attachment_count, default_color_blend_attachment_state);
 
   VkPipelineColorBlendStateCreateInfo color_blend_state_create_info = {
       VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
-  color_blend_state_create_info.attachmentCount = 1;
-  color_blend_state_create_info.pAttachments = attachment_states;
+  color_blend_state_create_info.attachmentCount = color_attachment_count;
+  color_blend_state_create_info.pAttachments = attachment_states.data();
 
   VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {
       VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
@@ -555,6 +702,7 @@ VkPipeline VulkanRHI::CreateGraphicsPipeline(VkRenderPass renderpass, uint32_t s
   graphics_pipeline_create_info.pInputAssemblyState =
       &input_assembly_state_create_info;
   graphics_pipeline_create_info.pViewportState = &viewport_state_create_info;
+  graphics_pipeline_create_info.pDynamicState = &dynamic_state_create_info;
   graphics_pipeline_create_info.pRasterizationState =
       &rasteriz_state_create_info;
   graphics_pipeline_create_info.pColorBlendState =
@@ -600,22 +748,63 @@ VkPipelineCache VulkanRHI::CreatePipelineCache(VkPipelineCacheCreateInfo* pcreat
     return pipeline_cache;
 }
 
+bool VulkanRHI::GetPipelineCacheData(VkPipelineCache pipeline_cache, std::vector<char>& out_data)
+{
+    size_t data_size = 0;
+    if (VKFAILED(vkGetPipelineCacheData(vk_device_, pipeline_cache, &data_size, nullptr)))
+    {
+        PEANUT_LOG_ERROR("Failed to query pipeline cache data size");
+        return false;
+    }
+
+    out_data.resize(data_size);
+    if (VKFAILED(vkGetPipelineCacheData(vk_device_, pipeline_cache, &data_size, out_data.data())))
+    {
+        PEANUT_LOG_ERROR("Failed to retrieve pipeline cache data");
+        out_data.clear();
+        return false;
+    }
+
+    out_data.resize(data_size);
+    return true;
+}
+
 VkShaderModule VulkanRHI::CreateShaderModule(const std::string& shader_file_path) 
 {
-    std::vector<char> shader_code;
-    if (!RenderUtils::ReadBinaryFile(shader_file_path, shader_code)) 
+    // map the spirv straight into the create info instead of copying it into a heap buffer
+    MappedFile shader_file;
+    if (!shader_file.Open(shader_file_path)) 
     {
         PEANUT_LOG_FATAL("Failed to read shader file {0}", shader_file_path.c_str());
+        return VK_NULL_HANDLE;
+    }
+
+    VkShaderModule shader_module = CreateShaderModule(reinterpret_cast<const uint32_t*>(shader_file.Data()), shader_file.Size());
+    if (shader_module == VK_NULL_HANDLE)
+    {
+        PEANUT_LOG_FATAL("Failed to create shader module with file {0}", shader_file_path);
+    }
+
+    return shader_module;
+}
+
+VkShaderModule VulkanRHI::CreateShaderModule(const uint32_t* code, size_t code_size)
+{
+    if (code == nullptr || code_size == 0 || code_size % sizeof(uint32_t) != 0)
+    {
+        PEANUT_LOG_ERROR("Invalid spirv code size {0}", code_size);
+        return VK_NULL_HANDLE;
     }
 
     VkShaderModuleCreateInfo create_info = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-    create_info.codeSize = shader_code.size();
-    create_info.pCode = reinterpret_cast<uint32_t*>(&shader_code[0]);
+    create_info.codeSize = code_size;
+    create_info.pCode = code;
 
     VkShaderModule shader_module = VK_NULL_HANDLE;
     if (VKFAILED(vkCreateShaderModule(vk_device_, &create_info, nullptr, &shader_module)))
     {
-        PEANUT_LOG_FATAL("Failed to create shader module with file {0}", shader_file_path);
+        PEANUT_LOG_ERROR("Failed to create shader module");
+        return VK_NULL_HANDLE;
     }
 
     return shader_module;
@@ -635,6 +824,7 @@ std::shared_ptr<TextureData> VulkanRHI::CreateTexture(uint32_t width, uint32_t h
     texture->width = width;
     texture->height = height;
     texture->layers = layers;
+    texture->format = format;
     texture->levels = levels > 0 ? levels : RenderUtils::NumMipmapLevels(width, height);
 
     VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | additional_usage;
@@ -711,9 +901,13 @@ void VulkanRHI::SetupInstance()
     std::vector<const char*> instance_layers;
     std::vector<const char*> instance_extensions;
 
-    uint32_t glfw_required_extensions_num;
-    const char** required_extensions =
-        glfwGetRequiredInstanceExtensions(&glfw_required_extensions_num);
+    // the headless mode has no surface and must not depend on glfw being initialized
+    uint32_t glfw_required_extensions_num = 0;
+    const char** required_extensions = nullptr;
+    if (!headless_)
+    {
+        required_extensions = glfwGetRequiredInstanceExtensions(&glfw_required_extensions_num);
+    }
 
     if (glfw_required_extensions_num > 0) 
     {
@@ -782,22 +976,57 @@ VkImageView VulkanRHI::CreateTextureView(const std::shared_ptr<TextureData>& tex
 
 void VulkanRHI::PresentFrame()
 {
-    VkResult result;
+    last_present_image_index_ = current_frame_index_;
+
+    if (headless_)
+    {
+        // nothing is presented, the next offscreen image is reused once the frame rendered to it finished
+        current_frame_index_ = (current_frame_index_ + 1) % frame_in_flight_numbers_;
+        if (tole_frame_count_ >= current_frame_index_)
+        {
+            vkWaitForFences(vk_device_, 1, &frame_submit_fences_[current_frame_index_], VK_TRUE, UINT64_MAX);
+            vkResetFences(vk_device_, 1, &frame_submit_fences_[current_frame_index_]);
+        }
+
+        if (tole_frame_count_ <= UINT16_MAX)
+        {
+            ++tole_frame_count_;
+        }
+        return;
+    }
 
     VkPresentInfoKHR present_info = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
     present_info.swapchainCount = 1;
     present_info.pSwapchains = &swapchain_;
     present_info.pImageIndices = &current_frame_index_;
-    present_info.pResults = &result;
-    if (VKFAILED(vkQueuePresentKHR(present_queue_, &present_info)) || VKFAILED(result))
+
+    // an out of date or suboptimal swapchain is recreated by the render system before the next frame
+    VkResult result = vkQueuePresentKHR(present_queue_, &present_info);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    {
+        swapchain_out_of_date_ = true;
+        return;
+    }
+    if (VKFAILED(result))
     {
         PEANUT_LOG_FATAL("Failed to queue swapchain image presentation");
         return;
     }
 
-    if (VKFAILED(vkAcquireNextImageKHR(vk_device_, swapchain_, UINT64_MAX,
-                                     VK_NULL_HANDLE, acquire_next_image_fence_,
-                                     &current_frame_index_)))
+    result = vkAcquireNextImageKHR(vk_device_, swapchain_, UINT64_MAX,
+                                   VK_NULL_HANDLE, acquire_next_image_fence_,
+                                   &current_frame_index_);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        swapchain_out_of_date_ = true;
+        return;
+    }
+    if (result == VK_SUBOPTIMAL_KHR)
+    {
+        // the image is still acquired and presentable, wait for it as usual
+        swapchain_out_of_date_ = true;
+    }
+    else if (VKFAILED(result))
     {
         PEANUT_LOG_FATAL("Failed to acquire next swapchain image");
         return;
@@ -818,6 +1047,11 @@ void VulkanRHI::SetupPhysicalDevice()
 {
   assert(vk_instance_ != VK_NULL_HANDLE);
 
+  required_device_features_.shaderStorageImageExtendedFormats = VK_TRUE;
+  required_device_features_.samplerAnisotropy = VK_TRUE;
+  // the reflection probes are sampled from one cube map array
+  required_device_features_.imageCubeArray = VK_TRUE;
+
   uint32_t physical_device_count;
   // get device count
   vkEnumeratePhysicalDevices(vk_instance_, &physical_device_count, nullptr);
@@ -839,7 +1073,16 @@ void VulkanRHI::SetupPhysicalDevice()
 
   physical_device_ = suitable_physical_device;
 
-  QuerySurfaceCapabilities(physical_device_, window_surface_);
+  if (!headless_) {
+    QuerySurfaceCapabilities(physical_device_, window_surface_);
+  }
+
+  std::vector<VkFormat> depth_format_candidates = {
+      VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+      VK_FORMAT_D24_UNORM_S8_UINT};
+  depth_image_format_ = FindSuitableDepthFormat(
+      depth_format_candidates, VK_IMAGE_TILING_OPTIMAL,
+      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 }
 
 VulkanPhysicalDevice VulkanRHI::FindSuitablePhysicalDevice(
@@ -870,7 +1113,7 @@ VulkanPhysicalDevice VulkanRHI::FindSuitablePhysicalDevice(
     }
 
     if (!CheckPhysicalDeviceExtensionSupport(physical_device_handle,
-                                             required_device_extensions_)) {
+                                             GetRequiredDeviceExtensions())) {
       PEANUT_LOG_WARN(
           "physical device ({0}) not support required extension, skip it",
           (uint64_t)physical_device_handle);
@@ -1003,6 +1246,15 @@ void VulkanRHI::FindPhysicalDeviceQueueFamily(VkPhysicalDevice handle,
         out_indices.compute_family = index;
       }
 
+      // without a surface the graphics queue stands in for the present queue
+      if (headless_) {
+        if (out_indices.graphics_family.has_value()) {
+          out_indices.present_family = out_indices.graphics_family;
+          break;
+        }
+        continue;
+      }
+
       // check whether or not support WSI surface
       VkBool32 support_surface = false;
       if (VKFAILED(vkGetPhysicalDeviceSurfaceSupportKHR(
@@ -1128,10 +1380,14 @@ void VulkanRHI::SetupLogicDevice() {
       static_cast<uint32_t>(queue_create_infos.size());
   device_create_info.pQueueCreateInfos = queue_create_infos.data();
   device_create_info.pEnabledFeatures = &required_device_features_;
+  std::vector<const char*> extension_names;
+  for (const std::string& extension : GetRequiredDeviceExtensions()) {
+    extension_names.push_back(extension.c_str());
+  }
   device_create_info.enabledExtensionCount =
-      static_cast<uint32_t>(required_device_extensions_.size());
-  const char* entesion_names = required_device_extensions_[0].c_str();
-  device_create_info.ppEnabledExtensionNames = &entesion_names;
+      static_cast<uint32_t>(extension_names.size());
+  device_create_info.ppEnabledExtensionNames =
+      extension_names.empty() ? nullptr : extension_names.data();
 
   if (VKFAILED(vkCreateDevice(physical_device_.physic_device_handle,
                               &device_create_info, nullptr, &vk_device_))) {
@@ -1151,19 +1407,14 @@ void VulkanRHI::SetupLogicDevice() {
                    0, &present_queue_);
 }
 
-void VulkanRHI::CreateSwapChain()
+void VulkanRHI::CreateSwapChain(VkSwapchainKHR old_swapchain, uint32_t image_count)
 {
-    VkPresentModeKHR present_mode = VkPresentModeKHR::VK_PRESENT_MODE_FIFO_KHR;
-    // not find in physical device present mode
-    if (std::find(physical_device_.present_modes.begin(),
-                physical_device_.present_modes.end(),
-                present_mode) == physical_device_.present_modes.end()) 
-    {
-        present_mode = physical_device_.present_modes[0];
-    }
+    const VkPresentModeKHR present_mode = ChoosePresentMode(present_mode_, physical_device_.present_modes);
 
     // get image counts
-    uint32_t image_counts = physical_device_.surface_capabilities.minImageCount + 1;
+    uint32_t image_counts = (image_count > 0)
+        ? std::max(image_count, physical_device_.surface_capabilities.minImageCount)
+        : physical_device_.surface_capabilities.minImageCount + 1;
 
     if (physical_device_.surface_capabilities.maxImageCount > 0 &&
         image_counts > physical_device_.surface_capabilities.maxImageCount)
@@ -1173,13 +1424,20 @@ void VulkanRHI::CreateSwapChain()
    
     swapchain_image_format_ = VK_FORMAT_B8G8R8A8_UNORM;
 
+    const VkExtent2D swapchain_extent = ChooseSwapchainExtent(window_width_, window_height_);
+    window_width_ = swapchain_extent.width;
+    window_height_ = swapchain_extent.height;
+
+    const uint32_t queue_family_indices[] = {
+        physical_device_.queue_family_indices.graphics_family.value(),
+        physical_device_.queue_family_indices.present_family.value()};
+
     VkSwapchainCreateInfoKHR swapchain_create_info = {VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
     swapchain_create_info.surface = window_surface_;
     swapchain_create_info.minImageCount = image_counts;
     swapchain_create_info.imageFormat = swapchain_image_format_;
     swapchain_create_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-    swapchain_create_info.imageExtent =
-        physical_device_.surface_capabilities.currentExtent;
+    swapchain_create_info.imageExtent = swapchain_extent;
     swapchain_create_info.imageArrayLayers = 1;
     swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     swapchain_create_info.preTransform =
@@ -1190,10 +1448,6 @@ void VulkanRHI::CreateSwapChain()
     {
         swapchain_create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         swapchain_create_info.queueFamilyIndexCount = 2;
-
-        uint32_t queue_family_indices[] = {
-            physical_device_.queue_family_indices.graphics_family.value(),
-            physical_device_.queue_family_indices.present_family.value()};
         swapchain_create_info.pQueueFamilyIndices = queue_family_indices;
         } else {
         swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -1202,7 +1456,7 @@ void VulkanRHI::CreateSwapChain()
     swapchain_create_info.presentMode = present_mode;
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchain_create_info.clipped = VK_TRUE;
-    swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
+    swapchain_create_info.oldSwapchain = old_swapchain;
     if (VKFAILED(vkCreateSwapchainKHR(vk_device_, &swapchain_create_info, nullptr,
                                     &swapchain_))) 
     {
@@ -1237,9 +1491,265 @@ void VulkanRHI::CreateSwapChain()
             PEANUT_LOG_FATAL("Failed to create image view with index {0}", i);
         }
     }
+}
+
+void VulkanRHI::CreateHeadlessImages()
+{
+    // same format as the swapchain so render passes and pipelines are shared with the windowed mode
+    swapchain_image_format_ = VK_FORMAT_B8G8R8A8_UNORM;
+    frame_in_flight_numbers_ = kHeadlessImageCount;
+
+    swapchain_images_.resize(frame_in_flight_numbers_);
+    swapchain_image_views_.resize(frame_in_flight_numbers_);
+    headless_image_memory_.resize(frame_in_flight_numbers_);
+    for (uint32_t i = 0; i < frame_in_flight_numbers_; ++i)
+    {
+        Resource<VkImage> image = CreateImage(window_width_, window_height_, 1, 1, 1, swapchain_image_format_,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+        swapchain_images_[i] = image.resource;
+        headless_image_memory_[i] = image.memory;
+        swapchain_image_views_[i] = CreateImageView(image.resource, swapchain_image_format_, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 1);
+    }
+}
+
+void VulkanRHI::DestroyHeadlessImages()
+{
+    for (size_t i = 0; i < headless_image_memory_.size(); ++i)
+    {
+        vkDestroyImage(vk_device_, swapchain_images_[i], nullptr);
+        vkFreeMemory(vk_device_, headless_image_memory_[i], nullptr);
+    }
+    headless_image_memory_.clear();
+}
+
+VkCommandBuffer VulkanRHI::AllocateCommandBuffer()
+{
+    VkCommandBufferAllocateInfo allocate_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocate_info.commandPool = command_pool_;
+    allocate_info.commandBufferCount = 1;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    if (VKFAILED(vkAllocateCommandBuffers(vk_device_, &allocate_info, &command_buffer)))
+    {
+        PEANUT_LOG_FATAL("Failed to allocate command buffer");
+    }
+    return command_buffer;
+}
+
+VkFence VulkanRHI::CreateFence()
+{
+    VkFenceCreateInfo create_info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VkFence fence = VK_NULL_HANDLE;
+    if (VKFAILED(vkCreateFence(vk_device_, &create_info, nullptr, &fence)))
+    {
+        PEANUT_LOG_ERROR("Failed to create fence");
+    }
+    return fence;
+}
+
+void VulkanRHI::SubmitCommandBuffer(VkCommandBuffer command_buffer, VkFence fence)
+{
+    // frames are submitted to the present queue, submissions on it execute in order with the frames
+    VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    if (VKFAILED(vkQueueSubmit(present_queue_, 1, &submit_info, fence)))
+    {
+        PEANUT_LOG_ERROR("Failed to submit command buffer");
+    }
+}
+
+bool VulkanRHI::HasMemoryType(VkMemoryPropertyFlags memory_flags)
+{
+    const VkPhysicalDeviceMemoryProperties& memory_properties = physical_device_.memory_properties;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+    {
+        if ((memory_properties.memoryTypes[i].propertyFlags & memory_flags) == memory_flags)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void VulkanRHI::InvalidateMappedMemory(VkDeviceMemory memory)
+{
+    const VkMappedMemoryRange invalidate_range = {
+        VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, memory, 0, VK_WHOLE_SIZE};
+    vkInvalidateMappedMemoryRanges(vk_device_, 1, &invalidate_range);
+}
+
+VkQueryPool VulkanRHI::CreateQueryPool(uint32_t query_count)
+{
+    VkQueryPoolCreateInfo create_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount = query_count;
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if (VKFAILED(vkCreateQueryPool(vk_device_, &create_info, nullptr, &query_pool)))
+    {
+        PEANUT_LOG_ERROR("Failed to create query pool");
+        return VK_NULL_HANDLE;
+    }
+    return query_pool;
+}
+
+bool VulkanRHI::GetQueryPoolResults(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count,
+                                    std::vector<uint64_t>& out_results)
+{
+    out_results.resize(query_count);
+    if (query_count == 0)
+    {
+        return true;
+    }
+
+    // without VK_QUERY_RESULT_WAIT_BIT the call returns VK_NOT_READY instead of stalling
+    const VkResult result = vkGetQueryPoolResults(vk_device_, query_pool, first_query, query_count,
+        query_count * sizeof(uint64_t), out_results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    return result == VK_SUCCESS;
+}
+
+uint32_t VulkanRHI::GetTimestampValidBits() const
+{
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device_.physic_device_handle, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> family_properties(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device_.physic_device_handle, &family_count,
+        family_properties.data());
+
+    // scopes are written by the frames on the present queue and by the immediate compute passes
+    const QueueFamilyIndices& indices = physical_device_.queue_family_indices;
+    uint32_t valid_bits = 64;
+    for (const std::optional<uint32_t>& family : {indices.present_family, indices.compute_family})
+    {
+        if (!family.has_value() || family.value() >= family_count)
+        {
+            return 0;
+        }
+        valid_bits = std::min(valid_bits, family_properties[family.value()].timestampValidBits);
+    }
+    return valid_bits;
+}
+
+void VulkanRHI::SetPresentMode(PresentMode present_mode)
+{
+    if (present_mode == present_mode_)
+    {
+        return;
+    }
+
+    present_mode_ = present_mode;
+    if (swapchain_ != VK_NULL_HANDLE)
+    {
+        swapchain_out_of_date_ = true;
+    }
+}
+
+VkPresentModeKHR VulkanRHI::ChoosePresentMode(PresentMode present_mode, const std::vector<VkPresentModeKHR>& supported_modes)
+{
+    // prefer a mode without tearing when the requested one is not supported
+    std::vector<VkPresentModeKHR> candidates;
+    switch (present_mode)
+    {
+    case PresentMode::Immediate:
+        candidates = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+        break;
+    case PresentMode::Mailbox:
+        candidates = {VK_PRESENT_MODE_MAILBOX_KHR};
+        break;
+    case PresentMode::Fifo:
+        break;
+    }
+
+    for (VkPresentModeKHR candidate : candidates)
+    {
+        if (std::find(supported_modes.begin(), supported_modes.end(), candidate) != supported_modes.end())
+        {
+            return candidate;
+        }
+    }
 
-    std::vector<VkFormat> depth_format_candidates = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
-    depth_image_format_ = FindSuitableDepthFormat(depth_format_candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    if (present_mode != PresentMode::Fifo)
+    {
+        PEANUT_LOG_WARN("Requested present mode {0} is not supported, fall back to fifo", static_cast<int>(present_mode));
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkExtent2D VulkanRHI::ChooseSwapchainExtent(uint32_t width, uint32_t height) const
+{
+    const VkSurfaceCapabilitiesKHR& capabilities = physical_device_.surface_capabilities;
+
+    // the surface size is fixed by the window unless the platform lets the swapchain decide
+    if (capabilities.currentExtent.width != UINT32_MAX)
+    {
+        return capabilities.currentExtent;
+    }
+
+    VkExtent2D extent;
+    extent.width = std::clamp(width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    extent.height = std::clamp(height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    return extent;
+}
+
+bool VulkanRHI::RecreateSwapchain(uint32_t width, uint32_t height)
+{
+    // the offscreen images of the headless mode keep the size they were created with
+    if (headless_)
+    {
+        return false;
+    }
+
+    // a minimized window has a zero sized surface, keep the old swapchain until it is restored
+    if (width == 0 || height == 0)
+    {
+        return false;
+    }
+
+    QuerySurfaceCapabilities(physical_device_, window_surface_);
+    const VkExtent2D extent = ChooseSwapchainExtent(width, height);
+    if (extent.width == 0 || extent.height == 0)
+    {
+        return false;
+    }
+
+    // drag resizes report sizes the swapchain already has, e.g. while the cursor does not move
+    if (!swapchain_out_of_date_ && extent.width == window_width_ && extent.height == window_height_)
+    {
+        return false;
+    }
+
+    vkDeviceWaitIdle(vk_device_);
+
+    for (VkImageView image_view : swapchain_image_views_)
+    {
+        vkDestroyImageView(vk_device_, image_view, nullptr);
+    }
+    swapchain_image_views_.clear();
+
+    const uint32_t old_image_count = frame_in_flight_numbers_;
+    VkSwapchainKHR old_swapchain = swapchain_;
+    window_width_ = width;
+    window_height_ = height;
+    // the command buffers, fences and the per frame resources of the render passes are sized by the image count
+    CreateSwapChain(old_swapchain, old_image_count);
+    vkDestroySwapchainKHR(vk_device_, old_swapchain, nullptr);
+
+    if (frame_in_flight_numbers_ != old_image_count)
+    {
+        PEANUT_LOG_FATAL("Swapchain image count changed from {0} to {1}, the frame resources can not follow",
+            old_image_count, frame_in_flight_numbers_);
+        std::abort();
+    }
+
+    ResetFrameSyncPrimitives();
+    swapchain_out_of_date_ = false;
+    InitializeFrameIndex();
+
+    PEANUT_LOG_INFO("Recreate swapchain with size ({0}, {1})", window_width_, window_height_);
+    return true;
 }
 
 void VulkanRHI::CreateCommandPoolAndCommandBuffers() {
@@ -1266,9 +1776,13 @@ void VulkanRHI::CreateCommandPoolAndCommandBuffers() {
 }
 
 void VulkanRHI::CreateDescriptorPool() {
-  const std::array<VkDescriptorPoolSize, 3> pool_size = {
-      {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16},
+  // the lighting sets alone bind shadow maps, ibl and reflection probe textures
+  const std::array<VkDescriptorPoolSize, 6> pool_size = {
+      {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 32},
        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16},
+       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 16},
+       {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 16},
+       {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 16},
        {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 16}}};
 
   VkDescriptorPoolCreateInfo create_info = {
@@ -1349,10 +1863,34 @@ void VulkanRHI::CreateSyncPrimitives() {
   }
 }
 
+void VulkanRHI::ResetFrameSyncPrimitives() {
+  // the device is idle, start over with unsignaled fences as after init
+  for (VkFence fence : frame_submit_fences_) {
+    vkDestroyFence(vk_device_, fence, nullptr);
+  }
+  vkDestroyFence(vk_device_, acquire_next_image_fence_, nullptr);
+  frame_submit_fences_.clear();
+
+  CreateSyncPrimitives();
+  tole_frame_count_ = 0;
+}
+
 void VulkanRHI::InitializeFrameIndex() {
-  if (VKFAILED(vkAcquireNextImageKHR(vk_device_, swapchain_, UINT64_MAX,
-                                     VK_NULL_HANDLE, acquire_next_image_fence_,
-                                     &current_frame_index_))) {
+  if (headless_) {
+    current_frame_index_ = 0;
+    return;
+  }
+
+  const VkResult result = vkAcquireNextImageKHR(
+      vk_device_, swapchain_, UINT64_MAX, VK_NULL_HANDLE,
+      acquire_next_image_fence_, &current_frame_index_);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    swapchain_out_of_date_ = true;
+    return;
+  }
+  if (result == VK_SUBOPTIMAL_KHR) {
+    swapchain_out_of_date_ = true;
+  } else if (VKFAILED(result)) {
     PEANUT_LOG_ERROR("Failed to acquire next image");
   }
 
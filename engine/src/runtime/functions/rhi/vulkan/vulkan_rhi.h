@@ -49,6 +49,7 @@ public:
     VulkanRHI() = default;
     virtual ~VulkanRHI() {}
     virtual void Init(const std::shared_ptr<WindowSystem>& window_system) override;
+    virtual void InitHeadless(uint32_t width, uint32_t height) override;
     virtual void Shutdown() override;
 
     virtual Resource<VkImage> CreateImage(uint32_t width, uint32_t height,
@@ -62,6 +63,21 @@ public:
                                         uint32_t num_mip_levels,
                                         uint32_t layers) override;
 
+    virtual VkImageView CreateImageLayerView(VkImage image, VkFormat format,
+                                             VkImageAspectFlags aspect_mask,
+                                             uint32_t layer) override;
+
+    virtual VkImageView CreateCubeImageView(VkImage image, VkFormat format,
+                                            uint32_t base_mip_level,
+                                            uint32_t num_mip_levels,
+                                            uint32_t base_layer,
+                                            uint32_t cube_count) override;
+
+    virtual VkImageView CreateImageArrayView(VkImage image, VkFormat format,
+                                             uint32_t base_mip_level,
+                                             uint32_t num_mip_levels,
+                                             uint32_t layers) override;
+
     virtual void DestroyImage(Resource<VkImage> image) override
     {
         if (image.resource != VK_NULL_HANDLE)
@@ -77,6 +93,29 @@ public:
             vkDestroyImageView(vk_device_, image_view, nullptr);
     }
 
+    virtual VkImage CreateUnboundImage(uint32_t width, uint32_t height, uint32_t layers, uint32_t levels,
+                                       uint32_t samples, VkFormat format, VkImageUsageFlags usage) override;
+
+    virtual VkMemoryRequirements GetImageMemoryRequirements(VkImage image) override
+    {
+        VkMemoryRequirements requirements{};
+        vkGetImageMemoryRequirements(vk_device_, image, &requirements);
+        return requirements;
+    }
+
+    virtual VkDeviceMemory AllocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags memory_flags) override;
+
+    virtual bool BindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) override
+    {
+        return VKSUCCESS(vkBindImageMemory(vk_device_, image, memory, offset));
+    }
+
+    virtual void FreeMemory(VkDeviceMemory memory) override
+    {
+        if (memory != VK_NULL_HANDLE)
+            vkFreeMemory(vk_device_, memory, nullptr);
+    }
+
     virtual Resource<VkBuffer> CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags) override;
 
     virtual void DestroyBuffer(Resource<VkBuffer> buffer) override;
@@ -115,6 +154,13 @@ public:
 
     virtual void GenerateMipmaps(const TextureData& texture) override;
 
+    virtual void CmdGenerateMipmaps(VkCommandBuffer command_buffer, const TextureData& texture,
+                                    MipGenerationMode mode) override;
+
+    virtual void SetMipGenerator(MipGenerator* mip_generator) override { mip_generator_ = mip_generator; }
+    virtual void SetMipGenerationMode(MipGenerationMode mode) override { mip_generation_mode_ = mode; }
+    virtual MipGenerationMode GetMipGenerationMode() const override { return mip_generation_mode_; }
+
     virtual void CreateSampler(VkSamplerCreateInfo* create_info,
                                 VkSampler* out_sampler) override;
 
@@ -199,12 +245,20 @@ public:
         const std::vector<VkVertexInputBindingDescription>* vertex_input_bindings,
         const std::vector<VkVertexInputAttributeDescription>* vertex_attributes,
         const VkPipelineMultisampleStateCreateInfo* multisample_state,
-        const VkPipelineDepthStencilStateCreateInfo* depth_stencil_stat) override;
+        const VkPipelineDepthStencilStateCreateInfo* depth_stencil_stat, uint32_t color_attachment_count) override;
 
     virtual VkPipeline CreateGraphicsPipeline(VkPipelineCache pipeline_cache, uint32_t createinfo_counts, VkGraphicsPipelineCreateInfo* pcreate_infos) override;
 
     virtual VkPipelineCache CreatePipelineCache(VkPipelineCacheCreateInfo* pcreate_info) override;
 
+    virtual bool GetPipelineCacheData(VkPipelineCache pipeline_cache, std::vector<char>& out_data) override;
+
+    virtual void DestroyPipelineCache(VkPipelineCache pipeline_cache) override
+    {
+        if (pipeline_cache != VK_NULL_HANDLE)
+            vkDestroyPipelineCache(vk_device_, pipeline_cache, nullptr);
+    }
+
     virtual VkPipeline CreateComputePipeline(
         VkShaderModule cs_shader, VkPipelineLayout layout,
         const VkSpecializationInfo* specialize_info = nullptr);
@@ -221,6 +275,8 @@ public:
 
     virtual VkShaderModule CreateShaderModule(const std::string& shader_file_path) override;
 
+    virtual VkShaderModule CreateShaderModule(const uint32_t* code, size_t code_size) override;
+
     virtual void DestroyShaderModule(VkShaderModule shader_module) override;
 
     virtual void QueueSubmit(uint32_t submit_count, uint32_t current_frame_index, VkSubmitInfo* submit_info) override
@@ -239,6 +295,82 @@ public:
         // }
     }
 
+    virtual bool IsSwapchainOutOfDate() const override { return swapchain_out_of_date_; }
+
+    virtual bool RecreateSwapchain(uint32_t width, uint32_t height) override;
+
+    virtual void SetPresentMode(PresentMode present_mode) override;
+    virtual PresentMode GetPresentMode() const override { return present_mode_; }
+
+    // the requested mode if the surface supports it, otherwise the closest supported one
+    static VkPresentModeKHR ChoosePresentMode(PresentMode present_mode, const std::vector<VkPresentModeKHR>& supported_modes);
+
+    virtual void WaitIdle() override
+    {
+        vkDeviceWaitIdle(vk_device_);
+    }
+
+    virtual bool IsHeadless() const override { return headless_; }
+
+    virtual VkImageLayout GetPresentImageLayout() const override
+    {
+        return headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+
+    virtual VkCommandBuffer AllocateCommandBuffer() override;
+
+    virtual void FreeCommandBuffer(VkCommandBuffer command_buffer) override
+    {
+        vkFreeCommandBuffers(vk_device_, command_pool_, 1, &command_buffer);
+    }
+
+    virtual VkFence CreateFence() override;
+
+    virtual void DestroyFence(VkFence fence) override
+    {
+        if (fence != VK_NULL_HANDLE)
+            vkDestroyFence(vk_device_, fence, nullptr);
+    }
+
+    virtual bool IsFenceSignaled(VkFence fence) override
+    {
+        return vkGetFenceStatus(vk_device_, fence) == VK_SUCCESS;
+    }
+
+    virtual void WaitForFence(VkFence fence) override
+    {
+        vkWaitForFences(vk_device_, 1, &fence, VK_TRUE, UINT64_MAX);
+    }
+
+    virtual void ResetFence(VkFence fence) override
+    {
+        vkResetFences(vk_device_, 1, &fence);
+    }
+
+    virtual void SubmitCommandBuffer(VkCommandBuffer command_buffer, VkFence fence) override;
+
+    virtual bool HasMemoryType(VkMemoryPropertyFlags memory_flags) override;
+
+    virtual void InvalidateMappedMemory(VkDeviceMemory memory) override;
+
+    virtual VkQueryPool CreateQueryPool(uint32_t query_count) override;
+
+    virtual void DestroyQueryPool(VkQueryPool query_pool) override
+    {
+        if (query_pool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(vk_device_, query_pool, nullptr);
+    }
+
+    virtual bool GetQueryPoolResults(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count,
+                                     std::vector<uint64_t>& out_results) override;
+
+    virtual float GetTimestampPeriod() const override
+    {
+        return physical_device_.properties.limits.timestampPeriod;
+    }
+
+    virtual uint32_t GetTimestampValidBits() const override;
+
     uint32_t GetCurrentFrameIndex() const { return current_frame_index_; }
     uint32_t GetRenderSamples() const { return render_samples_; }
     const std::vector<VkImageView>& GetSwapchainImageView()
@@ -251,6 +383,12 @@ public:
         return swapchain_images_[current_frame_index_];
     }
 
+    // image of the last finished frame, read it back after WaitIdle()
+    VkImage GetLastPresentedImage() const
+    {
+        return swapchain_images_[last_present_image_index_];
+    }
+
     uint32_t GetDisplayWidth() const { return window_width_; }
     uint32_t GetDisplayHeight() const { return window_height_; }
 
@@ -266,10 +404,16 @@ protected:
     void SetupInstance();
     void SetupPhysicalDevice();
     void SetupLogicDevice();
-    void CreateSwapChain();
+    // image_count 0 asks for one more image than the surface minimum
+    void CreateSwapChain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE, uint32_t image_count = 0);
+    void CreateHeadlessImages();
+    void DestroyHeadlessImages();
+    void SetupFrameResources();
+    VkExtent2D ChooseSwapchainExtent(uint32_t width, uint32_t height) const;
     void CreateCommandPoolAndCommandBuffers();
     void CreateDescriptorPool();
     void CreateSyncPrimitives();
+    void ResetFrameSyncPrimitives();
     void InitializeFrameIndex();
     uint32_t FindMemoryType(const VkMemoryRequirements& memory_requirements, VkMemoryPropertyFlags required_flag);
 
@@ -277,6 +421,12 @@ protected:
     void DestroyResource(Resource<T>& resource);
     void DestroyRenderTarget(RenderTarget& render_target);
 
+    const std::vector<std::string>& GetRequiredDeviceExtensions() const
+    {
+        static const std::vector<std::string> headless_device_extensions;
+        return headless_ ? headless_device_extensions : required_device_extensions_;
+    }
+
     VulkanPhysicalDevice FindSuitablePhysicalDevice(const std::vector<VkPhysicalDevice>& physical_devices);
 
     bool CheckRequiredFeaturesSupport(const VkPhysicalDeviceFeatures& required_device_features, const VkPhysicalDeviceFeatures& features);
@@ -295,6 +445,11 @@ private:
     // the physical device must contain these extensions
     const std::vector<std::string> required_device_extensions_ = {"VK_KHR_swapchain"};
 
+    // no window, surface or swapchain, frames are rendered into the offscreen images below
+    bool headless_ = false;
+    static constexpr uint32_t kHeadlessImageCount = 3;
+    std::vector<VkDeviceMemory> headless_image_memory_;
+
     // the physical device must contain the required features
     VkPhysicalDeviceFeatures required_device_features_ = {};
 
@@ -303,6 +458,7 @@ private:
     uint32_t window_width_;
     uint32_t window_height_;
     uint32_t current_frame_index_;
+    uint32_t last_present_image_index_ = 0;
     uint64_t tole_frame_count_;
 
     VulkanPhysicalDevice physical_device_;
@@ -314,12 +470,17 @@ private:
     VkQueue graphics_queue_;
     VkQueue compute_queue_;
 
-    VkSwapchainKHR swapchain_;
+    VkSwapchainKHR swapchain_ = VK_NULL_HANDLE;
+    PresentMode present_mode_ = PresentMode::Fifo;
     uint32_t frame_in_flight_numbers_;
     std::vector<VkImage> swapchain_images_;
     std::vector<VkImageView> swapchain_image_views_;
     std::vector<VkFramebuffer> swapchain_frame_buffers_;
     VkFormat swapchain_image_format_;
+    bool swapchain_out_of_date_ = false;
+
+    MipGenerator* mip_generator_ = nullptr;
+    MipGenerationMode mip_generation_mode_ = MipGenerationMode::SinglePassCompute;
 
     VkFormat depth_image_format_;
     
@@ -4,13 +4,18 @@
 #include "runtime/core/event/key_event.h"
 #include "runtime/core/event/mouse_event.h"
 #include "runtime/core/event/window_event.h"
+#include "runtime/core/profile/cpu_profiler.h"
 
 namespace peanut {
 WindowSystem::WindowSystem() : m_glf_window_(nullptr), intialized_(false) {}
 
 WindowSystem::~WindowSystem() {}
 
-void WindowSystem::OnUpdate() { glfwPollEvents(); }
+void WindowSystem::OnUpdate() {
+  // event callbacks are dispatched from inside glfwPollEvents
+  PEANUT_PROFILE_FUNCTION();
+  glfwPollEvents();
+}
 
 void WindowSystem::Shutdown() {
   if (m_glf_window_) glfwDestroyWindow(m_glf_window_);
@@ -19,11 +24,8 @@ void WindowSystem::Shutdown() {
 }
 
 void WindowSystem::SetVsync(bool enabled) {
-  if (enabled)
-    glfwSwapInterval(1);
-  else
-    glfwSwapInterval(0);
-
+  // the swap interval only applies to opengl contexts, vulkan presentation is
+  // paced by the present mode of the swapchain, see RHI::SetPresentMode()
   window_data_.vsync = enabled;
 }
 
@@ -9,4 +9,52 @@
 #define STD_GAMMA 2.2
 #define TONEMAP_EXPOSURE 4.5
 
+// material feature bits, baked into pipeline variants as a specialization constant
+#define MATERIAL_FEATURE_BASE_COLOR_TEXTURE 0x01
+#define MATERIAL_FEATURE_EMISSIVE_TEXTURE 0x02
+#define MATERIAL_FEATURE_METALLIC_ROUGHNESS_OCCLUSION_TEXTURE 0x04
+#define MATERIAL_FEATURE_OCCLUSION_CHANNEL 0x08
+#define MATERIAL_FEATURE_NORMAL_TEXTURE 0x10
+#define MATERIAL_FEATURE_BLEND 0x20
+#define MATERIAL_FEATURE_DOUBLE_SIDED 0x40
+#define MATERIAL_FEATURE_ALL 0x7F
+#define MATERIAL_FEATURE_CONSTANT_ID 0
+
+// clustered lighting, the view frustum is split into a froxel grid with exponential depth slices
+#define MAX_POINT_LIGHT_NUM 1024
+#define MAX_SPOT_LIGHT_NUM 1024
+#define LIGHT_CLUSTER_X 16
+#define LIGHT_CLUSTER_Y 9
+#define LIGHT_CLUSTER_Z 24
+#define LIGHT_CLUSTER_NUM (LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y * LIGHT_CLUSTER_Z)
+#define LIGHT_CLUSTER_MAX_LIGHTS 128
+
+// point and spot light shadows share one depth atlas, a point light takes six views
+#define MAX_LOCAL_SHADOW_VIEW_NUM 64
+#define LOCAL_SHADOW_ATLAS_SIZE 4096
+
+// diffuse sky light, l2 spherical harmonics of the environment map convolved with the cosine lobe
+#define SH_IRRADIANCE_COEFFICIENT_NUM 9
+#define SH_PROJECTION_GROUP_SIZE 64
+
+// local reflection probes, captured into one cube map array and blended by their influence boxes
+#define MAX_REFLECTION_PROBE_NUM 8
+#define REFLECTION_PROBE_SIZE 128
+#define REFLECTION_PROBE_MIP_LEVELS 8
+
+// post process chain, the effect ids are the entries of the effect order in PostCompositePCO
+#define POST_EFFECT_AUTO_EXPOSURE 0
+#define POST_EFFECT_BLOOM 1
+#define POST_EFFECT_TONE_MAPPING 2
+#define POST_EFFECT_COLOR_GRADING 3
+#define POST_EFFECT_NUM 4
+#define LUMINANCE_HISTOGRAM_BIN_NUM 256
+#define LUMINANCE_HISTOGRAM_SCALE 4 // the histogram takes one bilinear sample per 4x4 scene texels
+#define POST_EXPOSURE_KEY 0.18 // middle gray the average luminance is exposed to
+#define BLOOM_MAX_LEVELS 6 // the first level is at half resolution
+
+// temporal anti-aliasing, the jittered frames are accumulated in a history reprojected by the motion vectors
+#define TAA_GROUP_SIZE 8
+#define TAA_VARIANCE_CLIP_GAMMA 1.0 // standard deviations of the neighborhood the history is clipped to
+
 #endif
\ No newline at end of file
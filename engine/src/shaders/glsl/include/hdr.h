@@ -15,6 +15,17 @@ vec3 Uncharted2Tonemap(vec3 color)
 	return ((color*(A*color+C*B)+D*E)/(color*(A*color+B)+D*F))-E/F;
 }
 
+// Narkowicz's fit of the ACES filmic curve, maps exposed scene luminance to [0, 1]
+vec3 ACESFilmTonemap(vec3 color)
+{
+	float a = 2.51;
+	float b = 0.03;
+	float c = 2.43;
+	float d = 0.59;
+	float e = 0.14;
+	return clamp((color * (a * color + b)) / (color * (c * color + d) + e), 0.0, 1.0);
+}
+
 vec3 Tonemap(vec3 color)
 {
 	vec3 uncharted_color = Uncharted2Tonemap(color * TONEMAP_EXPOSURE);
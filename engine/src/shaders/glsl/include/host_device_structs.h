@@ -37,10 +37,17 @@ struct MaterialPCO // push constant
     int is_double_sided;
 };
 
+struct ShadowPCO // push constant
+{
+    mat4 model_light_view_proj;
+};
+
 struct SkyLight
 {
     vec3 color;
     float prefilter_mip_levels;
+    // rgb coefficients of the irradiance divided by PI, see spherical_harmonics.h
+    vec4 irradiance_sh[SH_IRRADIANCE_COEFFICIENT_NUM];
 };
 
 struct DirectionalLight
@@ -56,7 +63,7 @@ struct DirectionalLight
 struct PointLight
 {
     vec3 position;
-    float padding0;
+    int shadow_index; // first of the six cube face views in the local shadow atlas, -1 without a shadow
     vec3 color;
     float padding1;
 
@@ -66,6 +73,110 @@ struct PointLight
     int cast_shadow;
 };
 
+struct SpotLight
+{
+    vec3 position;
+    float radius;
+    vec3 color;
+    float inner_cone_cos;
+    vec3 direction;
+    float outer_cone_cos;
+
+    int cast_shadow;
+    int shadow_index; // view in the local shadow atlas, -1 without a shadow
+    vec2 padding0;
+};
+
+// a shadow view of a point or spot light, rendered into a tile of the local shadow atlas
+struct LocalShadowView
+{
+    mat4 view_proj;
+    vec4 atlas_rect; // xy uv offset, zw uv scale of the tile
+};
+
+// a local reflection probe, the cube is sampled box projected inside its influence box
+struct ReflectionProbe
+{
+    vec3 position; // capture point of the cube
+    float blend_distance; // the weight fades in over this distance from the faces of the box
+    vec3 box_min; // world space influence box
+    int array_index; // cube in the reflection probe array
+    vec3 box_max;
+    float padding0;
+};
+
+// what a reflection probe face is lit with, the capture only shades diffuse sky and directional light
+struct ReflectionProbeCaptureUBO
+{
+    mat4 face_view_projs[6];
+    SkyLight sky_light;
+    vec3 light_direction;
+    int has_directional_light;
+    vec3 light_color;
+    int has_sky_light;
+};
+
+struct ReflectionProbeCapturePCO // push constant
+{
+    mat4 model;
+    vec4 base_color_factor;
+    vec4 emissive_factor;
+    int face;
+    int padding0;
+    int padding1;
+    int padding2;
+};
+
+// auto exposure state kept across frames, written by the exposure average, read by bloom and the composite
+struct PostExposureState
+{
+    float adapted_luminance; // 0 until the first frame is measured
+    float exposure;
+    float average_luminance; // of the last measured frame
+    float padding0;
+};
+
+struct PostExposurePCO // push constant, luminance histogram and exposure average
+{
+    float min_log_luminance;
+    float log_luminance_range;
+    uint sample_num; // texels of the quarter resolution grid the histogram samples
+    float delta_time;
+    float adaptation_speed;
+    float exposure_compensation; // in stops
+};
+
+struct PostBloomPCO // push constant, bloom downsample and upsample
+{
+    vec2 inv_source_size; // texel size of the sampled level
+    vec2 inv_output_size; // texel size of the written level
+    float threshold; // exposed luminance the bloom starts at
+    float knee; // width of the soft threshold
+    float radius; // upsample filter radius in texels of the sampled level
+    int is_prefilter; // the first downsample reads the scene and thresholds it
+    int use_exposure; // the prefilter scales the scene by the auto exposure
+};
+
+struct PostCompositePCO // push constant
+{
+    int effects[POST_EFFECT_NUM]; // effect ids in the order they are applied
+    int effect_num;
+    float bloom_intensity;
+    int encode_srgb; // the output format stores values as they are, encode them in the shader
+    float padding0;
+};
+
+struct TemporalAAPCO // push constant, history resolve and sharpening
+{
+    vec2 inv_size; // texel size of the render target
+    float blend_factor; // weight of the current frame against the history
+    float sharpness; // of the resolved frame, 0 leaves it as is
+    int has_history; // the history is not reprojected after a reset, the current frame is taken as is
+    float padding0;
+    float padding1;
+    float padding2;
+};
+
 struct LightingUBO
 {
     // camera
@@ -73,12 +184,16 @@ struct LightingUBO
     float exposure;
     mat4 camera_view;
     mat4 inv_camera_view_proj;
+    mat4 inv_camera_proj;
+
+    // light clusters: x near, y far, z depth slice scale, w depth slice bias
+    vec4 cluster_params;
+    // xy render target size, zw its reciprocal
+    vec4 screen_params;
 
-    // lights
+    // lights, point and spot lights are read from storage buffers through the light clusters
     SkyLight sky_light;
     DirectionalLight directional_light;
-    // PointLight point_lights[MAX_POINT_LIGHT_NUM];
-    // SpotLight spot_lights[MAX_SPOT_LIGHT_NUM];
 
     int has_sky_light;
     int has_directional_light;
@@ -89,6 +204,14 @@ struct LightingUBO
     vec3 camera_dir;
     int shader_debug_option;
 
+    // captured probes, smaller influence boxes first, the sky light fills the weight they leave
+    int reflection_probe_num;
+    int padding0;
+    int padding1;
+    int padding2;
+    ReflectionProbe reflection_probes[MAX_REFLECTION_PROBE_NUM];
+
+#ifdef __cplusplus
     void CopyFrom(const LightingUBO& data)
     {
         this->camera_pos = data.camera_pos;
@@ -96,6 +219,9 @@ struct LightingUBO
         this->exposure = data.exposure;
         this->camera_view = data.camera_view;
         this->inv_camera_view_proj = data.inv_camera_view_proj;
+        this->inv_camera_proj = data.inv_camera_proj;
+        this->cluster_params = data.cluster_params;
+        this->screen_params = data.screen_params;
         this->sky_light = data.sky_light;
         this->directional_light = data.directional_light;
         this->point_light_num = data.point_light_num;
@@ -103,7 +229,13 @@ struct LightingUBO
         this->has_sky_light = data.has_sky_light;
         this->has_directional_light = data.has_directional_light;
         this->shader_debug_option = data.shader_debug_option;
+        this->reflection_probe_num = data.reflection_probe_num;
+        for (int i = 0; i < data.reflection_probe_num; ++i)
+        {
+            this->reflection_probes[i] = data.reflection_probes[i];
+        }
     }
+#endif
 };
 
 struct PbrMaterialInfo
@@ -117,6 +249,7 @@ struct PbrMaterialInfo
     float occlusion;
 };
 
+#ifdef __cplusplus
 enum ShaderDebugOption : uint32_t
 {
     Debug_Light = 0,
@@ -132,5 +265,19 @@ enum ShaderDebugOption : uint32_t
     Debug_Occulsion,
     Debug_Opacity
 };
+#else
+const int Debug_Light = 0;
+const int Debug_Unlit = 1;
+const int Debug_Wireframe = 2;
+const int Debug_LightOnly = 3;
+const int Debbug_Depth = 4;
+const int Debug_Normal = 5;
+const int Debug_BaseColor = 6;
+const int Debug_EmissiveColor = 7;
+const int Debug_Metallic = 8;
+const int Debug_Roughness = 9;
+const int Debug_Occulsion = 10;
+const int Debug_Opacity = 11;
+#endif
 
 #endif
\ No newline at end of file
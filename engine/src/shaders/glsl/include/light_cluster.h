@@ -0,0 +1,32 @@
+#ifndef _LIGHT_CLUSTER_H_
+#define _LIGHT_CLUSTER_H_
+
+#include "constants.h"
+
+// exponential depth slice of a positive view space depth,
+// cluster_params: x near, y far, z slice scale, w slice bias, see LightCullingPass::FillClusterParams()
+uint GetClusterDepthSlice(float view_depth, vec4 cluster_params)
+{
+    float slice = floor(log(max(view_depth, cluster_params.x)) * cluster_params.z - cluster_params.w);
+    return uint(clamp(slice, 0.0, float(LIGHT_CLUSTER_Z - 1)));
+}
+
+// view space depth of the near side of a depth slice
+float GetClusterSliceDepth(uint slice, vec4 cluster_params)
+{
+    return cluster_params.x * pow(cluster_params.y / cluster_params.x, float(slice) / float(LIGHT_CLUSTER_Z));
+}
+
+uint GetClusterIndex(uvec3 cluster)
+{
+    return (cluster.z * LIGHT_CLUSTER_Y + cluster.y) * LIGHT_CLUSTER_X + cluster.x;
+}
+
+// cluster of a screen position in [0, 1]
+uint GetClusterIndex(vec2 screen_uv, float view_depth, vec4 cluster_params)
+{
+    uvec2 tile = uvec2(clamp(screen_uv, vec2(0.0), vec2(0.999999)) * vec2(LIGHT_CLUSTER_X, LIGHT_CLUSTER_Y));
+    return GetClusterIndex(uvec3(tile, GetClusterDepthSlice(view_depth, cluster_params)));
+}
+
+#endif
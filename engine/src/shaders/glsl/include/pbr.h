@@ -3,20 +3,32 @@
 
 #include "host_device_structs.h"
 #include "hdr.h"
+#include "light_cluster.h"
+#include "spherical_harmonics.h"
 
-// global resource - ibl texture
-layout(set = 0, binding = 4) uniform samplerCube irradiance_texture_sampler;
+// global resource - ibl texture, the diffuse irradiance is read from the sh coefficients of the sky light
 layout(set = 0, binding = 5) uniform samplerCube perfilter_texture_sampler;
 layout(set = 0, binding = 6) uniform sampler2D brdf_LUT_texture_sampler;
 
 // shadow texture
-layout(set = 0, binding = 7) uniform sampler2DArray directonal_light_shadow_texture_sampler;
-// todo: point light
-// todo: spot light
+layout(set = 0, binding = 7) uniform sampler2DArrayShadow directonal_light_shadow_texture_sampler;
+layout(set = 0, binding = 8) uniform sampler2DShadow local_light_shadow_atlas_sampler;
 
 // light ubo
 layout(set = 0, binding = 9) uniform _LightingUBO {LightingUBO lighting_ubo;};
 
+// point and spot lights, binned into clusters by light_culling.comp
+layout(std430, set = 0, binding = 10) readonly buffer _PointLights { PointLight point_lights[]; };
+layout(std430, set = 0, binding = 11) readonly buffer _SpotLights { SpotLight spot_lights[]; };
+layout(std430, set = 0, binding = 12) readonly buffer _ClusterLightCounts { uint cluster_light_counts[]; };
+layout(std430, set = 0, binding = 13) readonly buffer _ClusterLightIndices { uint cluster_light_indices[]; };
+
+// views of the point and spot light shadows in the local shadow atlas
+layout(std430, set = 0, binding = 14) readonly buffer _LocalShadowViews { LocalShadowView local_shadow_views[]; };
+
+// prefiltered cubes of the local reflection probes, see ReflectionProbePass
+layout(set = 0, binding = 15) uniform samplerCubeArray reflection_probe_texture_sampler;
+
 struct PbrInfo
 {
     float NdotL; // cos(angle) between normal and light direction
@@ -33,22 +45,72 @@ struct PbrInfo
 	vec3 reflectance_90_angle;   // reflectance color at grazing angle
 	vec3 diffuse_color;           // color contribution from diffuse lighting
 	vec3 specular_color;          // color contribution from specular lighting
+};
+
+// weight of a probe at the position, 1 deeper than the blend distance inside the influence box, 0 outside of it
+float CalReflectionProbeWeight(ReflectionProbe probe, vec3 position)
+{
+    vec3 inner_distance = min(position - probe.box_min, probe.box_max - position);
+    float distance = min(min(inner_distance.x, inner_distance.y), inner_distance.z);
+    return clamp(distance / max(probe.blend_distance, 0.0001), 0.0, 1.0);
+}
+
+// the reflection ray is intersected with the influence box, so the cube is looked up towards the point
+// it hits instead of as if it was infinitely far away
+vec3 GetBoxProjectedDirection(ReflectionProbe probe, vec3 position, vec3 r)
+{
+    vec3 max_plane = (probe.box_max - position) / r;
+    vec3 min_plane = (probe.box_min - position) / r;
+    vec3 exit_plane = max(max_plane, min_plane);
+    float ray_distance = min(min(exit_plane.x, exit_plane.y), exit_plane.z);
+    return position + r * ray_distance - probe.position;
+}
+
+// specular light of the probes around the position in rgb, the weight left for the sky light in alpha.
+// the probes are ordered from small to large influence boxes, so a local probe covers the larger ones around it
+vec4 CalReflectionProbeSpecular(vec3 position, vec3 r, float roughness)
+{
+    vec3 specular_light = vec3(0.0);
+    float remaining_weight = 1.0;
+    float lod = roughness * float(REFLECTION_PROBE_MIP_LEVELS - 1);
+    for (int i = 0; i < lighting_ubo.reflection_probe_num && remaining_weight > 0.0; ++i)
+    {
+        ReflectionProbe probe = lighting_ubo.reflection_probes[i];
+        float weight = CalReflectionProbeWeight(probe, position) * remaining_weight;
+        if (weight <= 0.0)
+        {
+            continue;
+        }
+
+        vec3 direction = GetBoxProjectedDirection(probe, position, r);
+        vec3 probe_light = textureLod(reflection_probe_texture_sampler, vec4(direction, float(probe.array_index)), lod).rgb;
+        specular_light += SRGBToLinear(Tonemap(probe_light)) * weight;
+        remaining_weight -= weight;
+    }
+    return vec4(specular_light, remaining_weight);
 }
 
 // Calculation of the lighting contribution from an optional Image Based Light source.
 // Precomputed Environment Maps are required uniform inputs and are computed as outlined in [1].
-vec3 CalIBLContribution(PbrInfo pbr_info, vec3 n, vec3 r)
+// Reflection probes replace the specular sky light where their influence boxes reach.
+vec3 CalIBLContribution(PbrInfo pbr_info, vec3 n, vec3 r, vec3 position)
 {
     float lod = pbr_info.roughness * lighting_ubo.sky_light.prefilter_mip_levels;
+    vec3 sky_color = bool(lighting_ubo.has_sky_light) ? lighting_ubo.sky_light.color : vec3(0.0);
 
     vec3 brdf = (texture(brdf_LUT_texture_sampler, vec2(pbr_info.NdotV, 1.0 - pbr_info.roughness))).rgb;
-    vec3 diffuse_light = SRGBToLinear(Tonemap(texture(irradiance_texture_sampler, n).rgb));
-    vec3 specular_light = SRGBToLinear(Tonemap(textureLod(perfilter_texture_sampler, r, lod).rgb));
+    vec3 diffuse_light = SRGBToLinear(Tonemap(EvaluateSHIrradiance(lighting_ubo.sky_light.irradiance_sh, n))) * sky_color;
+    vec4 probe_specular = CalReflectionProbeSpecular(position, r, pbr_info.roughness);
+    vec3 specular_light = probe_specular.rgb;
+    if (probe_specular.a > 0.0)
+    {
+        specular_light += SRGBToLinear(Tonemap(textureLod(perfilter_texture_sampler, r, lod).rgb)) * sky_color * probe_specular.a;
+    }
 
     vec3 diffuse_color = diffuse_light * pbr_info.diffuse_color;
     vec3 specular_color = specular_light * (pbr_info.specular_color * brdf.x + brdf.y);
 
-    return (diffuse_color + specular_color) * lighting_ubo.sky_light.color;
+    return diffuse_color + specular_color;
 }
 
 // Basic Lambertian diffuse color
@@ -70,7 +132,7 @@ float CalMicrofacetNormalDistribution(float NdotH, float alpha_roughness)
 // F = F0 + (1 - F0) * (1 - cos(thea))^5
 // rapid version from epic game:
 // Karis B, Games E. Real shading in unreal engine 4[J]. Proc. Physically Based Shading Theory Practice, 2013, 4. https://cdn2.unrealengine.com/Resources/files/2013SiggraphPresentationsNotes-26915738.pdf
-float CalFresnelReflection(vec3 F0, vec3 F90, float VdotH)
+vec3 CalFresnelReflection(vec3 F0, vec3 F90, float VdotH)
 {
     // return F0 + (F90 - F0) * exp2(-5.55473 * pbr_info.VdotH - 6.98316 * pbr_info.VdotH );
     return F0 + (F90 - F0) * pow(clamp(1 - VdotH, 0.0, 1.0), 5);
@@ -95,21 +157,21 @@ float CalGeometricAttenuation(float NdotL, float NdotV, float roughness)
 // @arg [v]: view direction
 // @arg [l]: light direction
 // @arg [radiance]: intensity of incident radiance
-vec4 GetLightByCookTorrance(PbrInfo pbr_info, vec3 n, vec3 v, vec3 l, vec3 radiance)
+vec3 GetLightByCookTorrance(PbrInfo pbr_info, vec3 n, vec3 v, vec3 l, vec3 radiance)
 {
     // half vector
     vec3 h = normalize(v + l);
 
     // calculate cos angle
-    pbr_info.NdotL = clamp(dot(n, l), 0,001, 1.0);
-    pbr_info.NdotV = clamp(dot(n, v), 0,0, 1.0);
-    pbr_info.NdotH = clamp(dot(n, h), 0,0, 1.0);
-    pbr_info.VdotL = clamp(dot(v, l), 0,0, 1.0);
-    pbr_info.VdotH = clamp(dot(v, h), 0,0, 1.0);
+    pbr_info.NdotL = clamp(dot(n, l), 0.001, 1.0);
+    pbr_info.NdotV = clamp(dot(n, v), 0.0, 1.0);
+    pbr_info.NdotH = clamp(dot(n, h), 0.0, 1.0);
+    pbr_info.VdotL = clamp(dot(v, l), 0.0, 1.0);
+    pbr_info.VdotH = clamp(dot(v, h), 0.0, 1.0);
 
     // calculate Normal Distribution Function
     float D = CalMicrofacetNormalDistribution(pbr_info.NdotH, pbr_info.alpha_roughness);
-    float F = CalFresnelReflection(pbr_info.reflection, pbr_info.reflectance_90_angle);
+    vec3 F = CalFresnelReflection(pbr_info.reflection, pbr_info.reflectance_90_angle, pbr_info.VdotH);
     float G = CalGeometricAttenuation(pbr_info.NdotL, pbr_info.NdotV, pbr_info.roughness);
 
     // specular
@@ -120,18 +182,164 @@ vec4 GetLightByCookTorrance(PbrInfo pbr_info, vec3 n, vec3 v, vec3 l, vec3 radia
     return pbr_info.NdotL * radiance * (diffuse_contrib + specular_contrib);
 }
 
-bool IsDebugLight() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Light; }
-bool IsDebugUnlight() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Unlit; }
-bool IsDebugWireframe() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Wireframe; }
-bool IsDebugLightingOnly() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_LightOnly; }
-bool IsDebugDepth() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debbug_Depth; }
-bool IsDebugNormal() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Normal; }
-bool IsDebugBaseColor() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_BaseColor; }
-bool IsDebugEmissiveColor() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_EmissiveColor; }
-bool IsDebugMetallic() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Metallic; }
-bool IsDebugRoughness() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Roughness; }
-bool IsDebugOcclusion() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Occulsion; }
-bool IsDebugOpacity() { return lighting_ubo.shader_debug_option == ShaderDebugOption::Debug_Opacity; }
+// visibility of the directional light, the first cascade that reaches the view depth is sampled with 3x3 pcf
+float CalDirectionalShadow(DirectionalLight light, vec3 position)
+{
+    float view_depth = -(lighting_ubo.camera_view * vec4(position, 1.0)).z;
+    int cascade_index = -1;
+    for (int i = SHADOW_CASCADE_NUM - 1; i >= 0; --i)
+    {
+        if (view_depth <= light.cascade_splits[i])
+        {
+            cascade_index = i;
+        }
+    }
+    if (cascade_index < 0)
+    {
+        return 1.0;
+    }
+
+    vec4 shadow_position = light.cascade_view_projs[cascade_index] * vec4(position, 1.0);
+    vec3 shadow_coord = shadow_position.xyz / shadow_position.w;
+    vec2 shadow_uv = shadow_coord.xy * 0.5 + 0.5;
+
+    vec2 texel_size = 1.0 / vec2(textureSize(directonal_light_shadow_texture_sampler, 0).xy);
+    float visibility = 0.0;
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            vec2 uv = shadow_uv + vec2(x, y) * texel_size;
+            visibility += texture(directonal_light_shadow_texture_sampler, vec4(uv, float(cascade_index), shadow_coord.z));
+        }
+    }
+    return visibility / 9.0;
+}
+
+// 3x3 pcf in the atlas tile of a shadow view, taps are clamped to the tile so they never read a neighbour
+float CalLocalLightShadow(int view_index, vec3 position)
+{
+    LocalShadowView view = local_shadow_views[view_index];
+    vec4 shadow_position = view.view_proj * vec4(position, 1.0);
+    vec3 shadow_coord = shadow_position.xyz / shadow_position.w;
+
+    vec2 texel_size = 1.0 / vec2(textureSize(local_light_shadow_atlas_sampler, 0));
+    vec2 tile_min = view.atlas_rect.xy + texel_size * 1.5;
+    vec2 tile_max = view.atlas_rect.xy + view.atlas_rect.zw - texel_size * 1.5;
+    vec2 shadow_uv = view.atlas_rect.xy + (shadow_coord.xy * 0.5 + 0.5) * view.atlas_rect.zw;
+
+    float visibility = 0.0;
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            vec2 uv = clamp(shadow_uv + vec2(x, y) * texel_size, tile_min, tile_max);
+            visibility += texture(local_light_shadow_atlas_sampler, vec3(uv, shadow_coord.z));
+        }
+    }
+    return visibility / 9.0;
+}
+
+// the cube face views are ordered +x, -x, +y, -y, +z, -z
+int GetPointLightShadowFace(vec3 light_to_position)
+{
+    vec3 abs_direction = abs(light_to_position);
+    if (abs_direction.x >= abs_direction.y && abs_direction.x >= abs_direction.z)
+    {
+        return light_to_position.x >= 0.0 ? 0 : 1;
+    }
+    if (abs_direction.y >= abs_direction.z)
+    {
+        return light_to_position.y >= 0.0 ? 2 : 3;
+    }
+    return light_to_position.z >= 0.0 ? 4 : 5;
+}
+
+// smooth window that reaches zero at the light radius
+float CalDistanceAttenuation(float distance, float radius, float linear_attenuation, float quadratic_attenuation)
+{
+    float ratio = distance / max(radius, 0.0001);
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (1.0 + linear_attenuation * distance + quadratic_attenuation * distance * distance);
+}
+
+vec3 CalPointLight(PbrInfo pbr_info, vec3 n, vec3 v, vec3 position, PointLight light)
+{
+    vec3 to_light = light.position - position;
+    float distance = length(to_light);
+    float attenuation = CalDistanceAttenuation(distance, light.radius, light.linear_attenuation, light.quadratice_attenuation);
+    if (attenuation <= 0.0)
+    {
+        return vec3(0.0);
+    }
+    if (light.shadow_index >= 0)
+    {
+        attenuation *= CalLocalLightShadow(light.shadow_index + GetPointLightShadowFace(-to_light), position);
+    }
+    return GetLightByCookTorrance(pbr_info, n, v, to_light / distance, light.color * attenuation);
+}
+
+vec3 CalSpotLight(PbrInfo pbr_info, vec3 n, vec3 v, vec3 position, SpotLight light)
+{
+    vec3 to_light = light.position - position;
+    float distance = length(to_light);
+    vec3 l = to_light / distance;
+    float cone = smoothstep(light.outer_cone_cos, light.inner_cone_cos, dot(-l, light.direction));
+    float attenuation = cone * CalDistanceAttenuation(distance, light.radius, 0.0, 1.0);
+    if (attenuation <= 0.0)
+    {
+        return vec3(0.0);
+    }
+    if (light.shadow_index >= 0)
+    {
+        attenuation *= CalLocalLightShadow(light.shadow_index, position);
+    }
+    return GetLightByCookTorrance(pbr_info, n, v, l, light.color * attenuation);
+}
+
+// only the lights binned into the cluster of the fragment are evaluated
+vec3 CalClusteredLights(PbrInfo pbr_info, vec3 n, vec3 v, vec3 position)
+{
+    int point_light_num = lighting_ubo.point_light_num;
+    if (point_light_num + lighting_ubo.spot_light_num == 0)
+    {
+        return vec3(0.0);
+    }
+
+    float view_depth = -(lighting_ubo.camera_view * vec4(position, 1.0)).z;
+    vec2 screen_uv = gl_FragCoord.xy * lighting_ubo.screen_params.zw;
+    uint cluster_index = GetClusterIndex(screen_uv, view_depth, lighting_ubo.cluster_params);
+
+    vec3 light_color = vec3(0.0);
+    uint light_count = cluster_light_counts[cluster_index];
+    uint list_offset = cluster_index * LIGHT_CLUSTER_MAX_LIGHTS;
+    for (uint i = 0; i < light_count; ++i)
+    {
+        uint light_index = cluster_light_indices[list_offset + i];
+        if (light_index < uint(point_light_num))
+        {
+            light_color += CalPointLight(pbr_info, n, v, position, point_lights[light_index]);
+        }
+        else
+        {
+            light_color += CalSpotLight(pbr_info, n, v, position, spot_lights[light_index - uint(point_light_num)]);
+        }
+    }
+    return light_color;
+}
+
+bool IsDebugLight() { return lighting_ubo.shader_debug_option == Debug_Light; }
+bool IsDebugUnlight() { return lighting_ubo.shader_debug_option == Debug_Unlit; }
+bool IsDebugWireframe() { return lighting_ubo.shader_debug_option == Debug_Wireframe; }
+bool IsDebugLightingOnly() { return lighting_ubo.shader_debug_option == Debug_LightOnly; }
+bool IsDebugDepth() { return lighting_ubo.shader_debug_option == Debbug_Depth; }
+bool IsDebugNormal() { return lighting_ubo.shader_debug_option == Debug_Normal; }
+bool IsDebugBaseColor() { return lighting_ubo.shader_debug_option == Debug_BaseColor; }
+bool IsDebugEmissiveColor() { return lighting_ubo.shader_debug_option == Debug_EmissiveColor; }
+bool IsDebugMetallic() { return lighting_ubo.shader_debug_option == Debug_Metallic; }
+bool IsDebugRoughness() { return lighting_ubo.shader_debug_option == Debug_Roughness; }
+bool IsDebugOcclusion() { return lighting_ubo.shader_debug_option == Debug_Occulsion; }
+bool IsDebugOpacity() { return lighting_ubo.shader_debug_option == Debug_Opacity; }
 
 vec4 CalPbrLightColor(PbrMaterialInfo material_info)
 {
@@ -195,10 +403,10 @@ vec4 CalPbrLightColor(PbrMaterialInfo material_info)
 
     float reflection = max(max(specular_color.r, specular_color.g), specular_color.b);
     float reflection_90 = clamp(reflection * 25.0, 0, 1.0);
-    vec3 specular_color_reflection_90 = reflectance_90 * vec3(1.0);
+    vec3 specular_color_reflection_90 = reflection_90 * vec3(1.0);
 
     // surface, camera, and light directions
-    vec3 n = materail_info.normal;
+    vec3 n = material_info.normal;
     vec3 v = normalize(lighting_ubo.camera_pos - material_info.position);
     vec3 r = reflect(-v, n); // reflect direction
 
@@ -220,31 +428,27 @@ vec4 CalPbrLightColor(PbrMaterialInfo material_info)
     if (bool(lighting_ubo.has_directional_light))
     {
         DirectionalLight directional_light = lighting_ubo.directional_light;
-        // todo: draw shadow
-        
+        float visibility = bool(directional_light.cast_shadow) ? CalDirectionalShadow(directional_light, material_info.position) : 1.0;
+
         // brdf
-        light_color += GetLightByCookTorrance(pbr_info, n, v, -directional_light.direction, directional_light.color);
+        light_color += GetLightByCookTorrance(pbr_info, n, v, -directional_light.direction, directional_light.color * visibility);
     }
 
-    // point light
-
-    // spot light
+    // point and spot lights
+    light_color += CalClusteredLights(pbr_info, n, v, material_info.position);
 
     // ibl indirect light contribution
-    if (bool(lighting_ubo.has_sky_light))
+    if (bool(lighting_ubo.has_sky_light) || lighting_ubo.reflection_probe_num > 0)
     {
-        light_color += CalIBLContribution(pbr_info, n, r);
+        light_color += CalIBLContribution(pbr_info, n, r, material_info.position);
     }
 
     vec3 result_color = IsDebugUnlight() ? vec3(0.0) : light_color;
     
-    result_color = result_color * material_info.occlusion + material_info.emissive_color;
-
-    result_color = Tonemap(result_color);
-
-    result_color = LinearToSRGB(result_color);
+    // linear scene color, exposure, tone mapping and encoding are up to the post process chain
+    result_color = result_color * material_info.occlusion + material_info.emissive_color.rgb;
 
-    return vec4(result_color, materail_info.base_color.a);
+    return vec4(result_color, material_info.base_color.a);
 }
 
 
@@ -0,0 +1,62 @@
+#ifndef _SPHERICAL_HARMONICS_
+#define _SPHERICAL_HARMONICS_
+
+#include "constants.h"
+
+// real l2 spherical harmonics, coefficients are ordered (l, m) = (0, 0) (1, -1) (1, 0) (1, 1) (2, -2) (2, -1) (2, 0) (2, 1) (2, 2)
+void SHBasis(vec3 dir, out float basis[SH_IRRADIANCE_COEFFICIENT_NUM])
+{
+    basis[0] = 0.282095;
+    basis[1] = 0.488603 * dir.y;
+    basis[2] = 0.488603 * dir.z;
+    basis[3] = 0.488603 * dir.x;
+    basis[4] = 1.092548 * dir.x * dir.y;
+    basis[5] = 1.092548 * dir.y * dir.z;
+    basis[6] = 0.315392 * (3.0 * dir.z * dir.z - 1.0);
+    basis[7] = 1.092548 * dir.x * dir.z;
+    basis[8] = 0.546274 * (dir.x * dir.x - dir.y * dir.y);
+}
+
+// the clamped cosine lobe divided by PI in the sh bands, radiance coefficients times these give irradiance / PI
+float SHCosineLobeBand(uint index)
+{
+    return index == 0 ? 1.0 : (index < 4 ? 2.0 / 3.0 : 0.25);
+}
+
+// direction through the center of a cube map texel, st is the texel center in [0, 1] on the face
+vec3 CubeTexelDirection(uint face, vec2 st)
+{
+    vec2 uv = vec2(2.0 * st.x - 1.0, 1.0 - 2.0 * st.y);
+    vec3 dir;
+    if (face == 0)      dir = vec3(1.0, uv.y, -uv.x);
+    else if (face == 1) dir = vec3(-1.0, uv.y, uv.x);
+    else if (face == 2) dir = vec3(uv.x, 1.0, -uv.y);
+    else if (face == 3) dir = vec3(uv.x, -1.0, uv.y);
+    else if (face == 4) dir = vec3(uv.x, uv.y, 1.0);
+    else                dir = vec3(-uv.x, uv.y, -1.0);
+    return normalize(dir);
+}
+
+// solid angle of a texel relative to the one in the center of the face
+float CubeTexelWeight(vec2 st)
+{
+    vec2 uv = 2.0 * st - 1.0;
+    float distance_square = 1.0 + dot(uv, uv);
+    return 1.0 / (distance_square * sqrt(distance_square));
+}
+
+// irradiance divided by PI around the normal n
+vec3 EvaluateSHIrradiance(vec4 coefficients[SH_IRRADIANCE_COEFFICIENT_NUM], vec3 n)
+{
+    float basis[SH_IRRADIANCE_COEFFICIENT_NUM];
+    SHBasis(n, basis);
+
+    vec3 irradiance = vec3(0.0);
+    for (uint i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i)
+    {
+        irradiance += coefficients[i].rgb * basis[i];
+    }
+    return max(irradiance, vec3(0.0));
+}
+
+#endif
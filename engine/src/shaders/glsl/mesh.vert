@@ -3,7 +3,7 @@
 
 #include "host_device_structs.h"
 
-layout(push_constant) uniform _TransformUBO { TransformUBO transform_ubo; };
+layout(set = 1, binding = 0) uniform _TransformUBO { TransformUBO transform_ubo; };
 
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
@@ -4,6 +4,7 @@
 #include "host_device_structs.h"
 
 layout(push_constant) uniform _MaterialPCO { MaterialPCO material_pco; };
+layout(constant_id = MATERIAL_FEATURE_CONSTANT_ID) const int material_features = MATERIAL_FEATURE_ALL;
 layout(set = 0, binding = 0) uniform sampler2D base_color_texture_sampler;
 layout(set = 0, binding = 1) uniform sampler2D normal_texture_sampler;
 layout(set = 0, binding = 2) uniform sampler2D metallic_roughness_occlusion_texture_sampler;
@@ -21,8 +22,18 @@ layout(location = 1) out highp vec4 out_gbuffer_b; // metallic, roughness, occlu
 layout(location = 2) out highp vec4 out_gbuffer_c; // base color
 // todo: layout(location = 3) out highp vec4 out_emissive_color;
 
+bool has_feature(int feature)
+{
+    return (material_features & feature) != 0;
+}
+
 highp vec3 calculate_normal()
 {
+    if (!has_feature(MATERIAL_FEATURE_NORMAL_TEXTURE))
+    {
+        return normalize(in_normal);
+    }
+
     highp vec3 tagent_normal = texture(normal_texture_sampler, in_texcoord).xyz * 2 - 1.0; // clap the normal value to [0, 1]
 
     highp vec3 N = normalize(in_normal);
@@ -42,7 +53,7 @@ void main()
     
     // base color
     out_gbuffer_c = material_pco.base_color_factor;
-    if (bool(material_pco.has_base_color_texture))
+    if (has_feature(MATERIAL_FEATURE_BASE_COLOR_TEXTURE))
     {
         out_gbuffer_c *= texture(base_color_texture_sampler, in_texcoord);
     }
@@ -56,10 +67,10 @@ void main()
     
     // metallic roughness and occlusion
     vec3 metallic_roughness_occlusion = vec3(material_pco.metallic_factor, material_pco.roughness_factor, 1.0);
-    if (bool(material_pco.has_metallic_roughness_occlusion_texture))
+    if (has_feature(MATERIAL_FEATURE_METALLIC_ROUGHNESS_OCCLUSION_TEXTURE))
     {
         vec4 mro_data = texture(metallic_roughness_occlusion_texture_sampler, in_texcoord);
-        metallic_roughness_occlusion.xyz *= vec3(mro_data.b, mro_data.g, bool(material_pco.contains_occlusion_channel) ? mro_data.r : 1.0);
+        metallic_roughness_occlusion.xyz *= vec3(mro_data.b, mro_data.g, has_feature(MATERIAL_FEATURE_OCCLUSION_CHANNEL) ? mro_data.r : 1.0);
     }
 
     out_gbuffer_b.xyz = metallic_roughness_occlusion;
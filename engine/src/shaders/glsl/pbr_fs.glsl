@@ -29,6 +29,14 @@ layout(location=0) in Vertex
 
 layout(location=0) out vec4 color;
 
+// only the temporal anti-aliasing variant, the msaa render pass has no motion vector attachment
+#ifdef WRITE_MOTION_VECTOR
+layout(location=5) in vec4 currentClipPosition;
+layout(location=6) in vec4 prevClipPosition;
+
+layout(location=1) out vec2 motionVector;
+#endif
+
 #if VULKAN
 layout(set=0, binding=1) uniform ShadingUniforms
 #else
@@ -183,4 +191,9 @@ void main()
 
 	// Final fragment color.
 	color = vec4(directLighting + ambientLighting, 1.0);
+
+#ifdef WRITE_MOTION_VECTOR
+	// screen uv offset to this texel from where it was in the last frame
+	motionVector = (currentClipPosition.xy / currentClipPosition.w - prevClipPosition.xy / prevClipPosition.w) * 0.5;
+#endif
 }
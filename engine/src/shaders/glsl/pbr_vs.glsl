@@ -19,6 +19,11 @@ layout(std140, binding=0) uniform TransformUniforms
 	mat4 viewProjectionMatrix;
 	mat4 skyProjectionMatrix;
 	mat4 sceneRotationMatrix;
+	// last frame without jitter, for the motion vectors
+	mat4 prevViewProjectionMatrix;
+	mat4 prevSkyProjectionMatrix;
+	mat4 prevSceneRotationMatrix;
+	vec4 jitter; // xy: sub-pixel offset of this frame's projection in ndc
 };
 
 layout(location=0) out Vertex
@@ -28,6 +33,9 @@ layout(location=0) out Vertex
 	mat3 tangentBasis;
 } vout;
 
+layout(location=5) out vec4 currentClipPosition;
+layout(location=6) out vec4 prevClipPosition;
+
 void main()
 {
 	vout.position = vec3(sceneRotationMatrix * vec4(position, 1.0));
@@ -37,4 +45,8 @@ void main()
 	vout.tangentBasis = mat3(sceneRotationMatrix) * mat3(tangent, bitangent, normal);
 
 	gl_Position = viewProjectionMatrix * sceneRotationMatrix * vec4(position, 1.0);
+
+	// the motion is measured between the frames without their jitter
+	currentClipPosition = gl_Position - vec4(jitter.xy * gl_Position.w, 0.0, 0.0);
+	prevClipPosition = prevViewProjectionMatrix * prevSceneRotationMatrix * vec4(position, 1.0);
 }
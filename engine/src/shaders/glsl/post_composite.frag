@@ -0,0 +1,65 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "host_device_structs.h"
+#include "hdr.h"
+
+// Last stage of the post process chain, applies the full resolution part of every effect in the configured order
+// and writes the display image. The measurements and blurs were done at lower resolution by the compute stages.
+
+layout(set = 0, binding = 0) uniform sampler2D scene_texture;
+layout(set = 0, binding = 1) uniform sampler2D bloom_texture;
+// 2d strip of a 3d lut, size * size texels wide and size texels high, blue picks the slice
+layout(set = 0, binding = 2) uniform sampler2D color_grading_lut;
+layout(std430, set = 0, binding = 3) readonly buffer _PostExposureState { PostExposureState exposure_state; };
+
+layout(push_constant) uniform _PostCompositePCO { PostCompositePCO composite_pco; };
+
+layout(location = 0) in vec2 in_texcoord;
+
+layout(location = 0) out vec4 out_color;
+
+// the lut is authored on display encoded colors
+vec3 ApplyColorGrading(vec3 color)
+{
+    const float lut_size = float(textureSize(color_grading_lut, 0).y);
+    const vec3 lut_coord = LinearToSRGB(clamp(color, 0.0, 1.0)) * (lut_size - 1.0);
+
+    const float slice = floor(lut_coord.b);
+    const float next_slice = min(slice + 1.0, lut_size - 1.0);
+    const vec2 slice_uv = (lut_coord.rg + 0.5) / vec2(lut_size * lut_size, lut_size);
+    const vec3 graded = mix(textureLod(color_grading_lut, slice_uv + vec2(slice / lut_size, 0.0), 0.0).rgb,
+        textureLod(color_grading_lut, slice_uv + vec2(next_slice / lut_size, 0.0), 0.0).rgb, lut_coord.b - slice);
+    return SRGBToLinear(graded);
+}
+
+void main()
+{
+    vec3 color = texelFetch(scene_texture, ivec2(gl_FragCoord.xy), 0).rgb;
+
+    for (int i = 0; i < composite_pco.effect_num; ++i)
+    {
+        switch (composite_pco.effects[i])
+        {
+        case POST_EFFECT_AUTO_EXPOSURE:
+            color *= exposure_state.exposure;
+            break;
+        case POST_EFFECT_BLOOM:
+            color += textureLod(bloom_texture, in_texcoord, 0.0).rgb * composite_pco.bloom_intensity;
+            break;
+        case POST_EFFECT_TONE_MAPPING:
+            color = ACESFilmTonemap(color);
+            break;
+        case POST_EFFECT_COLOR_GRADING:
+            color = ApplyColorGrading(color);
+            break;
+        }
+    }
+
+    color = clamp(color, 0.0, 1.0);
+    if (bool(composite_pco.encode_srgb))
+    {
+        color = LinearToSRGB(color);
+    }
+    out_color = vec4(color, 1.0);
+}
@@ -0,0 +1,30 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "host_device_structs.h"
+#include "spherical_harmonics.h"
+
+layout(set = 0, binding = 0) uniform _ReflectionProbeCaptureUBO { ReflectionProbeCaptureUBO capture_ubo; };
+layout(push_constant) uniform _ReflectionProbeCapturePCO { ReflectionProbeCapturePCO capture_pco; };
+
+layout(location = 0) in vec3 in_normal;
+
+layout(location = 0) out vec4 out_color;
+
+// linear radiance like the environment map, the probe is prefiltered and tonemapped by the lighting as the sky is.
+// only the material factors are read and every surface is shaded as diffuse, metals keep their base color
+void main()
+{
+    vec3 n = normalize(in_normal);
+    vec3 irradiance = vec3(0.0);
+    if (bool(capture_ubo.has_sky_light))
+    {
+        irradiance += EvaluateSHIrradiance(capture_ubo.sky_light.irradiance_sh, n) * capture_ubo.sky_light.color;
+    }
+    if (bool(capture_ubo.has_directional_light))
+    {
+        irradiance += capture_ubo.light_color * max(dot(n, -capture_ubo.light_direction), 0.0) / PI;
+    }
+
+    out_color = vec4(capture_pco.base_color_factor.rgb * irradiance + capture_pco.emissive_factor.rgb, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "host_device_structs.h"
+
+layout(set = 0, binding = 0) uniform _ReflectionProbeCaptureUBO { ReflectionProbeCaptureUBO capture_ubo; };
+layout(push_constant) uniform _ReflectionProbeCapturePCO { ReflectionProbeCapturePCO capture_pco; };
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+
+layout(location = 0) out vec3 out_normal;
+
+void main()
+{
+    // the capture is tiny, so the normal matrix is not worth a transform buffer
+    out_normal = normalize(transpose(inverse(mat3(capture_pco.model))) * in_normal);
+    gl_Position = capture_ubo.face_view_projs[capture_pco.face] * capture_pco.model * vec4(in_position, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "host_device_structs.h"
+#include "spherical_harmonics.h"
+
+layout(set = 0, binding = 0) uniform _ReflectionProbeCaptureUBO { ReflectionProbeCaptureUBO capture_ubo; };
+layout(set = 0, binding = 1) uniform samplerCube sky_texture_sampler;
+layout(push_constant) uniform _ReflectionProbeCapturePCO { ReflectionProbeCapturePCO capture_pco; };
+
+layout(location = 0) in vec2 in_texcoord;
+
+layout(location = 0) out vec4 out_color;
+
+// background of a probe face, the texcoord of the full screen triangle is the st of the face texel
+void main()
+{
+    vec3 sky_color = vec3(0.0);
+    if (bool(capture_ubo.has_sky_light))
+    {
+        vec3 direction = CubeTexelDirection(uint(capture_pco.face), in_texcoord);
+        sky_color = textureLod(sky_texture_sampler, direction, 0.0).rgb * capture_ubo.sky_light.color;
+    }
+    out_color = vec4(sky_color, 1.0);
+}
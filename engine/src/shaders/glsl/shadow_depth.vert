@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "host_device_structs.h"
+
+// depth only, the transform into the cascade is premultiplied on the cpu
+layout(push_constant) uniform _ShadowPCO { ShadowPCO shadow_pco; };
+
+layout(location = 0) in vec3 in_position;
+
+void main()
+{
+    gl_Position = shadow_pco.model_light_view_proj * vec4(in_position, 1.0);
+}
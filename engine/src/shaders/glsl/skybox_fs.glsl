@@ -5,8 +5,17 @@
 // Environment skybox: Fragment program.
 
 layout(location=0) in vec3 localPosition;
+
 layout(location=0) out vec4 color;
 
+// only the temporal anti-aliasing variant, the msaa render pass has no motion vector attachment
+#ifdef WRITE_MOTION_VECTOR
+layout(location=1) in vec4 currentClipPosition;
+layout(location=2) in vec4 prevClipPosition;
+
+layout(location=1) out vec2 motionVector;
+#endif
+
 #if VULKAN
 layout(set=1, binding=0) uniform samplerCube envTexture;
 #else
@@ -17,4 +26,9 @@ void main()
 {
 	vec3 envVector = normalize(localPosition);
 	color = textureLod(envTexture, envVector, 0);
+
+#ifdef WRITE_MOTION_VECTOR
+	// screen uv offset to this texel from where it was in the last frame
+	motionVector = (currentClipPosition.xy / currentClipPosition.w - prevClipPosition.xy / prevClipPosition.w) * 0.5;
+#endif
 }
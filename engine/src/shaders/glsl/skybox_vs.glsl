@@ -12,13 +12,24 @@ layout(std140, binding=0) uniform TransformUniforms
 	mat4 viewProjectionMatrix;
 	mat4 skyProjectionMatrix;
 	mat4 sceneRotationMatrix;
+	// last frame without jitter, for the motion vectors
+	mat4 prevViewProjectionMatrix;
+	mat4 prevSkyProjectionMatrix;
+	mat4 prevSceneRotationMatrix;
+	vec4 jitter; // xy: sub-pixel offset of this frame's projection in ndc
 };
 
 layout(location=0) in vec3 position;
 layout(location=0) out vec3 localPosition;
+layout(location=1) out vec4 currentClipPosition;
+layout(location=2) out vec4 prevClipPosition;
 
 void main()
 {
 	localPosition = position.xyz;
 	gl_Position   = skyProjectionMatrix * vec4(position, 1.0);
+
+	// the motion is measured between the frames without their jitter
+	currentClipPosition = gl_Position - vec4(jitter.xy * gl_Position.w, 0.0, 0.0);
+	prevClipPosition = prevSkyProjectionMatrix * vec4(position, 1.0);
 }
@@ -4,14 +4,13 @@
 
 // Pre-filters environment cube map using GGX NDF importance sampling.
 // Part of specular IBL split-sum approximation.
+// Every sample reads the source mip whose texels cover the solid angle of the sample (filtered importance sampling),
+// so the sample count can follow the roughness of the level, IblPrefilter on the cpu mirrors this shader.
 
 const float PI = 3.141592;
 const float TwoPI = 2 * PI;
 const float Epsilon = 0.00001;
 
-const uint NumSamples = 1024;
-const float InvNumSamples = 1.0 / float(NumSamples);
-
 // In Vulkan whole mip tail is bound to the descriptor set and appropriate mip level is selected via a push constant.
 #if VULKAN
 layout(constant_id=0) const int NumMipLevels = 1;
@@ -31,16 +30,20 @@ layout(push_constant) uniform PushConstants
 	int level;
 	// Roughness value to pre-filter for.
 	float roughness;
+	// GGX samples per texel of this level.
+	uint sampleCount;
 } pushConstants;
 
-#define PARAM_LEVEL     pushConstants.level
-#define PARAM_ROUGHNESS pushConstants.roughness
+#define PARAM_LEVEL        pushConstants.level
+#define PARAM_ROUGHNESS    pushConstants.roughness
+#define PARAM_SAMPLE_COUNT pushConstants.sampleCount
 #else
 // Roughness value to pre-filter for.
 layout(location=0) uniform float roughness;
 
-#define PARAM_LEVEL     0
-#define PARAM_ROUGHNESS roughness
+#define PARAM_LEVEL        0
+#define PARAM_ROUGHNESS    roughness
+#define PARAM_SAMPLE_COUNT 1024u
 #endif // VULKAN
 
 // Compute Van der Corput radical inverse
@@ -55,10 +58,10 @@ float radicalInverse_VdC(uint bits)
 	return float(bits) * 2.3283064365386963e-10; // / 0x100000000
 }
 
-// Sample i-th point from Hammersley point set of NumSamples points total.
-vec2 sampleHammersley(uint i)
+// Sample i-th point from Hammersley point set of numSamples points total.
+vec2 sampleHammersley(uint i, uint numSamples)
 {
-	return vec2(i * InvNumSamples, radicalInverse_VdC(i));
+	return vec2(float(i) / float(numSamples), radicalInverse_VdC(i));
 }
 
 // Importance sample GGX normal distribution function for a fixed roughness value.
@@ -150,8 +153,8 @@ void main(void)
 
 	// Convolve environment map using GGX NDF importance sampling.
 	// Weight by cosine term since Epic claims it generally improves quality.
-	for(uint i=0; i<NumSamples; ++i) {
-		vec2 u = sampleHammersley(i);
+	for(uint i=0; i<PARAM_SAMPLE_COUNT; ++i) {
+		vec2 u = sampleHammersley(i, PARAM_SAMPLE_COUNT);
 		vec3 Lh = tangentToWorld(sampleGGX(u.x, u.y, PARAM_ROUGHNESS), N, S, T);
 
 		// Compute incident direction (Li) by reflecting viewing direction (Lo) around half-vector (Lh).
@@ -169,7 +172,7 @@ void main(void)
 			float pdf = ndfGGX(cosLh, PARAM_ROUGHNESS) * 0.25;
 
 			// Solid angle associated with this sample.
-			float ws = 1.0 / (NumSamples * pdf);
+			float ws = 1.0 / (float(PARAM_SAMPLE_COUNT) * pdf);
 
 			// Mip level to sample from.
 			float mipLevel = max(0.5 * log2(ws / wt) + 1.0, 0.0);
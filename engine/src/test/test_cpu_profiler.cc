@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include "runtime/core/profile/cpu_profiler.h"
+
+#ifdef PEANUT_ENABLE_PROFILER
+
+#include <json11.hpp>
+#include <thread>
+#include <vector>
+
+using namespace peanut;
+
+TEST(CpuProfilerTest, RingDropsEventsWhenFull) {
+  CpuProfileRing ring(3);
+  EXPECT_EQ(ring.GetCapacity(), 4u);
+
+  for (uint64_t i = 0; i < 6; ++i) {
+    ring.Push({"zone", 0, i, i + 1});
+  }
+  EXPECT_EQ(ring.GetDroppedCount(), 2u);
+
+  std::vector<CpuProfileEvent> events;
+  EXPECT_EQ(ring.Drain(events), 4u);
+  ASSERT_EQ(events.size(), 4u);
+  EXPECT_EQ(events.front().start_ns, 0u);
+  EXPECT_EQ(events.back().start_ns, 3u);
+
+  // drained slots are free again
+  EXPECT_TRUE(ring.Push({"zone", 0, 10, 11}));
+  events.clear();
+  EXPECT_EQ(ring.Drain(events), 1u);
+  EXPECT_EQ(events[0].start_ns, 10u);
+}
+
+TEST(CpuProfilerTest, RingKeepsOrderAcrossThreads) {
+  CpuProfileRing ring(64);
+  constexpr uint64_t kEventCount = 100000;
+
+  std::thread producer([&ring]() {
+    for (uint64_t i = 0; i < kEventCount; ++i) {
+      while (!ring.Push({"zone", 1, i, i})) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::vector<CpuProfileEvent> events;
+  while (events.size() < kEventCount) {
+    ring.Drain(events);
+  }
+  producer.join();
+
+  for (uint64_t i = 0; i < kEventCount; ++i) {
+    ASSERT_EQ(events[i].start_ns, i);
+  }
+}
+
+TEST(CpuProfilerTest, FindsLongestZonesOfFrame) {
+  const std::vector<CpuProfileEvent> events = {
+      {"before", 0, 0, 90},       // ends before the frame
+      {"short", 0, 100, 110},
+      {"load_mesh", 1, 120, 400},
+      {"record", 0, 150, 200},
+      {"straddle", 0, 50, 130},   // starts in the previous frame
+  };
+
+  const std::vector<CpuProfileEvent> longest =
+      CpuProfiler::FindLongestZones(events, 100, 500, 3);
+  ASSERT_EQ(longest.size(), 3u);
+  EXPECT_STREQ(longest[0].name, "load_mesh");
+  EXPECT_STREQ(longest[1].name, "straddle");
+  EXPECT_STREQ(longest[2].name, "record");
+}
+
+TEST(CpuProfilerTest, FormatsChromeTrace) {
+  const std::vector<CpuProfileEvent> events = {{"RenderSystem::Tick", 1, 2000, 5000}};
+  const std::vector<CpuProfileFrame> frames = {{0, 1, 1000, 9000}};
+
+  std::string error;
+  const json11::Json trace = json11::Json::parse(
+      CpuProfiler::FormatChromeTrace(events, frames, {"", "Main"}), error);
+  ASSERT_TRUE(error.empty()) << error;
+
+  const json11::Json::array& trace_events = trace["traceEvents"].array_items();
+  ASSERT_EQ(trace_events.size(), 4u);
+  EXPECT_EQ(trace_events[0]["args"]["name"].string_value(), "thread 0");
+  EXPECT_EQ(trace_events[1]["args"]["name"].string_value(), "Main");
+  EXPECT_EQ(trace_events[2]["name"].string_value(), "Frame");
+  EXPECT_DOUBLE_EQ(trace_events[2]["dur"].number_value(), 8.0);
+  EXPECT_EQ(trace_events[3]["name"].string_value(), "RenderSystem::Tick");
+  EXPECT_EQ(trace_events[3]["tid"].int_value(), 1);
+  EXPECT_DOUBLE_EQ(trace_events[3]["ts"].number_value(), 2.0);
+  EXPECT_DOUBLE_EQ(trace_events[3]["dur"].number_value(), 3.0);
+}
+
+#endif  // PEANUT_ENABLE_PROFILER
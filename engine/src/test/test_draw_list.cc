@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "runtime/functions/render/draw_list.h"
+
+using namespace peanut;
+
+TEST(DrawListTest, RadixSortMatchesStableSort) {
+  std::mt19937_64 rng(7);
+  std::vector<DrawSortEntry> entries(5000);
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    // few distinct keys so the stability is exercised
+    entries[i] = {(rng() % 64) << 40 | (rng() % 4), i};
+  }
+
+  std::vector<DrawSortEntry> expected = entries;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const DrawSortEntry& lhs, const DrawSortEntry& rhs) {
+                     return lhs.key < rhs.key;
+                   });
+
+  std::vector<DrawSortEntry> scratch;
+  DrawList::RadixSort(entries, scratch);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    ASSERT_EQ(entries[i].key, expected[i].key);
+    ASSERT_EQ(entries[i].index, expected[i].index);
+  }
+}
+
+TEST(DrawListTest, OpaqueDrawsGroupByPipelineThenFrontToBack) {
+  DrawList draw_list(DrawSortOrder::FrontToBack);
+  const auto* mesh = reinterpret_cast<const StaticMeshRenderData*>(0x10);
+  draw_list.Add({mesh, 0, 1}, 0, 1, 10.0f);
+  draw_list.Add({mesh, 1, 0}, 0, 1, 50.0f);
+  draw_list.Add({mesh, 2, 0}, 0, 1, 5.0f);
+  draw_list.Add({mesh, 3, 0}, 0, 1, -1.0f);  // behind the camera
+  draw_list.Sort();
+
+  const std::vector<MeshDrawCommand>& commands = draw_list.GetCommands();
+  ASSERT_EQ(commands.size(), 4u);
+  EXPECT_EQ(commands[0].submesh_index, 3u);
+  EXPECT_EQ(commands[1].submesh_index, 2u);
+  EXPECT_EQ(commands[2].submesh_index, 1u);
+  EXPECT_EQ(commands[3].submesh_index, 0u);
+}
+
+TEST(DrawListTest, TransparentDrawsSortBackToFront) {
+  DrawList draw_list(DrawSortOrder::BackToFront);
+  const auto* near_mesh = reinterpret_cast<const StaticMeshRenderData*>(0x10);
+  const auto* far_mesh = reinterpret_cast<const StaticMeshRenderData*>(0x20);
+  draw_list.Add({near_mesh, 0, 0}, 2, 1, 1.5f);
+  draw_list.Add({far_mesh, 0, 3}, 2, 2, 100.0f);
+  draw_list.Add({near_mesh, 1, 1}, 2, 1, 1.25f);
+  draw_list.Sort();
+
+  const std::vector<MeshDrawCommand>& commands = draw_list.GetCommands();
+  ASSERT_EQ(commands.size(), 3u);
+  EXPECT_EQ(commands[0].mesh, far_mesh);
+  EXPECT_EQ(commands[1].submesh_index, 0u);
+  EXPECT_EQ(commands[2].submesh_index, 1u);
+
+  // a lower pass always comes first regardless of depth
+  EXPECT_LT(DrawList::MakeBackToFrontKey(0, 0, 0, 0, 1.0f),
+            DrawList::MakeBackToFrontKey(1, 0, 0, 0, 1000.0f));
+}
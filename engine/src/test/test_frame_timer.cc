@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "runtime/core/time/frame_timer.h"
+
+using namespace peanut;
+
+TEST(FrameTimerTest, RollingStatsOverWindow) {
+  FrameTimer timer(100);
+  // 99 smooth frames and one hitch, then the window rolls past an early outlier
+  timer.AddFrameTime(500.0);
+  for (int i = 0; i < 99; ++i) {
+    timer.AddFrameTime(10.0);
+  }
+  timer.AddFrameTime(40.0);
+
+  const FrameTimeStats stats = timer.GetStats();
+  EXPECT_EQ(stats.frame_count, 100u);
+  EXPECT_DOUBLE_EQ(stats.min_ms, 10.0);
+  EXPECT_DOUBLE_EQ(stats.max_ms, 40.0);
+  EXPECT_DOUBLE_EQ(stats.avg_ms, (99 * 10.0 + 40.0) / 100.0);
+  // nearest rank: the 99th of 100 sorted samples
+  EXPECT_DOUBLE_EQ(stats.p99_ms, 10.0);
+  EXPECT_EQ(timer.GetFrameIndex(), 101u);
+}
+
+TEST(FrameTimerTest, HistogramAndClampedDeltaTime) {
+  FrameTimer timer;
+  timer.AddFrameTime(1.0);
+  timer.AddFrameTime(16.0);
+  timer.AddFrameTime(16.7);
+  timer.AddFrameTime(1000.0);
+
+  const auto& histogram = timer.GetHistogram();
+  EXPECT_EQ(histogram[0], 1u);   // up to 2ms
+  EXPECT_EQ(histogram[7], 2u);   // 14 - 16.7ms, the bound is inclusive
+  EXPECT_EQ(histogram.back(), 1u);
+
+  // a one second stall is clamped so the simulation does not jump
+  EXPECT_FLOAT_EQ(timer.GetDeltaTime(), 0.25f);
+}
+
+TEST(FrameTimerTest, LimiterPacesFrames) {
+  FrameLimiter limiter;
+  limiter.SetTargetFps(200.0);
+
+  const auto start = std::chrono::steady_clock::now();
+  limiter.Wait();  // starts the schedule
+  for (int i = 0; i < 10; ++i) {
+    limiter.Wait();
+  }
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+
+  // 10 intervals of 5ms, generous upper bound for loaded CI machines
+  EXPECT_GE(elapsed_ms, 49.0);
+  EXPECT_LT(elapsed_ms, 200.0);
+}
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+
+#include "runtime/functions/rhi/frame_uniform_allocator.h"
+
+using namespace peanut;
+
+TEST(FrameUniformAllocatorTest, AlignsAllocationsInsideTheFrameRegion) {
+  FrameUniformAllocator allocator;
+  allocator.SetLayout(1000, 3, 256);
+  EXPECT_EQ(allocator.GetFrameCapacity(), 1024u);
+
+  allocator.BeginFrame(1);
+  UniformBufferAllocation first;
+  UniformBufferAllocation second;
+  ASSERT_TRUE(allocator.Allocate(192, first));
+  ASSERT_TRUE(allocator.Allocate(192, second));
+  EXPECT_EQ(first.descriptor_info.offset, 1024u);
+  EXPECT_EQ(first.descriptor_info.range, 192u);
+  EXPECT_EQ(second.descriptor_info.offset, 1280u);
+  EXPECT_EQ(allocator.GetUsedSize(), 512u);
+}
+
+TEST(FrameUniformAllocatorTest, RewindsWhenTheSlotComesAround) {
+  FrameUniformAllocator allocator;
+  allocator.SetLayout(512, 2, 256);
+
+  UniformBufferAllocation allocation;
+  allocator.BeginFrame(0);
+  ASSERT_TRUE(allocator.Allocate(256, allocation));
+  ASSERT_TRUE(allocator.Allocate(256, allocation));
+  EXPECT_EQ(allocator.GetUsedSize(), allocator.GetFrameCapacity());
+
+  allocator.BeginFrame(1);
+  ASSERT_TRUE(allocator.Allocate(16, allocation));
+  EXPECT_EQ(allocation.descriptor_info.offset, 512u);
+
+  allocator.BeginFrame(2);
+  EXPECT_EQ(allocator.GetUsedSize(), 0u);
+  ASSERT_TRUE(allocator.Allocate(16, allocation));
+  EXPECT_EQ(allocation.descriptor_info.offset, 0u);
+}
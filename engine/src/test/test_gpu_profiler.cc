@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include <json11.hpp>
+#include <vector>
+
+#include "runtime/functions/rhi/gpu_profiler.h"
+
+using namespace peanut;
+
+TEST(GpuProfilerTest, ResolvesNestedScopes) {
+  std::vector<GpuScopeRecord> scopes = {
+      {"frame", 0, 0, 1},
+      {"gbuffer", 1, 2, 3},
+  };
+  // 2ns per tick, the inner scope is recorded after the outer one begins
+  const std::vector<uint64_t> timestamps = {1000, 1600, 1100, 1350};
+
+  uint64_t origin = 0;
+  std::vector<GpuProfileEvent> events;
+  GpuProfiler::ResolveScopes(scopes, timestamps, 2.0, ~0ull, 7, origin, events);
+
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(origin, 1000u);
+  EXPECT_EQ(events[0].name, "frame");
+  EXPECT_EQ(events[0].frame, 7u);
+  EXPECT_DOUBLE_EQ(events[0].start_ms, 0.0);
+  EXPECT_DOUBLE_EQ(events[0].duration_ms, 600 * 2.0 / 1e6);
+  EXPECT_EQ(events[1].depth, 1u);
+  EXPECT_DOUBLE_EQ(events[1].start_ms, 100 * 2.0 / 1e6);
+  EXPECT_DOUBLE_EQ(events[1].duration_ms, 250 * 2.0 / 1e6);
+}
+
+TEST(GpuProfilerTest, MasksInvalidBitsAndSkipsMissingQueries) {
+  std::vector<GpuScopeRecord> scopes = {
+      {"masked", 0, 0, 1},
+      {"missing", 0, 2, 3},
+  };
+  // only the low 32 bits are meaningful, the upper bits are garbage
+  const std::vector<uint64_t> timestamps = {0xabcd000000000010ull,
+                                            0x1234000000000030ull};
+
+  uint64_t origin = 0x8;
+  std::vector<GpuProfileEvent> events;
+  GpuProfiler::ResolveScopes(scopes, timestamps, 1.0, 0xffffffffull, 0, origin,
+                             events);
+
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(origin, 0x8u);
+  EXPECT_DOUBLE_EQ(events[0].start_ms, 8 / 1e6);
+  EXPECT_DOUBLE_EQ(events[0].duration_ms, 32 / 1e6);
+}
+
+TEST(GpuProfilerTest, FormatsChromeTrace) {
+  GpuProfileEvent event;
+  event.name = "brdf_lut";
+  event.frame = 3;
+  event.start_ms = 1.5;
+  event.duration_ms = 0.25;
+
+  std::string error;
+  const json11::Json trace =
+      json11::Json::parse(GpuProfiler::FormatChromeTrace({event}), error);
+  ASSERT_TRUE(error.empty()) << error;
+
+  const json11::Json::array& trace_events = trace["traceEvents"].array_items();
+  ASSERT_EQ(trace_events.size(), 1u);
+  EXPECT_EQ(trace_events[0]["name"].string_value(), "brdf_lut");
+  EXPECT_EQ(trace_events[0]["ph"].string_value(), "X");
+  EXPECT_DOUBLE_EQ(trace_events[0]["ts"].number_value(), 1500.0);
+  EXPECT_DOUBLE_EQ(trace_events[0]["dur"].number_value(), 250.0);
+  EXPECT_EQ(trace_events[0]["args"]["frame"].int_value(), 3);
+}
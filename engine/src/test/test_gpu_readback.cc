@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "runtime/functions/rhi/gpu_readback.h"
+
+using namespace peanut;
+
+TEST(GpuReadbackTest, PacksMipLevelsWithAlignedOffsets) {
+  ReadbackImageDesc desc;
+  desc.width = 5;
+  desc.height = 3;
+  desc.layers = 6;
+  desc.levels = 3;
+  desc.bytes_per_pixel = 2;
+
+  std::vector<ReadbackSubresource> subresources;
+  const VkDeviceSize size = GpuReadback::ComputeImageLayout(desc, subresources);
+
+  ASSERT_EQ(subresources.size(), 3u);
+  EXPECT_EQ(subresources[0].offset, 0u);
+  EXPECT_EQ(subresources[0].layer_size, 5u * 3u * 2u);
+
+  // level 1 is 2x1, 180 bytes of level 0 are already a multiple of 4
+  EXPECT_EQ(subresources[1].width, 2u);
+  EXPECT_EQ(subresources[1].height, 1u);
+  EXPECT_EQ(subresources[1].offset, 180u);
+
+  // level 2 is clamped to 1x1 and starts at the next multiple of 4 after 180 + 6 * 4
+  EXPECT_EQ(subresources[2].width, 1u);
+  EXPECT_EQ(subresources[2].height, 1u);
+  EXPECT_EQ(subresources[2].offset, 204u);
+  EXPECT_EQ(size, 204u + 6u * 2u);
+}
+
+TEST(GpuReadbackTest, StartsAtBaseLevel) {
+  ReadbackImageDesc desc;
+  desc.width = 64;
+  desc.height = 32;
+  desc.base_level = 2;
+  desc.levels = 1;
+  desc.bytes_per_pixel = 8;
+
+  std::vector<ReadbackSubresource> subresources;
+  EXPECT_EQ(GpuReadback::ComputeImageLayout(desc, subresources), 16u * 8u * 8u);
+  ASSERT_EQ(subresources.size(), 1u);
+  EXPECT_EQ(subresources[0].level, 2u);
+
+  desc.bytes_per_pixel = 0;
+  EXPECT_EQ(GpuReadback::ComputeImageLayout(desc, subresources), 0u);
+  EXPECT_TRUE(subresources.empty());
+}
+
+TEST(GpuReadbackTest, PoolsStagingBuffersInPowerOfTwoSizes) {
+  EXPECT_EQ(GpuReadback::GetStagingBufferSize(1), 64u * 1024u);
+  EXPECT_EQ(GpuReadback::GetStagingBufferSize(64 * 1024), 64u * 1024u);
+  EXPECT_EQ(GpuReadback::GetStagingBufferSize(64 * 1024 + 1), 128u * 1024u);
+  EXPECT_EQ(GpuReadback::GetStagingBufferSize(1280 * 720 * 4), 4u * 1024u * 1024u);
+
+  EXPECT_EQ(GpuReadback::GetFormatTexelSize(VK_FORMAT_B8G8R8A8_UNORM), 4u);
+  EXPECT_EQ(GpuReadback::GetFormatTexelSize(VK_FORMAT_R16G16B16A16_SFLOAT), 8u);
+  EXPECT_EQ(GpuReadback::GetFormatTexelSize(VK_FORMAT_BC7_UNORM_BLOCK), 0u);
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include "runtime/functions/render/ibl_cache.h"
+
+using namespace peanut;
+
+namespace {
+
+IblCacheTexture MakeTexture(uint32_t size, uint32_t layers, uint32_t levels, VkFormat format, uint8_t seed) {
+  IblCacheTexture texture;
+  texture.width = size;
+  texture.height = size;
+  texture.layers = layers;
+  texture.levels = levels;
+  texture.format = format;
+  texture.data.resize(IblCache::GetTextureDataSize(size, size, layers, levels, format));
+  for (size_t i = 0; i < texture.data.size(); ++i) {
+    texture.data[i] = static_cast<uint8_t>(i * 31 + seed);
+  }
+  return texture;
+}
+
+IblCacheData MakeCacheData() {
+  IblCacheData cache_data;
+  cache_data.environment_map = MakeTexture(64, 6, 7, VK_FORMAT_R16G16B16A16_SFLOAT, 1);
+  for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i) {
+    cache_data.irradiance_sh[i] = glm::vec4(0.1f * i, 0.2f * i, 0.3f * i, 0.0f);
+  }
+  cache_data.filtered_texture = MakeTexture(64, 6, 7, VK_FORMAT_R16G16B16A16_SFLOAT, 3);
+  cache_data.brdf_lut = MakeTexture(128, 1, 1, VK_FORMAT_R16G16_SFLOAT, 4);
+  return cache_data;
+}
+
+}  // namespace
+
+TEST(IblCacheTest, RoundTripsEveryTexture) {
+  const IblCacheData cache_data = MakeCacheData();
+  std::vector<char> data;
+  IblCache::Serialize(42, cache_data, data);
+
+  IblCacheData loaded;
+  ASSERT_TRUE(IblCache::Deserialize(data, 42, loaded));
+  EXPECT_EQ(loaded.environment_map.levels, 7u);
+  EXPECT_EQ(loaded.environment_map.data, cache_data.environment_map.data);
+  EXPECT_EQ(loaded.irradiance_sh, cache_data.irradiance_sh);
+  EXPECT_EQ(loaded.filtered_texture.data, cache_data.filtered_texture.data);
+  EXPECT_EQ(loaded.brdf_lut.format, VK_FORMAT_R16G16_SFLOAT);
+  EXPECT_EQ(loaded.brdf_lut.data, cache_data.brdf_lut.data);
+}
+
+TEST(IblCacheTest, RejectsOtherKeysAndBrokenFiles) {
+  std::vector<char> data;
+  IblCache::Serialize(42, MakeCacheData(), data);
+
+  IblCacheData loaded;
+  EXPECT_FALSE(IblCache::Deserialize(data, 43, loaded));
+
+  std::vector<char> truncated(data.begin(), data.end() - 1);
+  EXPECT_FALSE(IblCache::Deserialize(truncated, 42, loaded));
+
+  std::vector<char> extended = data;
+  extended.push_back(0);
+  EXPECT_FALSE(IblCache::Deserialize(extended, 42, loaded));
+
+  EXPECT_FALSE(IblCache::Deserialize(std::vector<char>(), 42, loaded));
+}
+
+TEST(IblCacheTest, TextureSizeFollowsTheMipChain) {
+  // 4x4 + 2x2 + 1x1 texels of 8 bytes on 6 faces
+  EXPECT_EQ(IblCache::GetTextureDataSize(4, 4, 6, 3, VK_FORMAT_R16G16B16A16_SFLOAT), 21u * 8u * 6u);
+  EXPECT_EQ(IblCache::GetTextureDataSize(4, 4, 1, 1, VK_FORMAT_UNDEFINED), 0u);
+}
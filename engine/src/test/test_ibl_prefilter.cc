@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "runtime/functions/render/ibl_prefilter.h"
+#include "runtime/functions/render/spherical_harmonics.h"
+
+using namespace peanut;
+
+namespace {
+
+// a dim sky with a small bright sun, the hard case for few samples
+std::vector<CubeMapLevel> MakeEnvironment(uint32_t size) {
+  std::vector<CubeMapLevel> levels(1);
+  levels[0].size = size;
+  const glm::vec3 sun_dir = glm::normalize(glm::vec3(0.3f, 0.8f, 0.5f));
+  for (uint32_t face = 0; face < 6; ++face) {
+    for (uint32_t y = 0; y < size; ++y) {
+      for (uint32_t x = 0; x < size; ++x) {
+        const glm::vec2 st = (glm::vec2(x, y) + 0.5f) / static_cast<float>(size);
+        const glm::vec3 dir = SphericalHarmonics::GetCubeTexelDirection(face, st);
+        const float sun = glm::dot(dir, sun_dir) > 0.97f ? 20.0f : 0.0f;
+        levels[0].texels.push_back(glm::vec4(glm::vec3(0.2f + 0.3f * dir.y + sun), 1.0f));
+      }
+    }
+  }
+  IblPrefilter::BuildMipChain(levels);
+  return levels;
+}
+
+std::vector<glm::vec3> PrefilterLevel(const std::vector<CubeMapLevel>& levels, uint32_t size, float roughness,
+                                      uint32_t sample_count) {
+  std::vector<glm::vec3> image;
+  for (uint32_t face = 0; face < 6; ++face) {
+    for (uint32_t y = 0; y < size; ++y) {
+      for (uint32_t x = 0; x < size; ++x) {
+        const glm::vec2 st = (glm::vec2(x, y) + 0.5f) / static_cast<float>(size);
+        image.push_back(IblPrefilter::Prefilter(levels, SphericalHarmonics::GetCubeTexelDirection(face, st), roughness,
+                                                sample_count));
+      }
+    }
+  }
+  return image;
+}
+
+}  // namespace
+
+TEST(IblPrefilterTest, SampleCountGrowsWithRoughness) {
+  EXPECT_EQ(IblPrefilter::GetSampleCount(0.0f), IblPrefilter::kMinSampleCount);
+  EXPECT_EQ(IblPrefilter::GetSampleCount(1.0f), IblPrefilter::kMaxSampleCount);
+  EXPECT_LT(IblPrefilter::GetSampleCount(0.2f), IblPrefilter::GetSampleCount(0.6f));
+}
+
+TEST(IblPrefilterTest, CubeMapLookupHitsTexelCenters) {
+  const std::vector<CubeMapLevel> levels = MakeEnvironment(8);
+  for (uint32_t face = 0; face < 6; ++face) {
+    const glm::vec2 st(2.5f / 8.0f, 5.5f / 8.0f);
+    const glm::vec3 sampled = IblPrefilter::SampleCubeMap(levels, SphericalHarmonics::GetCubeTexelDirection(face, st), 0.0f);
+    EXPECT_LT(glm::distance(sampled, glm::vec3(levels[0].texels[(face * 8 + 5) * 8 + 2])), 1e-4f);
+  }
+}
+
+// image diff of the reduced sample counts against the fixed 1024 samples of the previous prefilter
+TEST(IblPrefilterTest, ReducedSampleCountsMatchTheReference) {
+  const std::vector<CubeMapLevel> levels = MakeEnvironment(64);
+  const uint32_t level_num = static_cast<uint32_t>(levels.size());
+
+  for (uint32_t level : {1u, 3u, 5u}) {
+    const float roughness = static_cast<float>(level) / static_cast<float>(level_num - 1);
+    const uint32_t size = levels[0].size >> level;
+    const std::vector<glm::vec3> reference = PrefilterLevel(levels, size, roughness, IblPrefilter::kReferenceSampleCount);
+    const std::vector<glm::vec3> image = PrefilterLevel(levels, size, roughness, IblPrefilter::GetSampleCount(roughness));
+    EXPECT_LT(IblPrefilter::ComputeRelativeError(image, reference), 0.04f) << "level " << level;
+  }
+}
@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "runtime/functions/render/render_pass/light_culling_pass.h"
+
+using namespace peanut;
+
+namespace {
+
+LightingUBO MakeLightingUBO(float near_depth, float far_depth) {
+  LightingUBO lighting_ubo = {};
+  const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, near_depth, far_depth);
+  lighting_ubo.inv_camera_proj = glm::inverse(proj);
+  return lighting_ubo;
+}
+
+}  // namespace
+
+TEST(LightCullingTest, RecoversNearAndFarFromTheProjection) {
+  LightingUBO lighting_ubo = MakeLightingUBO(0.1f, 100.0f);
+  LightCullingPass::FillClusterParams(lighting_ubo);
+
+  EXPECT_NEAR(lighting_ubo.cluster_params.x, 0.1f, 1e-4f);
+  EXPECT_NEAR(lighting_ubo.cluster_params.y, 100.0f, 0.1f);
+}
+
+TEST(LightCullingTest, SlicesDepthExponentially) {
+  LightingUBO lighting_ubo = MakeLightingUBO(0.1f, 100.0f);
+  LightCullingPass::FillClusterParams(lighting_ubo);
+  const glm::vec4 params = lighting_ubo.cluster_params;
+
+  EXPECT_EQ(LightCullingPass::GetClusterDepthSlice(0.01f, params), 0u);
+  EXPECT_EQ(LightCullingPass::GetClusterDepthSlice(0.11f, params), 0u);
+  EXPECT_EQ(LightCullingPass::GetClusterDepthSlice(1000.0f, params), LIGHT_CLUSTER_Z - 1u);
+
+  // every slice covers the same depth ratio, so the geometric middle of the range is the middle slice
+  const float middle_depth = std::sqrt(0.1f * 100.0f) * 1.01f;
+  EXPECT_EQ(LightCullingPass::GetClusterDepthSlice(middle_depth, params), LIGHT_CLUSTER_Z / 2u);
+
+  uint32_t previous_slice = 0;
+  for (float depth = 0.1f; depth < 100.0f; depth *= 1.1f) {
+    const uint32_t slice = LightCullingPass::GetClusterDepthSlice(depth, params);
+    EXPECT_GE(slice, previous_slice);
+    previous_slice = slice;
+  }
+}
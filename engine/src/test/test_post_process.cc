@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "runtime/functions/render/render_pass/post_process_pass.h"
+
+using namespace peanut;
+
+namespace {
+
+constexpr float kMinLogLuminance = -8.0f;
+constexpr float kLogLuminanceRange = 12.0f;
+
+}  // namespace
+
+TEST(PostProcessTest, EffectsKeepTheirOrderWithoutRepeats) {
+  const std::vector<PostProcessEffect> effects = {PostProcessEffect::ToneMapping, PostProcessEffect::Bloom,
+                                                  PostProcessEffect::ToneMapping, PostProcessEffect::AutoExposure};
+  const std::vector<PostProcessEffect> expected = {PostProcessEffect::ToneMapping, PostProcessEffect::Bloom,
+                                                   PostProcessEffect::AutoExposure};
+  EXPECT_EQ(PostProcessPass::ResolveEffects(effects, true), expected);
+  EXPECT_TRUE(PostProcessPass::ResolveEffects({}, true).empty());
+}
+
+TEST(PostProcessTest, ColorGradingNeedsALut) {
+  const std::vector<PostProcessEffect> effects = {PostProcessEffect::ToneMapping, PostProcessEffect::ColorGrading};
+  EXPECT_EQ(PostProcessPass::ResolveEffects(effects, true).size(), 2u);
+
+  const std::vector<PostProcessEffect> without_lut = PostProcessPass::ResolveEffects(effects, false);
+  ASSERT_EQ(without_lut.size(), 1u);
+  EXPECT_EQ(without_lut[0], PostProcessEffect::ToneMapping);
+}
+
+TEST(PostProcessTest, BloomLevelsStopAtOneTexel) {
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(1920, 1080, BLOOM_MAX_LEVELS), static_cast<uint32_t>(BLOOM_MAX_LEVELS));
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(1920, 1080, 3), 3u);
+  // more levels than the shaders support are clamped
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(4096, 4096, 32), static_cast<uint32_t>(BLOOM_MAX_LEVELS));
+  // 8x8 halves to 4, 2 and 1
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(8, 8, BLOOM_MAX_LEVELS), 3u);
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(64, 2, BLOOM_MAX_LEVELS), 1u);
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(1, 1080, BLOOM_MAX_LEVELS), 0u);
+  EXPECT_EQ(PostProcessPass::GetBloomLevelCount(1920, 1080, 0), 0u);
+}
+
+TEST(PostProcessTest, HistogramBinsCoverTheLogRange) {
+  // bin 0 is reserved for texels darker than the range
+  EXPECT_EQ(PostProcessPass::GetHistogramBin(0.0f, kMinLogLuminance, kLogLuminanceRange), 0u);
+  EXPECT_EQ(PostProcessPass::GetHistogramBin(std::exp2(-9.0f), kMinLogLuminance, kLogLuminanceRange), 0u);
+
+  EXPECT_EQ(PostProcessPass::GetHistogramBin(std::exp2(kMinLogLuminance), kMinLogLuminance, kLogLuminanceRange), 1u);
+  EXPECT_EQ(PostProcessPass::GetHistogramBin(std::exp2(4.0f), kMinLogLuminance, kLogLuminanceRange),
+            static_cast<uint32_t>(LUMINANCE_HISTOGRAM_BIN_NUM - 1));
+  // brighter texels are clamped into the last bin
+  EXPECT_EQ(PostProcessPass::GetHistogramBin(1.0e6f, kMinLogLuminance, kLogLuminanceRange),
+            static_cast<uint32_t>(LUMINANCE_HISTOGRAM_BIN_NUM - 1));
+
+  const uint32_t mid_bin = PostProcessPass::GetHistogramBin(std::exp2(-2.0f), kMinLogLuminance, kLogLuminanceRange);
+  EXPECT_EQ(mid_bin, 128u);
+}
+
+TEST(PostProcessTest, AverageLuminanceOfAUniformImage) {
+  for (float luminance : {0.01f, 0.18f, 1.0f, 8.0f}) {
+    std::array<uint32_t, LUMINANCE_HISTOGRAM_BIN_NUM> histogram = {};
+    histogram[PostProcessPass::GetHistogramBin(luminance, kMinLogLuminance, kLogLuminanceRange)] = 1000;
+
+    const float average = PostProcessPass::ComputeAverageLuminance(histogram, 1000, kMinLogLuminance, kLogLuminanceRange);
+    // a bin spans 12 / 254 stops
+    EXPECT_NEAR(std::log2(average), std::log2(luminance), kLogLuminanceRange / (LUMINANCE_HISTOGRAM_BIN_NUM - 2));
+  }
+}
+
+TEST(PostProcessTest, AverageLuminanceSkipsDarkTexels) {
+  std::array<uint32_t, LUMINANCE_HISTOGRAM_BIN_NUM> histogram = {};
+  histogram[0] = 900;
+  const uint32_t bin = PostProcessPass::GetHistogramBin(1.0f, kMinLogLuminance, kLogLuminanceRange);
+  histogram[bin] = 100;
+
+  const float average = PostProcessPass::ComputeAverageLuminance(histogram, 1000, kMinLogLuminance, kLogLuminanceRange);
+  EXPECT_NEAR(std::log2(average), 0.0f, kLogLuminanceRange / (LUMINANCE_HISTOGRAM_BIN_NUM - 2));
+
+  // an all dark image averages to the bottom of the range
+  std::array<uint32_t, LUMINANCE_HISTOGRAM_BIN_NUM> dark_histogram = {};
+  dark_histogram[0] = 1000;
+  EXPECT_FLOAT_EQ(PostProcessPass::ComputeAverageLuminance(dark_histogram, 1000, kMinLogLuminance, kLogLuminanceRange),
+                  std::exp2(kMinLogLuminance));
+}
+
+TEST(PostProcessTest, LuminanceAdaptsOverTime) {
+  // the first measurement is taken as is
+  EXPECT_FLOAT_EQ(PostProcessPass::AdaptLuminance(0.0f, 2.0f, 0.016f, 1.5f), 2.0f);
+
+  const float adapted = PostProcessPass::AdaptLuminance(1.0f, 2.0f, 0.016f, 1.5f);
+  EXPECT_GT(adapted, 1.0f);
+  EXPECT_LT(adapted, 2.0f);
+  EXPECT_FLOAT_EQ(PostProcessPass::AdaptLuminance(1.0f, 2.0f, 0.0f, 1.5f), 1.0f);
+  EXPECT_NEAR(PostProcessPass::AdaptLuminance(1.0f, 2.0f, 100.0f, 1.5f), 2.0f, 1.0e-5f);
+
+  // two half steps end where one full step does
+  const float half_step = PostProcessPass::AdaptLuminance(1.0f, 2.0f, 0.5f, 1.5f);
+  EXPECT_NEAR(PostProcessPass::AdaptLuminance(half_step, 2.0f, 0.5f, 1.5f),
+              PostProcessPass::AdaptLuminance(1.0f, 2.0f, 1.0f, 1.5f), 1.0e-5f);
+}
+
+TEST(PostProcessTest, ExposureMapsTheAverageToMiddleGray) {
+  EXPECT_FLOAT_EQ(PostProcessPass::ComputeExposure(0.18f, 0.0f), 1.0f);
+  EXPECT_FLOAT_EQ(PostProcessPass::ComputeExposure(0.18f * 4.0f, 0.0f), 0.25f);
+  // compensation is in stops
+  EXPECT_FLOAT_EQ(PostProcessPass::ComputeExposure(0.18f, 1.0f), 2.0f);
+  EXPECT_FLOAT_EQ(PostProcessPass::ComputeExposure(0.18f, -2.0f), 0.25f);
+}
+
+TEST(PostProcessTest, BloomLevelsOfTheSettingsRunWithinTheAllocatedChain) {
+  // the chain is allocated for the most levels the size allows, whatever the settings
+  const uint32_t allocated_levels = PostProcessPass::GetBloomLevelCount(1920, 1080, BLOOM_MAX_LEVELS);
+  ASSERT_GT(allocated_levels, 3u);
+
+  PostProcessSettings settings;
+  EXPECT_EQ(PostProcessPass::GetActiveBloomLevelCount(settings, 1920, 1080, allocated_levels), allocated_levels);
+
+  settings.bloom_levels = 3;
+  EXPECT_EQ(PostProcessPass::GetActiveBloomLevelCount(settings, 1920, 1080, allocated_levels), 3u);
+  settings.bloom_levels = 0;
+  EXPECT_EQ(PostProcessPass::GetActiveBloomLevelCount(settings, 1920, 1080, allocated_levels), 0u);
+
+  // more than were allocated, e.g. before the targets are set, run the allocated ones
+  settings.bloom_levels = 5;
+  EXPECT_EQ(PostProcessPass::GetActiveBloomLevelCount(settings, 1920, 1080, 2), 2u);
+  EXPECT_EQ(PostProcessPass::GetActiveBloomLevelCount(settings, 1920, 1080, 0), 0u);
+}
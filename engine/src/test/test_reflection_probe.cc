@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "runtime/functions/render/render_pass/reflection_probe_pass.h"
+#include "runtime/functions/render/spherical_harmonics.h"
+
+using namespace peanut;
+
+namespace {
+
+std::shared_ptr<StaticMeshRenderData> MakeMesh(const glm::vec3& position, bool is_static) {
+  auto mesh = std::make_shared<StaticMeshRenderData>();
+  mesh->transform_ubo_data.model = glm::translate(glm::mat4(1.0f), position);
+  mesh->has_bounding_box = true;
+  mesh->bounding_box_min = glm::vec3(-0.5f);
+  mesh->bounding_box_max = glm::vec3(0.5f);
+  mesh->is_static = is_static;
+  return mesh;
+}
+
+ReflectionProbe MakeProbe(const glm::vec3& position, float half_extent) {
+  ReflectionProbe probe = {};
+  probe.position = position;
+  probe.box_min = position - glm::vec3(half_extent);
+  probe.box_max = position + glm::vec3(half_extent);
+  probe.blend_distance = 1.0f;
+  return probe;
+}
+
+LightingUBO MakeLighting() {
+  LightingUBO lighting_ubo = {};
+  lighting_ubo.has_directional_light = 1;
+  lighting_ubo.directional_light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+  lighting_ubo.directional_light.color = glm::vec3(1.0f);
+  return lighting_ubo;
+}
+
+}  // namespace
+
+TEST(ReflectionProbeTest, CapturesOneStepPerFrameAndOneProbeAtATime) {
+  ReflectionProbePass pass;
+  const std::vector<ReflectionProbe> probes = {MakeProbe(glm::vec3(20.0f, 0.0f, 0.0f), 2.0f),
+                                               MakeProbe(glm::vec3(0.0f), 2.0f)};
+  std::vector<std::shared_ptr<RenderData> > render_data = {MakeMesh(glm::vec3(0.0f), true)};
+
+  // the probe closer to the camera goes first
+  for (uint32_t probe : {1u, 0u}) {
+    for (uint32_t step = 0; step <= ReflectionProbePass::kPrefilterStep; ++step) {
+      LightingUBO lighting_ubo = MakeLighting();
+      pass.Update(probes, render_data, lighting_ubo);
+      ASSERT_EQ(pass.GetPlannedSteps(), std::vector<uint32_t>({step}));
+      EXPECT_EQ(pass.GetCaptureProbe(), step == ReflectionProbePass::kPrefilterStep ? -1 : static_cast<int>(probe));
+    }
+  }
+  EXPECT_EQ(pass.GetCapturedProbeCount(), 2u);
+
+  // nothing changed, nothing to capture
+  LightingUBO lighting_ubo = MakeLighting();
+  pass.Update(probes, render_data, lighting_ubo);
+  EXPECT_TRUE(pass.GetPlannedSteps().empty());
+  EXPECT_EQ(lighting_ubo.reflection_probe_num, 2);
+}
+
+TEST(ReflectionProbeTest, TimeBudgetSpreadsExpensiveSteps) {
+  ReflectionProbePass pass;
+  const std::vector<ReflectionProbe> probes = {MakeProbe(glm::vec3(0.0f), 2.0f)};
+  std::vector<std::shared_ptr<RenderData> > render_data;
+
+  // a 1.2 ms step on a 0.5 ms budget runs every third frame
+  pass.SetStepCosts(1.2, 1.2);
+  std::vector<uint32_t> frames_with_steps;
+  for (uint32_t frame = 1; frame <= 9; ++frame) {
+    LightingUBO lighting_ubo = MakeLighting();
+    pass.Update(probes, render_data, lighting_ubo);
+    if (!pass.GetPlannedSteps().empty()) {
+      frames_with_steps.push_back(frame);
+    }
+  }
+  EXPECT_EQ(frames_with_steps, std::vector<uint32_t>({3, 6, 9}));
+
+  // a large budget still stops at the end of the probe
+  ReflectionProbePass fast_pass;
+  ReflectionProbePass::Settings settings;
+  settings.time_budget_ms = 10.0f;
+  settings.max_steps_per_frame = 16;
+  fast_pass.SetSettings(settings);
+  const std::vector<ReflectionProbe> two_probes = {MakeProbe(glm::vec3(0.0f), 2.0f), MakeProbe(glm::vec3(10.0f), 2.0f)};
+  LightingUBO lighting_ubo = MakeLighting();
+  fast_pass.Update(two_probes, render_data, lighting_ubo);
+  EXPECT_EQ(fast_pass.GetPlannedSteps().size(), ReflectionProbePass::kFaceStepNum + 1);
+  EXPECT_EQ(lighting_ubo.reflection_probe_num, 1);
+}
+
+TEST(ReflectionProbeTest, StaticChangesRestartTheCapture) {
+  ReflectionProbePass pass;
+  ReflectionProbePass::Settings settings;
+  settings.time_budget_ms = 10.0f;
+  settings.max_steps_per_frame = 16;
+  pass.SetSettings(settings);
+
+  const std::vector<ReflectionProbe> probes = {MakeProbe(glm::vec3(0.0f), 2.0f)};
+  std::vector<std::shared_ptr<RenderData> > render_data = {MakeMesh(glm::vec3(0.0f), true),
+                                                           MakeMesh(glm::vec3(1.0f), false)};
+  LightingUBO lighting_ubo = MakeLighting();
+  pass.Update(probes, render_data, lighting_ubo);
+  ASSERT_EQ(pass.GetCapturedProbeCount(), 1u);
+
+  // moving a dynamic mesh does not capture again
+  static_cast<StaticMeshRenderData*>(render_data[1].get())->transform_ubo_data.model = glm::mat4(1.0f);
+  lighting_ubo = MakeLighting();
+  pass.Update(probes, render_data, lighting_ubo);
+  EXPECT_TRUE(pass.GetPlannedSteps().empty());
+
+  // a new light color does, one face at a time, while the old cube stays in the lighting
+  settings.max_steps_per_frame = 1;
+  pass.SetSettings(settings);
+  for (uint32_t step = 0; step < 3; ++step) {
+    lighting_ubo = MakeLighting();
+    lighting_ubo.directional_light.color = glm::vec3(2.0f);
+    pass.Update(probes, render_data, lighting_ubo);
+    EXPECT_EQ(pass.GetPlannedSteps(), std::vector<uint32_t>({step}));
+    EXPECT_EQ(lighting_ubo.reflection_probe_num, 1);
+  }
+
+  // moving a static mesh in the middle of the capture starts it over
+  static_cast<StaticMeshRenderData*>(render_data[0].get())->transform_ubo_data.model =
+      glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  lighting_ubo = MakeLighting();
+  lighting_ubo.directional_light.color = glm::vec3(2.0f);
+  pass.Update(probes, render_data, lighting_ubo);
+  EXPECT_EQ(pass.GetPlannedSteps(), std::vector<uint32_t>({0}));
+}
+
+TEST(ReflectionProbeTest, SmallerInfluenceBoxesComeFirst) {
+  ReflectionProbePass pass;
+  ReflectionProbePass::Settings settings;
+  settings.time_budget_ms = 10.0f;
+  settings.max_steps_per_frame = 16;
+  pass.SetSettings(settings);
+
+  const std::vector<ReflectionProbe> probes = {MakeProbe(glm::vec3(0.0f), 10.0f), MakeProbe(glm::vec3(1.0f), 2.0f)};
+  std::vector<std::shared_ptr<RenderData> > render_data;
+  LightingUBO lighting_ubo = MakeLighting();
+  pass.Update(probes, render_data, lighting_ubo);
+  lighting_ubo = MakeLighting();
+  pass.Update(probes, render_data, lighting_ubo);
+
+  ASSERT_EQ(lighting_ubo.reflection_probe_num, 2);
+  EXPECT_EQ(lighting_ubo.reflection_probes[0].array_index, 1);
+  EXPECT_EQ(lighting_ubo.reflection_probes[1].array_index, 0);
+  EXPECT_FLOAT_EQ(lighting_ubo.reflection_probes[0].box_max.x, 3.0f);
+
+  // a removed probe leaves the lighting
+  const std::vector<ReflectionProbe> one_probe = {probes[0]};
+  lighting_ubo = MakeLighting();
+  pass.Update(one_probe, render_data, lighting_ubo);
+  ASSERT_EQ(lighting_ubo.reflection_probe_num, 1);
+  EXPECT_EQ(lighting_ubo.reflection_probes[0].array_index, 0);
+}
+
+TEST(ReflectionProbeTest, FacesMatchTheCubeMapTexelDirections) {
+  const glm::vec3 position(1.0f, 2.0f, 3.0f);
+  const glm::vec2 st(0.25f, 0.7f);
+  for (uint32_t face = 0; face < ReflectionProbePass::kFaceStepNum; ++face) {
+    const glm::vec3 direction = SphericalHarmonics::GetCubeTexelDirection(face, st);
+    const glm::vec4 clip = ReflectionProbePass::ComputeFaceViewProj(position, face) * glm::vec4(position + direction * 5.0f, 1.0f);
+
+    // vulkan ndc y points down like the texel rows
+    EXPECT_NEAR(clip.x / clip.w, st.x * 2.0f - 1.0f, 1e-4f) << "face " << face;
+    EXPECT_NEAR(clip.y / clip.w, st.y * 2.0f - 1.0f, 1e-4f) << "face " << face;
+    EXPECT_GT(clip.z / clip.w, 0.0f);
+    EXPECT_LT(clip.z / clip.w, 1.0f);
+  }
+}
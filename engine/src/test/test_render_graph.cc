@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "runtime/functions/render/render_graph/render_graph.h"
+
+using namespace peanut;
+
+namespace {
+RGTextureDesc MakeDesc(uint32_t width, uint32_t height) {
+  RGTextureDesc desc;
+  desc.width = width;
+  desc.height = height;
+  desc.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+  return desc;
+}
+
+RGAliasRequest MakeRequest(VkDeviceSize size, uint32_t memory_type_bits, uint32_t first_pass, uint32_t last_pass) {
+  RGAliasRequest request;
+  request.size = size;
+  request.memory_type_bits = memory_type_bits;
+  request.first_pass = first_pass;
+  request.last_pass = last_pass;
+  return request;
+}
+}  // namespace
+
+TEST(RenderGraphTest, CullsPassesWithUnusedResults) {
+  RenderGraph graph;
+  RGTextureHandle output = graph.ImportTexture("output", VK_NULL_HANDLE, VK_NULL_HANDLE, MakeDesc(64, 64),
+                                               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  RGTextureHandle unused = graph.CreateTexture("unused", MakeDesc(64, 64));
+
+  graph.AddPass(
+      "write_output", [&](RGPassBuilder& builder) { builder.Write(output, RGResourceUsage::ComputeStorageWrite); },
+      [](VkCommandBuffer, const RenderGraph&) {});
+  graph.AddPass(
+      "write_unused", [&](RGPassBuilder& builder) { builder.Write(unused, RGResourceUsage::ColorAttachmentWrite); },
+      [](VkCommandBuffer, const RenderGraph&) {});
+  graph.AddPass(
+      "readback", [&](RGPassBuilder& builder) { builder.SetSideEffect(); }, [](VkCommandBuffer, const RenderGraph&) {});
+  graph.Compile();
+
+  EXPECT_FALSE(graph.IsPassCulled("write_output"));
+  EXPECT_TRUE(graph.IsPassCulled("write_unused"));
+  EXPECT_FALSE(graph.IsPassCulled("readback"));
+  EXPECT_EQ(graph.GetStats().culled_passes, 1u);
+  EXPECT_EQ(graph.GetStats().alias_blocks, 0u);
+}
+
+TEST(RenderGraphTest, PlansOneBarrierPerHazard) {
+  RenderGraph graph;
+  RGTextureHandle source = graph.ImportTexture("source", VK_NULL_HANDLE, VK_NULL_HANDLE, MakeDesc(64, 64),
+                                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  RGTextureHandle output = graph.ImportTexture("output", VK_NULL_HANDLE, VK_NULL_HANDLE, MakeDesc(64, 64),
+                                               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  graph.AddPass(
+      "first_read",
+      [&](RGPassBuilder& builder) {
+        builder.Read(source, RGResourceUsage::ComputeSampledRead);
+        builder.SetSideEffect();
+      },
+      [](VkCommandBuffer, const RenderGraph&) {});
+  graph.AddPass(
+      "second_read",
+      [&](RGPassBuilder& builder) {
+        builder.Read(source, RGResourceUsage::ComputeSampledRead);
+        builder.Write(output, RGResourceUsage::ComputeStorageWrite);
+      },
+      [](VkCommandBuffer, const RenderGraph&) {});
+  graph.AddPass(
+      "consume",
+      [&](RGPassBuilder& builder) {
+        builder.Read(output, RGResourceUsage::FragmentSampledRead);
+        builder.SetSideEffect();
+      },
+      [](VkCommandBuffer, const RenderGraph&) {});
+  graph.Compile();
+
+  // the source is already readable, reading it twice needs no barrier
+  EXPECT_TRUE(graph.GetPassBarriers("first_read").empty());
+
+  const std::vector<RGBarrier>& write_barriers = graph.GetPassBarriers("second_read");
+  ASSERT_EQ(write_barriers.size(), 1u);
+  EXPECT_EQ(write_barriers[0].texture, output.index);
+  EXPECT_EQ(write_barriers[0].new_layout, VK_IMAGE_LAYOUT_GENERAL);
+
+  const std::vector<RGBarrier>& read_barriers = graph.GetPassBarriers("consume");
+  ASSERT_EQ(read_barriers.size(), 1u);
+  EXPECT_EQ(read_barriers[0].old_layout, VK_IMAGE_LAYOUT_GENERAL);
+  EXPECT_EQ(read_barriers[0].new_layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  EXPECT_EQ(read_barriers[0].src_stage, static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+  EXPECT_EQ(read_barriers[0].dst_access, static_cast<VkAccessFlags>(VK_ACCESS_SHADER_READ_BIT));
+  EXPECT_GE(graph.GetStats().trimmed_barriers, 2u);
+}
+
+TEST(RenderGraphTest, AliasesDisjointLifetimes) {
+  std::vector<RGAliasRequest> requests = {
+      MakeRequest(1024, 0x3, 0, 1),
+      MakeRequest(512, 0x3, 2, 3),
+      MakeRequest(256, 0x3, 1, 2),
+      MakeRequest(2048, 0x4, 0, 0),
+  };
+
+  std::vector<RGAliasBlock> blocks;
+  std::vector<uint32_t> block_indices = RenderGraph::AssignAliasBlocks(requests, blocks);
+
+  ASSERT_EQ(block_indices.size(), requests.size());
+  EXPECT_EQ(block_indices[0], block_indices[1]);
+  EXPECT_NE(block_indices[0], block_indices[2]);
+  EXPECT_NE(block_indices[3], block_indices[0]);
+  EXPECT_NE(block_indices[3], block_indices[2]);
+  EXPECT_EQ(blocks.size(), 3u);
+  EXPECT_EQ(blocks[block_indices[0]].size, 1024u);
+  EXPECT_EQ(blocks[block_indices[3]].memory_type_bits, 0x4u);
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <array>
+
+#include "runtime/functions/render/render_pass/local_light_shadow_pass.h"
+#include "runtime/functions/render/shadow_atlas.h"
+
+using namespace peanut;
+
+namespace {
+
+std::shared_ptr<StaticMeshRenderData> MakeCaster(const glm::vec3& position, bool is_static) {
+  auto caster = std::make_shared<StaticMeshRenderData>();
+  caster->transform_ubo_data.model = glm::translate(glm::mat4(1.0f), position);
+  caster->has_bounding_box = true;
+  caster->bounding_box_min = glm::vec3(-0.5f);
+  caster->bounding_box_max = glm::vec3(0.5f);
+  caster->is_static = is_static;
+  return caster;
+}
+
+SpotLight MakeSpotLight() {
+  SpotLight light = {};
+  light.position = glm::vec3(0.0f, 5.0f, 0.0f);
+  light.radius = 10.0f;
+  light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+  light.inner_cone_cos = 0.9f;
+  light.outer_cone_cos = 0.8f;
+  light.cast_shadow = 1;
+  return light;
+}
+
+}  // namespace
+
+TEST(ShadowAtlasTest, PacksTilesAndMergesFreedSiblings) {
+  ShadowAtlas atlas;
+  atlas.Reset(1024, 128);
+
+  ShadowAtlasTile large;
+  ASSERT_TRUE(atlas.Allocate(512, large));
+  std::array<ShadowAtlasTile, 12> small_tiles;
+  for (ShadowAtlasTile& tile : small_tiles) {
+    ASSERT_TRUE(atlas.Allocate(256, tile));
+    EXPECT_EQ(tile.size, 256u);
+    // small tiles never overlap the large one
+    EXPECT_FALSE(tile.x < large.x + large.size && large.x < tile.x + tile.size &&
+                 tile.y < large.y + large.size && large.y < tile.y + tile.size);
+  }
+  EXPECT_EQ(atlas.GetAllocatedArea(), 1024u * 1024u);
+
+  ShadowAtlasTile no_space;
+  EXPECT_FALSE(atlas.Allocate(128, no_space));
+
+  // freeing four siblings gives a 512 tile back
+  for (uint32_t i = 0; i < 4; ++i) {
+    atlas.Free(small_tiles[i]);
+  }
+  ShadowAtlasTile merged;
+  EXPECT_TRUE(atlas.Allocate(512, merged));
+  EXPECT_EQ(merged.size, 512u);
+}
+
+TEST(ShadowAtlasTest, TileSizeFollowsImportance) {
+  EXPECT_EQ(ShadowAtlas::GetTileSizeForImportance(1.0f, 1024, 64), 1024u);
+  EXPECT_EQ(ShadowAtlas::GetTileSizeForImportance(0.3f, 1024, 64), 512u);
+  EXPECT_EQ(ShadowAtlas::GetTileSizeForImportance(0.001f, 1024, 64), 64u);
+
+  EXPECT_FLOAT_EQ(ShadowAtlas::ComputeLightImportance(glm::vec3(0.0f), 5.0f, glm::vec3(1.0f, 0.0f, 0.0f)), 1.0f);
+  EXPECT_FLOAT_EQ(ShadowAtlas::ComputeLightImportance(glm::vec3(0.0f), 5.0f, glm::vec3(20.0f, 0.0f, 0.0f)), 0.25f);
+}
+
+TEST(ShadowAtlasTest, StaticTilesAreReusedUntilTheirCastersMove) {
+  LocalLightShadowPass pass;
+  std::vector<std::shared_ptr<RenderData> > render_data = {
+      MakeCaster(glm::vec3(0.0f, 0.0f, 0.0f), true), MakeCaster(glm::vec3(0.5f, 1.0f, 0.0f), false)};
+  std::array<LocalShadowView, MAX_LOCAL_SHADOW_VIEW_NUM> views;
+  const glm::vec3 camera_position(0.0f, 2.0f, 10.0f);
+
+  SpotLight light = MakeSpotLight();
+  EXPECT_EQ(pass.Update(nullptr, 0, &light, 1, camera_position, render_data, views.data()), 1u);
+  EXPECT_EQ(light.shadow_index, 0);
+  EXPECT_EQ(pass.GetStaticRefreshCount(), 1u);
+
+  // a moving dynamic caster does not touch the cached static casters
+  light = MakeSpotLight();
+  static_cast<StaticMeshRenderData*>(render_data[1].get())->transform_ubo_data.model =
+      glm::translate(glm::mat4(1.0f), glm::vec3(-0.5f, 1.0f, 0.0f));
+  pass.Update(nullptr, 0, &light, 1, camera_position, render_data, views.data());
+  EXPECT_EQ(pass.GetStaticRefreshCount(), 0u);
+
+  // moving a static caster or the light renders the tile again
+  light = MakeSpotLight();
+  static_cast<StaticMeshRenderData*>(render_data[0].get())->transform_ubo_data.model =
+      glm::translate(glm::mat4(1.0f), glm::vec3(0.2f, 0.0f, 0.0f));
+  pass.Update(nullptr, 0, &light, 1, camera_position, render_data, views.data());
+  EXPECT_EQ(pass.GetStaticRefreshCount(), 1u);
+
+  light = MakeSpotLight();
+  light.position.x += 1.0f;
+  pass.Update(nullptr, 0, &light, 1, camera_position, render_data, views.data());
+  EXPECT_EQ(pass.GetStaticRefreshCount(), 1u);
+}
+
+TEST(ShadowAtlasTest, PointLightsTakeOneViewPerCubeFace) {
+  LocalLightShadowPass pass;
+  std::vector<std::shared_ptr<RenderData> > render_data;
+  std::array<LocalShadowView, MAX_LOCAL_SHADOW_VIEW_NUM> views;
+
+  PointLight light = {};
+  light.position = glm::vec3(0.0f);
+  light.radius = 5.0f;
+  light.cast_shadow = 1;
+  SpotLight unshadowed = MakeSpotLight();
+  unshadowed.cast_shadow = 0;
+
+  EXPECT_EQ(pass.Update(&light, 1, &unshadowed, 1, glm::vec3(0.0f, 0.0f, 20.0f), render_data, views.data()), 6u);
+  EXPECT_EQ(light.shadow_index, 0);
+  EXPECT_EQ(unshadowed.shadow_index, -1);
+
+  // the +x face sees a point on the +x axis in the middle of its tile
+  const glm::vec4 clip = views[0].view_proj * glm::vec4(3.0f, 0.0f, 0.0f, 1.0f);
+  EXPECT_NEAR(clip.x / clip.w, 0.0f, 1e-4f);
+  EXPECT_NEAR(clip.y / clip.w, 0.0f, 1e-4f);
+  EXPECT_GT(clip.z / clip.w, 0.0f);
+  EXPECT_LT(clip.z / clip.w, 1.0f);
+}
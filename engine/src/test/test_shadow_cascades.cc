@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "runtime/functions/render/shadow_cascades.h"
+
+using namespace peanut;
+
+namespace {
+
+glm::mat4 MakeInvCameraViewProj(const glm::vec3& eye) {
+  const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+  const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  return glm::inverse(proj * view);
+}
+
+}  // namespace
+
+TEST(ShadowCascadesTest, PracticalSplitsBlendUniformAndLogarithmic) {
+  std::array<float, SHADOW_CASCADE_NUM> uniform_splits;
+  ShadowCascades::ComputeSplitDepths(1.0f, 101.0f, 0.0f, uniform_splits);
+  EXPECT_NEAR(uniform_splits[0], 1.0f + 100.0f / SHADOW_CASCADE_NUM, 1e-3f);
+
+  std::array<float, SHADOW_CASCADE_NUM> splits;
+  ShadowCascades::ComputeSplitDepths(1.0f, 101.0f, 0.75f, splits);
+  EXPECT_NEAR(splits[SHADOW_CASCADE_NUM - 1], 101.0f, 1e-3f);
+  EXPECT_LT(splits[0], uniform_splits[0]);
+  for (uint32_t i = 1; i < SHADOW_CASCADE_NUM; ++i) {
+    EXPECT_GT(splits[i], splits[i - 1]);
+  }
+}
+
+TEST(ShadowCascadesTest, CascadesMoveInWholeTexels) {
+  ShadowCascadeSettings settings;
+  const glm::vec3 light_direction = glm::normalize(glm::vec3(0.3f, -1.0f, 0.2f));
+
+  ShadowCascades::Cascades cascades;
+  ShadowCascades::ComputeCascades(MakeInvCameraViewProj(glm::vec3(1.37f, 2.0f, 5.11f)), 0.1f, 200.0f,
+                                  light_direction, settings, cascades);
+
+  const float half_resolution = settings.resolution * 0.5f;
+  for (const ShadowCascade& cascade : cascades) {
+    const glm::vec4 origin = cascade.view_proj * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    const glm::vec2 origin_texels = glm::vec2(origin) * half_resolution;
+    EXPECT_NEAR(origin_texels.x, std::round(origin_texels.x), 1e-2f);
+    EXPECT_NEAR(origin_texels.y, std::round(origin_texels.y), 1e-2f);
+  }
+  EXPECT_NEAR(cascades[SHADOW_CASCADE_NUM - 1].split_depth, settings.shadow_distance, 1e-3f);
+}
+
+TEST(ShadowCascadesTest, CullsCastersOutsideTheCascade) {
+  ShadowCascadeSettings settings;
+  ShadowCascades::Cascades cascades;
+  ShadowCascades::ComputeCascades(MakeInvCameraViewProj(glm::vec3(0.0f)), 0.1f, 200.0f,
+                                  glm::vec3(0.0f, -1.0f, 0.0f), settings, cascades);
+
+  // the first cascade covers the view right in front of the camera
+  const ShadowCascade& first = cascades[0];
+  EXPECT_TRUE(ShadowCascades::IsAabbInFrustum(first.frustum_planes, glm::vec3(-0.5f, -0.5f, -2.0f), glm::vec3(0.5f, 0.5f, -1.0f)));
+  // casters above the view still shadow it, boxes far to the side do not
+  EXPECT_TRUE(ShadowCascades::IsAabbInFrustum(first.frustum_planes, glm::vec3(-0.5f, 20.0f, -2.0f), glm::vec3(0.5f, 21.0f, -1.0f)));
+  EXPECT_FALSE(ShadowCascades::IsAabbInFrustum(first.frustum_planes, glm::vec3(500.0f, 0.0f, -2.0f), glm::vec3(501.0f, 1.0f, -1.0f)));
+
+  glm::vec3 world_min;
+  glm::vec3 world_max;
+  const glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(500.0f, 0.0f, 0.0f));
+  ShadowCascades::TransformAabb(transform, glm::vec3(-1.0f), glm::vec3(1.0f), world_min, world_max);
+  EXPECT_FLOAT_EQ(world_min.x, 499.0f);
+  EXPECT_FLOAT_EQ(world_max.x, 501.0f);
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "runtime/functions/render/single_pass_downsampler.h"
+
+using namespace peanut;
+
+namespace {
+
+TextureData MakeTexture(uint32_t width, uint32_t height, uint32_t layers, uint32_t levels, VkFormat format) {
+  TextureData texture = {};
+  texture.width = width;
+  texture.height = height;
+  texture.layers = layers;
+  texture.levels = levels;
+  texture.format = format;
+  return texture;
+}
+
+}  // namespace
+
+TEST(SinglePassDownsamplerTest, DispatchCoversLevelZeroWithTiles) {
+  const SinglePassDownsampler::DispatchSetup full_chain = SinglePassDownsampler::ComputeDispatchSetup(4096, 4096, 13);
+  EXPECT_EQ(full_chain.group_count_x, 64u);
+  EXPECT_EQ(full_chain.group_count_y, 64u);
+  EXPECT_EQ(full_chain.level_num, 12u);
+
+  // partial tiles at the edges still get a workgroup
+  const SinglePassDownsampler::DispatchSetup odd_size = SinglePassDownsampler::ComputeDispatchSetup(100, 65, 7);
+  EXPECT_EQ(odd_size.group_count_x, 2u);
+  EXPECT_EQ(odd_size.group_count_y, 2u);
+  EXPECT_EQ(odd_size.level_num, 6u);
+
+  const SinglePassDownsampler::DispatchSetup small = SinglePassDownsampler::ComputeDispatchSetup(16, 8, 5);
+  EXPECT_EQ(small.group_count_x, 1u);
+  EXPECT_EQ(small.group_count_y, 1u);
+  EXPECT_EQ(small.level_num, 4u);
+}
+
+TEST(SinglePassDownsamplerTest, SrgbLevelsAreWrittenThroughUnorm) {
+  EXPECT_EQ(SinglePassDownsampler::GetStorageFormat(VK_FORMAT_R8G8B8A8_SRGB), VK_FORMAT_R8G8B8A8_UNORM);
+  EXPECT_EQ(SinglePassDownsampler::GetStorageFormat(VK_FORMAT_R8G8B8A8_UNORM), VK_FORMAT_R8G8B8A8_UNORM);
+  EXPECT_EQ(SinglePassDownsampler::GetStorageFormat(VK_FORMAT_R16G16B16A16_SFLOAT), VK_FORMAT_R16G16B16A16_SFLOAT);
+  EXPECT_EQ(SinglePassDownsampler::GetStorageFormat(VK_FORMAT_R8_UNORM), VK_FORMAT_UNDEFINED);
+  EXPECT_TRUE(SinglePassDownsampler::IsSrgbFormat(VK_FORMAT_R8G8B8A8_SRGB));
+  EXPECT_FALSE(SinglePassDownsampler::IsSrgbFormat(VK_FORMAT_R8G8B8A8_UNORM));
+}
+
+TEST(SinglePassDownsamplerTest, UnsupportedTexturesAreLeftToBlits) {
+  EXPECT_TRUE(SinglePassDownsampler::IsSupported(MakeTexture(2048, 2048, 1, 12, VK_FORMAT_R8G8B8A8_SRGB)));
+  EXPECT_TRUE(SinglePassDownsampler::IsSupported(MakeTexture(1024, 1024, 6, 11, VK_FORMAT_R16G16B16A16_SFLOAT)));
+
+  // the format is unknown or has no storage twin
+  EXPECT_FALSE(SinglePassDownsampler::IsSupported(MakeTexture(256, 256, 1, 9, VK_FORMAT_UNDEFINED)));
+  EXPECT_FALSE(SinglePassDownsampler::IsSupported(MakeTexture(256, 256, 1, 9, VK_FORMAT_R8_UNORM)));
+  // nothing to generate
+  EXPECT_FALSE(SinglePassDownsampler::IsSupported(MakeTexture(256, 256, 1, 1, VK_FORMAT_R8G8B8A8_UNORM)));
+  // more than 12 levels, or a level 6 larger than one tile
+  EXPECT_FALSE(SinglePassDownsampler::IsSupported(MakeTexture(8192, 8192, 1, 14, VK_FORMAT_R8G8B8A8_UNORM)));
+  EXPECT_FALSE(SinglePassDownsampler::IsSupported(MakeTexture(8192, 64, 1, 8, VK_FORMAT_R8G8B8A8_UNORM)));
+  EXPECT_TRUE(SinglePassDownsampler::IsSupported(MakeTexture(8192, 64, 1, 7, VK_FORMAT_R8G8B8A8_UNORM)));
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "runtime/functions/render/spherical_harmonics.h"
+
+using namespace peanut;
+
+namespace {
+
+constexpr uint32_t kFaceSize = 16;
+
+// texels of a cube map whose radiance is a function of the direction
+template <typename Radiance>
+std::vector<glm::vec4> MakeCubeMap(Radiance radiance) {
+  std::vector<glm::vec4> texels;
+  for (uint32_t face = 0; face < 6; ++face) {
+    for (uint32_t y = 0; y < kFaceSize; ++y) {
+      for (uint32_t x = 0; x < kFaceSize; ++x) {
+        const glm::vec2 st = (glm::vec2(x, y) + 0.5f) / static_cast<float>(kFaceSize);
+        texels.push_back(glm::vec4(radiance(SphericalHarmonics::GetCubeTexelDirection(face, st)), 1.0f));
+      }
+    }
+  }
+  return texels;
+}
+
+}  // namespace
+
+TEST(SphericalHarmonicsTest, CubeTexelsFollowTheVulkanFaceOrder) {
+  const glm::vec2 center(0.5f);
+  EXPECT_LT(glm::distance(SphericalHarmonics::GetCubeTexelDirection(0, center), glm::vec3(1.0f, 0.0f, 0.0f)), 1e-6f);
+  EXPECT_LT(glm::distance(SphericalHarmonics::GetCubeTexelDirection(3, center), glm::vec3(0.0f, -1.0f, 0.0f)), 1e-6f);
+  EXPECT_LT(glm::distance(SphericalHarmonics::GetCubeTexelDirection(5, center), glm::vec3(0.0f, 0.0f, -1.0f)), 1e-6f);
+
+  // the top row of the +z face looks up
+  EXPECT_GT(SphericalHarmonics::GetCubeTexelDirection(4, glm::vec2(0.5f, 0.0f)).y, 0.0f);
+}
+
+TEST(SphericalHarmonicsTest, ConstantSkyGivesItsRadianceInEveryDirection) {
+  const std::vector<glm::vec4> texels = MakeCubeMap([](const glm::vec3&) { return glm::vec3(1.0f, 0.5f, 0.25f); });
+  SphericalHarmonics::Coefficients coefficients;
+  SphericalHarmonics::ProjectIrradiance(texels.data(), kFaceSize, coefficients);
+
+  for (const glm::vec3& normal : {glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::normalize(glm::vec3(1.0f))}) {
+    const glm::vec3 irradiance = SphericalHarmonics::EvaluateIrradiance(coefficients, normal);
+    EXPECT_NEAR(irradiance.r, 1.0f, 1e-3f);
+    EXPECT_NEAR(irradiance.g, 0.5f, 1e-3f);
+    EXPECT_NEAR(irradiance.b, 0.25f, 1e-3f);
+  }
+}
+
+TEST(SphericalHarmonicsTest, UpperHemisphereLightsUpwardNormals) {
+  // radiance 1 from the upper hemisphere: irradiance / PI is 1 facing up, 0.5 sideways and 0 facing down
+  const std::vector<glm::vec4> texels =
+      MakeCubeMap([](const glm::vec3& dir) { return glm::vec3(dir.y > 0.0f ? 1.0f : 0.0f); });
+  SphericalHarmonics::Coefficients coefficients;
+  SphericalHarmonics::ProjectIrradiance(texels.data(), kFaceSize, coefficients);
+
+  EXPECT_NEAR(SphericalHarmonics::EvaluateIrradiance(coefficients, glm::vec3(0.0f, 1.0f, 0.0f)).r, 1.0f, 0.1f);
+  EXPECT_NEAR(SphericalHarmonics::EvaluateIrradiance(coefficients, glm::vec3(1.0f, 0.0f, 0.0f)).r, 0.5f, 0.05f);
+  EXPECT_NEAR(SphericalHarmonics::EvaluateIrradiance(coefficients, glm::vec3(0.0f, -1.0f, 0.0f)).r, 0.0f, 0.1f);
+}
+
+TEST(SphericalHarmonicsTest, SsePathIsBitExactWithTheScalarPath) {
+  // uneven hdr radiance so that every rounding of the sums shows
+  const std::vector<glm::vec4> texels = MakeCubeMap([](const glm::vec3& dir) {
+    const float sun = glm::dot(dir, glm::normalize(glm::vec3(0.4f, 0.7f, -0.2f))) > 0.95f ? 37.3f : 0.0f;
+    return glm::vec3(0.11f + 0.7f * dir.y * dir.y + sun, 0.31f * dir.x + 0.5f, 0.013f + 0.2f * dir.z + sun * 0.5f);
+  });
+
+  SphericalHarmonics::Coefficients coefficients;
+  SphericalHarmonics::Coefficients scalar_coefficients;
+  SphericalHarmonics::ProjectIrradiance(texels.data(), kFaceSize, coefficients);
+  SphericalHarmonics::ProjectIrradianceScalar(texels.data(), kFaceSize, scalar_coefficients);
+
+  for (uint32_t i = 0; i < SH_IRRADIANCE_COEFFICIENT_NUM; ++i) {
+    EXPECT_EQ(std::memcmp(&coefficients[i], &scalar_coefficients[i], sizeof(glm::vec4)), 0) << "coefficient " << i;
+  }
+}
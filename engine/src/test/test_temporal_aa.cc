@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "runtime/functions/render/render_pass/temporal_aa_pass.h"
+
+using namespace peanut;
+
+TEST(TemporalAATest, HaltonSequenceOfBaseTwoAndThree) {
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(1, 2), 0.5f);
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(2, 2), 0.25f);
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(3, 2), 0.75f);
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(4, 2), 0.125f);
+
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(1, 3), 1.0f / 3.0f);
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(2, 3), 2.0f / 3.0f);
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(3, 3), 1.0f / 9.0f);
+
+  EXPECT_FLOAT_EQ(TemporalAAPass::GetHaltonValue(0, 2), 0.0f);
+}
+
+TEST(TemporalAATest, JitterStaysInsideTheTexelAndRepeats) {
+  constexpr uint32_t kWidth = 1280;
+  constexpr uint32_t kHeight = 720;
+  constexpr uint32_t kSampleCount = 8;
+
+  glm::vec2 sum(0.0f);
+  for (uint64_t frame = 0; frame < kSampleCount; ++frame) {
+    const glm::vec2 jitter = TemporalAAPass::GetJitter(frame, kSampleCount, kWidth, kHeight);
+    // half a texel in either direction is 1 / size in ndc
+    EXPECT_LT(std::abs(jitter.x), 1.0f / kWidth);
+    EXPECT_LT(std::abs(jitter.y), 1.0f / kHeight);
+    sum += jitter;
+
+    const glm::vec2 repeated = TemporalAAPass::GetJitter(frame + kSampleCount, kSampleCount, kWidth, kHeight);
+    EXPECT_EQ(jitter, repeated);
+  }
+  // the offsets are spread around the texel center
+  EXPECT_LT(std::abs(sum.x / kSampleCount), 0.25f / kWidth);
+  EXPECT_LT(std::abs(sum.y / kSampleCount), 0.25f / kHeight);
+
+  EXPECT_NE(TemporalAAPass::GetJitter(0, kSampleCount, kWidth, kHeight),
+            TemporalAAPass::GetJitter(1, kSampleCount, kWidth, kHeight));
+  // a single sample does not move
+  EXPECT_EQ(TemporalAAPass::GetJitter(0, 1, kWidth, kHeight), TemporalAAPass::GetJitter(5, 1, kWidth, kHeight));
+}
+
+TEST(TemporalAATest, JitterMovesEveryDepthByTheSameOffset) {
+  const glm::mat4 projection = glm::perspectiveFov(glm::radians(45.0f), 1280.0f, 720.0f, 1.0f, 1000.0f);
+  const glm::vec2 jitter(0.001f, -0.002f);
+  const glm::mat4 jittered = TemporalAAPass::ApplyJitter(projection, jitter);
+
+  for (float depth : {-1.5f, -10.0f, -500.0f}) {
+    const glm::vec4 position(0.3f, -0.2f, depth, 1.0f);
+    const glm::vec4 clip = projection * position;
+    const glm::vec4 jittered_clip = jittered * position;
+
+    EXPECT_NEAR(jittered_clip.x / jittered_clip.w - clip.x / clip.w, jitter.x, 1.0e-5f);
+    EXPECT_NEAR(jittered_clip.y / jittered_clip.w - clip.y / clip.w, jitter.y, 1.0e-5f);
+    // depth is left as is
+    EXPECT_FLOAT_EQ(jittered_clip.z, clip.z);
+    EXPECT_FLOAT_EQ(jittered_clip.w, clip.w);
+  }
+}
+
+TEST(TemporalAATest, HistoryIsClippedToTheNeighborhoodBox) {
+  const glm::vec3 center(0.5f, 0.0f, 0.0f);
+  const glm::vec3 extent(0.1f, 0.05f, 0.05f);
+
+  // inside the box the history is kept
+  const glm::vec3 inside(0.55f, 0.02f, -0.01f);
+  EXPECT_EQ(TemporalAAPass::ClipToAabb(inside, center, extent), inside);
+
+  // outside it is moved towards the center onto the face it crosses
+  const glm::vec3 clipped = TemporalAAPass::ClipToAabb(glm::vec3(0.9f, 0.05f, 0.0f), center, extent);
+  EXPECT_NEAR(clipped.x, 0.6f, 1.0e-6f);
+  EXPECT_NEAR(clipped.y, 0.0125f, 1.0e-6f);
+  EXPECT_NEAR(clipped.z, 0.0f, 1.0e-6f);
+
+  // a box without extent collapses the history onto the center
+  const glm::vec3 collapsed = TemporalAAPass::ClipToAabb(glm::vec3(1.0f, 0.2f, -0.3f), center, glm::vec3(0.0f));
+  EXPECT_NEAR(glm::length(collapsed - center), 0.0f, 1.0e-3f);
+}
@@ -0,0 +1,31 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "runtime/core/thread/thread_pool.h"
+
+using namespace peanut;
+
+TEST(ThreadPoolTest, ReturnsJobResults) {
+  ThreadPool thread_pool(4);
+  std::vector<std::future<int> > results;
+  for (int i = 0; i < 64; ++i) {
+    results.push_back(thread_pool.Submit([i]() { return i * i; }));
+  }
+
+  for (int i = 0; i < 64; ++i) {
+    EXPECT_EQ(results[i].get(), i * i);
+  }
+}
+
+TEST(ThreadPoolTest, DrainsQueueOnDestruction) {
+  std::atomic<int> counter{0};
+  {
+    ThreadPool thread_pool(2);
+    for (int i = 0; i < 100; ++i) {
+      thread_pool.Submit([&counter]() { counter.fetch_add(1); });
+    }
+  }
+  EXPECT_EQ(counter.load(), 100);
+}